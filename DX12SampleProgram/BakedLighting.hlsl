@@ -0,0 +1,56 @@
+// Shader variant for statically lit geometry. The lighting of LightingUtil.hlsl
+// has been evaluated per vertex on the CPU (StaticLighting.h) and arrives as
+// a second vertex stream, so the pixel shader only interpolates it. Uses the
+// root signature of LitWavesApp: object constants at b0, the pass at b2.
+
+cbuffer cbPerObject :register(b0)
+{
+    float4x4 gWorld;
+};
+
+cbuffer cbPass :register(b2)
+{
+    float4x4 gView;
+    float4x4 gInvView;
+    float4x4 gProj;
+    float4x4 gInvProj;
+    float4x4 gViewProj;
+    float4x4 gInvViewProj;
+    float3 gEyePosW;
+    float cbPerObjectPad1;
+    float2 gRenderTargetSize;
+    float2 gInvRenderTargetSize;
+    float  gNearZ;
+    float  gFarZ;
+    float  gTotalTime;
+    float  gDeltaTime;
+};
+
+struct VertexIn
+{
+    float3 PosL:POSITION;
+    // Baked lit color, from vertex buffer slot 1.
+    float4 Color:COLOR;
+};
+
+struct VertexOut
+{
+    float4 PosH:SV_POSITION;
+    float4 Color:COLOR;
+};
+
+VertexOut VSMain(VertexIn vin)
+{
+    VertexOut vout;
+
+    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    vout.PosH = mul(posW, gViewProj);
+    vout.Color = vin.Color;
+
+    return vout;
+}
+
+float4 PSMain(VertexOut pin) :SV_Target
+{
+    return pin.Color;
+}
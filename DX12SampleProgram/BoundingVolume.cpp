@@ -0,0 +1,97 @@
+#include "stdafx.h"
+#include "BoundingVolume.h"
+
+using namespace DirectX;
+
+namespace
+{
+    inline XMVECTOR LoadPosition(const BYTE* base, UINT stride, size_t i)
+    {
+        return XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(base + i * stride));
+    }
+}
+
+void ComputeMinMax(const void* positions, UINT stride, size_t count, XMVECTOR& vMin, XMVECTOR& vMax)
+{
+    if (count == 0)
+    {
+        vMin = XMVectorZero();
+        vMax = XMVectorZero();
+        return;
+    }
+
+    const BYTE* base = static_cast<const BYTE*>(positions);
+
+    XMVECTOR min0 = LoadPosition(base, stride, 0);
+    XMVECTOR min1 = min0, min2 = min0, min3 = min0;
+    XMVECTOR max0 = min0, max1 = min0, max2 = min0, max3 = min0;
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        XMVECTOR p0 = LoadPosition(base, stride, i);
+        XMVECTOR p1 = LoadPosition(base, stride, i + 1);
+        XMVECTOR p2 = LoadPosition(base, stride, i + 2);
+        XMVECTOR p3 = LoadPosition(base, stride, i + 3);
+
+        min0 = XMVectorMin(min0, p0);
+        min1 = XMVectorMin(min1, p1);
+        min2 = XMVectorMin(min2, p2);
+        min3 = XMVectorMin(min3, p3);
+
+        max0 = XMVectorMax(max0, p0);
+        max1 = XMVectorMax(max1, p1);
+        max2 = XMVectorMax(max2, p2);
+        max3 = XMVectorMax(max3, p3);
+    }
+    for (; i < count; ++i)
+    {
+        XMVECTOR p = LoadPosition(base, stride, i);
+        min0 = XMVectorMin(min0, p);
+        max0 = XMVectorMax(max0, p);
+    }
+
+    vMin = XMVectorMin(XMVectorMin(min0, min1), XMVectorMin(min2, min3));
+    vMax = XMVectorMax(XMVectorMax(max0, max1), XMVectorMax(max2, max3));
+}
+
+VertexBounds MakeVertexBounds(FXMVECTOR vMin, FXMVECTOR vMax)
+{
+    VertexBounds bounds;
+    BoundingBox::CreateFromPoints(bounds.Box, vMin, vMax);
+    BoundingSphere::CreateFromBoundingBox(bounds.Sphere, bounds.Box);
+    return bounds;
+}
+
+VertexBounds ComputeVertexBounds(const void* positions, UINT stride, size_t count)
+{
+    XMVECTOR vMin, vMax;
+    ComputeMinMax(positions, stride, count, vMin, vMax);
+
+    VertexBounds bounds;
+    BoundingBox::CreateFromPoints(bounds.Box, vMin, vMax);
+
+    // Second pass: farthest squared distance from the box center, again with
+    // independent accumulators.
+    const BYTE* base = static_cast<const BYTE*>(positions);
+    XMVECTOR center = XMLoadFloat3(&bounds.Box.Center);
+    XMVECTOR d0 = XMVectorZero(), d1 = XMVectorZero(), d2 = XMVectorZero(), d3 = XMVectorZero();
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        d0 = XMVectorMax(d0, XMVector3LengthSq(XMVectorSubtract(LoadPosition(base, stride, i), center)));
+        d1 = XMVectorMax(d1, XMVector3LengthSq(XMVectorSubtract(LoadPosition(base, stride, i + 1), center)));
+        d2 = XMVectorMax(d2, XMVector3LengthSq(XMVectorSubtract(LoadPosition(base, stride, i + 2), center)));
+        d3 = XMVectorMax(d3, XMVector3LengthSq(XMVectorSubtract(LoadPosition(base, stride, i + 3), center)));
+    }
+    for (; i < count; ++i)
+    {
+        d0 = XMVectorMax(d0, XMVector3LengthSq(XMVectorSubtract(LoadPosition(base, stride, i), center)));
+    }
+
+    XMVECTOR radiusSq = XMVectorMax(XMVectorMax(d0, d1), XMVectorMax(d2, d3));
+    bounds.Sphere.Center = bounds.Box.Center;
+    bounds.Sphere.Radius = XMVectorGetX(XMVectorSqrt(radiusSq));
+    return bounds;
+}
@@ -0,0 +1,34 @@
+// Bounding volumes of vertex streams, for frustum and occlusion culling.
+//
+// Positions are reduced with DirectXMath vector min/max over four independent
+// accumulators, so the loop is bound by the strided loads rather than by the
+// dependency chain of a single running min/max.
+#pragma once
+#include "stdafx.h"
+#include <DirectXCollision.h>
+
+struct VertexBounds
+{
+    DirectX::BoundingBox Box;
+    DirectX::BoundingSphere Sphere;
+};
+
+// Axis-aligned box and bounding sphere of count positions starting at
+// positions and stride bytes apart. The sphere is centered on the box and
+// its radius is the distance to the farthest position, which is never larger
+// than the box's circumscribed sphere.
+VertexBounds ComputeVertexBounds(const void* positions, UINT stride, size_t count);
+
+// Same as above for tightly packed positions.
+inline VertexBounds ComputeVertexBounds(const DirectX::XMFLOAT3* positions, size_t count)
+{
+    return ComputeVertexBounds(positions, sizeof(DirectX::XMFLOAT3), count);
+}
+
+// Min and max of count positions as vectors, for callers that merge partial
+// results themselves (e.g. per row of a dynamic grid).
+void ComputeMinMax(const void* positions, UINT stride, size_t count,
+    DirectX::XMVECTOR& vMin, DirectX::XMVECTOR& vMax);
+
+// Box and sphere from a min/max pair.
+VertexBounds MakeVertexBounds(DirectX::FXMVECTOR vMin, DirectX::FXMVECTOR vMax);
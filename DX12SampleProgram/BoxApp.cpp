@@ -143,6 +143,11 @@ void BoxApp::BuildBoxGeometry()
     m_boxGeo->IndexBufferGPU = CreateDefaultBuffer(m_device.Get(), m_commandList.Get(),
         indices.data(), ibByteSize, m_boxGeo->IndexBufferUploader);
 
+    // The uploaders go once the initialization commands have run.
+    DeferRelease(m_boxGeo->VertexBufferUploader);
+    DeferRelease(m_boxGeo->IndexBufferUploader);
+    m_boxGeo->DisposeUploaders();
+
     m_boxGeo->VertexByteStride = sizeof(VertexForBox);
     m_boxGeo->VertexBufferByteSize = vbByteSize;
     m_boxGeo->IndexFormat = DXGI_FORMAT_R16_UINT;
@@ -152,6 +157,7 @@ void BoxApp::BuildBoxGeometry()
     submesh.IndexCount = (UINT)indices.size();
     submesh.BaseVertexLocation = 0;
     submesh.StartIndexCount = 0;
+    submesh.SetBounds(ComputeVertexBounds(vertices.data(), sizeof(VertexForBox), vertices.size()));
 
     m_boxGeo->DrawArags["box"] = submesh;
 }
@@ -250,10 +256,8 @@ void BoxApp::Draw(const GameTimer& gt)
     m_commandList->RSSetScissorRects(1, &m_scissorRect);
 
     // Indicate a state transition on the resource usage.
-    m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-        CurrentBackBuffer(),D3D12_RESOURCE_STATE_PRESENT,
-        D3D12_RESOURCE_STATE_RENDER_TARGET
-    ));
+    m_barriers.Transition(CurrentBackBuffer(), D3D12_RESOURCE_STATE_RENDER_TARGET);
+    m_barriers.FlushBarriers(m_commandList.Get());
     
     // Clear the back buffer and depth buffer.
     m_commandList->ClearRenderTargetView(CurrentBackBufferView(), Colors::LightBlue, 0, nullptr);
@@ -278,15 +282,10 @@ void BoxApp::Draw(const GameTimer& gt)
         1, 0, 0, 0);
 
     // Indicate a state transition on the resource usage.
-    m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
-        D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
-
-    // Done recording commands.
-    ThrowIfFailed(m_commandList->Close());
+    m_barriers.Transition(CurrentBackBuffer(), D3D12_RESOURCE_STATE_PRESENT);
 
-    // Add the command list to the queue for execution.
-    ID3D12CommandList* cmdLists[] = { m_commandList.Get() };
-    m_commandQueue->ExecuteCommandLists(_countof(cmdLists), cmdLists);
+    // Done recording commands; execute them after the barriers they start with.
+    ExecuteCommandList(m_commandList.Get(), m_barriers);
 
     // swap the back and front buffers.
     ThrowIfFailed(m_swapchain->Present(0, 0));
@@ -0,0 +1,79 @@
+#include "stdafx.h"
+#include "CopyQueue.h"
+
+CopyQueue::CopyQueue(ID3D12Device* device) :
+    m_device(device)
+{
+    D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+    queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+    queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+    ThrowIfFailed(m_device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&m_queue)));
+    ThrowIfFailed(m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
+    m_waitableFence = std::make_unique<D3D12WaitableFence>(m_fence.Get());
+}
+
+CopyQueue::~CopyQueue()
+{
+    WaitForIdle();
+}
+
+ID3D12GraphicsCommandList* CopyQueue::GetCommandList()
+{
+    if (m_isRecording)
+    {
+        return m_commandList.Get();
+    }
+
+    if (!m_allocators.empty() && m_allocators.front().first <= m_fence->GetCompletedValue())
+    {
+        m_recordingAllocator = m_allocators.front().second;
+        m_allocators.pop_front();
+        ThrowIfFailed(m_recordingAllocator->Reset());
+    }
+    else
+    {
+        ThrowIfFailed(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY,
+            IID_PPV_ARGS(&m_recordingAllocator)));
+    }
+
+    if (m_commandList == nullptr)
+    {
+        ThrowIfFailed(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY,
+            m_recordingAllocator.Get(), nullptr, IID_PPV_ARGS(&m_commandList)));
+    }
+    else
+    {
+        ThrowIfFailed(m_commandList->Reset(m_recordingAllocator.Get(), nullptr));
+    }
+    m_isRecording = true;
+    return m_commandList.Get();
+}
+
+UINT64 CopyQueue::Submit()
+{
+    if (m_isRecording)
+    {
+        ThrowIfFailed(m_commandList->Close());
+        ID3D12CommandList* cmdLists[] = { m_commandList.Get() };
+        m_queue->ExecuteCommandLists(_countof(cmdLists), cmdLists);
+        m_isRecording = false;
+    }
+
+    ThrowIfFailed(m_queue->Signal(m_fence.Get(), ++m_fenceValue));
+    if (m_recordingAllocator != nullptr)
+    {
+        m_allocators.push_back({ m_fenceValue, m_recordingAllocator });
+        m_recordingAllocator = nullptr;
+    }
+    return m_fenceValue;
+}
+
+void CopyQueue::MakeQueueWait(ID3D12CommandQueue* queue, UINT64 fence)
+{
+    ThrowIfFailed(queue->Wait(m_fence.Get(), fence));
+}
+
+void CopyQueue::WaitForIdle()
+{
+    m_waiter.Wait(*m_waitableFence, m_fenceValue);
+}
@@ -0,0 +1,60 @@
+// A copy command queue with its fence and command list.
+//
+// Copies are recorded into the command list, which is opened on first use
+// after each Submit with a command allocator of its own. Submit executes the
+// list and signals the fence; the allocator is kept until that value has
+// completed and is then reset and reused, so recording never waits for the
+// GPU. UploadBatch and D3D12StreamingBackend put their copies through one.
+//
+// Recording and submission happen on one thread.
+#pragma once
+#include "stdafx.h"
+#include "D3DUtil.h"
+#include "FenceWaiter.h"
+#include <deque>
+
+class CopyQueue
+{
+public:
+    explicit CopyQueue(ID3D12Device* device);
+    CopyQueue(const CopyQueue& rhs) = delete;
+    CopyQueue& operator=(const CopyQueue& rhs) = delete;
+
+    // Waits for every submission.
+    ~CopyQueue();
+
+    // The list to record copies into, opened if it is not already.
+    ID3D12GraphicsCommandList* GetCommandList();
+
+    bool IsRecording()const { return m_isRecording; }
+
+    // Executes what was recorded, if anything, and signals the fence.
+    // Returns the value signaled; values increase by one per call.
+    UINT64 Submit();
+
+    // Makes queue wait on the GPU until fence has passed.
+    void MakeQueueWait(ID3D12CommandQueue* queue, UINT64 fence);
+
+    // Blocks until every submission has finished.
+    void WaitForIdle();
+
+    UINT64 GetCompletedFence()const { return m_fence->GetCompletedValue(); }
+    UINT64 GetLastFence()const { return m_fenceValue; }
+
+    ID3D12CommandQueue* GetQueue()const { return m_queue.Get(); }
+
+private:
+    ID3D12Device* m_device = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12CommandQueue> m_queue;
+    Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> m_commandList;
+    Microsoft::WRL::ComPtr<ID3D12Fence> m_fence;
+    UINT64 m_fenceValue = 0;
+    std::unique_ptr<D3D12WaitableFence> m_waitableFence;
+    FenceWaiter m_waiter;
+    bool m_isRecording = false;
+
+    // The allocator being recorded into, and one per submission that may
+    // still be on the GPU, oldest first.
+    Microsoft::WRL::ComPtr<ID3D12CommandAllocator> m_recordingAllocator;
+    std::deque<std::pair<UINT64, Microsoft::WRL::ComPtr<ID3D12CommandAllocator>>> m_allocators;
+};
@@ -27,6 +27,8 @@ D3DAppBase::D3DAppBase(HINSTANCE hInstance):m_hAppInstance(hInstance)
     WCHAR assetsPath[512];
     GetAssetPath(assetsPath, _countof(assetsPath));
     m_assetPath = assetsPath;
+
+    m_meshCache = std::make_unique<MeshCache>(GetAssetFullPath(L"MeshCache"));
 }
 
 D3DAppBase::~D3DAppBase()
@@ -88,9 +90,11 @@ int D3DAppBase::Run()
             m_gameTimer.Tick();
             if (!m_appPaused)
             {
+                m_deferredReleases.Sweep(m_fence->GetCompletedValue());
                 CalculateFrameStats();
                 Update(m_gameTimer);
                 Draw(m_gameTimer);
+                m_fenceWaiter.EndFrame();
             }
             else
             {
@@ -334,6 +338,7 @@ void D3DAppBase::CreateAdapter()
 void D3DAppBase::CreateFenceObject()
 {
     ThrowIfFailed(m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
+    m_waitableFence = std::make_unique<D3D12WaitableFence>(m_fence.Get());
 }
 
 void D3DAppBase::InitDescriptorSize()
@@ -379,6 +384,14 @@ void D3DAppBase::CreateCommandObjects()
     // to the command list we will Reset it, and it needs to be closed before
     // calling reset.
     m_commandList->Close();
+
+    ThrowIfFailed(m_device->CreateCommandList(
+        0, m_commandListType,
+        m_commandAllocator.Get(),
+        nullptr,
+        IID_PPV_ARGS(&m_barrierCommandList)
+    ));
+    m_barrierCommandList->Close();
 }
 
 void D3DAppBase::CreateSwapChain()
@@ -447,6 +460,7 @@ void D3DAppBase::CreateRenderTargetViews()
     for (UINT i = 0; i < m_swapChainBufferCount; i++)
     {
         ThrowIfFailed(m_swapchain->GetBuffer(i, IID_PPV_ARGS(&m_swapChainBuffer[i])));
+        m_resourceStates.Register(m_swapChainBuffer[i].Get(), D3D12_RESOURCE_STATE_PRESENT);
         m_device->CreateRenderTargetView(m_swapChainBuffer[i].Get(), nullptr, rtvHeapHandle);
         rtvHeapHandle.Offset(1, m_rtvDescriptorSize);
     }
@@ -497,8 +511,8 @@ void D3DAppBase::CreateDepthStencilBufferAndView()
     m_device->CreateDepthStencilView(m_depthStencilBuffer.Get(), &dsvDesc, m_dsvHeap->GetCPUDescriptorHandleForHeapStart());
 
     // Transition the resource from its initial state to be used as a depth buffer.
-    m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_depthStencilBuffer.Get(),
-        D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_DEPTH_WRITE));
+    m_resourceStates.Register(m_depthStencilBuffer.Get(), D3D12_RESOURCE_STATE_COMMON);
+    m_barriers.Transition(m_depthStencilBuffer.Get(), D3D12_RESOURCE_STATE_DEPTH_WRITE);
 }
 
 void D3DAppBase::FlushCommandQueue()
@@ -512,17 +526,61 @@ void D3DAppBase::FlushCommandQueue()
     ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), m_currentFence));
 
     // Wait until the GPU has completed commands up tp this fence point.
-    if (m_fence->GetCompletedValue() < m_currentFence)
-    {
-        HANDLE eventHandle = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
+    WaitForFence(m_currentFence);
 
-        // Fire event when GPU hits current fence.
-        ThrowIfFailed(m_fence->SetEventOnCompletion(m_currentFence, eventHandle));
+    // Everything retired so far is now free.
+    m_deferredReleases.Sweep(m_currentFence);
+}
 
-        // Wait until the GPU hits current fence.
-        WaitForSingleObject(eventHandle, INFINITE);
-        CloseHandle(eventHandle);
+void D3DAppBase::WaitForFence(UINT64 value)
+{
+    m_fenceWaiter.Wait(*m_waitableFence, value);
+}
+
+void D3DAppBase::DeferRelease(ComPtr<ID3D12Resource> resource)
+{
+    m_deferredReleases.Retire(std::move(resource), m_currentFence + 1);
+}
+
+void D3DAppBase::DeferRelease(DeferredReleaseQueue::Callback callback)
+{
+    m_deferredReleases.Retire(std::move(callback), m_currentFence + 1);
+}
+
+void D3DAppBase::ExecuteCommandList(ID3D12GraphicsCommandList* cmdList, ResourceStateTracker& tracker)
+{
+    tracker.FlushBarriers(cmdList);
+    ThrowIfFailed(cmdList->Close());
+
+    m_initialBarriers.clear();
+    if (tracker.Submit(m_initialBarriers) == 0)
+    {
+        ID3D12CommandList* cmdLists[] = { cmdList };
+        m_commandQueue->ExecuteCommandLists(_countof(cmdLists), cmdLists);
+        return;
+    }
+
+    ComPtr<ID3D12CommandAllocator> allocator;
+    if (!m_freeBarrierAllocators.empty())
+    {
+        allocator = std::move(m_freeBarrierAllocators.back());
+        m_freeBarrierAllocators.pop_back();
+        ThrowIfFailed(allocator->Reset());
+    }
+    else
+    {
+        ThrowIfFailed(m_device->CreateCommandAllocator(m_commandListType, IID_PPV_ARGS(&allocator)));
     }
+
+    ThrowIfFailed(m_barrierCommandList->Reset(allocator.Get(), nullptr));
+    m_barrierCommandList->ResourceBarrier((UINT)m_initialBarriers.size(), m_initialBarriers.data());
+    ThrowIfFailed(m_barrierCommandList->Close());
+
+    ID3D12CommandList* cmdLists[] = { m_barrierCommandList.Get(), cmdList };
+    m_commandQueue->ExecuteCommandLists(_countof(cmdLists), cmdLists);
+
+    // The allocator can be reset once the next fence signal has passed.
+    DeferRelease([this, allocator]() { m_freeBarrierAllocators.push_back(allocator); });
 }
 
 void D3DAppBase::OnResize()
@@ -540,8 +598,10 @@ void D3DAppBase::OnResize()
     m_swapChainBuffer.resize(m_swapChainBufferCount);
     for (UINT i = 0; i < m_swapChainBufferCount; i++)
     {
+        m_resourceStates.Unregister(m_swapChainBuffer[i].Get());
         m_swapChainBuffer[i].Reset();
     }
+    m_resourceStates.Unregister(m_depthStencilBuffer.Get());
     m_depthStencilBuffer.Reset();
 
     // Resize the swap chain.
@@ -557,9 +617,7 @@ void D3DAppBase::OnResize()
     CreateDepthStencilBufferAndView();
 
     // Execute the resize commands.
-    ThrowIfFailed(m_commandList->Close());
-    ID3D12CommandList* cmdLists[] = { m_commandList.Get() };
-    m_commandQueue->ExecuteCommandLists(_countof(cmdLists), cmdLists);
+    ExecuteCommandList(m_commandList.Get(), m_barriers);
 
     // Wait until resize is complete.
     FlushCommandQueue();
@@ -625,6 +683,7 @@ void D3DAppBase::CalculateFrameStats()
 
     static int frameCnt = 0;
     static float timeElapsed = 0.0f;
+    static double gpuWaitAtLastAverage = 0.0;
 
     frameCnt++;
 
@@ -634,17 +693,24 @@ void D3DAppBase::CalculateFrameStats()
         float fps = (float)frameCnt; // fps = frameCnt / 1
         float mspf = 1000.0f / fps;
 
+        // Time per frame the CPU spent waiting for the GPU.
+        double gpuWait = m_fenceWaiter.GetStats().TotalWaitSeconds;
+        float waitmspf = (float)((gpuWait - gpuWaitAtLastAverage) * 1000.0 / frameCnt);
+
         wstring fpsStr = to_wstring(fps);
         wstring mspfStr = to_wstring(mspf);
+        wstring waitStr = to_wstring(waitmspf);
 
         wstring windowText = m_mainWndCaption +
             L"    fps: " + fpsStr +
-            L"   mspf: " + mspfStr;
+            L"   mspf: " + mspfStr +
+            L"   gpu wait: " + waitStr;
 
         SetWindowText(m_hMainWnd, windowText.c_str());
 
         // Reset for next average.
         frameCnt = 0;
         timeElapsed += 1.0f;
+        gpuWaitAtLastAverage = gpuWait;
     }
 }
\ No newline at end of file
@@ -7,6 +7,10 @@
 #include "stdafx.h"
 #include "D3DUtil.h"
 #include "GameTimer.h"
+#include "MeshCache.h"
+#include "DeferredRelease.h"
+#include "FenceWaiter.h"
+#include "ResourceStateTracker.h"
 
 using Microsoft::WRL::ComPtr;
 
@@ -50,6 +54,19 @@ protected:
 
     void FlushCommandQueue();
 
+    // Blocks until m_fence reaches value; the time is counted as GPU wait.
+    void WaitForFence(UINT64 value);
+
+    // Releases resource, or runs callback, once the GPU is done with every
+    // command submitted so far and up to the next fence signal.
+    void DeferRelease(ComPtr<ID3D12Resource> resource);
+    void DeferRelease(DeferredReleaseQueue::Callback callback);
+
+    // Flushes tracker's barriers into cmdList, closes it and executes it,
+    // preceded by a list holding the barriers that bring its resources into
+    // the states it starts with.
+    void ExecuteCommandList(ID3D12GraphicsCommandList* cmdList, ResourceStateTracker& tracker);
+
     void CalculateFrameStats();
 
     /*void LogAdapters();
@@ -102,10 +119,28 @@ protected:
     ComPtr<ID3D12Fence>     m_fence;
     UINT64                  m_currentFence = 0;
 
+    std::unique_ptr<D3D12WaitableFence> m_waitableFence;
+    FenceWaiter             m_fenceWaiter;
+
+    // Swept against m_fence every frame and on every flush.
+    DeferredReleaseQueue    m_deferredReleases;
+
     ComPtr<ID3D12CommandQueue> m_commandQueue;
     ComPtr<ID3D12CommandAllocator> m_commandAllocator;
     ComPtr<ID3D12GraphicsCommandList> m_commandList;
 
+    // States of the back buffers, the depth buffer and anything else the
+    // apps register, as left by the last list executed; m_barriers tracks
+    // m_commandList.
+    ResourceStateRegistry   m_resourceStates;
+    ResourceStateTracker    m_barriers{ m_resourceStates };
+
+    // Records the initial barriers of ExecuteCommandList. Allocators return
+    // to the free list through m_deferredReleases.
+    ComPtr<ID3D12GraphicsCommandList> m_barrierCommandList;
+    std::vector<ComPtr<ID3D12CommandAllocator>> m_freeBarrierAllocators;
+    std::vector<D3D12_RESOURCE_BARRIER> m_initialBarriers;
+
     UINT m_swapChainBufferCount = 2;
     int m_currentBackBufferIndex = 0;
     std::vector<ComPtr<ID3D12Resource>> m_swapChainBuffer;
@@ -126,6 +161,9 @@ protected:
     const D3D12_COMMAND_LIST_TYPE m_commandListType = D3D12_COMMAND_LIST_TYPE_DIRECT;
     std::wstring m_assetPath;
 
+    // Built geometry is cached on disk next to the executable.
+    std::unique_ptr<MeshCache> m_meshCache;
+
     // Derived class should set these in derived constructor to customize starting value.
     std::wstring m_mainWndCaption = L"d3dApp";
     D3D_DRIVER_TYPE m_d3dDriverType = D3D_DRIVER_TYPE_HARDWARE;
@@ -17,4 +17,37 @@ std::wstring DxException::ToString()const
     std::wstring msg = err.ErrorMessage();
 
     return FunctionName + L" failed in " + FileName + L"; line " + std::to_wstring(LineNumber) + L"; error: " + msg;
-}
\ No newline at end of file
+}
+
+void StreamToUploadHeap(void* dest, const void* src, size_t byteSize)
+{
+    BYTE* d = static_cast<BYTE*>(dest);
+    const BYTE* s = static_cast<const BYTE*>(src);
+
+    // Plain stores up to the first 16-byte boundary.
+    size_t head = std::min(byteSize, (size_t)((16 - ((uintptr_t)d & 15)) & 15));
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    byteSize -= head;
+
+    // A cache line per iteration, so each write-combining buffer fills up
+    // and goes out as one burst.
+    for (; byteSize >= 64; byteSize -= 64, d += 64, s += 64)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 32));
+        __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 48));
+        _mm_stream_si128(reinterpret_cast<__m128i*>(d), a);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(d + 16), b);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(d + 32), c);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(d + 48), e);
+    }
+    for (; byteSize >= 16; byteSize -= 16, d += 16, s += 16)
+    {
+        _mm_stream_si128(reinterpret_cast<__m128i*>(d), _mm_loadu_si128(reinterpret_cast<const __m128i*>(s)));
+    }
+
+    memcpy(d, s, byteSize);
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include "stdafx.h"
 #include <DirectXCollision.h>
+#include "BoundingVolume.h"
 
 const unsigned int gNumFrameResources = 3;
 
@@ -48,6 +49,15 @@ struct SubmeshGeometry
     // Bounding box of the geometry defined by this submesh
     // This is used in later chapters of the book.
     DirectX::BoundingBox Bounds;
+
+    // Bounding sphere of the same geometry, for cheaper first-pass culling.
+    DirectX::BoundingSphere SphereBounds;
+
+    void SetBounds(const VertexBounds& bounds)
+    {
+        Bounds = bounds.Box;
+        SphereBounds = bounds.Sphere;
+    }
 };
 struct MeshGeometry
 {
@@ -65,7 +75,9 @@ struct MeshGeometry
     Microsoft::WRL::ComPtr<ID3D12Resource> VertexBufferUploader = nullptr;
     Microsoft::WRL::ComPtr<ID3D12Resource> IndexBufferUploader = nullptr;
 
-    // Data about the buffers.
+    // Data about the buffers. The vertices start VertexBufferOffset bytes
+    // into VertexBufferGPU, which may be shared, e.g. an UploadRing buffer.
+    UINT64 VertexBufferOffset = 0;
     UINT VertexByteStride = 0;
     UINT VertexBufferByteSize = 0;
     DXGI_FORMAT IndexFormat = DXGI_FORMAT_R16_UINT;
@@ -79,7 +91,7 @@ struct MeshGeometry
     D3D12_VERTEX_BUFFER_VIEW VertexBufferView()const
     {
         D3D12_VERTEX_BUFFER_VIEW vbv;
-        vbv.BufferLocation = VertexBufferGPU->GetGPUVirtualAddress();
+        vbv.BufferLocation = VertexBufferGPU->GetGPUVirtualAddress() + VertexBufferOffset;
         vbv.SizeInBytes = VertexBufferByteSize;
         vbv.StrideInBytes = VertexByteStride;
 
@@ -121,6 +133,18 @@ static UINT CalculateConstantBufferByteSize(UINT byteSize)
     return (byteSize + (D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1)) & ~(D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1);
 }
 
+// Rounds value up to a multiple of alignment, which must be a power of two.
+inline UINT64 AlignUp(UINT64 value, UINT64 alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Copies byteSize bytes to write-combined memory, such as a mapped upload
+// heap, with non-temporal stores and without reading dest. Call _mm_sfence()
+// after the last copy and before the GPU may read the data.
+void StreamToUploadHeap(void* dest, const void* src, size_t byteSize);
+
+#if defined(_WIN32)
 inline void GetAssetPath(_Out_writes_(pathSize)WCHAR* path, UINT pathSize)
 {
     if (path == nullptr)
@@ -181,8 +205,8 @@ static Microsoft::WRL::ComPtr<ID3D12Resource> CreateDefaultBuffer(
     // the helper function UpdateSubresources will copy the CPU memory into 
     // the intermediate upload heap. Then using ID3D12CommandList::CopySubresourceRegion,
     // the intermediate upload heap data will be copied to mBuffer.
-    cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(),
-        D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST));
+    // Buffers are promoted from COMMON to COPY_DEST by the copy itself, so
+    // only the transition out of it needs a barrier.
     UpdateSubresources<1>(cmdList, defaultBuffer.Get(), uploadBuffer.Get(), 0, 0, 1, &subResourceData);
     cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(),
         D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ));
@@ -192,6 +216,7 @@ static Microsoft::WRL::ComPtr<ID3D12Resource> CreateDefaultBuffer(
     // copy. The caller can Release the uploadBuffer after it knows the copy has been done.
     return defaultBuffer;
 }
+#endif
 
 // Simple struct to represent a material for demos.
 struct Material
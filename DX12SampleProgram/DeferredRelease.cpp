@@ -0,0 +1,102 @@
+#include "stdafx.h"
+#include "DeferredRelease.h"
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+    // Size of the memory behind resource; exact for buffers, the allocation
+    // size for textures.
+    UINT64 GetResourceByteSize(ID3D12Resource* resource)
+    {
+        D3D12_RESOURCE_DESC desc = resource->GetDesc();
+        if (desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+        {
+            return desc.Width;
+        }
+
+        ComPtr<ID3D12Device> device;
+        if (FAILED(resource->GetDevice(IID_PPV_ARGS(&device))))
+        {
+            return 0;
+        }
+        return device->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+    }
+}
+
+void DeferredReleaseQueue::Push(Entry&& entry)
+{
+    if (!m_entries.empty())
+    {
+        entry.Fence = std::max(entry.Fence, m_entries.back().Fence);
+    }
+    m_entries.push_back(std::move(entry));
+}
+
+void DeferredReleaseQueue::Retire(ComPtr<ID3D12Resource> resource, UINT64 fence)
+{
+    if (resource == nullptr)
+    {
+        return;
+    }
+
+    Entry entry;
+    entry.Fence = fence;
+    entry.ByteSize = GetResourceByteSize(resource.Get());
+    entry.Resource = std::move(resource);
+
+    ++m_pendingResources;
+    m_pendingBytes += entry.ByteSize;
+    m_peakPendingBytes = std::max(m_peakPendingBytes, m_pendingBytes);
+    Push(std::move(entry));
+}
+
+void DeferredReleaseQueue::Retire(Callback callback, UINT64 fence)
+{
+    assert(callback);
+
+    Entry entry;
+    entry.Fence = fence;
+    entry.OnRelease = std::move(callback);
+    Push(std::move(entry));
+}
+
+UINT DeferredReleaseQueue::Sweep(UINT64 completedFence)
+{
+    UINT released = 0;
+    while (!m_entries.empty() && m_entries.front().Fence <= completedFence)
+    {
+        // Popped first, as the callback may retire more.
+        Entry entry = std::move(m_entries.front());
+        m_entries.pop_front();
+
+        if (entry.Resource != nullptr)
+        {
+            entry.Resource = nullptr;
+            --m_pendingResources;
+            m_pendingBytes -= entry.ByteSize;
+            ++m_releasedResources;
+            m_releasedBytes += entry.ByteSize;
+        }
+        else
+        {
+            entry.OnRelease();
+            ++m_callbacksRun;
+        }
+        ++released;
+    }
+    return released;
+}
+
+DeferredReleaseStats DeferredReleaseQueue::GetStats()const
+{
+    DeferredReleaseStats stats;
+    stats.PendingResources = m_pendingResources;
+    stats.PendingCallbacks = (UINT)m_entries.size() - m_pendingResources;
+    stats.PendingBytes = m_pendingBytes;
+    stats.PeakPendingBytes = m_peakPendingBytes;
+    stats.ReleasedResources = m_releasedResources;
+    stats.ReleasedBytes = m_releasedBytes;
+    stats.CallbacksRun = m_callbacksRun;
+    return stats;
+}
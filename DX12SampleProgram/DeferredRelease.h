@@ -0,0 +1,76 @@
+// Fence-tracked deferred release of GPU resources.
+//
+// A resource the GPU may still be reading, such as an upload buffer whose
+// copy was just recorded or a buffer being replaced, is retired with the
+// fence value that marks the end of the work using it. Sweep, called once a
+// frame with the fence's completed value, drops the references of everything
+// whose fence has passed, so memory goes as soon as it is free instead of at
+// the next full flush. Callbacks can be retired the same way, e.g. to hand a
+// heap range back once the resource placed in it is gone.
+//
+// Entries are released in the order they were retired. A fence lower than
+// that of an earlier entry is raised to it, which only delays the release.
+//
+// Nothing here is thread safe; retire and sweep on the render thread.
+#pragma once
+#include "stdafx.h"
+#include <deque>
+#include <functional>
+
+struct DeferredReleaseStats
+{
+    UINT PendingResources = 0;
+    UINT PendingCallbacks = 0;
+
+    // Bytes of the pending resources, now and at most.
+    UINT64 PendingBytes = 0;
+    UINT64 PeakPendingBytes = 0;
+
+    UINT64 ReleasedResources = 0;
+    UINT64 ReleasedBytes = 0;
+    UINT64 CallbacksRun = 0;
+};
+
+class DeferredReleaseQueue
+{
+public:
+    using Callback = std::function<void()>;
+
+    DeferredReleaseQueue() = default;
+    DeferredReleaseQueue(const DeferredReleaseQueue& rhs) = delete;
+    DeferredReleaseQueue& operator=(const DeferredReleaseQueue& rhs) = delete;
+
+    // Keeps resource alive until fence has passed. Null resources are ignored.
+    void Retire(Microsoft::WRL::ComPtr<ID3D12Resource> resource, UINT64 fence);
+
+    // Runs callback from Sweep once fence has passed.
+    void Retire(Callback callback, UINT64 fence);
+
+    // Releases everything retired with a fence up to completedFence. Returns
+    // the number of entries released.
+    UINT Sweep(UINT64 completedFence);
+
+    bool IsEmpty()const { return m_entries.empty(); }
+
+    DeferredReleaseStats GetStats()const;
+
+private:
+    struct Entry
+    {
+        UINT64 Fence = 0;
+        Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+        UINT64 ByteSize = 0;
+        Callback OnRelease;
+    };
+
+    void Push(Entry&& entry);
+
+    std::deque<Entry> m_entries;
+
+    UINT m_pendingResources = 0;
+    UINT64 m_pendingBytes = 0;
+    UINT64 m_peakPendingBytes = 0;
+    UINT64 m_releasedResources = 0;
+    UINT64 m_releasedBytes = 0;
+    UINT64 m_callbacksRun = 0;
+};
@@ -0,0 +1,262 @@
+#include "stdafx.h"
+#include "DescriptorAllocator.h"
+
+#if defined(_WIN32)
+D3D12DescriptorBackend::D3D12DescriptorBackend(ID3D12Device* device, D3D12_DESCRIPTOR_HEAP_TYPE type) :
+    m_device(device),
+    m_type(type),
+    m_incrementSize(device->GetDescriptorHandleIncrementSize(type))
+{
+}
+
+void D3D12DescriptorBackend::CreateHeap(UINT heapId, UINT descriptorCount, bool shaderVisible,
+    D3D12_CPU_DESCRIPTOR_HANDLE& cpuStart, D3D12_GPU_DESCRIPTOR_HANDLE& gpuStart)
+{
+    assert(!shaderVisible || m_type == D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV || m_type == D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER);
+
+    D3D12_DESCRIPTOR_HEAP_DESC heapDesc;
+    heapDesc.NumDescriptors = descriptorCount;
+    heapDesc.Type = m_type;
+    heapDesc.Flags = shaderVisible ? D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE : D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+    heapDesc.NodeMask = 0;
+
+    if (heapId >= m_heaps.size())
+    {
+        m_heaps.resize(heapId + 1);
+    }
+    ThrowIfFailed(m_device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&m_heaps[heapId])));
+
+    cpuStart = m_heaps[heapId]->GetCPUDescriptorHandleForHeapStart();
+    gpuStart = {};
+    if (shaderVisible)
+    {
+        gpuStart = m_heaps[heapId]->GetGPUDescriptorHandleForHeapStart();
+    }
+}
+
+void D3D12DescriptorBackend::CopyDescriptors(UINT destRangeCount, const D3D12_CPU_DESCRIPTOR_HANDLE* destStarts,
+    const UINT* destSizes, UINT srcRangeCount, const D3D12_CPU_DESCRIPTOR_HANDLE* srcStarts, const UINT* srcSizes)
+{
+    m_device->CopyDescriptors(destRangeCount, destStarts, destSizes, srcRangeCount, srcStarts, srcSizes, m_type);
+}
+#endif
+
+void MockDescriptorBackend::CreateHeap(UINT heapId, UINT descriptorCount, bool shaderVisible,
+    D3D12_CPU_DESCRIPTOR_HANDLE& cpuStart, D3D12_GPU_DESCRIPTOR_HANDLE& gpuStart)
+{
+    if (heapId >= m_heaps.size())
+    {
+        m_heaps.resize(heapId + 1);
+    }
+    m_heaps[heapId].assign(descriptorCount, 0);
+
+    cpuStart.ptr = (SIZE_T)heapId << 32;
+    gpuStart.ptr = shaderVisible ? (UINT64)heapId << 32 : 0;
+}
+
+UINT64& MockDescriptorBackend::Descriptor(D3D12_CPU_DESCRIPTOR_HANDLE handle)
+{
+    std::vector<UINT64>& heap = m_heaps[(UINT)((UINT64)handle.ptr >> 32)];
+    UINT index = (UINT)(handle.ptr & 0xffffffff);
+    assert(index < heap.size());
+    return heap[index];
+}
+
+void MockDescriptorBackend::CopyDescriptors(UINT destRangeCount, const D3D12_CPU_DESCRIPTOR_HANDLE* destStarts,
+    const UINT* destSizes, UINT srcRangeCount, const D3D12_CPU_DESCRIPTOR_HANDLE* srcStarts, const UINT* srcSizes)
+{
+    // Walks both lists of ranges at once, as the device does.
+    UINT destRange = 0;
+    UINT destIndex = 0;
+    for (UINT srcRange = 0; srcRange < srcRangeCount; ++srcRange)
+    {
+        for (UINT i = 0; i < srcSizes[srcRange]; ++i)
+        {
+            while (destIndex == destSizes[destRange])
+            {
+                ++destRange;
+                destIndex = 0;
+            }
+            assert(destRange < destRangeCount);
+            Descriptor({ destStarts[destRange].ptr + destIndex }) = Descriptor({ srcStarts[srcRange].ptr + i });
+            ++destIndex;
+        }
+    }
+    ++m_copyCallCount;
+}
+
+DescriptorAllocator::DescriptorAllocator(DescriptorBackend& backend, const DescriptorAllocatorDesc& desc) :
+    m_backend(backend),
+    m_desc(desc),
+    m_incrementSize(backend.GetIncrementSize()),
+    m_ring(desc.ShaderVisibleCount)
+{
+    assert(m_desc.StagingPageSize > 0 && m_desc.ShaderVisibleCount > 0);
+    m_backend.CreateHeap(ShaderVisibleHeapId, m_desc.ShaderVisibleCount, true, m_visibleCPU, m_visibleGPU);
+}
+
+UINT DescriptorAllocator::CreatePage(UINT descriptorCount)
+{
+    Page page;
+    page.HeapId = (UINT)m_pages.size() + 1;
+    UINT size = std::max(descriptorCount, m_desc.StagingPageSize);
+
+    D3D12_GPU_DESCRIPTOR_HANDLE unused;
+    m_backend.CreateHeap(page.HeapId, size, false, page.CPU, unused);
+    page.Ranges = std::make_unique<RangeAllocator>(size);
+
+    m_pages.push_back(std::move(page));
+    return (UINT)m_pages.size() - 1;
+}
+
+DescriptorAllocation DescriptorAllocator::Allocate(UINT count)
+{
+    assert(count > 0);
+
+    DescriptorAllocation allocation;
+    for (UINT i = 0; i < (UINT)m_pages.size() && !allocation.IsValid(); ++i)
+    {
+        if (m_pages[i].Ranges->GetFreeSize() < count)
+        {
+            continue;
+        }
+
+        UINT64 offset = m_pages[i].Ranges->Allocate(count);
+        if (offset != RangeAllocator::InvalidOffset)
+        {
+            allocation.Page = i;
+            allocation.Offset = (UINT)offset;
+        }
+    }
+
+    if (!allocation.IsValid())
+    {
+        allocation.Page = CreatePage(count);
+        allocation.Offset = (UINT)m_pages[allocation.Page].Ranges->Allocate(count);
+    }
+
+    allocation.Count = count;
+    allocation.CPU = Offset(m_pages[allocation.Page].CPU, allocation.Offset);
+    m_persistentDescriptors += count;
+    ++m_persistentAllocationCount;
+    return allocation;
+}
+
+void DescriptorAllocator::Free(DescriptorAllocation& allocation)
+{
+    if (!allocation.IsValid())
+    {
+        return;
+    }
+
+    m_pages[allocation.Page].Ranges->Free(allocation.Offset);
+    m_persistentDescriptors -= allocation.Count;
+    --m_persistentAllocationCount;
+    allocation = DescriptorAllocation();
+}
+
+void DescriptorAllocator::BeginFrame(UINT64 completedFence)
+{
+    assert(m_ring.GetFrameSize() == 0 && "EndFrame was not called for the previous frame.");
+    m_ring.Retire(completedFence);
+}
+
+DescriptorTable DescriptorAllocator::AllocateTransient(UINT count)
+{
+    // Tables are contiguous; the ring skips its tail when one does not fit.
+    UINT64 offset = 0;
+    if (!m_ring.Allocate(count, 1, offset))
+    {
+        throw std::overflow_error("DescriptorAllocator: the shader-visible heap is full.");
+    }
+    m_highWaterMark = std::max(m_highWaterMark, (UINT)m_ring.GetUsed());
+
+    DescriptorTable table;
+    table.CPU = Offset(m_visibleCPU, (UINT)offset);
+    table.GPU.ptr = m_visibleGPU.ptr + offset * m_incrementSize;
+    table.Offset = (UINT)offset;
+    table.Count = count;
+    return table;
+}
+
+void DescriptorAllocator::AppendRange(std::vector<D3D12_CPU_DESCRIPTOR_HANDLE>& starts, std::vector<UINT>& sizes,
+    D3D12_CPU_DESCRIPTOR_HANDLE start, UINT size, UINT incrementSize, bool canMerge)
+{
+    if (canMerge && !starts.empty() && starts.back().ptr + (SIZE_T)sizes.back() * incrementSize == start.ptr)
+    {
+        sizes.back() += size;
+    }
+    else
+    {
+        starts.push_back(start);
+        sizes.push_back(size);
+    }
+}
+
+void DescriptorAllocator::StageCopy(const DescriptorTable& table, UINT slot, const DescriptorAllocation& source)
+{
+    assert(source.IsValid());
+    assert(slot + source.Count <= table.Count);
+
+    // A range must not run from one staging heap into another that happens
+    // to follow it in memory.
+    AppendRange(m_copyDestStarts, m_copyDestSizes, Offset(table.CPU, slot), source.Count, m_incrementSize, true);
+    AppendRange(m_copySourceStarts, m_copySourceSizes, source.CPU, source.Count, m_incrementSize,
+        source.Page == m_lastSourcePage);
+    m_lastSourcePage = source.Page;
+    m_descriptorsCopied += source.Count;
+}
+
+DescriptorTable DescriptorAllocator::CopyToTransient(const DescriptorAllocation& source)
+{
+    DescriptorTable table = AllocateTransient(source.Count);
+    StageCopy(table, 0, source);
+    return table;
+}
+
+void DescriptorAllocator::FlushCopies()
+{
+    if (m_copySourceStarts.empty())
+    {
+        return;
+    }
+
+    m_backend.CopyDescriptors((UINT)m_copyDestStarts.size(), m_copyDestStarts.data(), m_copyDestSizes.data(),
+        (UINT)m_copySourceStarts.size(), m_copySourceStarts.data(), m_copySourceSizes.data());
+    ++m_copyCalls;
+
+    m_copyDestStarts.clear();
+    m_copyDestSizes.clear();
+    m_copySourceStarts.clear();
+    m_copySourceSizes.clear();
+    m_lastSourcePage = DescriptorAllocation::InvalidPage;
+}
+
+void DescriptorAllocator::EndFrame(UINT64 fence)
+{
+    assert(m_copySourceStarts.empty() && "FlushCopies was not called before executing the frame.");
+
+    m_lastFrameSize = (UINT)m_ring.EndFrame(fence);
+}
+
+DescriptorAllocatorStats DescriptorAllocator::GetStats()const
+{
+    DescriptorAllocatorStats stats;
+    stats.StagingPageCount = (UINT)m_pages.size();
+    for (const Page& page : m_pages)
+    {
+        stats.StagingCapacity += page.Ranges->GetSize();
+    }
+    stats.PersistentDescriptors = m_persistentDescriptors;
+    stats.PersistentAllocationCount = m_persistentAllocationCount;
+
+    stats.TransientCapacity = m_desc.ShaderVisibleCount;
+    stats.TransientInFlight = (UINT)m_ring.GetUsed();
+    stats.TransientHighWaterMark = m_highWaterMark;
+    stats.LastFrameTransient = m_lastFrameSize;
+    stats.FramesInFlight = m_ring.GetFramesInFlight();
+
+    stats.DescriptorsCopied = m_descriptorsCopied;
+    stats.CopyCalls = m_copyCalls;
+    return stats;
+}
@@ -0,0 +1,229 @@
+// Descriptor allocator for one descriptor heap type.
+//
+// Persistent descriptors, created once and kept, such as the CBV of an
+// object's constants, live in CPU-only staging heaps. Staging heaps come in
+// pages of StagingPageSize descriptors, each page handing out ranges with a
+// RangeAllocator (TLSF free lists), and a new page is added when none has
+// room, so adding or removing objects never rebuilds anything.
+//
+// What shaders see is one shader-visible heap used as a ring, like
+// UploadRing: every frame allocates its descriptor tables linearly from the
+// head, and a whole frame is given back at once when the GPU has passed the
+// fence it was submitted with. Tables are filled by copying persistent
+// descriptors into them; the copies are queued and issued together by
+// FlushCopies in as few CopyDescriptors calls as possible.
+//
+// The heaps are created and copied through a DescriptorBackend.
+// D3D12DescriptorBackend uses ID3D12DescriptorHeaps; MockDescriptorBackend
+// keeps a tag per descriptor in plain memory, so allocation and copies can be
+// checked without a device.
+//
+// Usage, on the render thread only:
+//     descriptors.BeginFrame(fence->GetCompletedValue());
+//     ... CopyToTransient / AllocateTransient + StageCopy while recording ...
+//     descriptors.FlushCopies(); queue->ExecuteCommandLists(...);
+//     queue->Signal(fence, value); descriptors.EndFrame(value);
+#pragma once
+#include "stdafx.h"
+#include "D3DUtil.h"
+#include "FencedRing.h"
+#include "RangeAllocator.h"
+
+class DescriptorBackend
+{
+public:
+    virtual ~DescriptorBackend() = default;
+
+    virtual UINT GetIncrementSize()const = 0;
+
+    // Creates the heap known as heapId from now on, of descriptorCount
+    // descriptors. gpuStart is only set for shader-visible heaps.
+    virtual void CreateHeap(UINT heapId, UINT descriptorCount, bool shaderVisible,
+        D3D12_CPU_DESCRIPTOR_HANDLE& cpuStart, D3D12_GPU_DESCRIPTOR_HANDLE& gpuStart) = 0;
+
+    // As ID3D12Device::CopyDescriptors.
+    virtual void CopyDescriptors(UINT destRangeCount, const D3D12_CPU_DESCRIPTOR_HANDLE* destStarts, const UINT* destSizes,
+        UINT srcRangeCount, const D3D12_CPU_DESCRIPTOR_HANDLE* srcStarts, const UINT* srcSizes) = 0;
+};
+
+#if defined(_WIN32)
+class D3D12DescriptorBackend : public DescriptorBackend
+{
+public:
+    D3D12DescriptorBackend(ID3D12Device* device, D3D12_DESCRIPTOR_HEAP_TYPE type);
+
+    virtual UINT GetIncrementSize()const override { return m_incrementSize; }
+    virtual void CreateHeap(UINT heapId, UINT descriptorCount, bool shaderVisible,
+        D3D12_CPU_DESCRIPTOR_HANDLE& cpuStart, D3D12_GPU_DESCRIPTOR_HANDLE& gpuStart)override;
+    virtual void CopyDescriptors(UINT destRangeCount, const D3D12_CPU_DESCRIPTOR_HANDLE* destStarts, const UINT* destSizes,
+        UINT srcRangeCount, const D3D12_CPU_DESCRIPTOR_HANDLE* srcStarts, const UINT* srcSizes)override;
+
+    ID3D12DescriptorHeap* GetHeap(UINT heapId)const { return m_heaps[heapId].Get(); }
+
+private:
+    ID3D12Device* m_device = nullptr;
+    D3D12_DESCRIPTOR_HEAP_TYPE m_type;
+    UINT m_incrementSize = 0;
+    std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> m_heaps;
+};
+#endif
+
+// Each descriptor is a UINT64 tag. Handles encode the heap id in the upper
+// 32 bits of ptr and the descriptor index in the lower ones.
+class MockDescriptorBackend : public DescriptorBackend
+{
+public:
+    virtual UINT GetIncrementSize()const override { return 1; }
+    virtual void CreateHeap(UINT heapId, UINT descriptorCount, bool shaderVisible,
+        D3D12_CPU_DESCRIPTOR_HANDLE& cpuStart, D3D12_GPU_DESCRIPTOR_HANDLE& gpuStart)override;
+    virtual void CopyDescriptors(UINT destRangeCount, const D3D12_CPU_DESCRIPTOR_HANDLE* destStarts, const UINT* destSizes,
+        UINT srcRangeCount, const D3D12_CPU_DESCRIPTOR_HANDLE* srcStarts, const UINT* srcSizes)override;
+
+    // The tag of the descriptor at handle, as a CreateConstantBufferView
+    // would write it.
+    UINT64& Descriptor(D3D12_CPU_DESCRIPTOR_HANDLE handle);
+
+    UINT GetCopyCallCount()const { return m_copyCallCount; }
+
+private:
+    std::vector<std::vector<UINT64>> m_heaps;
+    UINT m_copyCallCount = 0;
+};
+
+struct DescriptorAllocatorDesc
+{
+    // Descriptors per staging heap.
+    UINT StagingPageSize = 4096;
+
+    // Descriptors in the shader-visible ring.
+    UINT ShaderVisibleCount = 65536;
+};
+
+struct DescriptorAllocation
+{
+    static const UINT InvalidPage = ~0u;
+
+    UINT Page = InvalidPage;
+    UINT Offset = 0;
+    UINT Count = 0;
+    D3D12_CPU_DESCRIPTOR_HANDLE CPU = {};
+
+    bool IsValid()const { return Page != InvalidPage; }
+};
+
+// A range of the shader-visible heap, valid for the frame it was allocated
+// in.
+struct DescriptorTable
+{
+    D3D12_CPU_DESCRIPTOR_HANDLE CPU = {};
+    D3D12_GPU_DESCRIPTOR_HANDLE GPU = {};
+    UINT Offset = 0;
+    UINT Count = 0;
+};
+
+struct DescriptorAllocatorStats
+{
+    UINT StagingPageCount = 0;
+    UINT64 StagingCapacity = 0;
+    UINT64 PersistentDescriptors = 0;
+    UINT PersistentAllocationCount = 0;
+
+    // Ring descriptors owned by frames the GPU has not finished, wrap
+    // padding included, and the most there have ever been.
+    UINT TransientCapacity = 0;
+    UINT TransientInFlight = 0;
+    UINT TransientHighWaterMark = 0;
+    UINT LastFrameTransient = 0;
+    UINT FramesInFlight = 0;
+
+    // Descriptors copied into tables, and the CopyDescriptors calls it took.
+    UINT64 DescriptorsCopied = 0;
+    UINT64 CopyCalls = 0;
+};
+
+class DescriptorAllocator
+{
+public:
+    // Heap id of the shader-visible ring; staging pages follow.
+    static const UINT ShaderVisibleHeapId = 0;
+
+    DescriptorAllocator(DescriptorBackend& backend, const DescriptorAllocatorDesc& desc = DescriptorAllocatorDesc());
+    DescriptorAllocator(const DescriptorAllocator& rhs) = delete;
+    DescriptorAllocator& operator=(const DescriptorAllocator& rhs) = delete;
+
+    // count contiguous persistent descriptors, to be written through CPU.
+    DescriptorAllocation Allocate(UINT count = 1);
+
+    // The descriptors must no longer be needed by any copy still queued.
+    void Free(DescriptorAllocation& allocation);
+
+    // Reclaims the ring space of every frame whose fence is at most
+    // completedFence.
+    void BeginFrame(UINT64 completedFence);
+
+    // count contiguous descriptors of the shader-visible heap. Throws if the
+    // ring has no room left.
+    DescriptorTable AllocateTransient(UINT count);
+
+    // Queues a copy of source into table from slot on.
+    void StageCopy(const DescriptorTable& table, UINT slot, const DescriptorAllocation& source);
+
+    // A table holding a copy of source.
+    DescriptorTable CopyToTransient(const DescriptorAllocation& source);
+
+    // Issues the queued copies. Call before the command lists using the
+    // tables are executed.
+    void FlushCopies();
+
+    // Everything allocated since BeginFrame is in use until fence completes.
+    void EndFrame(UINT64 fence);
+
+    DescriptorAllocatorStats GetStats()const;
+
+private:
+    struct Page
+    {
+        UINT HeapId = 0;
+        D3D12_CPU_DESCRIPTOR_HANDLE CPU = {};
+        std::unique_ptr<RangeAllocator> Ranges;
+    };
+
+    // Returns the new page index. Pages hold at least StagingPageSize
+    // descriptors.
+    UINT CreatePage(UINT descriptorCount);
+
+    static void AppendRange(std::vector<D3D12_CPU_DESCRIPTOR_HANDLE>& starts, std::vector<UINT>& sizes,
+        D3D12_CPU_DESCRIPTOR_HANDLE start, UINT size, UINT incrementSize, bool canMerge);
+
+    D3D12_CPU_DESCRIPTOR_HANDLE Offset(D3D12_CPU_DESCRIPTOR_HANDLE start, UINT index)const
+    {
+        return { start.ptr + (SIZE_T)index * m_incrementSize };
+    }
+
+    DescriptorBackend& m_backend;
+    DescriptorAllocatorDesc m_desc;
+    UINT m_incrementSize = 0;
+
+    std::vector<Page> m_pages;
+
+    // Shader-visible ring, as in UploadRing.
+    D3D12_CPU_DESCRIPTOR_HANDLE m_visibleCPU = {};
+    D3D12_GPU_DESCRIPTOR_HANDLE m_visibleGPU = {};
+    FencedRing m_ring;
+    UINT m_highWaterMark = 0;
+    UINT m_lastFrameSize = 0;
+
+    // Queued copies. CopyDescriptors flattens destination and source ranges
+    // separately, so each side merges with its previous range whenever it
+    // continues it.
+    std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> m_copyDestStarts;
+    std::vector<UINT> m_copyDestSizes;
+    std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> m_copySourceStarts;
+    std::vector<UINT> m_copySourceSizes;
+    UINT m_lastSourcePage = DescriptorAllocation::InvalidPage;
+
+    UINT64 m_persistentDescriptors = 0;
+    UINT m_persistentAllocationCount = 0;
+    UINT64 m_descriptorsCopied = 0;
+    UINT64 m_copyCalls = 0;
+};
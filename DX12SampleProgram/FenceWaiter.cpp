@@ -0,0 +1,146 @@
+#include "stdafx.h"
+#include "FenceWaiter.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double SecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // Longest a ManualFence blocks in one go.
+    const FenceTimeout MaxBlockSlice = std::chrono::seconds(1);
+}
+
+#if defined(_WIN32)
+D3D12WaitableFence::D3D12WaitableFence(ID3D12Fence* fence) :
+    m_fence(fence)
+{
+    // Auto-reset, so a wait that timed out and was set later only costs the
+    // next wait one extra check of the fence.
+    m_event = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+    if (m_event == nullptr)
+    {
+        ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+    }
+}
+
+D3D12WaitableFence::~D3D12WaitableFence()
+{
+    CloseHandle(m_event);
+}
+
+void D3D12WaitableFence::Block(UINT64 value, FenceTimeout timeout)
+{
+    ThrowIfFailed(m_fence->SetEventOnCompletion(value, m_event));
+    DWORD timeoutMs = INFINITE;
+    if (timeout != NoFenceTimeout)
+    {
+        timeoutMs = (DWORD)std::min<FenceTimeout::rep>(timeout.count(), INFINITE - 1);
+    }
+    WaitForSingleObject(m_event, timeoutMs);
+}
+#endif
+
+void ManualFence::Signal(UINT64 value)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_value = std::max(m_value, value);
+    }
+    m_signaled.notify_all();
+}
+
+UINT64 ManualFence::GetCompletedValue()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_value;
+}
+
+void ManualFence::Block(UINT64 value, FenceTimeout timeout)
+{
+    // NoFenceTimeout would overflow the deadline of wait_for, so blocks are
+    // cut into slices; the caller checks again and blocks anew.
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_signaled.wait_for(lock, std::min(timeout, MaxBlockSlice), [this, value]() { return m_value >= value; });
+}
+
+FenceWaiter::FenceWaiter(const FenceWaitPolicy& policy) :
+    m_policy(policy)
+{
+}
+
+bool FenceWaiter::Wait(WaitableFence& fence, UINT64 value, FenceTimeout timeout)
+{
+    if (fence.GetCompletedValue() >= value)
+    {
+        ++m_stats.ImmediateCount;
+        return true;
+    }
+
+    const Clock::time_point start = Clock::now();
+    const double spinSeconds = m_policy.SpinMicroseconds * 1e-6;
+    bool completed = false;
+    while (!completed && SecondsSince(start) < spinSeconds)
+    {
+        YieldProcessor();
+        completed = fence.GetCompletedValue() >= value;
+    }
+
+    bool timedOut = false;
+    if (completed)
+    {
+        ++m_stats.SpinCount;
+    }
+    else
+    {
+        ++m_stats.BlockCount;
+        while (fence.GetCompletedValue() < value)
+        {
+            FenceTimeout remaining = NoFenceTimeout;
+            if (timeout != NoFenceTimeout)
+            {
+                const Clock::duration elapsed = Clock::now() - start;
+                if (elapsed >= timeout)
+                {
+                    timedOut = true;
+                    break;
+                }
+                // Rounded up, so the last block does not end just short.
+                remaining = std::chrono::duration_cast<FenceTimeout>(timeout - elapsed) + FenceTimeout(1);
+            }
+            fence.Block(value, remaining);
+        }
+    }
+
+    const double waitSeconds = SecondsSince(start);
+    m_frameWaitSeconds += waitSeconds;
+    m_stats.TotalWaitSeconds += waitSeconds;
+
+    if (waitSeconds * 1000.0 >= m_policy.StallMilliseconds)
+    {
+        ++m_stats.StallCount;
+#if defined(_WIN32)
+        char message[128];
+        sprintf_s(message, "FenceWaiter: %s %.1f ms for fence value %llu.\n",
+            timedOut ? "gave up after" : "stalled", waitSeconds * 1000.0, value);
+        ::OutputDebugStringA(message);
+#endif
+    }
+
+    if (timedOut)
+    {
+        ++m_stats.TimeoutCount;
+        return false;
+    }
+    return true;
+}
+
+void FenceWaiter::EndFrame()
+{
+    m_stats.LastFrameWaitSeconds = m_frameWaitSeconds;
+    m_stats.MaxFrameWaitSeconds = std::max(m_stats.MaxFrameWaitSeconds, m_frameWaitSeconds);
+    m_frameWaitSeconds = 0.0;
+}
@@ -0,0 +1,121 @@
+// CPU waits on GPU fences.
+//
+// Waiting the usual way creates an event, sets it on completion, waits on it
+// and closes it, a round trip through the kernel for every wait. Here each
+// fence keeps its event for reuse, and FenceWaiter, before blocking at all,
+// spins for a short, bounded time on the completed value, which catches the
+// GPU finishing just as the CPU gets there. Every wait is timed on
+// steady_clock: the stats give the time the CPU spent on the GPU in the last
+// frame and the worst frame, and waits longer than StallMilliseconds are
+// counted, and logged to the debugger, as stalls.
+//
+// What is waited on is a WaitableFence. D3D12WaitableFence wraps an
+// ID3D12Fence and owns the Win32 event it blocks on; ManualFence is a
+// CPU-side stand-in signaled by hand, from any thread, for code that runs
+// without a device.
+//
+// A FenceWaiter is used from one thread.
+#pragma once
+#include "stdafx.h"
+#include "D3DUtil.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+// How long a wait may take; NoFenceTimeout waits for as long as it takes.
+using FenceTimeout = std::chrono::milliseconds;
+const FenceTimeout NoFenceTimeout = FenceTimeout::max();
+
+class WaitableFence
+{
+public:
+    virtual ~WaitableFence() = default;
+
+    virtual UINT64 GetCompletedValue() = 0;
+
+    // Blocks until value has completed or timeout has passed, or at worst
+    // returns early. The caller checks the value again.
+    virtual void Block(UINT64 value, FenceTimeout timeout) = 0;
+};
+
+#if defined(_WIN32)
+class D3D12WaitableFence : public WaitableFence
+{
+public:
+    explicit D3D12WaitableFence(ID3D12Fence* fence);
+    D3D12WaitableFence(const D3D12WaitableFence& rhs) = delete;
+    D3D12WaitableFence& operator=(const D3D12WaitableFence& rhs) = delete;
+    ~D3D12WaitableFence();
+
+    virtual UINT64 GetCompletedValue()override { return m_fence->GetCompletedValue(); }
+    virtual void Block(UINT64 value, FenceTimeout timeout)override;
+
+private:
+    ID3D12Fence* m_fence = nullptr;
+    HANDLE m_event = nullptr;
+};
+#endif
+
+class ManualFence : public WaitableFence
+{
+public:
+    void Signal(UINT64 value);
+
+    virtual UINT64 GetCompletedValue()override;
+    virtual void Block(UINT64 value, FenceTimeout timeout)override;
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_signaled;
+    UINT64 m_value = 0;
+};
+
+struct FenceWaitPolicy
+{
+    // How long to poll the fence before blocking.
+    UINT SpinMicroseconds = 50;
+
+    // Waits longer than this are counted and logged.
+    UINT StallMilliseconds = 100;
+};
+
+struct FenceWaiterStats
+{
+    // Waits that found the value completed, that saw it complete while
+    // spinning, that blocked, and that gave up.
+    UINT64 ImmediateCount = 0;
+    UINT64 SpinCount = 0;
+    UINT64 BlockCount = 0;
+    UINT64 TimeoutCount = 0;
+    UINT64 StallCount = 0;
+
+    double TotalWaitSeconds = 0.0;
+
+    // Time spent waiting between the last two EndFrame calls, and the most
+    // of any frame.
+    double LastFrameWaitSeconds = 0.0;
+    double MaxFrameWaitSeconds = 0.0;
+};
+
+class FenceWaiter
+{
+public:
+    explicit FenceWaiter(const FenceWaitPolicy& policy = FenceWaitPolicy());
+    FenceWaiter(const FenceWaiter& rhs) = delete;
+    FenceWaiter& operator=(const FenceWaiter& rhs) = delete;
+
+    // Returns once fence has reached value, or false if timeout passed
+    // first.
+    bool Wait(WaitableFence& fence, UINT64 value, FenceTimeout timeout = NoFenceTimeout);
+
+    // Closes the frame's wait time into the stats.
+    void EndFrame();
+
+    const FenceWaiterStats& GetStats()const { return m_stats; }
+
+private:
+    FenceWaitPolicy m_policy;
+
+    double m_frameWaitSeconds = 0.0;
+    FenceWaiterStats m_stats;
+};
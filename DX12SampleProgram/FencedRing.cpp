@@ -0,0 +1,87 @@
+#include "stdafx.h"
+#include "FencedRing.h"
+
+void FencedRing::Reset(UINT64 capacity)
+{
+    m_capacity = capacity;
+    m_head = 0;
+    m_used = 0;
+    m_frameSize = 0;
+    m_frames.clear();
+}
+
+void FencedRing::Retire(UINT64 completedFence)
+{
+    while (!m_frames.empty() && m_frames.front().Fence <= completedFence)
+    {
+        m_used -= m_frames.front().Size;
+        m_frames.pop_front();
+    }
+}
+
+bool FencedRing::Allocate(UINT64 size, UINT64 alignment, UINT64& offset)
+{
+    return Reserve(size, alignment, size, false, offset) == size;
+}
+
+UINT64 FencedRing::AllocatePartial(UINT64 size, UINT64 alignment, UINT64 preferredSize, UINT64& offset)
+{
+    return Reserve(size, alignment, std::min(size, preferredSize), true, offset);
+}
+
+UINT64 FencedRing::Reserve(UINT64 size, UINT64 alignment, UINT64 needed, bool partial, UINT64& offset)
+{
+    assert(size > 0);
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+
+    // Start over from the beginning when the GPU has caught up, so nothing
+    // has to wrap.
+    if (m_used == 0)
+    {
+        m_head = 0;
+    }
+    if (m_used >= m_capacity)
+    {
+        return 0;
+    }
+
+    // Free space is [head, end) and [0, tail) when the live units do not
+    // wrap, [head, tail) when they do.
+    const UINT64 tail = (m_head + m_capacity - m_used) % m_capacity;
+    const bool freeToEnd = m_used == 0 || m_head >= tail;
+
+    UINT64 start = AlignUp(m_head, alignment);
+    const UINT64 limit = freeToEnd ? m_capacity : tail;
+    UINT64 available = start < limit ? limit - start : 0;
+    UINT64 padding = start - m_head;
+
+    if (available < needed && freeToEnd)
+    {
+        // Skip the end of the ring and start over.
+        start = 0;
+        padding = m_capacity - m_head;
+        available = tail;
+    }
+    if (available < needed && (!partial || available == 0))
+    {
+        return 0;
+    }
+
+    const UINT64 allocated = std::min(size, available);
+    offset = start;
+    m_head = start + allocated;
+    m_used += padding + allocated;
+    m_frameSize += padding + allocated;
+    return allocated;
+}
+
+UINT64 FencedRing::EndFrame(UINT64 fence)
+{
+    const UINT64 frameSize = m_frameSize;
+    if (frameSize > 0)
+    {
+        m_frames.push_back({ fence, frameSize });
+    }
+    m_frameSize = 0;
+    return frameSize;
+}
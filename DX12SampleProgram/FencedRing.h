@@ -0,0 +1,69 @@
+// Space bookkeeping for a ring that is given back a frame at a time.
+//
+// A ring of capacity units, bytes of an upload buffer or descriptors of a
+// heap, is handed out linearly from the head. Everything allocated between
+// two EndFrame calls belongs to one frame, which is given back as a whole
+// when the GPU has passed the fence it ended with. An allocation never wraps:
+// when it does not fit before the end of the ring, the end is skipped as
+// padding, owned by the frame like the allocation, and it starts over at 0.
+//
+// FencedRing only does the arithmetic; UploadRing, StreamingUploader and
+// DescriptorAllocator own the memory the offsets point into.
+#pragma once
+#include "stdafx.h"
+#include "D3DUtil.h"
+#include <deque>
+
+class FencedRing
+{
+public:
+    explicit FencedRing(UINT64 capacity = 0) : m_capacity(capacity) {}
+
+    // Starts over with capacity free units, forgetting every frame.
+    void Reset(UINT64 capacity);
+
+    // Gives back every frame whose fence is at most completedFence.
+    void Retire(UINT64 completedFence);
+
+    // size contiguous units at a multiple of alignment, a power of two.
+    // Returns false, and changes nothing, if they do not fit.
+    bool Allocate(UINT64 size, UINT64 alignment, UINT64& offset);
+
+    // Up to size contiguous units at alignment, for data that can be split.
+    // Rather than take fewer than preferredSize units before the end of the
+    // ring, it starts over at 0 if there is more room there. Returns the
+    // units allocated, 0 if nothing is free.
+    UINT64 AllocatePartial(UINT64 size, UINT64 alignment, UINT64 preferredSize, UINT64& offset);
+
+    // Everything allocated since the last EndFrame is in use until fence
+    // completes. Returns the units the frame took, padding included.
+    UINT64 EndFrame(UINT64 fence);
+
+    UINT64 GetCapacity()const { return m_capacity; }
+
+    // Units owned by frames not yet retired, the open one included.
+    UINT64 GetUsed()const { return m_used; }
+
+    // Units taken since the last EndFrame.
+    UINT64 GetFrameSize()const { return m_frameSize; }
+
+    UINT GetFramesInFlight()const { return (UINT)m_frames.size(); }
+
+private:
+    struct Frame
+    {
+        UINT64 Fence;
+        UINT64 Size;
+    };
+
+    UINT64 Reserve(UINT64 size, UINT64 alignment, UINT64 needed, bool partial, UINT64& offset);
+
+    UINT64 m_capacity = 0;
+
+    // Next free unit and units in use; the oldest live unit is implied.
+    UINT64 m_head = 0;
+    UINT64 m_used = 0;
+    UINT64 m_frameSize = 0;
+
+    std::deque<Frame> m_frames;
+};
@@ -0,0 +1,63 @@
+#include "stdafx.h"
+#include "FileUtil.h"
+
+namespace
+{
+    // Keep each call well inside a DWORD.
+    const std::uint64_t MaxChunkByteSize = 1u << 30;
+}
+
+bool WriteAll(HANDLE file, const void* data, std::uint64_t byteSize)
+{
+    const BYTE* p = static_cast<const BYTE*>(data);
+    while (byteSize > 0)
+    {
+        DWORD chunk = static_cast<DWORD>(std::min(byteSize, MaxChunkByteSize));
+        DWORD written = 0;
+        if (!WriteFile(file, p, chunk, &written, nullptr) || written != chunk)
+        {
+            return false;
+        }
+        p += chunk;
+        byteSize -= chunk;
+    }
+    return true;
+}
+
+bool ReadAll(HANDLE file, void* data, std::uint64_t byteSize)
+{
+    BYTE* p = static_cast<BYTE*>(data);
+    while (byteSize > 0)
+    {
+        DWORD chunk = static_cast<DWORD>(std::min(byteSize, MaxChunkByteSize));
+        DWORD read = 0;
+        if (!ReadFile(file, p, chunk, &read, nullptr) || read != chunk)
+        {
+            return false;
+        }
+        p += chunk;
+        byteSize -= chunk;
+    }
+    return true;
+}
+
+bool WriteFileAtomic(const std::wstring& fileName, const std::function<bool(HANDLE file)>& write)
+{
+    std::wstring tempName = fileName + L".tmp";
+    HANDLE file = CreateFile(tempName.c_str(), GENERIC_WRITE, 0, nullptr,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    bool ok = write(file);
+    CloseHandle(file);
+
+    if (!ok || !MoveFileEx(tempName.c_str(), fileName.c_str(), MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFile(tempName.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,15 @@
+// Whole-buffer reads and writes on top of ReadFile and WriteFile, whose sizes
+// are 32 bits, and replacing a file in one step.
+#pragma once
+#include "stdafx.h"
+#include <functional>
+
+// Returns false unless every byte was transferred.
+bool WriteAll(HANDLE file, const void* data, std::uint64_t byteSize);
+bool ReadAll(HANDLE file, void* data, std::uint64_t byteSize);
+
+// Creates fileName by letting write fill a temporary file and moving it into
+// place only once write returns true, so a crash mid-write never leaves a
+// truncated file that looks valid. On failure the temporary file is deleted
+// and any existing fileName is left as it was.
+bool WriteFileAtomic(const std::wstring& fileName, const std::function<bool(HANDLE file)>& write);
@@ -1,16 +1,32 @@
 #include "stdafx.h"
 #include "FrameResource.h"
 
-FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount,UINT waveVertexCount,UINT materialCount)
+FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount,UINT waveVertexCount,UINT materialCount, UINT terrainPatchCount)
 {
     ThrowIfFailed(device->CreateCommandAllocator(
         D3D12_COMMAND_LIST_TYPE_DIRECT,
         IID_PPV_ARGS(&m_commandAllocator)
     ));
-    m_passCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
-    m_objCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
-    m_wavesVB = std::make_unique<UploadBuffer<Vertex>>(device, waveVertexCount, false);
-    m_materialCB = std::make_unique<UploadBuffer<MaterialConstants>>(device, materialCount, true);;
+    if (passCount != 0)
+    {
+        m_passCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
+    }
+    if (objectCount != 0)
+    {
+        m_objCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
+    }
+    if (waveVertexCount != 0)
+    {
+        m_wavesVB = std::make_unique<UploadBuffer<Vertex>>(device, waveVertexCount, false);
+    }
+    if (materialCount != 0)
+    {
+        m_materialCB = std::make_unique<UploadBuffer<MaterialConstants>>(device, materialCount, true);
+    }
+    if (terrainPatchCount != 0)
+    {
+        m_terrainPatchVB = std::make_unique<UploadBuffer<CdlodPatch>>(device, terrainPatchCount, false);
+    }
 }
 
 FrameResource::~FrameResource()
@@ -1,10 +1,19 @@
 #pragma once
 #include "stdafx.h"
 #include "UploadBuffer.h"
+#include "TerrainLod.h"
+#include "VertexFormat.h"
 
 struct ObjectConstants
 {
     DirectX::XMMATRIX World = DirectX::XMMatrixIdentity();
+
+    // Decode of quantized positions, see PackedVertexRange. Shaders reading
+    // full precision positions ignore them.
+    DirectX::XMFLOAT3 PosScale = { 1.0f,1.0f,1.0f };
+    float ObjectPad0 = 0.0f;
+    DirectX::XMFLOAT3 PosBias = { 0.0f,0.0f,0.0f };
+    float ObjectPad1 = 0.0f;
 };
 
 struct PassConstants
@@ -43,10 +52,12 @@ struct Vertex
 };
 
 // Store the resources needed for the CPU to build the command lists for a frame.
+// Buffers whose count is 0 are not created; apps that stream their per-frame
+// data through an UploadRing only use the allocator and the fence.
 struct FrameResource
 {
 public:
-    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT waveVertexCount=256, UINT materialCount=1);
+    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT waveVertexCount=256, UINT materialCount=1, UINT terrainPatchCount=0);
     FrameResource(const FrameResource& rhs) = delete;
     FrameResource& operator=(const FrameResource& rhs) = delete;
     ~FrameResource();
@@ -66,6 +77,9 @@ public:
 
     std::unique_ptr<UploadBuffer<MaterialConstants>>    m_materialCB = nullptr;
 
+    // Per-instance data of the terrain patches selected this frame.
+    std::unique_ptr<UploadBuffer<CdlodPatch>> m_terrainPatchVB = nullptr;
+
     // Fence value to mark commands up to this fence point.
     // This lets us check if these frame resources are still in use by the GPU.
     UINT64 m_fence = 0;
@@ -99,6 +113,9 @@ public:
     Material* Mat = nullptr;
     MeshGeometry* Geo = nullptr;
 
+    // Decode constants of the submesh drawn, when its vertices are packed.
+    PackedVertexRange VertexRange;
+
     // Primitive topology.
     D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 
@@ -0,0 +1,415 @@
+#include "stdafx.h"
+#include "GeometryBenchmark.h"
+
+#if IS_ENABLE_GEOMETRY_BENCHMARK
+
+#include "GeometryGenerator.h"
+#include "MeshNormals.h"
+#include <cfloat>
+#include <chrono>
+#include <functional>
+#include <sstream>
+
+using namespace DirectX;
+
+namespace
+{
+    // The generators as they were before rows were built in parallel and the
+    // ring sines and cosines were tabulated, kept so the benchmark can check
+    // the current output against them bit for bit. Only the MeshWriter
+    // plumbing is replaced by direct writes into a MeshData.
+    namespace Baseline
+    {
+        using Vertex = GeometryGenerator::Vertex;
+        using MeshData = GeometryGenerator::MeshData;
+        using uint32 = GeometryGenerator::uint32;
+
+        MeshData CreateSphere(float radius, uint32 sliceCount, uint32 stackCount)
+        {
+            MeshData meshData;
+            GeometryGenerator::MeshCounts counts = GeometryGenerator::SphereCounts(sliceCount, stackCount);
+            meshData.Vertices.resize(counts.VertexCount);
+            meshData.Indices32.resize(counts.IndexCount);
+
+            Vertex topVertex(0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+            Vertex bottomVertex(0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+
+            uint32 vertexIndex = 0;
+            meshData.Vertices[vertexIndex++] = topVertex;
+
+            float phiStep = XM_PI / stackCount;
+            float thetaStep = 2.0f * XM_PI / sliceCount;
+
+            for (uint32 i = 1; i <= stackCount - 1; ++i)
+            {
+                float phi = i * phiStep;
+                for (uint32 j = 0; j <= sliceCount; ++j)
+                {
+                    float theta = j * thetaStep;
+
+                    Vertex v;
+                    v.Position.x = radius * sinf(phi) * cosf(theta);
+                    v.Position.y = radius * cosf(phi);
+                    v.Position.z = radius * sinf(phi) * sinf(theta);
+
+                    v.TangentU.x = -radius * sinf(phi) * sinf(theta);
+                    v.TangentU.y = 0.0f;
+                    v.TangentU.z = +radius * sinf(phi) * cosf(theta);
+
+                    XMVECTOR T = XMLoadFloat3(&v.TangentU);
+                    XMStoreFloat3(&v.TangentU, XMVector3Normalize(T));
+
+                    XMVECTOR p = XMLoadFloat3(&v.Position);
+                    XMStoreFloat3(&v.Normal, XMVector3Normalize(p));
+
+                    v.TexC.x = theta / XM_2PI;
+                    v.TexC.y = phi / XM_PI;
+
+                    meshData.Vertices[vertexIndex++] = v;
+                }
+            }
+            meshData.Vertices[vertexIndex++] = bottomVertex;
+
+            std::vector<uint32>& indices = meshData.Indices32;
+            size_t k = 0;
+            for (uint32 i = 1; i <= sliceCount; i++)
+            {
+                indices[k++] = 0;
+                indices[k++] = i % sliceCount + 1;
+                indices[k++] = i;
+            }
+
+            uint32 baseIndex = 1;
+            uint32 ringVertexCount = sliceCount + 1;
+            for (uint32 i = 0; i < stackCount - 2; ++i)
+            {
+                for (uint32 j = 0; j < sliceCount; j++)
+                {
+                    indices[k++] = baseIndex + i * ringVertexCount + j;
+                    indices[k++] = baseIndex + i * ringVertexCount + j + 1;
+                    indices[k++] = baseIndex + (i + 1) * ringVertexCount + j;
+
+                    indices[k++] = baseIndex + (i + 1) * ringVertexCount + j;
+                    indices[k++] = baseIndex + i * ringVertexCount + j + 1;
+                    indices[k++] = baseIndex + (i + 1) * ringVertexCount + j + 1;
+                }
+            }
+
+            uint32 southPoleIndex = vertexIndex - 1;
+            baseIndex = southPoleIndex - ringVertexCount;
+            for (uint32 i = 0; i < sliceCount; i++)
+            {
+                indices[k++] = southPoleIndex;
+                indices[k++] = baseIndex + i;
+                indices[k++] = i == sliceCount - 1 ? baseIndex : baseIndex + i + 1;
+            }
+            return meshData;
+        }
+
+        void BuildCylinderCap(float radius, float height, uint32 sliceCount, bool top,
+            MeshData& meshData, uint32 vertexOffset, size_t k)
+        {
+            float y = (top ? 0.5f : -0.5f) * height;
+            float ny = top ? 1.0f : -1.0f;
+            float dTheta = 2.0f * XM_PI / sliceCount;
+
+            for (uint32 i = 0; i <= sliceCount; ++i)
+            {
+                float x = radius * cosf(i * dTheta);
+                float z = radius * sinf(i * dTheta);
+                float u = x / height + 0.5f;
+                float v = z / height + 0.5f;
+                meshData.Vertices[vertexOffset + i] = Vertex(x, y, z, 0.0f, ny, 0.0f, 1.0f, 0.0f, 0.0f, u, v);
+            }
+
+            uint32 centerIndex = vertexOffset + sliceCount + 1;
+            meshData.Vertices[centerIndex] = Vertex(0.0f, y, 0.0f, 0.0f, ny, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f);
+
+            for (uint32 i = 0; i < sliceCount; ++i)
+            {
+                meshData.Indices32[k++] = centerIndex;
+                meshData.Indices32[k++] = vertexOffset + (top ? i + 1 : i);
+                meshData.Indices32[k++] = vertexOffset + (top ? i : i + 1);
+            }
+        }
+
+        MeshData CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount)
+        {
+            MeshData meshData;
+            GeometryGenerator::MeshCounts counts = GeometryGenerator::CylinderCounts(sliceCount, stackCount);
+            meshData.Vertices.resize(counts.VertexCount);
+            meshData.Indices32.resize(counts.IndexCount);
+
+            float stackHeight = height / stackCount;
+            float radiusStep = (topRadius - bottomRadius) / stackCount;
+            uint32 ringCount = stackCount + 1;
+            uint32 ringVertexCount = sliceCount + 1;
+
+            for (uint32 i = 0; i < ringCount; ++i)
+            {
+                float y = -0.5f * height + i * stackHeight;
+                float r = bottomRadius + i * radiusStep;
+
+                float dTheta = 2.0f * XM_PI / sliceCount;
+                for (uint32 j = 0; j <= sliceCount; ++j)
+                {
+                    Vertex vertex;
+
+                    float c = cosf(j * dTheta);
+                    float s = sinf(j * dTheta);
+
+                    vertex.Position = XMFLOAT3(r * c, y, r * s);
+                    vertex.TexC.x = (float)j / sliceCount;
+                    vertex.TexC.y = 1.0f - (float)i / stackCount;
+                    vertex.TangentU = XMFLOAT3(-s, 0.0f, c);
+
+                    float dr = bottomRadius - topRadius;
+                    XMFLOAT3 bitangent = XMFLOAT3(dr * c, -height, dr * s);
+
+                    XMVECTOR T = XMLoadFloat3(&vertex.TangentU);
+                    XMVECTOR B = XMLoadFloat3(&bitangent);
+                    XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
+                    XMStoreFloat3(&vertex.Normal, N);
+
+                    meshData.Vertices[i * ringVertexCount + j] = vertex;
+                }
+            }
+
+            std::vector<uint32>& indices = meshData.Indices32;
+            size_t k = 0;
+            for (uint32 i = 0; i < stackCount; ++i)
+            {
+                for (uint32 j = 0; j < sliceCount; ++j)
+                {
+                    indices[k++] = i * ringVertexCount + j;
+                    indices[k++] = (i + 1) * ringVertexCount + j;
+                    indices[k++] = (i + 1) * ringVertexCount + (j + 1);
+
+                    indices[k++] = i * ringVertexCount + j;
+                    indices[k++] = (i + 1) * ringVertexCount + (j + 1);
+                    indices[k++] = i * ringVertexCount + j + 1;
+                }
+            }
+
+            uint32 capVertexCount = sliceCount + 2;
+            uint32 capIndexCount = 3 * sliceCount;
+            uint32 bodyVertexCount = ringCount * ringVertexCount;
+            BuildCylinderCap(topRadius, height, sliceCount, true, meshData, bodyVertexCount, k);
+            BuildCylinderCap(bottomRadius, height, sliceCount, false, meshData,
+                bodyVertexCount + capVertexCount, k + capIndexCount);
+            return meshData;
+        }
+
+        MeshData CreateGrid(float width, float depth, uint32 m, uint32 n)
+        {
+            MeshData meshData;
+            GeometryGenerator::MeshCounts counts = GeometryGenerator::GridCounts(m, n);
+            meshData.Vertices.resize(counts.VertexCount);
+            meshData.Indices32.resize(counts.IndexCount);
+
+            float halfWidth = 0.5f * width;
+            float halfDepth = 0.5f * depth;
+            float dx = width / (n - 1);
+            float dz = depth / (m - 1);
+            float du = 1.0f / (n - 1);
+            float dv = 1.0f / (m - 1);
+
+            for (UINT64 i = 0; i < m; i++)
+            {
+                float z = halfDepth - i * dz;
+                for (UINT64 j = 0; j < n; j++)
+                {
+                    float x = -halfWidth + j * dx;
+
+                    Vertex v;
+                    v.Position = XMFLOAT3(x, 0.0f, z);
+                    v.Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+                    v.TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
+                    v.TexC.x = j * du;
+                    v.TexC.y = i * dv;
+
+                    meshData.Vertices[(size_t)(i * n + j)] = v;
+                }
+            }
+
+            std::vector<uint32>& indices = meshData.Indices32;
+            size_t k = 0;
+            for (uint32 i = 0; i < m - 1; i++)
+            {
+                for (uint32 j = 0; j < n - 1; j++)
+                {
+                    indices[k] = i * n + j;
+                    indices[k + 1] = i * n + j + 1;
+                    indices[k + 2] = (i + 1) * n + j;
+
+                    indices[k + 3] = (i + 1) * n + j;
+                    indices[k + 4] = i * n + j + 1;
+                    indices[k + 5] = (i + 1) * n + j + 1;
+                    k += 6;
+                }
+            }
+            return meshData;
+        }
+    }
+
+    using MeshFactory = std::function<GeometryGenerator::MeshData(GeometryGenerator&)>;
+
+    // Best time in seconds over iterations runs; the last mesh is kept in result.
+    double TimeGeneration(const MeshFactory& create, bool parallel, UINT iterations,
+        GeometryGenerator::MeshData& result)
+    {
+        GeometryGenerator geoGen;
+        geoGen.SetParallel(parallel);
+
+        double best = DBL_MAX;
+        for (UINT i = 0; i < iterations; ++i)
+        {
+            auto start = std::chrono::steady_clock::now();
+            result = create(geoGen);
+            auto end = std::chrono::steady_clock::now();
+            best = std::min(best, std::chrono::duration<double>(end - start).count());
+        }
+        return best;
+    }
+
+    bool SameMesh(const GeometryGenerator::MeshData& a, const GeometryGenerator::MeshData& b)
+    {
+        return a.Vertices.size() == b.Vertices.size() &&
+            a.Indices32 == b.Indices32 &&
+            memcmp(a.Vertices.data(), b.Vertices.data(),
+                a.Vertices.size() * sizeof(GeometryGenerator::Vertex)) == 0;
+    }
+
+    // Best time in milliseconds over iterations runs of recompute.
+    double TimeMilliseconds(const std::function<void()>& recompute, UINT iterations)
+    {
+        double best = DBL_MAX;
+        for (UINT i = 0; i < iterations; ++i)
+        {
+            auto start = std::chrono::steady_clock::now();
+            recompute();
+            auto end = std::chrono::steady_clock::now();
+            best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+        }
+        return best;
+    }
+
+    GeometryBenchmarkResult Measure(const wchar_t* name, const MeshFactory& createBaseline,
+        const MeshFactory& create, UINT iterations)
+    {
+        GeometryGenerator::MeshData baseline;
+        GeometryGenerator::MeshData serial;
+        GeometryGenerator::MeshData parallel;
+        double baselineTime = TimeGeneration(createBaseline, false, iterations, baseline);
+        double serialTime = TimeGeneration(create, false, iterations, serial);
+        double parallelTime = TimeGeneration(create, true, iterations, parallel);
+
+        GeometryBenchmarkResult result;
+        result.Name = name;
+        result.VertexCount = (UINT)serial.Vertices.size();
+        result.BaselineVerticesPerSecond = result.VertexCount / baselineTime;
+        result.SerialVerticesPerSecond = result.VertexCount / serialTime;
+        result.ParallelVerticesPerSecond = result.VertexCount / parallelTime;
+        result.MatchesBaseline = SameMesh(baseline, serial);
+        result.Identical = SameMesh(serial, parallel);
+        return result;
+    }
+}
+
+std::vector<GeometryBenchmarkResult> RunGeometryBenchmark(UINT tessellation, UINT iterations)
+{
+    std::vector<GeometryBenchmarkResult> results;
+    results.push_back(Measure(L"Sphere", [=](GeometryGenerator&)
+    {
+        return Baseline::CreateSphere(1.0f, tessellation, tessellation);
+    }, [=](GeometryGenerator& geoGen)
+    {
+        return geoGen.CreateSphere(1.0f, tessellation, tessellation);
+    }, iterations));
+    results.push_back(Measure(L"Cylinder", [=](GeometryGenerator&)
+    {
+        return Baseline::CreateCylinder(1.0f, 0.5f, 2.0f, tessellation, tessellation);
+    }, [=](GeometryGenerator& geoGen)
+    {
+        return geoGen.CreateCylinder(1.0f, 0.5f, 2.0f, tessellation, tessellation);
+    }, iterations));
+    results.push_back(Measure(L"Grid", [=](GeometryGenerator&)
+    {
+        return Baseline::CreateGrid(100.0f, 100.0f, tessellation, tessellation);
+    }, [=](GeometryGenerator& geoGen)
+    {
+        return geoGen.CreateGrid(100.0f, 100.0f, tessellation, tessellation);
+    }, iterations));
+    return results;
+}
+
+std::wstring FormatGeometryBenchmark(const std::vector<GeometryBenchmarkResult>& results)
+{
+    std::wostringstream out;
+    out.precision(1);
+    out << std::fixed;
+    for (const auto& r : results)
+    {
+        out << r.Name << L": " << r.VertexCount << L" vertices, "
+            << r.BaselineVerticesPerSecond / 1e6 << L" Mverts/s baseline, "
+            << r.SerialVerticesPerSecond / 1e6 << L" Mverts/s serial, "
+            << r.ParallelVerticesPerSecond / 1e6 << L" Mverts/s parallel ("
+            << r.ParallelVerticesPerSecond / r.BaselineVerticesPerSecond << L"x), "
+            << (r.MatchesBaseline ? L"matches baseline" : L"BASELINE MISMATCH") << L", "
+            << (r.Identical ? L"identical" : L"MISMATCH") << L"\n";
+    }
+    return out.str();
+}
+
+std::vector<NormalBenchmarkResult> RunNormalBenchmark(UINT tessellation, UINT iterations)
+{
+    GeometryGenerator geoGen;
+    GeometryGenerator::MeshData mesh = geoGen.CreateGrid(100.0f, 100.0f, tessellation, tessellation);
+    for (GeometryGenerator::Vertex& v : mesh.Vertices)
+    {
+        v.Position.y = 2.0f * sinf(0.3f * v.Position.x) * cosf(0.2f * v.Position.z) +
+            0.5f * sinf(1.7f * v.Position.x + 1.1f * v.Position.z);
+    }
+
+    const UINT vertexCount = (UINT)mesh.Vertices.size();
+    NormalRecomputer recomputer(mesh);
+
+    auto strided = [&]()
+    {
+        recomputer.ComputeNormals(&mesh.Vertices[0].Position, sizeof(GeometryGenerator::Vertex),
+            &mesh.Vertices[0].Normal, sizeof(GeometryGenerator::Vertex));
+    };
+
+    std::vector<NormalBenchmarkResult> results(3);
+    results[0].Name = L"Normals, area weighted";
+    recomputer.SetWeighting(NormalWeighting::Area);
+    results[0].Milliseconds = TimeMilliseconds(strided, iterations);
+
+    results[1].Name = L"Normals, angle weighted";
+    recomputer.SetWeighting(NormalWeighting::Angle);
+    results[1].Milliseconds = TimeMilliseconds(strided, iterations);
+
+    results[2].Name = L"Normals and tangents, area weighted";
+    recomputer.SetWeighting(NormalWeighting::Area);
+    results[2].Milliseconds = TimeMilliseconds([&]() { recomputer.Compute(mesh); }, iterations);
+
+    for (NormalBenchmarkResult& r : results)
+    {
+        r.VertexCount = vertexCount;
+    }
+    return results;
+}
+
+std::wstring FormatNormalBenchmark(const std::vector<NormalBenchmarkResult>& results)
+{
+    std::wostringstream out;
+    out.precision(2);
+    out << std::fixed;
+    for (const auto& r : results)
+    {
+        out << r.Name << L": " << r.VertexCount << L" vertices, " << r.Milliseconds << L" ms\n";
+    }
+    return out.str();
+}
+
+#endif // IS_ENABLE_GEOMETRY_BENCHMARK
@@ -0,0 +1,55 @@
+// Generation throughput of the high-tessellation primitives, and the cost of
+// recomputing the normals of a large deformed mesh.
+//
+// Build with IS_ENABLE_GEOMETRY_BENCHMARK set to 1 to run the benchmark from
+// WinMain instead of a sample. Every primitive is generated by a copy of the
+// generator from before the row-parallel rewrite, then serially and in
+// parallel by the current one; all three outputs are compared byte for byte.
+#pragma once
+#include "stdafx.h"
+
+#ifndef IS_ENABLE_GEOMETRY_BENCHMARK
+#define IS_ENABLE_GEOMETRY_BENCHMARK 0
+#endif // !IS_ENABLE_GEOMETRY_BENCHMARK
+
+#if IS_ENABLE_GEOMETRY_BENCHMARK
+
+struct GeometryBenchmarkResult
+{
+    std::wstring Name;
+    UINT VertexCount = 0;
+    double BaselineVerticesPerSecond = 0.0;
+    double SerialVerticesPerSecond = 0.0;
+    double ParallelVerticesPerSecond = 0.0;
+
+    // Serial output matches the baseline generator bit for bit.
+    bool MatchesBaseline = false;
+
+    // Parallel output matches the serial output bit for bit.
+    bool Identical = false;
+};
+
+// Generates a sphere, cylinder and grid of tessellation x tessellation and
+// keeps the best of iterations runs for each.
+std::vector<GeometryBenchmarkResult> RunGeometryBenchmark(UINT tessellation = 1000, UINT iterations = 5);
+
+std::wstring FormatGeometryBenchmark(const std::vector<GeometryBenchmarkResult>& results);
+
+struct NormalBenchmarkResult
+{
+    std::wstring Name;
+    UINT VertexCount = 0;
+
+    // Best time of one recompute, the adjacency already built.
+    double Milliseconds = 0.0;
+};
+
+// Displaces a tessellation x tessellation grid with a few sine waves and
+// recomputes its normals with NormalRecomputer: through strided streams with
+// each weighting, and through MeshData with tangents. Keeps the best of
+// iterations runs for each.
+std::vector<NormalBenchmarkResult> RunNormalBenchmark(UINT tessellation = 1000, UINT iterations = 5);
+
+std::wstring FormatNormalBenchmark(const std::vector<NormalBenchmarkResult>& results);
+
+#endif // IS_ENABLE_GEOMETRY_BENCHMARK
@@ -1,8 +1,64 @@
 #include "stdafx.h"
 #include "GeometryGenerator.h"
+#include <ppl.h>
 
 using namespace DirectX;
 
+namespace
+{
+    // Below this many vertices a mesh is generated on the calling thread; the
+    // task overhead would outweigh the work.
+    const std::uint32_t ParallelVertexThreshold = 16 * 1024;
+
+    // Runs fn(row) for every row in [begin, end). Rows write disjoint vertex
+    // and index ranges, so the order they run in does not affect the output.
+    template<typename Fn>
+    void ForEachRow(bool parallel, std::uint32_t begin, std::uint32_t end, const Fn& fn)
+    {
+        if (begin >= end)
+        {
+            return;
+        }
+        if (parallel)
+        {
+            concurrency::parallel_for(begin, end, fn);
+        }
+        else
+        {
+            for (std::uint32_t i = begin; i < end; ++i)
+            {
+                fn(i);
+            }
+        }
+    }
+
+    // Angles around a ring and their sine/cosine, shared by every ring of a
+    // mesh. Evaluated with the same expressions the per-vertex code used, so
+    // the results are bit-identical.
+    struct RingTable
+    {
+        RingTable(std::uint32_t sliceCount, float thetaStep) :
+            Theta(sliceCount + 1), Sin(sliceCount + 1), Cos(sliceCount + 1)
+        {
+            for (std::uint32_t j = 0; j <= sliceCount; ++j)
+            {
+                Theta[j] = j * thetaStep;
+                Sin[j] = sinf(Theta[j]);
+                Cos[j] = cosf(Theta[j]);
+            }
+        }
+
+        std::vector<float> Theta;
+        std::vector<float> Sin;
+        std::vector<float> Cos;
+    };
+}
+
+bool GeometryGenerator::UseParallelRows(const MeshCounts& counts)const
+{
+    return m_parallel && counts.VertexCount >= ParallelVertexThreshold;
+}
+
 
 GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions)
 {
@@ -94,6 +150,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float heig
     for (uint32 i = 0; i < numSubdivisions; ++i)
         Subdivide(meshData);
 
+    meshData.ComputeBounds();
     return meshData;
 }
 
@@ -105,7 +162,13 @@ GeometryGenerator::MeshData GeometryGenerator::CreateFixedBox()
 GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32 sliceCount, uint32 stackCount)
 {
     MeshData meshData;
+    GenerateSphere(radius, sliceCount, stackCount, PrepareMeshData(meshData, SphereCounts(sliceCount, stackCount)));
+    meshData.ComputeBounds();
+    return meshData;
+}
 
+void GeometryGenerator::GenerateSphere(float radius, uint32 sliceCount, uint32 stackCount, const MeshWriter& out)
+{
     // Compute the vertices stating at the top pole and moving down the stacks.
 
     // Poles: note that there will be texture coordinate distortion as there is
@@ -114,31 +177,39 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
     Vertex topVertex(0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
     Vertex bottomVertex(0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
 
-    meshData.Vertices.push_back(topVertex);
+    const bool parallel = UseParallelRows(SphereCounts(sliceCount, stackCount));
+    uint32 ringVertexCount = sliceCount + 1;
+    uint32 southPoleIndex = 1 + (stackCount - 1) * ringVertexCount;
+
+    out.SetVertex(0, topVertex);
 
     float phiStep = XM_PI / stackCount;
     float thetaStep = 2.0f * XM_PI / sliceCount;
+    RingTable ring(sliceCount, thetaStep);
 
     // Compute vertices for each stack ring (do not count the poles as rings)
-    for (uint32 i = 1; i <= stackCount - 1; ++i)
+    ForEachRow(parallel, 1, stackCount, [&](uint32 i)
     {
         float phi = i * phiStep;// phi is vertically
+        float sinPhi = sinf(phi);
+        float cosPhi = cosf(phi);
+        uint32 vertexIndex = 1 + (i - 1) * ringVertexCount;
 
         // Vertices of ring.
         for (uint32 j = 0; j <= sliceCount; ++j)
         {
-            float theta = j * thetaStep;// theta for horizontally.
+            float theta = ring.Theta[j];// theta for horizontally.
 
             Vertex v;
             // Spherical to Cartesian.
-            v.Position.x = radius * sinf(phi) * cosf(theta);
-            v.Position.y = radius * cosf(phi);
-            v.Position.z = radius * sinf(phi) * sinf(theta);
+            v.Position.x = radius * sinPhi * ring.Cos[j];
+            v.Position.y = radius * cosPhi;
+            v.Position.z = radius * sinPhi * ring.Sin[j];
 
             // Partial derivative of P with respect to theta
-            v.TangentU.x = -radius * sinf(phi) * sinf(theta);
+            v.TangentU.x = -radius * sinPhi * ring.Sin[j];
             v.TangentU.y = 0.0f;
-            v.TangentU.z = +radius * sinf(phi) * cosf(theta);
+            v.TangentU.z = +radius * sinPhi * ring.Cos[j];
 
             XMVECTOR T = XMLoadFloat3(&v.TangentU);
             XMStoreFloat3(&v.TangentU, XMVector3Normalize(T));
@@ -149,64 +220,61 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
             v.TexC.x = theta / XM_2PI;
             v.TexC.y = phi / XM_PI;
 
-            meshData.Vertices.push_back(v);
+            out.SetVertex(vertexIndex + j, v);
         }
-    }
-    meshData.Vertices.push_back(bottomVertex);
+    });
+    out.SetVertex(southPoleIndex, bottomVertex);
 
     // Compute indices for top stack. The top stack was written first to 
     // the vertex buffer and connects the top pole to the first ring.
-
+    size_t k = 0;
     for (uint32 i = 1; i <= sliceCount; i++)
     {
-        meshData.Indices32.push_back(0);
-        meshData.Indices32.push_back(i % sliceCount + 1);
-        meshData.Indices32.push_back(i);
+        out.SetIndex(k++, 0);
+        out.SetIndex(k++, i % sliceCount + 1);
+        out.SetIndex(k++, i);
     }
 
     // Compute indices for inner stacks (not connected to poles).
     // Offset the indices to the index of the first vertex in the first ring.
     // This is just skipping the top pole vertex.
     uint32 baseIndex = 1;
-    uint32 ringVertexCount = sliceCount + 1;
-    for (uint32 i = 0; i < stackCount - 2; ++i)
+    const size_t innerIndexStart = k;
+    ForEachRow(parallel, 0, stackCount - 2, [&](uint32 i)
     {
+        size_t r = innerIndexStart + (size_t)i * 6 * sliceCount;
         for (uint32 j = 0; j < sliceCount; j++)
         {
-            meshData.Indices32.push_back(baseIndex + i * ringVertexCount + j);
-            meshData.Indices32.push_back(baseIndex + i * ringVertexCount + j + 1);
-            meshData.Indices32.push_back(baseIndex + (i + 1) * ringVertexCount + j);
+            out.SetIndex(r++, baseIndex + i * ringVertexCount + j);
+            out.SetIndex(r++, baseIndex + i * ringVertexCount + j + 1);
+            out.SetIndex(r++, baseIndex + (i + 1) * ringVertexCount + j);
 
-            meshData.Indices32.push_back(baseIndex + (i + 1) * ringVertexCount + j);
-            meshData.Indices32.push_back(baseIndex + i * ringVertexCount + j + 1);
-            meshData.Indices32.push_back(baseIndex + (i + 1) * ringVertexCount + j + 1);
+            out.SetIndex(r++, baseIndex + (i + 1) * ringVertexCount + j);
+            out.SetIndex(r++, baseIndex + i * ringVertexCount + j + 1);
+            out.SetIndex(r++, baseIndex + (i + 1) * ringVertexCount + j + 1);
         }
-    }
+    });
+    k += (size_t)(stackCount - 2) * 6 * sliceCount;
 
     // Compute indices for bottom stack. The bottom stack was written last to the vertex buffer
     // and connects the bottom pole to the bottom ring.
 
-    // South pole vertex was added last.
-    uint32 southPoleIndex = (uint32)meshData.Vertices.size() - 1;
-
     // Offset the indices to the index of the first vertex of last ring.
     baseIndex = southPoleIndex - ringVertexCount;
 
     for (uint32 i = 0; i < sliceCount; i++)
     {
-        meshData.Indices32.push_back(southPoleIndex);
-        meshData.Indices32.push_back(baseIndex + i);
+        out.SetIndex(k++, southPoleIndex);
+        out.SetIndex(k++, baseIndex + i);
         if (i == sliceCount - 1)
         {
-            meshData.Indices32.push_back(baseIndex);
+            out.SetIndex(k++, baseIndex);
         }
         else
         {
-            meshData.Indices32.push_back(baseIndex + i + 1);
+            out.SetIndex(k++, baseIndex + i + 1);
         }
     }
-
-    return meshData;
 }
 
 GeometryGenerator::Vertex GeometryGenerator::MidPoint(const Vertex& v0, const Vertex& v1)
@@ -371,16 +439,15 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uin
         XMVECTOR T = XMLoadFloat3(&meshData.Vertices[i].TangentU);
         XMStoreFloat3(&meshData.Vertices[i].TangentU, XMVector3Normalize(T));
     }
+    meshData.ComputeBounds();
     return meshData;
 }
 
-void GeometryGenerator::BuildCylinderTopCap(float bottomRadius,
-    float topRadius, float height, uint32 sliceCount,
-    uint32 stackCount, MeshData& meshData
+void GeometryGenerator::BuildCylinderTopCap(float topRadius, float height, uint32 sliceCount,
+    const MeshWriter& out, uint32 vertexOffset, uint32 indexOffset
 )
 {
-    uint32 baseIndex = (uint32)meshData.Vertices.size();
-
+    uint32 baseIndex = vertexOffset;
 
     float y = 0.5f * height;
     float dTheta = 2.0f * XM_PI / sliceCount;
@@ -396,28 +463,27 @@ void GeometryGenerator::BuildCylinderTopCap(float bottomRadius,
         float u = x / height + 0.5f;
         float v = z / height + 0.5f;
 
-        meshData.Vertices.push_back(Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v));
+        out.SetVertex(vertexOffset + i, Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v));
     }
 
     // Cap center vertex.
-    meshData.Vertices.push_back(Vertex(0.0f, y, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f));
-
-    // Index of center vertex.
-    uint32 centerIndex = (uint32)meshData.Vertices.size() - 1;
+    uint32 centerIndex = baseIndex + sliceCount + 1;
+    out.SetVertex(centerIndex, Vertex(0.0f, y, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f));
 
+    size_t k = indexOffset;
     for (uint32 i = 0; i < sliceCount; ++i)
     {
-        meshData.Indices32.push_back(centerIndex);
-        meshData.Indices32.push_back(baseIndex + i + 1);
-        meshData.Indices32.push_back(baseIndex + i);
+        out.SetIndex(k++, centerIndex);
+        out.SetIndex(k++, baseIndex + i + 1);
+        out.SetIndex(k++, baseIndex + i);
     }
 }
 
-void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadius,
-    float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData
+void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float height, uint32 sliceCount,
+    const MeshWriter& out, uint32 vertexOffset, uint32 indexOffset
 )
 {
-    uint32 baseIndex = (uint32)meshData.Vertices.size();
+    uint32 baseIndex = vertexOffset;
     float y = -0.5f * height;
 
     // vertices of ring.
@@ -432,28 +498,34 @@ void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadi
         float u = x / height + 0.5f;
         float v = z / height + 0.5f;
 
-        meshData.Vertices.push_back(Vertex(x, y, z, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v));
+        out.SetVertex(vertexOffset + i, Vertex(x, y, z, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v));
     }
 
     // Cap center vertex.
-    meshData.Vertices.push_back(Vertex(0.0f, y, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f));
-
-
-    // Cache the index of center vertex.
-    uint32 centerIndex = (uint32)meshData.Vertices.size() - 1;
+    uint32 centerIndex = baseIndex + sliceCount + 1;
+    out.SetVertex(centerIndex, Vertex(0.0f, y, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f));
 
+    size_t k = indexOffset;
     for (uint32 i = 0; i < sliceCount; i++)
     {
-        meshData.Indices32.push_back(centerIndex);
-        meshData.Indices32.push_back(centerIndex + i);
-        meshData.Indices32.push_back(centerIndex + i + 1);
+        out.SetIndex(k++, centerIndex);
+        out.SetIndex(k++, baseIndex + i);
+        out.SetIndex(k++, baseIndex + i + 1);
     }
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount)
 {
     MeshData meshData;
+    GenerateCylinder(bottomRadius, topRadius, height, sliceCount, stackCount,
+        PrepareMeshData(meshData, CylinderCounts(sliceCount, stackCount)));
+    meshData.ComputeBounds();
+    return meshData;
+}
 
+void GeometryGenerator::GenerateCylinder(float bottomRadius, float topRadius, float height,
+    uint32 sliceCount, uint32 stackCount, const MeshWriter& out)
+{
     // Build Stacks.
 
     float stackHeight = height / stackCount;
@@ -463,20 +535,27 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius
 
     uint32 ringCount = stackCount + 1;
 
+    // Add one because we duplicate the first and last vertex per ring
+    // since the texture coordinates are different.
+    uint32 ringVertexCount = sliceCount + 1;
+
+    const bool parallel = UseParallelRows(CylinderCounts(sliceCount, stackCount));
+    float dTheta = 2.0f * XM_PI / sliceCount;
+    RingTable ring(sliceCount, dTheta);
+
     // Compute vertices for each stack ring starting at the bottom and moving up.
-    for (uint32 i = 0; i < ringCount; ++i)
+    ForEachRow(parallel, 0, ringCount, [&](uint32 i)
     {
         float y = -0.5f * height + i * stackHeight;
         float r = bottomRadius + i * radiusStep;
 
         // Vertices of ring.
-        float dTheta = 2.0f * XM_PI / sliceCount;
         for (uint32 j = 0; j <= sliceCount; ++j)
         {
             Vertex vertex;
 
-            float c = cosf(j * dTheta);
-            float s = sinf(j * dTheta);
+            float c = ring.Cos[j];
+            float s = ring.Sin[j];
 
             vertex.Position = XMFLOAT3(r * c, y, r * s);
             vertex.TexC.x = (float)j / sliceCount;
@@ -512,42 +591,46 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius
             XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
             XMStoreFloat3(&vertex.Normal, N);
 
-            meshData.Vertices.push_back(vertex);
+            out.SetVertex(i * ringVertexCount + j, vertex);
         }
-    }
-
-    // Add one because we duplicate the first and last vertex per ring
-    // since the texture coordinates are different.
-    uint32 ringVertexCount = sliceCount + 1;
+    });
 
     // Compute indices for each stack.
-    for (uint32 i = 0; i < stackCount; ++i)
+    ForEachRow(parallel, 0, stackCount, [&](uint32 i)
     {
+        size_t k = (size_t)i * 6 * sliceCount;
         for (uint32 j = 0; j < sliceCount; ++j)
         {
-            meshData.Indices32.push_back(i * ringVertexCount + j);
-            meshData.Indices32.push_back((i + 1) * ringVertexCount + j);
-            meshData.Indices32.push_back((i + 1) * ringVertexCount + (j + 1));
+            out.SetIndex(k++, i * ringVertexCount + j);
+            out.SetIndex(k++, (i + 1) * ringVertexCount + j);
+            out.SetIndex(k++, (i + 1) * ringVertexCount + (j + 1));
 
-            meshData.Indices32.push_back(i * ringVertexCount + j);
-            meshData.Indices32.push_back((i + 1) * ringVertexCount + (j + 1));
-            meshData.Indices32.push_back(i * ringVertexCount + j + 1);
+            out.SetIndex(k++, i * ringVertexCount + j);
+            out.SetIndex(k++, (i + 1) * ringVertexCount + (j + 1));
+            out.SetIndex(k++, i * ringVertexCount + j + 1);
         }
-    }
+    });
 
-    BuildCylinderTopCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
-    BuildCylinderBottomCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
+    uint32 capVertexCount = sliceCount + 2;
+    uint32 capIndexCount = 3 * sliceCount;
+    uint32 bodyVertexCount = ringCount * ringVertexCount;
+    uint32 bodyIndexCount = 6 * stackCount * sliceCount;
 
-    return meshData;
+    BuildCylinderTopCap(topRadius, height, sliceCount, out, bodyVertexCount, bodyIndexCount);
+    BuildCylinderBottomCap(bottomRadius, height, sliceCount, out,
+        bodyVertexCount + capVertexCount, bodyIndexCount + capIndexCount);
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float depth, uint32 m, uint32 n)
 {
     MeshData meshData;
+    GenerateGrid(width, depth, m, n, PrepareMeshData(meshData, GridCounts(m, n)));
+    meshData.ComputeBounds();
+    return meshData;
+}
 
-    uint32 vertexCount = m * n;
-    uint32 faceCount = (m - 1) * (n - 1) * 2;
-
+void GeometryGenerator::GenerateGrid(float width, float depth, uint32 m, uint32 n, const MeshWriter& out)
+{
     // Create the vertices.
 
     float halfWidth = 0.5f * width;
@@ -559,47 +642,46 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
     float du = 1.0f / (n - 1);
     float dv = 1.0f / (m - 1);
 
-    meshData.Vertices.resize(vertexCount);
+    const bool parallel = UseParallelRows(GridCounts(m, n));
 
-    for (UINT64 i = 0; i < m; i++)
+    ForEachRow(parallel, 0, m, [&](uint32 row)
     {
+        UINT64 i = row;
         float z = halfDepth - i * dz;
         for (UINT64 j = 0; j < n; j++)
         {
             float x = -halfWidth + j * dx;
 
-            meshData.Vertices[i * static_cast<UINT64>(n) + j].Position = XMFLOAT3(x, 0.0f, z);
-            meshData.Vertices[i * static_cast<UINT64>(n) + j].Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
-            meshData.Vertices[i * static_cast<UINT64>(n) + j].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
+            Vertex v;
+            v.Position = XMFLOAT3(x, 0.0f, z);
+            v.Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+            v.TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
 
             // Stretch texture over grid.
-            meshData.Vertices[i * static_cast<UINT64>(n) + j].TexC.x = j * du;
-            meshData.Vertices[i * static_cast<UINT64>(n) + j].TexC.y = i * dv;
-        }
-    }
+            v.TexC.x = j * du;
+            v.TexC.y = i * dv;
 
-    // Create Indices.
-    meshData.Indices32.resize(static_cast<UINT64>(faceCount) * 3);
+            out.SetVertex((uint32)(i * n + j), v);
+        }
+    });
 
     // Iterate over each quad and compute indices.
-    UINT64 k = 0;
-    for (uint32 i = 0; i < m - 1; i++)
+    ForEachRow(parallel, 0, m - 1, [&](uint32 i)
     {
+        size_t k = (size_t)i * (n - 1) * 6;
         for (uint32 j = 0; j < n - 1; j++)
         {
-            meshData.Indices32[k] = i * n + j;
-            meshData.Indices32[k + 1] = i * n + j + 1;
-            meshData.Indices32[k + 2] = (i + 1) * n + j;
+            out.SetIndex(k, i * n + j);
+            out.SetIndex(k + 1, i * n + j + 1);
+            out.SetIndex(k + 2, (i + 1) * n + j);
 
-            meshData.Indices32[k + 3] = (i + 1) * n + j;
-            meshData.Indices32[k + 4] = i * n + j + 1;
-            meshData.Indices32[k + 5] = (i + 1) * n + j + 1;
+            out.SetIndex(k + 3, (i + 1) * n + j);
+            out.SetIndex(k + 4, i * n + j + 1);
+            out.SetIndex(k + 5, (i + 1) * n + j + 1);
 
             k += 6;// next quad
         }
-    }
-
-    return meshData;
+    });
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateQuad(float x, float y,
@@ -607,45 +689,46 @@ GeometryGenerator::MeshData GeometryGenerator::CreateQuad(float x, float y,
 )
 {
     MeshData meshData;
+    GenerateQuad(x, y, w, h, depth, PrepareMeshData(meshData, QuadCounts()));
+    meshData.ComputeBounds();
+    return meshData;
+}
 
-    meshData.Vertices.resize(4);
-    meshData.Indices32.resize(6);
-
+void GeometryGenerator::GenerateQuad(float x, float y, float w, float h, float depth, const MeshWriter& out)
+{
     // Position coordinates specified in NDC space.
-    meshData.Vertices[0] = Vertex(
+    out.SetVertex(0, Vertex(
         x, y - h, depth,
         0.0f, 0.0f, -1.0f,
         1.0f, 0.0f, 0.0f,
         0.0f, 1.0f
-    );
+    ));
 
-    meshData.Vertices[1] = Vertex(
+    out.SetVertex(1, Vertex(
         x, y, depth,
         0.0f, 0.0f, -1.0f,
         1.0f, 0.0f, 0.0f,
-        0.0f, 0.0f);
+        0.0f, 0.0f));
 
-    meshData.Vertices[2] = Vertex(
+    out.SetVertex(2, Vertex(
         x + w, y, depth,
         0.0f, 0.0f, -1.0f,
         1.0f, 0.0f, 0.0f,
-        1.0f, 0.0f);
+        1.0f, 0.0f));
 
-    meshData.Vertices[3] = Vertex(
+    out.SetVertex(3, Vertex(
         x + w, y - h, depth,
         0.0f, 0.0f, -1.0f,
         1.0f, 0.0f, 0.0f,
-        1.0f, 1.0f);
+        1.0f, 1.0f));
 
-    meshData.Indices32[0] = 0;
-    meshData.Indices32[1] = 1;
-    meshData.Indices32[2] = 2;
+    out.SetIndex(0, 0);
+    out.SetIndex(1, 1);
+    out.SetIndex(2, 2);
 
-    meshData.Indices32[3] = 0;
-    meshData.Indices32[4] = 2;
-    meshData.Indices32[5] = 3;
-
-    return meshData;
+    out.SetIndex(3, 0);
+    out.SetIndex(4, 2);
+    out.SetIndex(5, 3);
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreatePyramid(
@@ -654,4 +737,117 @@ GeometryGenerator::MeshData GeometryGenerator::CreatePyramid(
     float height)
 {
     return CreateCylinder(bottomRadius, 0.0f, height, bottomSliceCount, stackCount);
-}
\ No newline at end of file
+}
+
+void GeometryGenerator::GeneratePyramid(uint32 stackCount, uint32 bottomSliceCount, float bottomRadius,
+    float height, const MeshWriter& out)
+{
+    GenerateCylinder(bottomRadius, 0.0f, height, bottomSliceCount, stackCount, out);
+}
+
+void GeometryGenerator::GenerateBox(float width, float height, float depth, uint32 numSubdivisions,
+    const MeshWriter& out)
+{
+    WriteMeshData(CreateBox(width, height, depth, numSubdivisions), out);
+}
+
+void GeometryGenerator::GenerateGeosphere(float radius, uint32 numSubdivisions, const MeshWriter& out)
+{
+    WriteMeshData(CreateGeosphere(radius, numSubdivisions), out);
+}
+
+GeometryGenerator::MeshCounts GeometryGenerator::BoxCounts(uint32 numSubdivisions)
+{
+    // Same cap as CreateBox. Each subdivision splits every triangle into four
+    // and emits six unshared vertices per source triangle.
+    numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
+
+    MeshCounts counts;
+    uint32 triangleCount = 12;
+    counts.VertexCount = 24;
+    for (uint32 i = 0; i < numSubdivisions; ++i)
+    {
+        counts.VertexCount = triangleCount * 6;
+        triangleCount *= 4;
+    }
+    counts.IndexCount = triangleCount * 3;
+    return counts;
+}
+
+GeometryGenerator::MeshCounts GeometryGenerator::SphereCounts(uint32 sliceCount, uint32 stackCount)
+{
+    // Two poles plus (stackCount-1) rings of sliceCount+1 vertices.
+    MeshCounts counts;
+    counts.VertexCount = 2 + (stackCount - 1) * (sliceCount + 1);
+    counts.IndexCount = 6 * sliceCount + 6 * sliceCount * (stackCount - 2);
+    return counts;
+}
+
+GeometryGenerator::MeshCounts GeometryGenerator::GeosphereCounts(uint32 numSubdivisions)
+{
+    MeshCounts counts;
+    uint32 triangleCount = 20;
+    counts.VertexCount = 12;
+    for (uint32 i = 0; i < numSubdivisions; ++i)
+    {
+        counts.VertexCount = triangleCount * 6;
+        triangleCount *= 4;
+    }
+    counts.IndexCount = triangleCount * 3;
+    return counts;
+}
+
+GeometryGenerator::MeshCounts GeometryGenerator::CylinderCounts(uint32 sliceCount, uint32 stackCount)
+{
+    // Body rings plus two caps of (ring + center) vertices.
+    MeshCounts counts;
+    counts.VertexCount = (stackCount + 1) * (sliceCount + 1) + 2 * (sliceCount + 2);
+    counts.IndexCount = 6 * stackCount * sliceCount + 2 * 3 * sliceCount;
+    return counts;
+}
+
+GeometryGenerator::MeshCounts GeometryGenerator::GridCounts(uint32 m, uint32 n)
+{
+    MeshCounts counts;
+    counts.VertexCount = m * n;
+    counts.IndexCount = (m - 1) * (n - 1) * 6;
+    return counts;
+}
+
+GeometryGenerator::MeshCounts GeometryGenerator::QuadCounts()
+{
+    MeshCounts counts;
+    counts.VertexCount = 4;
+    counts.IndexCount = 6;
+    return counts;
+}
+
+GeometryGenerator::MeshCounts GeometryGenerator::PyramidCounts(uint32 stackCount, uint32 bottomSliceCount)
+{
+    return CylinderCounts(bottomSliceCount, stackCount);
+}
+
+GeometryGenerator::MeshWriter GeometryGenerator::PrepareMeshData(MeshData& meshData, const MeshCounts& counts)
+{
+    meshData.Vertices.resize(counts.VertexCount);
+    meshData.Indices32.resize(counts.IndexCount);
+
+    MeshWriter out;
+    out.VertexData = meshData.Vertices.data();
+    out.VertexStride = sizeof(Vertex);
+    out.IndexData = meshData.Indices32.data();
+    out.IndexByteWidth = sizeof(uint32);
+    return out;
+}
+
+void GeometryGenerator::WriteMeshData(const MeshData& meshData, const MeshWriter& out)
+{
+    for (size_t i = 0; i < meshData.Vertices.size(); ++i)
+    {
+        out.SetVertex((uint32)i, meshData.Vertices[i]);
+    }
+    for (size_t i = 0; i < meshData.Indices32.size(); ++i)
+    {
+        out.SetIndex(i, meshData.Indices32[i]);
+    }
+}
@@ -6,6 +6,8 @@
 //   3. Update the texture coordinates and tangent vectors.
 #pragma once
 #include "stdafx.h"
+#include "IndexBuffer.h"
+#include "BoundingVolume.h"
 
 class GeometryGenerator
 {
@@ -55,24 +57,134 @@ public:
     {
         std::vector<Vertex> Vertices;
         std::vector<uint32> Indices32;
-        
-        std::vector<uint16>& GetIndices16()
+
+        // Filled in by the Create* functions; call ComputeBounds() again after
+        // modifying Vertices.
+        DirectX::BoundingBox Bounds;
+        DirectX::BoundingSphere SphereBounds;
+
+        void ComputeBounds()
+        {
+            const void* positions = Vertices.empty() ? nullptr : &Vertices[0].Position;
+            VertexBounds bounds = ComputeVertexBounds(positions, sizeof(Vertex), Vertices.size());
+            Bounds = bounds.Box;
+            SphereBounds = bounds.Sphere;
+        }
+
+        // Narrowest index format that can address every vertex of the mesh.
+        DXGI_FORMAT GetIndexFormat()const
         {
-            if (m_indices16.empty())
+            return SelectIndexFormat(Indices32.data(), Indices32.size());
+        }
+
+        // Returns a 16-bit copy of Indices32. Nothing is cached, so the copy
+        // only lives as long as the caller keeps it. Throws if the mesh
+        // references more vertices than 16-bit indices can address; check
+        // GetIndexFormat() or use TakeIndexBuffer() for meshes that may be large.
+        std::vector<uint16> GetIndices16()const
+        {
+            std::vector<uint16> indices16(Indices32.size());
+            if (!NarrowIndices(Indices32.data(), Indices32.size(), indices16.data()))
             {
-                m_indices16.resize(Indices32.size());
-                for (size_t i = 0; i < Indices32.size(); i++)
-                {
-                    m_indices16[i] = static_cast<uint16>(Indices32[i]);
-                }
+                throw std::overflow_error("MeshData::GetIndices16: index does not fit in 16 bits.");
             }
-            return m_indices16;
+            return indices16;
+        }
+
+        // Moves Indices32 into an IndexBuffer in the narrowest format. The wide
+        // copy is released, so Indices32 is empty afterwards.
+        IndexBuffer TakeIndexBuffer()
+        {
+            return IndexBuffer(std::move(Indices32));
         }
+    };
 
-    private:
-        std::vector<uint16> m_indices16;
+    // Exact sizes of a primitive, used to size caller buffers before
+    // generating into them with the Generate* functions.
+    struct MeshCounts
+    {
+        uint32 VertexCount = 0;
+        uint32 IndexCount = 0;
     };
 
+    // Destination of the Generate* functions. Nothing is allocated: vertex i
+    // is handed to WriteVertex together with the address of slot i, so the
+    // caller decides the final vertex layout, and indices are stored directly
+    // at the requested width. Several meshes can be packed into one buffer by
+    // advancing VertexData/IndexData between calls.
+    struct MeshWriter
+    {
+        // Converts a generated vertex into the caller's layout at dst.
+        // Leave WriteVertex null to store GeometryGenerator::Vertex as is.
+        using VertexWriterFn = void(*)(void* dst, const Vertex& v, void* context);
+
+        void* VertexData = nullptr;
+        UINT VertexStride = sizeof(Vertex);
+        VertexWriterFn WriteVertex = nullptr;
+        void* Context = nullptr;
+
+        void* IndexData = nullptr;
+        UINT IndexByteWidth = sizeof(uint32); // 2 or 4.
+
+        // Added to every index. Leave at 0 when drawing with BaseVertexLocation.
+        uint32 BaseVertex = 0;
+
+        void SetVertex(uint32 i, const Vertex& v)const
+        {
+            void* dst = static_cast<BYTE*>(VertexData) + (size_t)i * VertexStride;
+            if (WriteVertex != nullptr)
+            {
+                WriteVertex(dst, v, Context);
+            }
+            else
+            {
+                memcpy(dst, &v, sizeof(Vertex));
+            }
+        }
+
+        void SetIndex(size_t i, uint32 index)const
+        {
+            index += BaseVertex;
+            if (IndexByteWidth == sizeof(uint16))
+            {
+                assert(index <= 0xffff && "Index does not fit in 16 bits.");
+                static_cast<uint16*>(IndexData)[i] = static_cast<uint16>(index);
+            }
+            else
+            {
+                static_cast<uint32*>(IndexData)[i] = index;
+            }
+        }
+    };
+
+    static MeshCounts BoxCounts(uint32 numSubdivisions);
+    static MeshCounts SphereCounts(uint32 sliceCount, uint32 stackCount);
+    static MeshCounts GeosphereCounts(uint32 numSubdivisions);
+    static MeshCounts CylinderCounts(uint32 sliceCount, uint32 stackCount);
+    static MeshCounts GridCounts(uint32 m, uint32 n);
+    static MeshCounts QuadCounts();
+    static MeshCounts PyramidCounts(uint32 stackCount, uint32 bottomSliceCount);
+
+    // Large spheres, cylinders and grids are generated a row per task. The
+    // output does not depend on this, but WriteVertex is then called from
+    // several threads at once (for distinct slots). Disable to keep every
+    // call on the calling thread.
+    void SetParallel(bool enable) { m_parallel = enable; }
+
+    // Two-phase versions of the Create* functions: query the counts above,
+    // provide buffers of that size in out, then generate straight into them.
+    // The box and geosphere are refined iteratively by Subdivide, so they still
+    // go through a scratch MeshData internally.
+    void GenerateBox(float width, float height, float depth, uint32 numSubdivisions, const MeshWriter& out);
+    void GenerateSphere(float radius, uint32 sliceCount, uint32 stackCount, const MeshWriter& out);
+    void GenerateGeosphere(float radius, uint32 numSubdivisions, const MeshWriter& out);
+    void GenerateCylinder(float bottomRadius, float topRadius, float height,
+        uint32 sliceCount, uint32 stackCount, const MeshWriter& out);
+    void GenerateGrid(float width, float depth, uint32 m, uint32 n, const MeshWriter& out);
+    void GenerateQuad(float x, float y, float w, float h, float depth, const MeshWriter& out);
+    void GeneratePyramid(uint32 stackCount, uint32 bottomSliceCount, float bottomRadius, float height,
+        const MeshWriter& out);
+
     // Create a box centered at the origin with the given dimensions, where
     // each face has m rows and n column of vertices.
     MeshData CreateBox(float width, float height, float depth, uint32 numSubdivisions);
@@ -106,10 +218,23 @@ public:
     MeshData CreatePyramid(uint32 stackCount,uint32 bottomSliceCount, float bottomRadius, float height);
 
 private:
+    bool UseParallelRows(const MeshCounts& counts)const;
+
     void Subdivide(MeshData& meshData);
     Vertex MidPoint(const Vertex& v0, const Vertex& v1);
-    void BuildCylinderTopCap(float bottomRadius, float topRadius, float height,
-        uint32 sliceCount, uint32 stackCount, MeshData& meshData);
-    void BuildCylinderBottomCap(float bottomRadius, float topRadius, float height, 
-        uint32 sliceCount, uint32 stackCount, MeshData& meshData);
+
+    // Caps write sliceCount+2 vertices and 3*sliceCount indices starting at the
+    // given offsets into out.
+    void BuildCylinderTopCap(float topRadius, float height, uint32 sliceCount,
+        const MeshWriter& out, uint32 vertexOffset, uint32 indexOffset);
+    void BuildCylinderBottomCap(float bottomRadius, float height, uint32 sliceCount,
+        const MeshWriter& out, uint32 vertexOffset, uint32 indexOffset);
+
+    // Sizes meshData for counts and returns a writer targeting it.
+    static MeshWriter PrepareMeshData(MeshData& meshData, const MeshCounts& counts);
+
+    // Copies an already built mesh into out.
+    static void WriteMeshData(const MeshData& meshData, const MeshWriter& out);
+
+    bool m_parallel = true;
 };
\ No newline at end of file
@@ -0,0 +1,409 @@
+#include "stdafx.h"
+#include "GeometryPool.h"
+
+using Microsoft::WRL::ComPtr;
+
+GeometryPool::GeometryPool(ID3D12Device* device, const GeometryPoolDesc& desc)
+    :m_device(device), m_desc(desc), m_heaps(device)
+{
+    assert(m_desc.VertexByteStride > 0);
+    assert(m_desc.IndexFormat == DXGI_FORMAT_R16_UINT || m_desc.IndexFormat == DXGI_FORMAT_R32_UINT);
+}
+
+GeometryPool::~GeometryPool()
+{
+    DisposeUploaders();
+    m_releases.Sweep(~0ull);
+}
+
+UINT GeometryPool::IndexByteSize()const
+{
+    return m_desc.IndexFormat == DXGI_FORMAT_R32_UINT ? 4 : 2;
+}
+
+void GeometryPool::Transition(ID3D12Resource* resource, D3D12_RESOURCE_STATES& state, D3D12_RESOURCE_STATES newState)
+{
+    if (state != newState)
+    {
+        m_pendingBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(resource, state, newState));
+        state = newState;
+    }
+}
+
+void GeometryPool::FlushBarriers(ID3D12GraphicsCommandList* cmdList)
+{
+    if (!m_pendingBarriers.empty())
+    {
+        cmdList->ResourceBarrier((UINT)m_pendingBarriers.size(), m_pendingBarriers.data());
+        m_pendingBarriers.clear();
+    }
+}
+
+UINT GeometryPool::CreatePage(UINT vertexCount, UINT indexCount)
+{
+    std::unique_ptr<Page> page = std::make_unique<Page>();
+    vertexCount = std::max(vertexCount, m_desc.PageVertexCount);
+    indexCount = std::max(indexCount, m_desc.PageIndexCount);
+
+    const UINT64 vbByteSize = (UINT64)vertexCount * m_desc.VertexByteStride;
+    const UINT64 ibByteSize = (UINT64)indexCount * IndexByteSize();
+
+    // Buffers always start out in the common state.
+    page->VertexBuffer = m_heaps.CreateBuffer(D3D12_HEAP_TYPE_DEFAULT, vbByteSize,
+        D3D12_RESOURCE_STATE_COMMON, page->VertexBufferAllocation);
+    page->IndexBuffer = m_heaps.CreateBuffer(D3D12_HEAP_TYPE_DEFAULT, ibByteSize,
+        D3D12_RESOURCE_STATE_COMMON, page->IndexBufferAllocation);
+
+    page->Vertices = std::make_unique<RangeAllocator>(vertexCount);
+    page->Indices = std::make_unique<RangeAllocator>(indexCount);
+
+    for (UINT i = 0; i < (UINT)m_pages.size(); ++i)
+    {
+        if (m_pages[i] == nullptr)
+        {
+            m_pages[i] = std::move(page);
+            return i;
+        }
+    }
+    m_pages.push_back(std::move(page));
+    return (UINT)m_pages.size() - 1;
+}
+
+bool GeometryPool::AllocateInPage(UINT pageIndex, UINT vertexCount, UINT indexCount, Range& range)
+{
+    Page* page = m_pages[pageIndex].get();
+    if (page == nullptr)
+    {
+        return false;
+    }
+
+    UINT64 vertexOffset = page->Vertices->Allocate(vertexCount);
+    if (vertexOffset == RangeAllocator::InvalidOffset)
+    {
+        return false;
+    }
+    UINT64 indexOffset = page->Indices->Allocate(indexCount);
+    if (indexOffset == RangeAllocator::InvalidOffset)
+    {
+        page->Vertices->Free(vertexOffset);
+        return false;
+    }
+
+    range.Page = pageIndex;
+    range.BaseVertexLocation = (UINT)vertexOffset;
+    range.StartIndexLocation = (UINT)indexOffset;
+    range.VertexCount = vertexCount;
+    range.IndexCount = indexCount;
+    ++page->AllocationCount;
+    return true;
+}
+
+void GeometryPool::FreeInPage(const Range& range)
+{
+    Page* page = m_pages[range.Page].get();
+    page->Vertices->Free(range.BaseVertexLocation);
+    page->Indices->Free(range.StartIndexLocation);
+    --page->AllocationCount;
+}
+
+GeometryPool::Handle GeometryPool::Allocate(UINT vertexCount, UINT indexCount)
+{
+    if (m_desc.IndexFormat == DXGI_FORMAT_R16_UINT && vertexCount > 0x10000)
+    {
+        throw std::overflow_error("GeometryPool::Allocate: mesh has too many vertices for 16-bit indices.");
+    }
+
+    Range range;
+    bool placed = false;
+    for (UINT i = 0; i < (UINT)m_pages.size() && !placed; ++i)
+    {
+        placed = AllocateInPage(i, vertexCount, indexCount, range);
+    }
+    if (!placed)
+    {
+        placed = AllocateInPage(CreatePage(vertexCount, indexCount), vertexCount, indexCount, range);
+        assert(placed);
+    }
+
+    Handle handle;
+    if (!m_freeHandles.empty())
+    {
+        handle = m_freeHandles.back();
+        m_freeHandles.pop_back();
+        m_ranges[handle] = range;
+        m_rangeLive[handle] = true;
+    }
+    else
+    {
+        handle = (Handle)m_ranges.size();
+        m_ranges.push_back(range);
+        m_rangeLive.push_back(true);
+    }
+    return handle;
+}
+
+GeometryPool::StagedUpload GeometryPool::BeginUpload(Handle handle)
+{
+    const Range& range = m_ranges[handle];
+
+    const UINT64 vbByteSize = (UINT64)range.VertexCount * m_desc.VertexByteStride;
+    const UINT64 ibByteSize = (UINT64)range.IndexCount * IndexByteSize();
+
+    // One staging buffer for both; the index part starts 4-byte aligned as
+    // CopyBufferRegion requires.
+    StagedUpload upload;
+    upload.Mesh = handle;
+    upload.IndexOffset = (vbByteSize + 3) & ~3ull;
+    upload.Buffer = m_heaps.CreateBuffer(D3D12_HEAP_TYPE_UPLOAD, upload.IndexOffset + ibByteSize,
+        D3D12_RESOURCE_STATE_GENERIC_READ, upload.Allocation);
+
+    BYTE* mapped = nullptr;
+    CD3DX12_RANGE readRange(0, 0);
+    ThrowIfFailed(upload.Buffer->Map(0, &readRange, reinterpret_cast<void**>(&mapped)));
+    upload.VertexData = mapped;
+    upload.IndexData = mapped + upload.IndexOffset;
+    return upload;
+}
+
+void GeometryPool::EndUpload(ID3D12GraphicsCommandList* cmdList, StagedUpload& upload)
+{
+    const Range& range = m_ranges[upload.Mesh];
+    Page* page = m_pages[range.Page].get();
+
+    const UINT64 vbByteSize = (UINT64)range.VertexCount * m_desc.VertexByteStride;
+    const UINT64 ibByteSize = (UINT64)range.IndexCount * IndexByteSize();
+
+    upload.Buffer->Unmap(0, nullptr);
+    upload.VertexData = nullptr;
+    upload.IndexData = nullptr;
+
+    Transition(page->VertexBuffer.Get(), page->VertexBufferState, D3D12_RESOURCE_STATE_COPY_DEST);
+    Transition(page->IndexBuffer.Get(), page->IndexBufferState, D3D12_RESOURCE_STATE_COPY_DEST);
+    FlushBarriers(cmdList);
+
+    cmdList->CopyBufferRegion(page->VertexBuffer.Get(), (UINT64)range.BaseVertexLocation * m_desc.VertexByteStride,
+        upload.Buffer.Get(), 0, vbByteSize);
+    cmdList->CopyBufferRegion(page->IndexBuffer.Get(), (UINT64)range.StartIndexLocation * IndexByteSize(),
+        upload.Buffer.Get(), upload.IndexOffset, ibByteSize);
+
+    Transition(page->VertexBuffer.Get(), page->VertexBufferState, D3D12_RESOURCE_STATE_GENERIC_READ);
+    Transition(page->IndexBuffer.Get(), page->IndexBufferState, D3D12_RESOURCE_STATE_GENERIC_READ);
+    FlushBarriers(cmdList);
+
+    // The copy has not executed yet, keep the staging buffer alive.
+    m_pendingReleases.push_back({ std::move(upload.Buffer), upload.Allocation });
+}
+
+void GeometryPool::Upload(ID3D12GraphicsCommandList* cmdList, Handle handle,
+    const void* vertexData, const void* indexData)
+{
+    const Range& range = m_ranges[handle];
+
+    StagedUpload upload = BeginUpload(handle);
+    StreamToUploadHeap(upload.VertexData, vertexData, (size_t)range.VertexCount * m_desc.VertexByteStride);
+    StreamToUploadHeap(upload.IndexData, indexData, (size_t)range.IndexCount * IndexByteSize());
+    EndUpload(cmdList, upload);
+}
+
+GeometryPool::Handle GeometryPool::Add(ID3D12GraphicsCommandList* cmdList, const void* vertexData, UINT vertexCount,
+    const void* indexData, UINT indexCount)
+{
+    Handle handle = Allocate(vertexCount, indexCount);
+    Upload(cmdList, handle, vertexData, indexData);
+    return handle;
+}
+
+void GeometryPool::Free(Handle handle)
+{
+    assert(handle < m_ranges.size() && m_rangeLive[handle]);
+
+    FreeInPage(m_ranges[handle]);
+    m_rangeLive[handle] = false;
+    m_freeHandles.push_back(handle);
+}
+
+SubmeshGeometry GeometryPool::Rebase(Handle handle, const SubmeshGeometry& local)const
+{
+    const Range& range = m_ranges[handle];
+
+    SubmeshGeometry submesh = local;
+    submesh.BaseVertexLocation += range.BaseVertexLocation;
+    submesh.StartIndexCount += range.StartIndexLocation;
+    return submesh;
+}
+
+void GeometryPool::FillMeshGeometry(Handle handle, MeshGeometry& geo)const
+{
+    const Page* page = m_pages[m_ranges[handle].Page].get();
+
+    geo.VertexBufferGPU = page->VertexBuffer;
+    geo.IndexBufferGPU = page->IndexBuffer;
+    geo.VertexBufferUploader = nullptr;
+    geo.IndexBufferUploader = nullptr;
+
+    geo.VertexByteStride = m_desc.VertexByteStride;
+    geo.VertexBufferByteSize = (UINT)page->VertexBuffer->GetDesc().Width;
+    geo.IndexFormat = m_desc.IndexFormat;
+    geo.IndexBufferByteSize = (UINT)page->IndexBuffer->GetDesc().Width;
+}
+
+UINT GeometryPool::Defragment(ID3D12GraphicsCommandList* cmdList, UINT64 maxBytes)
+{
+    // Pick the least occupied page as the one to evacuate. With a single page
+    // there is nowhere to move to: copies within one buffer would need it in
+    // COPY_SOURCE and COPY_DEST at once.
+    UINT source = ~0u;
+    float sourceOccupancy = 1.0f;
+    UINT livePages = 0;
+    for (UINT i = 0; i < (UINT)m_pages.size(); ++i)
+    {
+        if (m_pages[i] == nullptr)
+        {
+            continue;
+        }
+        ++livePages;
+
+        float occupancy = (float)m_pages[i]->Vertices->GetUsedSize() / m_pages[i]->Vertices->GetSize();
+        if (source == ~0u || occupancy < sourceOccupancy)
+        {
+            source = i;
+            sourceOccupancy = occupancy;
+        }
+    }
+    if (livePages < 2)
+    {
+        return 0;
+    }
+
+    Page* sourcePage = m_pages[source].get();
+    UINT64 bytesMoved = 0;
+    UINT moved = 0;
+
+    for (Handle handle = 0; handle < (Handle)m_ranges.size(); ++handle)
+    {
+        if (!m_rangeLive[handle] || m_ranges[handle].Page != source)
+        {
+            continue;
+        }
+
+        const Range oldRange = m_ranges[handle];
+        const UINT64 vbByteSize = (UINT64)oldRange.VertexCount * m_desc.VertexByteStride;
+        const UINT64 ibByteSize = (UINT64)oldRange.IndexCount * IndexByteSize();
+        if (bytesMoved + vbByteSize + ibByteSize > maxBytes)
+        {
+            break;
+        }
+
+        Range newRange;
+        bool placed = false;
+        for (UINT i = 0; i < (UINT)m_pages.size() && !placed; ++i)
+        {
+            if (i != source)
+            {
+                placed = AllocateInPage(i, oldRange.VertexCount, oldRange.IndexCount, newRange);
+            }
+        }
+        if (!placed)
+        {
+            // The other pages are full; moving would only create a new page.
+            break;
+        }
+
+        Page* destPage = m_pages[newRange.Page].get();
+
+        // GENERIC_READ already includes COPY_SOURCE, so only the destination moves.
+        Transition(sourcePage->VertexBuffer.Get(), sourcePage->VertexBufferState, D3D12_RESOURCE_STATE_GENERIC_READ);
+        Transition(sourcePage->IndexBuffer.Get(), sourcePage->IndexBufferState, D3D12_RESOURCE_STATE_GENERIC_READ);
+        Transition(destPage->VertexBuffer.Get(), destPage->VertexBufferState, D3D12_RESOURCE_STATE_COPY_DEST);
+        Transition(destPage->IndexBuffer.Get(), destPage->IndexBufferState, D3D12_RESOURCE_STATE_COPY_DEST);
+        FlushBarriers(cmdList);
+
+        cmdList->CopyBufferRegion(
+            destPage->VertexBuffer.Get(), (UINT64)newRange.BaseVertexLocation * m_desc.VertexByteStride,
+            sourcePage->VertexBuffer.Get(), (UINT64)oldRange.BaseVertexLocation * m_desc.VertexByteStride,
+            vbByteSize);
+        cmdList->CopyBufferRegion(
+            destPage->IndexBuffer.Get(), (UINT64)newRange.StartIndexLocation * IndexByteSize(),
+            sourcePage->IndexBuffer.Get(), (UINT64)oldRange.StartIndexLocation * IndexByteSize(),
+            ibByteSize);
+
+        FreeInPage(oldRange);
+        m_ranges[handle] = newRange;
+
+        bytesMoved += vbByteSize + ibByteSize;
+        ++moved;
+    }
+
+    // Leave every destination readable again.
+    for (UINT i = 0; i < (UINT)m_pages.size(); ++i)
+    {
+        if (m_pages[i] != nullptr)
+        {
+            Transition(m_pages[i]->VertexBuffer.Get(), m_pages[i]->VertexBufferState, D3D12_RESOURCE_STATE_GENERIC_READ);
+            Transition(m_pages[i]->IndexBuffer.Get(), m_pages[i]->IndexBufferState, D3D12_RESOURCE_STATE_GENERIC_READ);
+        }
+    }
+    FlushBarriers(cmdList);
+
+    if (sourcePage->AllocationCount == 0)
+    {
+        // The GPU may still be reading it, so release with the staging buffers.
+        m_pendingReleases.push_back({ sourcePage->VertexBuffer, sourcePage->VertexBufferAllocation });
+        m_pendingReleases.push_back({ sourcePage->IndexBuffer, sourcePage->IndexBufferAllocation });
+        m_pages[source] = nullptr;
+    }
+
+    m_defragmentBytesMoved += bytesMoved;
+    return moved;
+}
+
+void GeometryPool::DisposeUploaders()
+{
+    for (PendingRelease& release : m_pendingReleases)
+    {
+        release.Resource = nullptr;
+        m_heaps.Free(release.Allocation);
+    }
+    m_pendingReleases.clear();
+}
+
+void GeometryPool::RetireUploaders(UINT64 fence)
+{
+    for (PendingRelease& release : m_pendingReleases)
+    {
+        // The range is freed after the buffer placed in it is released.
+        m_releases.Retire(std::move(release.Resource), fence);
+        HeapAllocation allocation = release.Allocation;
+        m_releases.Retire([this, allocation]() mutable { m_heaps.Free(allocation); }, fence);
+    }
+    m_pendingReleases.clear();
+}
+
+void GeometryPool::ReleaseCompleted(UINT64 completedFence)
+{
+    m_releases.Sweep(completedFence);
+}
+
+GeometryPoolStats GeometryPool::GetStats()const
+{
+    GeometryPoolStats stats;
+    for (const std::unique_ptr<Page>& page : m_pages)
+    {
+        if (page == nullptr)
+        {
+            continue;
+        }
+
+        ++stats.PageCount;
+        stats.AllocationCount += page->AllocationCount;
+        stats.VertexCapacity += page->Vertices->GetSize();
+        stats.VertexCount += page->Vertices->GetUsedSize();
+        stats.IndexCapacity += page->Indices->GetSize();
+        stats.IndexCount += page->Indices->GetUsedSize();
+        stats.VertexFragmentation = std::max(stats.VertexFragmentation, page->Vertices->GetFragmentation());
+        stats.IndexFragmentation = std::max(stats.IndexFragmentation, page->Indices->GetFragmentation());
+    }
+    stats.DefragmentBytesMoved = m_defragmentBytesMoved;
+    stats.Heaps = m_heaps.GetStats();
+    return stats;
+}
@@ -0,0 +1,198 @@
+// Shared vertex/index buffers for many meshes.
+//
+// Instead of one committed VB and IB per mesh, meshes are sub-allocated from a
+// few large pages. Each page is a VB/IB pair whose ranges are handed out by a
+// RangeAllocator in units of vertices and indices, so an allocation maps
+// directly to the BaseVertexLocation/StartIndexLocation of its draws and
+// every mesh in a page draws with the same buffer bindings.
+//
+// All meshes in a pool share one vertex stride and index format. Indices are
+// relative to the mesh (the draw adds BaseVertexLocation), so 16-bit pools
+// can hold any number of meshes of up to 65536 vertices each.
+//
+// Pages and the staging buffers of uploads are placed in large heaps from a
+// HeapAllocator rather than committed one by one.
+#pragma once
+#include "stdafx.h"
+#include "D3DUtil.h"
+#include "RangeAllocator.h"
+#include "HeapAllocator.h"
+#include "DeferredRelease.h"
+
+struct GeometryPoolDesc
+{
+    UINT VertexByteStride = 0;
+    DXGI_FORMAT IndexFormat = DXGI_FORMAT_R16_UINT;
+
+    // Capacity of each page. A mesh larger than this gets a page of its own.
+    UINT PageVertexCount = 1 << 16;
+    UINT PageIndexCount = 1 << 18;
+};
+
+struct GeometryPoolStats
+{
+    UINT PageCount = 0;
+    UINT AllocationCount = 0;
+
+    UINT64 VertexCapacity = 0;
+    UINT64 VertexCount = 0;
+    UINT64 IndexCapacity = 0;
+    UINT64 IndexCount = 0;
+
+    // Worst page, see RangeAllocator::GetFragmentation.
+    float VertexFragmentation = 0.0f;
+    float IndexFragmentation = 0.0f;
+
+    // Total bytes copied by Defragment since the pool was created.
+    UINT64 DefragmentBytesMoved = 0;
+
+    // The heaps under the pages and staging buffers.
+    HeapAllocatorStats Heaps;
+};
+
+class GeometryPool
+{
+public:
+    using Handle = UINT;
+    static const Handle InvalidHandle = ~0u;
+
+    // Where a mesh currently lives.
+    struct Range
+    {
+        UINT Page = 0;
+        UINT BaseVertexLocation = 0;
+        UINT StartIndexLocation = 0;
+        UINT VertexCount = 0;
+        UINT IndexCount = 0;
+    };
+
+    GeometryPool(ID3D12Device* device, const GeometryPoolDesc& desc);
+    GeometryPool(const GeometryPool& rhs) = delete;
+    GeometryPool& operator=(const GeometryPool& rhs) = delete;
+
+    // Releases whatever is still retired. The GPU must be done with the pool.
+    ~GeometryPool();
+
+    const GeometryPoolDesc& GetDesc()const { return m_desc; }
+
+    // Reserves room for a mesh, adding a page if none has space.
+    Handle Allocate(UINT vertexCount, UINT indexCount);
+
+    // Staging memory of an upload in flight. The caller writes the mesh
+    // straight into VertexData (VertexCount * VertexByteStride bytes) and
+    // IndexData (IndexCount indices in the pool's format), then records the
+    // copy with EndUpload. The memory is write-combined and mapped without a
+    // read range, so writes should go in order and it must not be read.
+    struct StagedUpload
+    {
+        Handle Mesh = InvalidHandle;
+        void* VertexData = nullptr;
+        void* IndexData = nullptr;
+
+        Microsoft::WRL::ComPtr<ID3D12Resource> Buffer;
+        HeapAllocation Allocation;
+        UINT64 IndexOffset = 0;
+    };
+
+    StagedUpload BeginUpload(Handle handle);
+    void EndUpload(ID3D12GraphicsCommandList* cmdList, StagedUpload& upload);
+
+    // BeginUpload, a copy of vertexData and indexData, then EndUpload.
+    void Upload(ID3D12GraphicsCommandList* cmdList, Handle handle, const void* vertexData, const void* indexData);
+
+    // Allocate + Upload.
+    Handle Add(ID3D12GraphicsCommandList* cmdList, const void* vertexData, UINT vertexCount,
+        const void* indexData, UINT indexCount);
+
+    // Returns the range to the pool. Work already submitted keeps reading the
+    // old data since copies into a reused range are ordered after it on the
+    // queue, but the caller must not record new draws of the handle.
+    void Free(Handle handle);
+
+    const Range& GetRange(Handle handle)const { return m_ranges[handle]; }
+
+    // Offsets a submesh expressed relative to the mesh into pool coordinates.
+    SubmeshGeometry Rebase(Handle handle, const SubmeshGeometry& local)const;
+
+    // Points geo at the page buffers of handle. The CPU blobs are left alone.
+    void FillMeshGeometry(Handle handle, MeshGeometry& geo)const;
+
+    // Incremental compaction. Moves meshes out of the least occupied page into
+    // the others, copying at most maxBytes, and retires pages that end up
+    // empty. Moved handles get a new Range, so callers must refresh anything
+    // derived from it (FillMeshGeometry, Rebase, render item draw args).
+    // Returns the number of meshes moved.
+    UINT Defragment(ID3D12GraphicsCommandList* cmdList, UINT64 maxBytes);
+
+    // Call once the command lists passed to Upload/Defragment have finished
+    // executing, to release staging buffers and retired pages.
+    void DisposeUploaders();
+
+    // Same, without waiting: they go from ReleaseCompleted once fence, which
+    // must come after those command lists, has passed.
+    void RetireUploaders(UINT64 fence);
+
+    // Releases what RetireUploaders retired with a fence up to
+    // completedFence. Cheap enough to call once a frame.
+    void ReleaseCompleted(UINT64 completedFence);
+
+    GeometryPoolStats GetStats()const;
+
+private:
+    struct Page
+    {
+        Microsoft::WRL::ComPtr<ID3D12Resource> VertexBuffer;
+        Microsoft::WRL::ComPtr<ID3D12Resource> IndexBuffer;
+        HeapAllocation VertexBufferAllocation;
+        HeapAllocation IndexBufferAllocation;
+        D3D12_RESOURCE_STATES VertexBufferState = D3D12_RESOURCE_STATE_COMMON;
+        D3D12_RESOURCE_STATES IndexBufferState = D3D12_RESOURCE_STATE_COMMON;
+
+        std::unique_ptr<RangeAllocator> Vertices;
+        std::unique_ptr<RangeAllocator> Indices;
+        UINT AllocationCount = 0;
+    };
+
+    UINT IndexByteSize()const;
+
+    UINT CreatePage(UINT vertexCount, UINT indexCount);
+
+    // Tries to place a mesh in page; fills range on success.
+    bool AllocateInPage(UINT page, UINT vertexCount, UINT indexCount, Range& range);
+    void FreeInPage(const Range& range);
+
+    // Queues a barrier if state differs; FlushBarriers records the queued
+    // ones with one call.
+    void Transition(ID3D12Resource* resource, D3D12_RESOURCE_STATES& state, D3D12_RESOURCE_STATES newState);
+    void FlushBarriers(ID3D12GraphicsCommandList* cmdList);
+
+    // A buffer to release, and its heap range to free, in DisposeUploaders or
+    // RetireUploaders.
+    struct PendingRelease
+    {
+        Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+        HeapAllocation Allocation;
+    };
+
+    ID3D12Device* m_device = nullptr;
+    GeometryPoolDesc m_desc;
+
+    // Declared before the pages so the heaps outlive them.
+    PlacedBufferHeaps m_heaps;
+
+    // Retired buffers and the heap ranges under them. The pool's own, so the
+    // callbacks freeing the ranges never outlive it.
+    DeferredReleaseQueue m_releases;
+
+    // Retired pages leave a null slot so page indices stay stable.
+    std::vector<std::unique_ptr<Page>> m_pages;
+
+    std::vector<Range> m_ranges;
+    std::vector<bool> m_rangeLive;
+    std::vector<Handle> m_freeHandles;
+
+    std::vector<PendingRelease> m_pendingReleases;
+    std::vector<D3D12_RESOURCE_BARRIER> m_pendingBarriers;
+
+    UINT64 m_defragmentBytesMoved = 0;
+};
@@ -0,0 +1,249 @@
+#include "stdafx.h"
+#include "HalfEdgeMesh.h"
+#include <ppl.h>
+
+namespace
+{
+    using uint32 = std::uint32_t;
+
+    std::uint64_t DirectedEdgeKey(uint32 from, uint32 to)
+    {
+        return ((std::uint64_t)from << 32) | to;
+    }
+
+    struct DirectedEdge
+    {
+        std::uint64_t Key;
+        uint32 HalfEdge;
+
+        bool operator<(const DirectedEdge& rhs)const
+        {
+            return Key < rhs.Key || (Key == rhs.Key && HalfEdge < rhs.HalfEdge);
+        }
+    };
+}
+
+HalfEdgeMesh::HalfEdgeMesh(uint32 vertexCount, const std::vector<uint32>& indices, uint32 faceSize) :
+    m_faceSize(faceSize),
+    m_origin(indices)
+{
+    assert(faceSize >= 3 && indices.size() % faceSize == 0);
+    BuildTwins();
+    BuildLinks(vertexCount);
+}
+
+HalfEdgeMesh::HalfEdgeMesh(const GeometryGenerator::MeshData& meshData) :
+    HalfEdgeMesh((uint32)meshData.Vertices.size(), meshData.Indices32, 3)
+{
+}
+
+void HalfEdgeMesh::BuildTwins()
+{
+    const uint32 halfEdgeCount = GetHalfEdgeCount();
+
+    std::vector<DirectedEdge> edges(halfEdgeCount);
+    concurrency::parallel_for(0u, halfEdgeCount, [&](uint32 h)
+    {
+        edges[h].Key = DirectedEdgeKey(Origin(h), Target(h));
+        edges[h].HalfEdge = h;
+    });
+    concurrency::parallel_sort(edges.begin(), edges.end());
+
+    // A half-edge a->b is paired with b->a when each directed edge occurs
+    // exactly once; both sides come to the same conclusion independently.
+    m_twin.assign(halfEdgeCount, (uint32)Invalid);
+    concurrency::parallel_for(0u, halfEdgeCount, [&](uint32 i)
+    {
+        const DirectedEdge& edge = edges[i];
+        if ((i > 0 && edges[i - 1].Key == edge.Key) ||
+            (i + 1 < halfEdgeCount && edges[i + 1].Key == edge.Key))
+        {
+            return;
+        }
+
+        uint32 from = (uint32)(edge.Key >> 32);
+        uint32 to = (uint32)edge.Key;
+        if (from == to)
+        {
+            return;
+        }
+
+        DirectedEdge probe = { DirectedEdgeKey(to, from), 0 };
+        auto it = std::lower_bound(edges.begin(), edges.end(), probe);
+        if (it == edges.end() || it->Key != probe.Key)
+        {
+            return;
+        }
+        auto next = it + 1;
+        if (next != edges.end() && next->Key == probe.Key)
+        {
+            return;
+        }
+        m_twin[edge.HalfEdge] = it->HalfEdge;
+    });
+}
+
+void HalfEdgeMesh::BuildLinks(uint32 vertexCount)
+{
+    const uint32 halfEdgeCount = GetHalfEdgeCount();
+
+    // One outgoing half-edge per vertex, preferring a boundary one.
+    m_vertexHalfEdge.assign(vertexCount, (uint32)Invalid);
+    for (uint32 h = 0; h < halfEdgeCount; ++h)
+    {
+        uint32& outgoing = m_vertexHalfEdge[m_origin[h]];
+        if (outgoing == Invalid || m_twin[h] == Invalid)
+        {
+            outgoing = h;
+        }
+    }
+
+    // An edge is numbered by its first half-edge: the lower index of a pair,
+    // or the only one on the boundary.
+    m_edge.resize(halfEdgeCount);
+    m_edgeHalfEdge.clear();
+    m_edgeHalfEdge.reserve(halfEdgeCount / 2 + 1);
+    for (uint32 h = 0; h < halfEdgeCount; ++h)
+    {
+        if (m_twin[h] == Invalid || h < m_twin[h])
+        {
+            m_edge[h] = (uint32)m_edgeHalfEdge.size();
+            m_edgeHalfEdge.push_back(h);
+        }
+    }
+    concurrency::parallel_for(0u, halfEdgeCount, [&](uint32 h)
+    {
+        if (m_twin[h] != Invalid && h > m_twin[h])
+        {
+            m_edge[h] = m_edge[m_twin[h]];
+        }
+    });
+}
+
+HalfEdgeMesh::uint32 HalfEdgeMesh::FaceValence(uint32 v)const
+{
+    uint32 valence = 0;
+    ForEachOutgoing(v, [&](uint32) { ++valence; });
+    return valence;
+}
+
+HalfEdgeMesh HalfEdgeMesh::RefineLoop()const
+{
+    assert(m_faceSize == 3 && "Loop subdivision needs triangles.");
+
+    const uint32 vertexCount = GetVertexCount();
+    const uint32 faceCount = GetFaceCount();
+
+    // Child half-edge j of child face c is c * 3 + j. For parent face f with
+    // corners v0 v1 v2 and edge vertices e0 (v0v1), e1 (v1v2), e2 (v2v0):
+    //   corner k  = face 4f+k: v_k -> e_k -> e_(k-1)
+    //   center    = face 4f+3: e0 -> e1 -> e2
+    // The twins follow from the parent's twins without any searching.
+    HalfEdgeMesh child;
+    child.m_faceSize = 3;
+    child.m_origin.resize((size_t)faceCount * 12);
+    child.m_twin.resize((size_t)faceCount * 12);
+
+    concurrency::parallel_for(0u, faceCount, [&](uint32 f)
+    {
+        for (uint32 k = 0; k < 3; ++k)
+        {
+            uint32 h = f * 3 + k;
+            uint32 prevK = (k + 2) % 3;
+            uint32 corner = (f * 4 + k) * 3;
+            uint32 center = (f * 4 + 3) * 3;
+
+            child.m_origin[corner + 0] = m_origin[h];
+            child.m_origin[corner + 1] = vertexCount + m_edge[h];
+            child.m_origin[corner + 2] = vertexCount + m_edge[f * 3 + prevK];
+            child.m_origin[center + k] = vertexCount + m_edge[h];
+
+            // Inner edge e_k -> e_(k-1) against the center's e_(k-1) -> e_k.
+            child.m_twin[corner + 1] = center + prevK;
+            child.m_twin[center + prevK] = corner + 1;
+
+            // v_k -> e_k is the first half of parent half-edge k; its twin is
+            // the second half of the parent twin, which ends corner k'+1.
+            uint32 twin = m_twin[h];
+            child.m_twin[corner + 0] = twin == Invalid ? Invalid :
+                (Face(twin) * 4 + (twin % 3 + 1) % 3) * 3 + 2;
+
+            // e_(k-1) -> v_k is the second half of parent half-edge k-1.
+            twin = m_twin[f * 3 + prevK];
+            child.m_twin[corner + 2] = twin == Invalid ? Invalid :
+                (Face(twin) * 4 + twin % 3) * 3 + 0;
+        }
+    });
+
+    child.BuildLinks(vertexCount + GetEdgeCount());
+    return child;
+}
+
+HalfEdgeMesh HalfEdgeMesh::RefineCatmullClark()const
+{
+    const uint32 vertexCount = GetVertexCount();
+    const uint32 edgeCount = GetEdgeCount();
+    const uint32 halfEdgeCount = GetHalfEdgeCount();
+
+    // One quad per parent half-edge: quad q = f*FaceSize+k has corners
+    //   v_k -> e_k -> face(f) -> e_(k-1)
+    // so its child half-edges are q*4+0..3.
+    HalfEdgeMesh child;
+    child.m_faceSize = 4;
+    child.m_origin.resize((size_t)halfEdgeCount * 4);
+    child.m_twin.resize((size_t)halfEdgeCount * 4);
+
+    concurrency::parallel_for(0u, halfEdgeCount, [&](uint32 h)
+    {
+        uint32 f = Face(h);
+        uint32 prev = Prev(h);
+        uint32 next = Next(h);
+        uint32 q = h * 4;
+
+        child.m_origin[q + 0] = m_origin[h];
+        child.m_origin[q + 1] = vertexCount + m_edge[h];
+        child.m_origin[q + 2] = vertexCount + edgeCount + f;
+        child.m_origin[q + 3] = vertexCount + m_edge[prev];
+
+        // Inner edges pair with the neighbouring quads of the same face.
+        child.m_twin[q + 1] = next * 4 + 2;
+        child.m_twin[q + 2] = prev * 4 + 1;
+
+        // v_k -> e_k is the first half of h; its twin is the second half of
+        // the parent twin, which belongs to the quad after it.
+        uint32 twin = m_twin[h];
+        child.m_twin[q + 0] = twin == Invalid ? Invalid : Next(twin) * 4 + 3;
+
+        // e_(k-1) -> v_k is the second half of the previous half-edge.
+        twin = m_twin[prev];
+        child.m_twin[q + 3] = twin == Invalid ? Invalid : twin * 4 + 0;
+    });
+
+    child.BuildLinks(vertexCount + edgeCount + GetFaceCount());
+    return child;
+}
+
+std::vector<HalfEdgeMesh::uint32> HalfEdgeMesh::Triangulate()const
+{
+    if (m_faceSize == 3)
+    {
+        return m_origin;
+    }
+
+    const uint32 faceCount = GetFaceCount();
+    const uint32 trianglesPerFace = m_faceSize - 2;
+
+    std::vector<uint32> indices((size_t)faceCount * trianglesPerFace * 3);
+    concurrency::parallel_for(0u, faceCount, [&](uint32 f)
+    {
+        const uint32* face = &m_origin[(size_t)f * m_faceSize];
+        uint32* out = &indices[(size_t)f * trianglesPerFace * 3];
+        for (uint32 t = 0; t < trianglesPerFace; ++t)
+        {
+            *out++ = face[0];
+            *out++ = face[t + 1];
+            *out++ = face[t + 2];
+        }
+    });
+    return indices;
+}
@@ -0,0 +1,117 @@
+// Index-based half-edge connectivity.
+//
+// All faces of a HalfEdgeMesh have the same number of sides (FaceSize), which
+// keeps the structure compact: the half-edges of face f are the FaceSize
+// consecutive indices starting at f * FaceSize, in winding order, so Next, Prev
+// and Face are arithmetic. Per half-edge only the origin vertex, the twin and
+// the undirected edge id are stored. Half-edges on the boundary of the mesh
+// have no twin.
+//
+// The structure expects a manifold mesh. Directed edges that occur more than
+// once are left unpaired, so non-manifold edges behave like boundaries.
+#pragma once
+#include "stdafx.h"
+#include "GeometryGenerator.h"
+
+class HalfEdgeMesh
+{
+public:
+    using uint32 = std::uint32_t;
+    static const uint32 Invalid = 0xffffffff;
+
+    HalfEdgeMesh() = default;
+
+    // indices holds faceSize vertex indices per face.
+    HalfEdgeMesh(uint32 vertexCount, const std::vector<uint32>& indices, uint32 faceSize);
+
+    // Triangle connectivity of meshData.
+    explicit HalfEdgeMesh(const GeometryGenerator::MeshData& meshData);
+
+    uint32 GetVertexCount()const { return (uint32)m_vertexHalfEdge.size(); }
+    uint32 GetFaceCount()const { return GetHalfEdgeCount() / m_faceSize; }
+    uint32 GetFaceSize()const { return m_faceSize; }
+    uint32 GetHalfEdgeCount()const { return (uint32)m_origin.size(); }
+    uint32 GetEdgeCount()const { return (uint32)m_edgeHalfEdge.size(); }
+
+    // Half-edge queries.
+    uint32 Origin(uint32 h)const { return m_origin[h]; }
+    uint32 Target(uint32 h)const { return m_origin[Next(h)]; }
+    uint32 Next(uint32 h)const { return h % m_faceSize == m_faceSize - 1 ? h + 1 - m_faceSize : h + 1; }
+    uint32 Prev(uint32 h)const { return h % m_faceSize == 0 ? h + m_faceSize - 1 : h - 1; }
+    uint32 Twin(uint32 h)const { return m_twin[h]; }
+    uint32 Face(uint32 h)const { return h / m_faceSize; }
+    uint32 Edge(uint32 h)const { return m_edge[h]; }
+    bool IsBoundary(uint32 h)const { return m_twin[h] == Invalid; }
+
+    // First half-edge of face f; the others follow with Next.
+    uint32 FaceHalfEdge(uint32 f)const { return f * m_faceSize; }
+
+    // A half-edge of edge e. For boundary edges it is the one inside the mesh.
+    uint32 EdgeHalfEdge(uint32 e)const { return m_edgeHalfEdge[e]; }
+
+    // An outgoing half-edge of v, Invalid if no face uses v. On the boundary
+    // this is the outgoing boundary half-edge, so ForEachOutgoing visits every
+    // face around v.
+    uint32 VertexHalfEdge(uint32 v)const { return m_vertexHalfEdge[v]; }
+    bool IsBoundaryVertex(uint32 v)const
+    {
+        uint32 h = m_vertexHalfEdge[v];
+        return h != Invalid && m_twin[h] == Invalid;
+    }
+
+    // Calls fn(h) for every half-edge leaving v, rotating from one face to
+    // the next. Target(h) walks the one-ring and Face(h) the incident faces.
+    // On the boundary the last neighbour, Origin(Prev(h)) of the final h, is
+    // not the target of any outgoing half-edge.
+    template<typename Fn>
+    void ForEachOutgoing(uint32 v, Fn fn)const
+    {
+        uint32 start = m_vertexHalfEdge[v];
+        if (start == Invalid)
+        {
+            return;
+        }
+        uint32 h = start;
+        do
+        {
+            fn(h);
+            h = m_twin[Prev(h)];
+        } while (h != Invalid && h != start);
+    }
+
+    // Number of faces around v.
+    uint32 FaceValence(uint32 v)const;
+
+    // Connectivity after one step of Loop subdivision (triangles only). Old
+    // vertices keep their index, the vertex on edge e becomes
+    // GetVertexCount() + e, and face f splits into faces 4f..4f+3.
+    HalfEdgeMesh RefineLoop()const;
+
+    // Connectivity after one step of Catmull-Clark subdivision; the result is
+    // all quads. Old vertices keep their index, the vertex on edge e becomes
+    // GetVertexCount() + e and the vertex of face f
+    // GetVertexCount() + GetEdgeCount() + f. Face f splits into the quads
+    // f*FaceSize..f*FaceSize+FaceSize-1, one per corner.
+    HalfEdgeMesh RefineCatmullClark()const;
+
+    // Vertex indices of all faces, FaceSize per face.
+    std::vector<uint32> GetIndices()const { return m_origin; }
+
+    // Triangle list of the faces; larger faces are fanned from their first
+    // vertex.
+    std::vector<uint32> Triangulate()const;
+
+private:
+    // Pairs half-edges by sorting their directed edges.
+    void BuildTwins();
+
+    // Fills the vertex half-edges and edge ids once origins and twins are set.
+    void BuildLinks(uint32 vertexCount);
+
+    uint32 m_faceSize = 3;
+    std::vector<uint32> m_origin;
+    std::vector<uint32> m_twin;
+    std::vector<uint32> m_edge;
+    std::vector<uint32> m_edgeHalfEdge;
+    std::vector<uint32> m_vertexHalfEdge;
+};
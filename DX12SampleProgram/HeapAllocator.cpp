@@ -0,0 +1,362 @@
+#include "stdafx.h"
+#include "HeapAllocator.h"
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+    const D3D12_HEAP_FLAGS KindHeapFlags[(UINT)HeapResourceKind::Count] =
+    {
+        D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS,
+        D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES,
+        D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES,
+    };
+}
+
+bool MockHeapBackend::CreateHeap(UINT heapId, const D3D12_HEAP_DESC& desc)
+{
+    if (desc.SizeInBytes > m_budget - m_liveBytes)
+    {
+        return false;
+    }
+    if (heapId >= m_heapSizes.size())
+    {
+        m_heapSizes.resize(heapId + 1, 0);
+    }
+    assert(m_heapSizes[heapId] == 0);
+
+    m_heapSizes[heapId] = desc.SizeInBytes;
+    m_liveBytes += desc.SizeInBytes;
+    ++m_liveHeapCount;
+    ++m_createCount;
+    return true;
+}
+
+void MockHeapBackend::DestroyHeap(UINT heapId)
+{
+    assert(heapId < m_heapSizes.size() && m_heapSizes[heapId] != 0);
+
+    m_liveBytes -= m_heapSizes[heapId];
+    m_heapSizes[heapId] = 0;
+    --m_liveHeapCount;
+    ++m_destroyCount;
+}
+
+#if defined(_WIN32)
+bool D3D12HeapBackend::CreateHeap(UINT heapId, const D3D12_HEAP_DESC& desc)
+{
+    if (heapId >= m_heaps.size())
+    {
+        m_heaps.resize(heapId + 1);
+    }
+
+    HRESULT hr = m_device->CreateHeap(&desc, IID_PPV_ARGS(&m_heaps[heapId]));
+    if (hr == E_OUTOFMEMORY)
+    {
+        return false;
+    }
+    ThrowIfFailed(hr);
+    return true;
+}
+
+void D3D12HeapBackend::DestroyHeap(UINT heapId)
+{
+    // Placed resources hold a reference to their heap, so this only frees
+    // the memory once the last of them is gone.
+    m_heaps[heapId] = nullptr;
+}
+#endif
+
+HeapAllocator::HeapAllocator(HeapBackend& backend, const HeapAllocatorDesc& desc) :
+    m_backend(backend),
+    m_desc(desc)
+{
+    assert(m_desc.Granularity != 0 && (m_desc.Granularity & (m_desc.Granularity - 1)) == 0);
+    m_desc.BlockSize = AlignUp(m_desc.BlockSize, D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT);
+}
+
+HeapAllocator::~HeapAllocator()
+{
+    for (UINT id = 0; id < (UINT)m_blocks.size(); ++id)
+    {
+        if (m_blocks[id].Live)
+        {
+            DestroyBlock(id);
+        }
+    }
+}
+
+HeapAlignmentTier HeapAllocator::GetAlignmentTier(UINT64 alignment)
+{
+    if (alignment <= D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT)
+    {
+        return HeapAlignmentTier::Small;
+    }
+    if (alignment <= D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT)
+    {
+        return HeapAlignmentTier::Default;
+    }
+    return HeapAlignmentTier::Msaa;
+}
+
+UINT HeapAllocator::PoolIndex(D3D12_HEAP_TYPE type, HeapResourceKind kind)
+{
+    // Custom heaps are not pooled.
+    assert(type == D3D12_HEAP_TYPE_DEFAULT || type == D3D12_HEAP_TYPE_UPLOAD || type == D3D12_HEAP_TYPE_READBACK);
+    return ((UINT)type - (UINT)D3D12_HEAP_TYPE_DEFAULT) * (UINT)HeapResourceKind::Count + (UINT)kind;
+}
+
+bool HeapAllocator::IsEmpty(const Block& block)const
+{
+    return block.Dedicated ? !block.DedicatedInUse : block.Ranges->GetAllocationCount() == 0;
+}
+
+UINT HeapAllocator::CreateBlock(UINT pool, UINT64 size, UINT64 alignment, bool dedicated)
+{
+    UINT id;
+    if (!m_freeIds.empty())
+    {
+        id = m_freeIds.back();
+        m_freeIds.pop_back();
+    }
+    else
+    {
+        id = (UINT)m_blocks.size();
+        m_blocks.emplace_back();
+    }
+
+    const UINT kind = pool % (UINT)HeapResourceKind::Count;
+    D3D12_HEAP_DESC heapDesc = {};
+    heapDesc.SizeInBytes = size;
+    heapDesc.Properties.Type = (D3D12_HEAP_TYPE)(pool / (UINT)HeapResourceKind::Count + (UINT)D3D12_HEAP_TYPE_DEFAULT);
+    heapDesc.Alignment = alignment;
+    heapDesc.Flags = KindHeapFlags[kind];
+    if (!m_backend.CreateHeap(id, heapDesc))
+    {
+        m_freeIds.push_back(id);
+        return HeapAllocation::InvalidHeap;
+    }
+
+    Block& block = m_blocks[id];
+    block.Pool = pool;
+    block.Size = size;
+    block.Alignment = alignment;
+    block.Live = true;
+    block.Dedicated = dedicated;
+    block.DedicatedInUse = false;
+    if (!dedicated)
+    {
+        block.Ranges = std::make_unique<RangeAllocator>(size);
+    }
+
+    m_pools[pool].push_back(id);
+    ++m_heapCreateCount;
+    return id;
+}
+
+void HeapAllocator::DestroyBlock(UINT id)
+{
+    Block& block = m_blocks[id];
+    std::vector<UINT>& pool = m_pools[block.Pool];
+    pool.erase(std::find(pool.begin(), pool.end(), id));
+
+    m_backend.DestroyHeap(id);
+    block.Live = false;
+    block.Ranges = nullptr;
+    m_freeIds.push_back(id);
+    ++m_heapDestroyCount;
+}
+
+HeapAllocation HeapAllocator::Allocate(D3D12_HEAP_TYPE type, HeapResourceKind kind, UINT64 size, UINT64 alignment)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    assert(alignment <= D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT);
+
+    const UINT pool = PoolIndex(type, kind);
+    size = AlignUp(std::max(size, (UINT64)1), m_desc.Granularity);
+
+    // MSAA placements need a heap aligned to 4MB; all other heaps only need
+    // the default 64KB.
+    const UINT64 heapAlignment = alignment > D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT ?
+        D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT : D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+
+    HeapAllocation allocation;
+    allocation.Size = size;
+    allocation.Tier = GetAlignmentTier(alignment);
+
+    // RangeAllocator asks for the worst case padding on top of size.
+    if (size + alignment - 1 > m_desc.BlockSize)
+    {
+        UINT id = CreateBlock(pool, AlignUp(size, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT), heapAlignment, true);
+        if (id == HeapAllocation::InvalidHeap)
+        {
+            return HeapAllocation();
+        }
+        m_blocks[id].DedicatedInUse = true;
+        allocation.HeapId = id;
+        allocation.Offset = 0;
+    }
+    else
+    {
+        for (UINT id : m_pools[pool])
+        {
+            Block& block = m_blocks[id];
+            if (block.Dedicated || block.Alignment < heapAlignment)
+            {
+                continue;
+            }
+            UINT64 offset = block.Ranges->Allocate(size, alignment);
+            if (offset != RangeAllocator::InvalidOffset)
+            {
+                allocation.HeapId = id;
+                allocation.Offset = offset;
+                break;
+            }
+        }
+
+        if (!allocation.IsValid())
+        {
+            UINT id = CreateBlock(pool, m_desc.BlockSize, heapAlignment, false);
+            if (id == HeapAllocation::InvalidHeap)
+            {
+                return HeapAllocation();
+            }
+            allocation.HeapId = id;
+            allocation.Offset = m_blocks[id].Ranges->Allocate(size, alignment);
+            assert(allocation.Offset != RangeAllocator::InvalidOffset);
+        }
+    }
+
+    m_allocatedBytes += size;
+    ++m_allocationCount;
+    ++m_tierAllocationCount[(UINT)allocation.Tier];
+    m_tierAllocatedBytes[(UINT)allocation.Tier] += size;
+    return allocation;
+}
+
+void HeapAllocator::Free(HeapAllocation& allocation)
+{
+    if (!allocation.IsValid())
+    {
+        return;
+    }
+    assert(allocation.HeapId < m_blocks.size() && m_blocks[allocation.HeapId].Live);
+
+    Block& block = m_blocks[allocation.HeapId];
+    if (block.Dedicated)
+    {
+        block.DedicatedInUse = false;
+    }
+    else
+    {
+        block.Ranges->Free(allocation.Offset);
+    }
+
+    m_allocatedBytes -= allocation.Size;
+    --m_allocationCount;
+    --m_tierAllocationCount[(UINT)allocation.Tier];
+    m_tierAllocatedBytes[(UINT)allocation.Tier] -= allocation.Size;
+
+    if (IsEmpty(block))
+    {
+        // Keep one empty block per pool so a free/allocate cycle at a block
+        // boundary does not recreate heaps.
+        bool hasSpare = false;
+        for (UINT id : m_pools[block.Pool])
+        {
+            if (id != allocation.HeapId && !m_blocks[id].Dedicated && IsEmpty(m_blocks[id]))
+            {
+                hasSpare = true;
+                break;
+            }
+        }
+        if (block.Dedicated || hasSpare)
+        {
+            DestroyBlock(allocation.HeapId);
+        }
+    }
+
+    allocation = HeapAllocation();
+}
+
+void HeapAllocator::Trim()
+{
+    for (UINT id = 0; id < (UINT)m_blocks.size(); ++id)
+    {
+        if (m_blocks[id].Live && IsEmpty(m_blocks[id]))
+        {
+            DestroyBlock(id);
+        }
+    }
+}
+
+HeapAllocatorStats HeapAllocator::GetStats()const
+{
+    HeapAllocatorStats stats;
+    stats.AllocatedBytes = m_allocatedBytes;
+    stats.AllocationCount = m_allocationCount;
+    for (UINT i = 0; i < (UINT)HeapAlignmentTier::Count; ++i)
+    {
+        stats.TierAllocationCount[i] = m_tierAllocationCount[i];
+        stats.TierAllocatedBytes[i] = m_tierAllocatedBytes[i];
+    }
+    stats.HeapCreateCount = m_heapCreateCount;
+    stats.HeapDestroyCount = m_heapDestroyCount;
+
+    double weightedFragmentation = 0.0;
+    UINT64 freeBytes = 0;
+    for (const Block& block : m_blocks)
+    {
+        if (!block.Live)
+        {
+            continue;
+        }
+        ++stats.HeapCount;
+        stats.ReservedBytes += block.Size;
+        if (block.Dedicated)
+        {
+            ++stats.DedicatedHeapCount;
+            continue;
+        }
+
+        float fragmentation = block.Ranges->GetFragmentation();
+        stats.WorstFragmentation = std::max(stats.WorstFragmentation, fragmentation);
+        weightedFragmentation += (double)fragmentation * (double)block.Ranges->GetFreeSize();
+        freeBytes += block.Ranges->GetFreeSize();
+    }
+    if (freeBytes > 0)
+    {
+        stats.AverageFragmentation = (float)(weightedFragmentation / (double)freeBytes);
+    }
+    return stats;
+}
+
+#if defined(_WIN32)
+PlacedBufferHeaps::PlacedBufferHeaps(ID3D12Device* device, const HeapAllocatorDesc& desc) :
+    m_device(device),
+    m_backend(device),
+    m_allocator(m_backend, desc)
+{
+}
+
+ComPtr<ID3D12Resource> PlacedBufferHeaps::CreateBuffer(D3D12_HEAP_TYPE type, UINT64 byteSize,
+    D3D12_RESOURCE_STATES initialState, HeapAllocation& allocation)
+{
+    // Buffers are always placed at 64KB.
+    allocation = m_allocator.Allocate(type, HeapResourceKind::Buffer, byteSize, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+    if (!allocation.IsValid())
+    {
+        ThrowIfFailed(E_OUTOFMEMORY);
+    }
+
+    ComPtr<ID3D12Resource> buffer;
+    ThrowIfFailed(m_device->CreatePlacedResource(
+        m_backend.GetHeap(allocation.HeapId),
+        allocation.Offset,
+        &CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+        initialState,
+        nullptr,
+        IID_PPV_ARGS(&buffer)));
+    return buffer;
+}
+#endif
@@ -0,0 +1,223 @@
+// Placed-resource heap sub-allocator.
+//
+// CreateCommittedResource gives every buffer an implicit heap of its own.
+// HeapAllocator instead reserves large heap blocks and places resources
+// inside them, handing out offsets with a RangeAllocator (TLSF) per block.
+// Blocks are pooled by heap type and by resource kind, since heaps of
+// resource heap tier 1 hardware may only hold buffers, non render target
+// textures or render target textures. Allocations are counted per
+// placement alignment tier (4KB small textures, 64KB buffers and textures,
+// 4MB MSAA textures).
+//
+// The allocator only decides where things go; heaps are created and
+// destroyed through a HeapBackend. D3D12HeapBackend creates ID3D12Heaps,
+// MockHeapBackend creates nothing and only counts, so the bookkeeping can
+// be exercised and timed without a device. PlacedBufferHeaps puts the two
+// together for buffers.
+//
+// Nothing here is thread safe.
+#pragma once
+#include "stdafx.h"
+#include "D3DUtil.h"
+#include "RangeAllocator.h"
+
+enum class HeapResourceKind : UINT
+{
+    Buffer = 0,
+    Texture,
+    RenderTargetTexture,
+    Count
+};
+
+enum class HeapAlignmentTier : UINT
+{
+    Small = 0,  // D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT
+    Default,    // D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT
+    Msaa,       // D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT
+    Count
+};
+
+class HeapBackend
+{
+public:
+    virtual ~HeapBackend() = default;
+
+    // Creates the heap known as heapId from now on. Returns false when out
+    // of memory; the allocator then fails the allocation.
+    virtual bool CreateHeap(UINT heapId, const D3D12_HEAP_DESC& desc) = 0;
+    virtual void DestroyHeap(UINT heapId) = 0;
+};
+
+// Creates no heaps, only keeps count. Fails creations past Budget bytes.
+class MockHeapBackend : public HeapBackend
+{
+public:
+    explicit MockHeapBackend(UINT64 budget = ~0ull) : m_budget(budget) {}
+
+    virtual bool CreateHeap(UINT heapId, const D3D12_HEAP_DESC& desc)override;
+    virtual void DestroyHeap(UINT heapId)override;
+
+    UINT64 GetLiveBytes()const { return m_liveBytes; }
+    UINT GetLiveHeapCount()const { return m_liveHeapCount; }
+    UINT GetCreateCount()const { return m_createCount; }
+    UINT GetDestroyCount()const { return m_destroyCount; }
+
+private:
+    UINT64 m_budget;
+    UINT64 m_liveBytes = 0;
+    UINT m_liveHeapCount = 0;
+    UINT m_createCount = 0;
+    UINT m_destroyCount = 0;
+    std::vector<UINT64> m_heapSizes;
+};
+
+#if defined(_WIN32)
+class D3D12HeapBackend : public HeapBackend
+{
+public:
+    explicit D3D12HeapBackend(ID3D12Device* device) : m_device(device) {}
+
+    virtual bool CreateHeap(UINT heapId, const D3D12_HEAP_DESC& desc)override;
+    virtual void DestroyHeap(UINT heapId)override;
+
+    ID3D12Heap* GetHeap(UINT heapId)const { return m_heaps[heapId].Get(); }
+
+private:
+    ID3D12Device* m_device = nullptr;
+    std::vector<Microsoft::WRL::ComPtr<ID3D12Heap>> m_heaps;
+};
+#endif
+
+struct HeapAllocatorDesc
+{
+    // Size of the heap blocks. Allocations that do not fit in one get a
+    // dedicated heap.
+    UINT64 BlockSize = 32ull * 1024 * 1024;
+
+    // Sizes are rounded up to this, so freed holes stay usable.
+    UINT64 Granularity = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
+};
+
+struct HeapAllocation
+{
+    static const UINT InvalidHeap = ~0u;
+
+    UINT HeapId = InvalidHeap;
+    UINT64 Offset = 0;
+    UINT64 Size = 0;
+    HeapAlignmentTier Tier = HeapAlignmentTier::Default;
+
+    bool IsValid()const { return HeapId != InvalidHeap; }
+};
+
+struct HeapAllocatorStats
+{
+    UINT HeapCount = 0;
+    UINT DedicatedHeapCount = 0;
+    UINT64 ReservedBytes = 0;
+    UINT64 AllocatedBytes = 0;
+    UINT AllocationCount = 0;
+
+    UINT TierAllocationCount[(UINT)HeapAlignmentTier::Count] = {};
+    UINT64 TierAllocatedBytes[(UINT)HeapAlignmentTier::Count] = {};
+
+    // Heaps created and destroyed since the allocator was made.
+    UINT HeapCreateCount = 0;
+    UINT HeapDestroyCount = 0;
+
+    // See RangeAllocator::GetFragmentation; the worst block, and the average
+    // over blocks weighted by their free space.
+    float WorstFragmentation = 0.0f;
+    float AverageFragmentation = 0.0f;
+};
+
+class HeapAllocator
+{
+public:
+    HeapAllocator(HeapBackend& backend, const HeapAllocatorDesc& desc = HeapAllocatorDesc());
+    HeapAllocator(const HeapAllocator& rhs) = delete;
+    HeapAllocator& operator=(const HeapAllocator& rhs) = delete;
+    ~HeapAllocator();
+
+    // size bytes at a multiple of alignment (a placement alignment, as from
+    // GetResourceAllocationInfo) in a heap of type that can hold kind.
+    // Returns an invalid allocation if the backend cannot create a heap.
+    HeapAllocation Allocate(D3D12_HEAP_TYPE type, HeapResourceKind kind, UINT64 size, UINT64 alignment);
+
+    // The resource placed at allocation must already be released. Empty
+    // blocks are destroyed, except for one per pool kept for reuse.
+    void Free(HeapAllocation& allocation);
+
+    // Destroys every empty block, including the spares.
+    void Trim();
+
+    HeapAllocatorStats GetStats()const;
+
+    static HeapAlignmentTier GetAlignmentTier(UINT64 alignment);
+
+private:
+    static const UINT HeapTypeCount = 3;
+    static const UINT PoolCount = HeapTypeCount * (UINT)HeapResourceKind::Count;
+
+    struct Block
+    {
+        UINT Pool = 0;
+        UINT64 Size = 0;
+        UINT64 Alignment = 0;
+        bool Live = false;
+
+        // Dedicated blocks hold one allocation at offset 0 and have no
+        // RangeAllocator.
+        bool Dedicated = false;
+        bool DedicatedInUse = false;
+        std::unique_ptr<RangeAllocator> Ranges;
+    };
+
+    static UINT PoolIndex(D3D12_HEAP_TYPE type, HeapResourceKind kind);
+    bool IsEmpty(const Block& block)const;
+
+    // Returns the new block id, or HeapAllocation::InvalidHeap.
+    UINT CreateBlock(UINT pool, UINT64 size, UINT64 alignment, bool dedicated);
+    void DestroyBlock(UINT id);
+
+    HeapBackend& m_backend;
+    HeapAllocatorDesc m_desc;
+
+    // Indexed by heap id; destroyed blocks leave a dead slot for reuse.
+    std::vector<Block> m_blocks;
+    std::vector<UINT> m_freeIds;
+    std::vector<UINT> m_pools[PoolCount];
+
+    UINT64 m_allocatedBytes = 0;
+    UINT m_allocationCount = 0;
+    UINT m_tierAllocationCount[(UINT)HeapAlignmentTier::Count] = {};
+    UINT64 m_tierAllocatedBytes[(UINT)HeapAlignmentTier::Count] = {};
+    UINT m_heapCreateCount = 0;
+    UINT m_heapDestroyCount = 0;
+};
+
+#if defined(_WIN32)
+// Buffers placed in heaps from a HeapAllocator over ID3D12Heaps.
+class PlacedBufferHeaps
+{
+public:
+    PlacedBufferHeaps(ID3D12Device* device, const HeapAllocatorDesc& desc = HeapAllocatorDesc());
+    PlacedBufferHeaps(const PlacedBufferHeaps& rhs) = delete;
+    PlacedBufferHeaps& operator=(const PlacedBufferHeaps& rhs) = delete;
+
+    // Like CreateCommittedResource of a byteSize buffer on a heap of type.
+    // Throws if no memory is left.
+    Microsoft::WRL::ComPtr<ID3D12Resource> CreateBuffer(D3D12_HEAP_TYPE type, UINT64 byteSize,
+        D3D12_RESOURCE_STATES initialState, HeapAllocation& allocation);
+
+    // Release the buffer, and let the GPU finish with it, first.
+    void Free(HeapAllocation& allocation) { m_allocator.Free(allocation); }
+
+    HeapAllocatorStats GetStats()const { return m_allocator.GetStats(); }
+
+private:
+    ID3D12Device* m_device = nullptr;
+    D3D12HeapBackend m_backend;
+    HeapAllocator m_allocator;
+};
+#endif
@@ -0,0 +1,391 @@
+#include "stdafx.h"
+#include "HeightFieldPyramid.h"
+
+using namespace DirectX;
+
+namespace
+{
+    // Nodes refitted on the calling thread; larger refits are split by row.
+    const size_t SerialRefitNodes = 4096;
+
+    // Slack on barycentric tests so rays through shared edges hit one side.
+    const float EdgeEpsilon = 1e-5f;
+
+    // Clips [tMin, tMax] to lo <= origin + t * direction <= hi.
+    bool ClipSlab(float origin, float direction, float invDirection, float lo, float hi, float& tMin, float& tMax)
+    {
+        if (direction == 0.0f)
+        {
+            return origin >= lo && origin <= hi;
+        }
+
+        float t0 = (lo - origin) * invDirection;
+        float t1 = (hi - origin) * invDirection;
+        if (t0 > t1)
+        {
+            std::swap(t0, t1);
+        }
+
+        tMin = std::max(tMin, t0);
+        tMax = std::min(tMax, t1);
+        return tMin <= tMax;
+    }
+
+    // Moller-Trumbore; t must fall in [0, maxT].
+    bool IntersectTriangle(const float origin[3], const float direction[3],
+        const float a[3], const float b[3], const float c[3], float maxT, float& t)
+    {
+        float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+
+        float p[3] =
+        {
+            direction[1] * e2[2] - direction[2] * e2[1],
+            direction[2] * e2[0] - direction[0] * e2[2],
+            direction[0] * e2[1] - direction[1] * e2[0],
+        };
+        float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+        if (std::fabs(det) < 1e-12f)
+        {
+            return false;
+        }
+        float invDet = 1.0f / det;
+
+        float s[3] = { origin[0] - a[0], origin[1] - a[1], origin[2] - a[2] };
+        float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * invDet;
+        if (u < -EdgeEpsilon || u > 1.0f + EdgeEpsilon)
+        {
+            return false;
+        }
+
+        float q[3] =
+        {
+            s[1] * e1[2] - s[2] * e1[1],
+            s[2] * e1[0] - s[0] * e1[2],
+            s[0] * e1[1] - s[1] * e1[0],
+        };
+        float v = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * invDet;
+        if (v < -EdgeEpsilon || u + v > 1.0f + EdgeEpsilon)
+        {
+            return false;
+        }
+
+        t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * invDet;
+        return t >= 0.0f && t <= maxT;
+    }
+}
+
+void HeightFieldPyramid::Build(const HeightFieldDesc& desc)
+{
+    assert(desc.Columns >= 2 && desc.Rows >= 2);
+    assert(desc.SpacingX != 0.0f && desc.SpacingZ != 0.0f);
+
+    m_desc = desc;
+    m_desc.Data = nullptr;
+    m_columns = desc.Columns;
+    m_rows = desc.Rows;
+    m_heights.resize((size_t)m_columns * m_rows);
+
+    m_levels.clear();
+    UINT width = m_columns - 1;
+    UINT height = m_rows - 1;
+    for (;;)
+    {
+        Level level;
+        level.Width = width;
+        level.Height = height;
+        level.Nodes.resize((size_t)width * height);
+        m_levels.push_back(std::move(level));
+        if (width == 1 && height == 1)
+        {
+            break;
+        }
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+
+    UpdateRows(desc.Data, 0, m_rows);
+}
+
+void HeightFieldPyramid::UpdateRows(const void* data, UINT firstRow, UINT endRow)
+{
+    endRow = std::min(endRow, m_rows);
+    if (firstRow >= endRow)
+    {
+        return;
+    }
+
+    CopyRows(data, firstRow, endRow);
+
+    // Cells touching the rows, then their ancestors.
+    UINT first = firstRow > 0 ? firstRow - 1 : 0;
+    UINT end = std::min(endRow, m_rows - 1);
+    for (UINT level = 0; level < (UINT)m_levels.size(); ++level)
+    {
+        RefitLevel(level, first, end);
+        first /= 2;
+        end = (end + 1) / 2;
+    }
+}
+
+void HeightFieldPyramid::CopyRows(const void* data, UINT firstRow, UINT endRow)
+{
+    const BYTE* bytes = static_cast<const BYTE*>(data);
+    auto copyRow = [&](UINT row)
+    {
+        const BYTE* source = bytes + (size_t)row * m_desc.RowStride;
+        float* dest = &m_heights[(size_t)row * m_columns];
+        if (m_desc.ColumnStride == sizeof(float))
+        {
+            std::memcpy(dest, source, m_columns * sizeof(float));
+            return;
+        }
+        for (UINT column = 0; column < m_columns; ++column)
+        {
+            std::memcpy(&dest[column], source + (size_t)column * m_desc.ColumnStride, sizeof(float));
+        }
+    };
+
+    if ((size_t)(endRow - firstRow) * m_columns <= SerialRefitNodes)
+    {
+        for (UINT row = firstRow; row < endRow; ++row)
+        {
+            copyRow(row);
+        }
+    }
+    else
+    {
+        concurrency::parallel_for(firstRow, endRow, copyRow);
+    }
+}
+
+void HeightFieldPyramid::RefitLevel(UINT level, UINT firstRow, UINT endRow)
+{
+    Level& target = m_levels[level];
+    endRow = std::min(endRow, target.Height);
+
+    auto refitRow = [&](UINT row)
+    {
+        Range* nodes = &target.Nodes[(size_t)row * target.Width];
+        if (level == 0)
+        {
+            const float* row0 = &m_heights[(size_t)row * m_columns];
+            const float* row1 = row0 + m_columns;
+            for (UINT column = 0; column < target.Width; ++column)
+            {
+                float a = std::min(row0[column], row0[column + 1]);
+                float b = std::min(row1[column], row1[column + 1]);
+                float c = std::max(row0[column], row0[column + 1]);
+                float d = std::max(row1[column], row1[column + 1]);
+                nodes[column].Min = std::min(a, b);
+                nodes[column].Max = std::max(c, d);
+            }
+            return;
+        }
+
+        // Children past the edge of an odd-sized level are missing.
+        const Level& below = m_levels[level - 1];
+        const Range* child0 = &below.Nodes[(size_t)(row * 2) * below.Width];
+        const Range* child1 = row * 2 + 1 < below.Height ? child0 + below.Width : child0;
+        for (UINT column = 0; column < target.Width; ++column)
+        {
+            UINT x0 = column * 2;
+            UINT x1 = std::min(x0 + 1, below.Width - 1);
+            nodes[column].Min = std::min(std::min(child0[x0].Min, child0[x1].Min), std::min(child1[x0].Min, child1[x1].Min));
+            nodes[column].Max = std::max(std::max(child0[x0].Max, child0[x1].Max), std::max(child1[x0].Max, child1[x1].Max));
+        }
+    };
+
+    if (firstRow >= endRow)
+    {
+        return;
+    }
+    if ((size_t)(endRow - firstRow) * target.Width <= SerialRefitNodes)
+    {
+        for (UINT row = firstRow; row < endRow; ++row)
+        {
+            refitRow(row);
+        }
+    }
+    else
+    {
+        concurrency::parallel_for(firstRow, endRow, refitRow);
+    }
+}
+
+bool HeightFieldPyramid::GetHeight(float x, float z, float& height)const
+{
+    float gx = (x - m_desc.OriginX) / m_desc.SpacingX;
+    float gz = (z - m_desc.OriginZ) / m_desc.SpacingZ;
+    if (!(gx >= 0.0f && gz >= 0.0f && gx <= (float)(m_columns - 1) && gz <= (float)(m_rows - 1)))
+    {
+        return false;
+    }
+
+    UINT column = std::min((UINT)gx, m_columns - 2);
+    UINT row = std::min((UINT)gz, m_rows - 2);
+    float u = gx - (float)column;
+    float v = gz - (float)row;
+
+    float h00 = Sample(column, row);
+    float h10 = Sample(column + 1, row);
+    float h01 = Sample(column, row + 1);
+    if (u + v <= 1.0f)
+    {
+        height = h00 + u * (h10 - h00) + v * (h01 - h00);
+    }
+    else
+    {
+        float h11 = Sample(column + 1, row + 1);
+        height = h11 + (1.0f - u) * (h01 - h11) + (1.0f - v) * (h10 - h11);
+    }
+    return true;
+}
+
+bool HeightFieldPyramid::Intersect(FXMVECTOR origin, FXMVECTOR direction, float maxT, HeightFieldHit& hit)const
+{
+    hit = HeightFieldHit();
+    if (m_levels.empty())
+    {
+        return false;
+    }
+
+    XMFLOAT3 o;
+    XMFLOAT3 d;
+    XMStoreFloat3(&o, origin);
+    XMStoreFloat3(&d, direction);
+
+    float gridOrigin[3] = { (o.x - m_desc.OriginX) / m_desc.SpacingX, o.y, (o.z - m_desc.OriginZ) / m_desc.SpacingZ };
+    float gridDirection[3] = { d.x / m_desc.SpacingX, d.y, d.z / m_desc.SpacingZ };
+    if (!IntersectGrid(gridOrigin, gridDirection, maxT, hit))
+    {
+        return false;
+    }
+
+    XMStoreFloat3(&hit.Position, XMVectorMultiplyAdd(XMVectorReplicate(hit.T), direction, origin));
+    return true;
+}
+
+void HeightFieldPyramid::IntersectSegments(const HeightFieldSegment* segments, size_t count, HeightFieldHit* hits)const
+{
+    concurrency::parallel_for(size_t(0), count, [&](size_t i)
+    {
+        XMVECTOR start = XMLoadFloat3(&segments[i].Start);
+        XMVECTOR end = XMLoadFloat3(&segments[i].End);
+        Intersect(start, XMVectorSubtract(end, start), 1.0f, hits[i]);
+    });
+}
+
+bool HeightFieldPyramid::IntersectGrid(const float origin[3], const float direction[3], float maxT, HeightFieldHit& hit)const
+{
+    struct Node
+    {
+        UINT Level;
+        UINT X;
+        UINT Z;
+    };
+
+    // Each pop pushes at most four nodes one level down.
+    Node stack[3 * 32 + 1];
+    UINT top = 0;
+    stack[top++] = { (UINT)m_levels.size() - 1, 0, 0 };
+
+    // Children front to back: the one nearest the ray's start first, the
+    // farthest last. A ray cannot cross both of the other two, so their order
+    // does not matter.
+    const UINT sx = direction[0] < 0.0f ? 1 : 0;
+    const UINT sz = direction[2] < 0.0f ? 1 : 0;
+    const UINT order[4] =
+    {
+        (sz << 1) | sx,
+        (sz << 1) | (sx ^ 1),
+        ((sz ^ 1) << 1) | sx,
+        ((sz ^ 1) << 1) | (sx ^ 1),
+    };
+
+    float inv[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        inv[i] = direction[i] != 0.0f ? 1.0f / direction[i] : 0.0f;
+    }
+
+    while (top > 0)
+    {
+        Node node = stack[--top];
+        const Level& level = m_levels[node.Level];
+        const Range& range = level.Nodes[(size_t)node.Z * level.Width + node.X];
+
+        // Grid-space box of the node, clamped to the cells that exist.
+        const UINT cells = 1u << node.Level;
+        float x0 = (float)(node.X * cells);
+        float z0 = (float)(node.Z * cells);
+        float x1 = (float)std::min((node.X + 1) * cells, m_columns - 1);
+        float z1 = (float)std::min((node.Z + 1) * cells, m_rows - 1);
+
+        float tMin = 0.0f;
+        float tMax = maxT;
+        if (!ClipSlab(origin[0], direction[0], inv[0], x0, x1, tMin, tMax) ||
+            !ClipSlab(origin[2], direction[2], inv[2], z0, z1, tMin, tMax) ||
+            !ClipSlab(origin[1], direction[1], inv[1], range.Min, range.Max, tMin, tMax))
+        {
+            continue;
+        }
+
+        if (node.Level == 0)
+        {
+            // Leaves are visited in order along the ray, so the first hit is
+            // the nearest.
+            if (IntersectCell(node.X, node.Z, origin, direction, maxT, hit))
+            {
+                return true;
+            }
+            continue;
+        }
+
+        const Level& below = m_levels[node.Level - 1];
+        for (int i = 3; i >= 0; --i)
+        {
+            UINT x = node.X * 2 + (order[i] & 1);
+            UINT z = node.Z * 2 + (order[i] >> 1);
+            if (x < below.Width && z < below.Height)
+            {
+                stack[top++] = { node.Level - 1, x, z };
+            }
+        }
+    }
+    return false;
+}
+
+bool HeightFieldPyramid::IntersectCell(UINT column, UINT row, const float origin[3], const float direction[3], float maxT,
+    HeightFieldHit& hit)const
+{
+    float x0 = (float)column;
+    float z0 = (float)row;
+    float p00[3] = { x0, Sample(column, row), z0 };
+    float p10[3] = { x0 + 1.0f, Sample(column + 1, row), z0 };
+    float p01[3] = { x0, Sample(column, row + 1), z0 + 1.0f };
+    float p11[3] = { x0 + 1.0f, Sample(column + 1, row + 1), z0 + 1.0f };
+
+    float t = 0.0f;
+    bool found = false;
+    if (IntersectTriangle(origin, direction, p00, p10, p01, maxT, t))
+    {
+        hit.T = t;
+        hit.Upper = false;
+        found = true;
+    }
+    if (IntersectTriangle(origin, direction, p10, p11, p01, found ? hit.T : maxT, t) && (!found || t < hit.T))
+    {
+        hit.T = t;
+        hit.Upper = true;
+        found = true;
+    }
+
+    if (found)
+    {
+        hit.Hit = true;
+        hit.Column = column;
+        hit.Row = row;
+    }
+    return found;
+}
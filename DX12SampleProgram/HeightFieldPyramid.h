@@ -0,0 +1,120 @@
+// Min/max pyramid over a height field, for ray casting and picking.
+//
+// Level 0 stores the height range of every grid cell, each level above the
+// range of 2x2 nodes below it. A ray walks the pyramid front to back and only
+// descends into nodes whose box it actually crosses, so a query touches a few
+// dozen nodes instead of every triangle, and the first leaf hit is the
+// nearest. The surface is the triangulation the apps draw: every cell is split
+// along the diagonal from (column + 1, row) to (column, row + 1).
+//
+// Queries are const and may run on any number of threads at once, but not
+// while the heights are being updated. Rows can be updated in place, which
+// refits only the nodes above them; use that for surfaces that change every
+// frame such as Waves.
+#pragma once
+#include "stdafx.h"
+
+// Where the samples come from: sample (column, row) is the float at
+// Data + row * RowStride + column * ColumnStride (strides in bytes), at world
+// x = OriginX + column * SpacingX and z = OriginZ + row * SpacingZ. A spacing
+// may be negative, as for Waves whose rows run towards -z.
+struct HeightFieldDesc
+{
+    const void* Data = nullptr;
+    UINT ColumnStride = sizeof(float);
+    UINT RowStride = 0;
+
+    UINT Columns = 0;
+    UINT Rows = 0;
+
+    float OriginX = 0.0f;
+    float OriginZ = 0.0f;
+    float SpacingX = 1.0f;
+    float SpacingZ = 1.0f;
+};
+
+struct HeightFieldHit
+{
+    bool Hit = false;
+
+    // Ray parameter: distance in units of the ray direction, or the fraction
+    // of a segment.
+    float T = 0.0f;
+    DirectX::XMFLOAT3 Position = { 0.0f, 0.0f, 0.0f };
+
+    // Cell hit; the triangle is the upper one when Upper is set.
+    UINT Column = 0;
+    UINT Row = 0;
+    bool Upper = false;
+};
+
+struct HeightFieldSegment
+{
+    DirectX::XMFLOAT3 Start;
+    DirectX::XMFLOAT3 End;
+};
+
+class HeightFieldPyramid
+{
+public:
+    HeightFieldPyramid() = default;
+    explicit HeightFieldPyramid(const HeightFieldDesc& desc) { Build(desc); }
+    HeightFieldPyramid(const HeightFieldPyramid& rhs) = delete;
+    HeightFieldPyramid& operator=(const HeightFieldPyramid& rhs) = delete;
+
+    // Copies the samples and builds every level.
+    void Build(const HeightFieldDesc& desc);
+
+    // Copies rows [firstRow, endRow) from data, laid out like the height
+    // field passed to Build, and refits the nodes above them.
+    void UpdateRows(const void* data, UINT firstRow, UINT endRow);
+
+    UINT GetColumns()const { return m_columns; }
+    UINT GetRows()const { return m_rows; }
+    UINT GetLevelCount()const { return (UINT)m_levels.size(); }
+
+    // Surface height at world (x, z); false outside the height field.
+    bool GetHeight(float x, float z, float& height)const;
+
+    // Nearest hit of origin + t * direction for t in [0, maxT].
+    bool Intersect(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction, float maxT, HeightFieldHit& hit)const;
+
+    // First hit along each segment, in parallel. hits[i].T is a fraction of
+    // segment i.
+    void IntersectSegments(const HeightFieldSegment* segments, size_t count, HeightFieldHit* hits)const;
+
+private:
+    struct Range
+    {
+        float Min;
+        float Max;
+    };
+
+    struct Level
+    {
+        UINT Width;
+        UINT Height;
+        std::vector<Range> Nodes;
+    };
+
+    float Sample(UINT column, UINT row)const { return m_heights[(size_t)row * m_columns + column]; }
+
+    void CopyRows(const void* data, UINT firstRow, UINT endRow);
+
+    // Recomputes node rows [firstRow, endRow) of a level from the level below,
+    // or from the samples for level 0.
+    void RefitLevel(UINT level, UINT firstRow, UINT endRow);
+
+    // Ray in grid space: x in columns, z in rows, y unchanged.
+    bool IntersectGrid(const float origin[3], const float direction[3], float maxT, HeightFieldHit& hit)const;
+    bool IntersectCell(UINT column, UINT row, const float origin[3], const float direction[3], float maxT,
+        HeightFieldHit& hit)const;
+
+    HeightFieldDesc m_desc;
+    UINT m_columns = 0;
+    UINT m_rows = 0;
+    std::vector<float> m_heights;
+
+    // m_levels[0] holds one range per cell; the last level is a single node.
+    std::vector<Level> m_levels;
+};
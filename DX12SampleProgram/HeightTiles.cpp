@@ -0,0 +1,469 @@
+#include "stdafx.h"
+#include "HeightTiles.h"
+#include "FileUtil.h"
+
+namespace
+{
+    // Each row is predicted from its left neighbour, the first sample from
+    // the one above it. Residuals are zigzag coded so small negative steps
+    // stay small, then stored as little-endian base-128 varints.
+    void EncodeDeltaVarint(const std::uint16_t* samples, UINT tileSize, std::vector<BYTE>& bytes)
+    {
+        bytes.clear();
+        for (UINT row = 0; row < tileSize; ++row)
+        {
+            const std::uint16_t* s = samples + (size_t)row * tileSize;
+            int prediction = row > 0 ? s[-(int)tileSize] : 0;
+            for (UINT i = 0; i < tileSize; ++i)
+            {
+                int delta = (int)s[i] - prediction;
+                std::uint32_t zigzag = ((std::uint32_t)delta << 1) ^ (std::uint32_t)(delta >> 31);
+                while (zigzag >= 0x80)
+                {
+                    bytes.push_back((BYTE)(zigzag | 0x80));
+                    zigzag >>= 7;
+                }
+                bytes.push_back((BYTE)zigzag);
+                prediction = s[i];
+            }
+        }
+    }
+
+    bool DecodeDeltaVarint(const BYTE* p, const BYTE* end, UINT tileSize, std::uint16_t* samples)
+    {
+        for (UINT row = 0; row < tileSize; ++row)
+        {
+            std::uint16_t* s = samples + (size_t)row * tileSize;
+            int prediction = row > 0 ? s[-(int)tileSize] : 0;
+            for (UINT i = 0; i < tileSize; ++i)
+            {
+                std::uint32_t zigzag = 0;
+                for (UINT shift = 0;; shift += 7)
+                {
+                    if (p == end || shift > 14)
+                    {
+                        return false;
+                    }
+                    BYTE b = *p++;
+                    zigzag |= (std::uint32_t)(b & 0x7f) << shift;
+                    if ((b & 0x80) == 0)
+                    {
+                        break;
+                    }
+                }
+                int value = prediction + (int)((zigzag >> 1) ^ (0u - (zigzag & 1)));
+                if (value < 0 || value > 0xffff)
+                {
+                    return false;
+                }
+                s[i] = (std::uint16_t)value;
+                prediction = value;
+            }
+        }
+        return p == end;
+    }
+}
+
+bool WriteHeightTileFile(const std::wstring& fileName, const HeightTileFileDesc& desc, const HeightTileSource& source)
+{
+    assert(desc.TileSize >= 2 && desc.TileSize <= HeightTileMaxSize && desc.TilesX > 0 && desc.TilesZ > 0);
+
+    HeightTileFileHeader header;
+    header.TileSize = desc.TileSize;
+    header.TilesX = desc.TilesX;
+    header.TilesZ = desc.TilesZ;
+    header.Compression = desc.Compression;
+    header.OriginX = desc.OriginX;
+    header.OriginZ = desc.OriginZ;
+    header.Spacing = desc.Spacing;
+    header.HeightOffset = desc.MinHeight;
+    header.HeightScale = desc.MaxHeight > desc.MinHeight ? (desc.MaxHeight - desc.MinHeight) / 65535.0f : 1.0f;
+
+    std::vector<HeightTileEntry> table((size_t)desc.TilesX * desc.TilesZ);
+    const std::uint64_t tableByteSize = table.size() * sizeof(HeightTileEntry);
+
+    return WriteFileAtomic(fileName, [&](HANDLE file)
+    {
+        // The table is written last, once the tile sizes are known.
+        bool ok = WriteAll(file, &header, sizeof(header)) && WriteAll(file, table.data(), tableByteSize);
+
+        const size_t sampleCount = (size_t)desc.TileSize * desc.TileSize;
+        std::vector<float> heights(sampleCount);
+        std::vector<std::uint16_t> samples(sampleCount);
+        std::vector<BYTE> bytes;
+        std::uint64_t offset = sizeof(header) + tableByteSize;
+        for (UINT tileZ = 0; ok && tileZ < desc.TilesZ; ++tileZ)
+        {
+            for (UINT tileX = 0; ok && tileX < desc.TilesX; ++tileX)
+            {
+                source(tileX, tileZ, heights.data());
+                for (size_t i = 0; i < sampleCount; ++i)
+                {
+                    float q = (heights[i] - header.HeightOffset) / header.HeightScale + 0.5f;
+                    samples[i] = (std::uint16_t)std::min(std::max(q, 0.0f), 65535.0f);
+                }
+
+                const void* data = samples.data();
+                size_t byteSize = sampleCount * sizeof(std::uint16_t);
+                if (desc.Compression == HeightTileCompression::DeltaVarint)
+                {
+                    EncodeDeltaVarint(samples.data(), desc.TileSize, bytes);
+                    data = bytes.data();
+                    byteSize = bytes.size();
+                }
+
+                HeightTileEntry& entry = table[(size_t)tileZ * desc.TilesX + tileX];
+                entry.Offset = offset;
+                entry.ByteSize = (std::uint32_t)byteSize;
+                ok = WriteAll(file, data, byteSize);
+                offset += byteSize;
+            }
+        }
+
+        LARGE_INTEGER tablePosition;
+        tablePosition.QuadPart = sizeof(header);
+        return ok && SetFilePointerEx(file, tablePosition, nullptr, FILE_BEGIN) &&
+            WriteAll(file, table.data(), tableByteSize);
+    });
+}
+
+HeightTileFile::~HeightTileFile()
+{
+    Close();
+}
+
+bool HeightTileFile::Open(const std::wstring& fileName)
+{
+    Close();
+
+    m_file = CreateFile(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size) || size.QuadPart < (LONGLONG)sizeof(HeightTileFileHeader) ||
+        !ReadAll(m_file, &m_header, sizeof(m_header)))
+    {
+        Close();
+        return false;
+    }
+    m_fileSize = static_cast<std::uint64_t>(size.QuadPart);
+
+    const HeightTileFileHeader& h = m_header;
+    if (h.Magic != HeightTileFileMagic || h.Version != HeightTileFileVersion ||
+        h.TileSize < 2 || h.TileSize > HeightTileMaxSize || h.TilesX == 0 || h.TilesZ == 0 ||
+        (h.Compression != HeightTileCompression::Raw && h.Compression != HeightTileCompression::DeltaVarint))
+    {
+        Close();
+        return false;
+    }
+
+    // The table is small; keep it in memory and validate it once. Its size
+    // comes from the file, so check it fits before allocating anything.
+    const std::uint64_t tileCount = (std::uint64_t)h.TilesX * h.TilesZ;
+    const std::uint64_t tableByteSize = tileCount * sizeof(HeightTileEntry);
+    if (tableByteSize > m_fileSize - sizeof(HeightTileFileHeader))
+    {
+        Close();
+        return false;
+    }
+    m_table.resize((size_t)tileCount);
+    if (!ReadAll(m_file, m_table.data(), tableByteSize))
+    {
+        Close();
+        return false;
+    }
+
+    const std::uint64_t rawByteSize = (std::uint64_t)h.TileSize * h.TileSize * sizeof(std::uint16_t);
+    for (const HeightTileEntry& entry : m_table)
+    {
+        if (entry.ByteSize == 0 || entry.Offset > m_fileSize || entry.ByteSize > m_fileSize - entry.Offset ||
+            (h.Compression == HeightTileCompression::Raw && entry.ByteSize != rawByteSize))
+        {
+            Close();
+            return false;
+        }
+    }
+
+    m_mapping = CreateFileMapping(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    m_allocationGranularity = systemInfo.dwAllocationGranularity;
+    return true;
+}
+
+void HeightTileFile::Close()
+{
+    if (m_mapping != nullptr)
+    {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+    if (m_file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+    m_fileSize = 0;
+    m_table.clear();
+}
+
+bool HeightTileFile::ReadTile(UINT tileX, UINT tileZ, std::uint16_t* samples)const
+{
+    assert(m_mapping != nullptr && tileX < m_header.TilesX && tileZ < m_header.TilesZ);
+    const HeightTileEntry& entry = m_table[(size_t)tileZ * m_header.TilesX + tileX];
+
+    // Views have to start on the allocation granularity.
+    std::uint64_t viewOffset = entry.Offset - entry.Offset % m_allocationGranularity;
+    size_t skip = (size_t)(entry.Offset - viewOffset);
+    const BYTE* view = static_cast<const BYTE*>(MapViewOfFile(m_mapping, FILE_MAP_READ,
+        (DWORD)(viewOffset >> 32), (DWORD)viewOffset, skip + entry.ByteSize));
+    if (view == nullptr)
+    {
+        return false;
+    }
+
+    const BYTE* data = view + skip;
+    bool ok = true;
+    if (m_header.Compression == HeightTileCompression::Raw)
+    {
+        memcpy(samples, data, entry.ByteSize);
+    }
+    else
+    {
+        ok = DecodeDeltaVarint(data, data + entry.ByteSize, m_header.TileSize, samples);
+    }
+
+    UnmapViewOfFile(view);
+    return ok;
+}
+
+HeightTileStream::HeightTileStream(const HeightTileStreamDesc& desc) :
+    m_desc(desc)
+{
+}
+
+HeightTileStream::~HeightTileStream()
+{
+    m_cache.WaitForRequests();
+}
+
+bool HeightTileStream::Open(const std::wstring& fileName)
+{
+    m_cache.Clear();
+    m_hasLastCameraPos = false;
+
+    if (!m_file.Open(fileName))
+    {
+        return false;
+    }
+
+    const UINT tileSize = m_file.Header().TileSize;
+    m_tileBytes = (size_t)tileSize * tileSize * sizeof(std::uint16_t) + sizeof(HeightTile);
+    m_capacity = std::max<size_t>(m_desc.MemoryBudget / m_tileBytes, 1);
+    m_cache.SetCapacity(m_capacity);
+    return true;
+}
+
+std::shared_ptr<const HeightTile> HeightTileStream::ReadTile(UINT tileX, UINT tileZ)const
+{
+    const UINT tileSize = m_file.Header().TileSize;
+
+    auto tile = std::make_shared<HeightTile>();
+    tile->X = tileX;
+    tile->Z = tileZ;
+    tile->Samples.resize((size_t)tileSize * tileSize);
+    ++m_tilesRead;
+    if (!m_file.ReadTile(tileX, tileZ, tile->Samples.data()))
+    {
+        // Keep going with a flat tile rather than failing the frame.
+        ++m_readFailures;
+        std::fill(tile->Samples.begin(), tile->Samples.end(), (std::uint16_t)0);
+    }
+    return tile;
+}
+
+std::shared_ptr<const HeightTile> HeightTileStream::GetTile(UINT tileX, UINT tileZ)
+{
+    return m_cache.GetOrFetch(TileKey(tileX, tileZ), [this, tileX, tileZ]() { return ReadTile(tileX, tileZ); });
+}
+
+std::shared_ptr<const HeightTile> HeightTileStream::FindTile(UINT tileX, UINT tileZ)
+{
+    return m_cache.Lookup(TileKey(tileX, tileZ));
+}
+
+bool HeightTileStream::RequestTile(UINT tileX, UINT tileZ)
+{
+    LruCacheRequest result = m_cache.Request(TileKey(tileX, tileZ),
+        [this, tileX, tileZ]() { return ReadTile(tileX, tileZ); }, m_desc.MaxPendingRequests);
+    return result != LruCacheRequest::Busy;
+}
+
+void HeightTileStream::WaitForRequests()
+{
+    m_cache.WaitForRequests();
+}
+
+size_t HeightTileStream::GetResidentTileCount()const
+{
+    return m_cache.GetCount();
+}
+
+HeightTileStreamStats HeightTileStream::GetStats()const
+{
+    HeightTileStreamStats stats;
+    stats.ResidentTiles = (UINT)GetResidentTileCount();
+    stats.TileCapacity = (UINT)m_capacity;
+    stats.TilesRead = m_tilesRead;
+    stats.ReadFailures = m_readFailures;
+    return stats;
+}
+
+bool HeightTileStream::SampleHeight(float x, float z, bool read, std::shared_ptr<const HeightTile>& hint, float& height)
+{
+    const HeightTileFileHeader& h = m_file.Header();
+    const UINT tileSize = h.TileSize;
+    const UINT width = h.TilesX * tileSize;
+    const UINT depth = h.TilesZ * tileSize;
+
+    float tx = std::min(std::max((x - h.OriginX) / h.Spacing, 0.0f), (float)(width - 1));
+    float tz = std::min(std::max((z - h.OriginZ) / h.Spacing, 0.0f), (float)(depth - 1));
+    UINT i = std::min((UINT)tx, width - 2);
+    UINT j = std::min((UINT)tz, depth - 2);
+    float wx = tx - (float)i;
+    float wz = tz - (float)j;
+
+    // The four corners usually share a tile; hint carries it between calls.
+    float s[4];
+    for (UINT k = 0; k < 4; ++k)
+    {
+        UINT sx = i + (k & 1);
+        UINT sz = j + (k >> 1);
+        UINT tileX = sx / tileSize;
+        UINT tileZ = sz / tileSize;
+        if (hint == nullptr || hint->X != tileX || hint->Z != tileZ)
+        {
+            hint = read ? GetTile(tileX, tileZ) : FindTile(tileX, tileZ);
+            if (hint == nullptr)
+            {
+                return false;
+            }
+        }
+        s[k] = (float)hint->Samples[(size_t)(sz % tileSize) * tileSize + sx % tileSize];
+    }
+
+    float h0 = s[0] + (s[1] - s[0]) * wx;
+    float h1 = s[2] + (s[3] - s[2]) * wx;
+    height = h.HeightOffset + (h0 + (h1 - h0) * wz) * h.HeightScale;
+    return true;
+}
+
+float HeightTileStream::GetHeight(float x, float z)
+{
+    std::shared_ptr<const HeightTile> hint;
+    float height = 0.0f;
+    SampleHeight(x, z, true, hint, height);
+    return height;
+}
+
+void HeightTileStream::GetHeights(const float* x, const float* z, size_t count, float* heights)
+{
+    std::shared_ptr<const HeightTile> hint;
+    for (size_t i = 0; i < count; ++i)
+    {
+        SampleHeight(x[i], z[i], true, hint, heights[i]);
+    }
+}
+
+bool HeightTileStream::TryGetHeight(float x, float z, float& height)
+{
+    std::shared_ptr<const HeightTile> hint;
+    return SampleHeight(x, z, false, hint, height);
+}
+
+void HeightTileStream::GatherTiles(float x, float z, float radius, std::vector<std::uint64_t>& keys)const
+{
+    const HeightTileFileHeader& h = m_file.Header();
+    const float tileWorldSize = h.TileSize * h.Spacing;
+
+    float localX = (x - h.OriginX) / tileWorldSize;
+    float localZ = (z - h.OriginZ) / tileWorldSize;
+    float localRadius = radius / tileWorldSize;
+
+    int x0 = std::max((int)floorf(localX - localRadius), 0);
+    int z0 = std::max((int)floorf(localZ - localRadius), 0);
+    int x1 = std::min((int)floorf(localX + localRadius), (int)h.TilesX - 1);
+    int z1 = std::min((int)floorf(localZ + localRadius), (int)h.TilesZ - 1);
+
+    std::vector<std::pair<float, std::uint64_t>> tiles;
+    for (int tileZ = z0; tileZ <= z1; ++tileZ)
+    {
+        for (int tileX = x0; tileX <= x1; ++tileX)
+        {
+            // Distance from the point to the tile's square, in tiles.
+            float dx = std::max(std::max((float)tileX - localX, localX - (float)(tileX + 1)), 0.0f);
+            float dz = std::max(std::max((float)tileZ - localZ, localZ - (float)(tileZ + 1)), 0.0f);
+            float distanceSq = dx * dx + dz * dz;
+            if (distanceSq <= localRadius * localRadius)
+            {
+                tiles.push_back(std::make_pair(distanceSq, TileKey((UINT)tileX, (UINT)tileZ)));
+            }
+        }
+    }
+    std::sort(tiles.begin(), tiles.end());
+
+    for (const auto& tile : tiles)
+    {
+        keys.push_back(tile.second);
+    }
+}
+
+void HeightTileStream::Update(const DirectX::XMFLOAT3& cameraPos, float deltaTime)
+{
+    DirectX::XMFLOAT3 ahead = cameraPos;
+    if (m_hasLastCameraPos && deltaTime > 0.0f)
+    {
+        float t = m_desc.LookAheadSeconds / deltaTime;
+        ahead.x += (cameraPos.x - m_lastCameraPos.x) * t;
+        ahead.z += (cameraPos.z - m_lastCameraPos.z) * t;
+    }
+    m_lastCameraPos = cameraPos;
+    m_hasLastCameraPos = true;
+
+    // Around the camera first, then ahead of it.
+    std::vector<std::uint64_t> keys;
+    GatherTiles(cameraPos.x, cameraPos.z, m_desc.PrefetchRadius, keys);
+    GatherTiles(ahead.x, ahead.z, m_desc.PrefetchRadius, keys);
+
+    // Never prefetch more than fits, or the tail would evict the head.
+    std::unordered_set<std::uint64_t> seen;
+    size_t wanted = 0;
+    for (std::uint64_t key : keys)
+    {
+        if (wanted == m_capacity)
+        {
+            break;
+        }
+        if (!seen.insert(key).second)
+        {
+            continue;
+        }
+        ++wanted;
+
+        // Touch resident tiles so the LRU keeps the neighbourhood.
+        if (m_cache.Lookup(key) == nullptr && !RequestTile((UINT)(key >> 32), (UINT)key))
+        {
+            break;
+        }
+    }
+}
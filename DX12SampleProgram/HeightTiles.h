@@ -0,0 +1,224 @@
+// Tiled height maps streamed from disk.
+//
+// A height-map file is laid out as:
+//
+//   HeightTileFileHeader
+//   HeightTileEntry[TilesX * TilesZ]   (row by row along +z)
+//   tile data
+//
+// Each tile holds TileSize x TileSize 16-bit samples, either raw or
+// delta-coded per row with zigzag varints, which pays off where neighbouring
+// samples differ by less than 64 steps. Heights are HeightOffset + sample *
+// HeightScale.
+//
+// HeightTileStream pages tiles in on demand: a tile is read by mapping just
+// the bytes it occupies, decoding them and unmapping the view, so neither
+// memory nor address space grows with the file. Decoded tiles live in an LRU
+// cache bounded by a byte budget, and Update prefetches the tiles around the
+// camera and ahead of its motion on worker threads.
+#pragma once
+#include "stdafx.h"
+#include "LruCache.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+
+const std::uint32_t HeightTileFileVersion = 1;
+const std::uint32_t HeightTileFileMagic = 0x314C5448; // "HTL1"
+
+// Largest tile edge in samples. Files with bigger tiles are rejected rather
+// than trusted with a decode buffer sized from the header.
+const std::uint32_t HeightTileMaxSize = 4096;
+
+enum class HeightTileCompression : std::uint32_t
+{
+    Raw = 0,
+    DeltaVarint = 1,
+};
+
+#pragma pack(push, 4)
+struct HeightTileFileHeader
+{
+    std::uint32_t Magic = HeightTileFileMagic;
+    std::uint32_t Version = HeightTileFileVersion;
+
+    std::uint32_t TileSize = 0;
+    std::uint32_t TilesX = 0;
+    std::uint32_t TilesZ = 0;
+    HeightTileCompression Compression = HeightTileCompression::Raw;
+
+    // World xz of sample (0, 0) and the distance between samples.
+    float OriginX = 0.0f;
+    float OriginZ = 0.0f;
+    float Spacing = 1.0f;
+
+    float HeightOffset = 0.0f;
+    float HeightScale = 1.0f;
+    std::uint32_t Reserved = 0;
+};
+
+struct HeightTileEntry
+{
+    std::uint64_t Offset = 0;
+    std::uint32_t ByteSize = 0;
+    std::uint32_t Reserved = 0;
+};
+#pragma pack(pop)
+
+struct HeightTileFileDesc
+{
+    UINT TileSize = 256;
+    UINT TilesX = 1;
+    UINT TilesZ = 1;
+    HeightTileCompression Compression = HeightTileCompression::DeltaVarint;
+
+    float OriginX = 0.0f;
+    float OriginZ = 0.0f;
+    float Spacing = 1.0f;
+
+    // Heights are quantized to 16 bits over this range.
+    float MinHeight = 0.0f;
+    float MaxHeight = 1.0f;
+};
+
+// Fills TileSize * TileSize heights of one tile, row by row along +z.
+using HeightTileSource = std::function<void(UINT tileX, UINT tileZ, float* heights)>;
+
+// Writes a height-map file one tile at a time, so maps larger than memory
+// can be produced. Returns false if the file cannot be written.
+bool WriteHeightTileFile(const std::wstring& fileName, const HeightTileFileDesc& desc, const HeightTileSource& source);
+
+// A height-map file opened for tile reads. Reads may run on several threads.
+class HeightTileFile
+{
+public:
+    HeightTileFile() = default;
+    HeightTileFile(const HeightTileFile& rhs) = delete;
+    HeightTileFile& operator=(const HeightTileFile& rhs) = delete;
+    ~HeightTileFile();
+
+    // Returns false if the file is missing, truncated or of another version.
+    bool Open(const std::wstring& fileName);
+    void Close();
+
+    const HeightTileFileHeader& Header()const { return m_header; }
+
+    // Decodes tile (tileX, tileZ) into TileSize * TileSize samples. Returns
+    // false if the tile data is corrupt.
+    bool ReadTile(UINT tileX, UINT tileZ, std::uint16_t* samples)const;
+
+private:
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+    std::uint64_t m_fileSize = 0;
+    DWORD m_allocationGranularity = 0;
+
+    HeightTileFileHeader m_header;
+    std::vector<HeightTileEntry> m_table;
+};
+
+struct HeightTile
+{
+    UINT X = 0;
+    UINT Z = 0;
+    std::vector<std::uint16_t> Samples;
+};
+
+struct HeightTileStreamDesc
+{
+    // Bytes of decoded tiles kept resident.
+    size_t MemoryBudget = 64 * 1024 * 1024;
+
+    // Tiles within this world distance of the camera, and of where it will be
+    // LookAheadSeconds from now, are prefetched.
+    float PrefetchRadius = 512.0f;
+    float LookAheadSeconds = 1.0f;
+
+    // Tile reads in flight at once.
+    UINT MaxPendingRequests = 8;
+};
+
+struct HeightTileStreamStats
+{
+    UINT ResidentTiles = 0;
+    UINT TileCapacity = 0;
+
+    // Tiles read from the file, and those that failed to read or decode and
+    // were replaced by flat ones.
+    UINT64 TilesRead = 0;
+    UINT64 ReadFailures = 0;
+};
+
+class HeightTileStream
+{
+public:
+    explicit HeightTileStream(const HeightTileStreamDesc& desc = HeightTileStreamDesc());
+    HeightTileStream(const HeightTileStream& rhs) = delete;
+    HeightTileStream& operator=(const HeightTileStream& rhs) = delete;
+    ~HeightTileStream();
+
+    bool Open(const std::wstring& fileName);
+
+    const HeightTileFileHeader& Header()const { return m_file.Header(); }
+
+    // Bilinearly filtered height, clamped to the map. Tiles that are not
+    // resident are read on the calling thread.
+    float GetHeight(float x, float z);
+
+    // Heights of count points, with the signature CdlodQuadtree samples.
+    void GetHeights(const float* x, const float* z, size_t count, float* heights);
+
+    // Height from resident tiles only; returns false instead of reading.
+    bool TryGetHeight(float x, float z, float& height);
+
+    // Resident tile, read on the calling thread if it is not.
+    std::shared_ptr<const HeightTile> GetTile(UINT tileX, UINT tileZ);
+
+    // Resident tile or null; never reads.
+    std::shared_ptr<const HeightTile> FindTile(UINT tileX, UINT tileZ);
+
+    // Queues a read on a worker thread. Does nothing if the tile is resident
+    // or already queued. Returns false if too many reads are in flight.
+    bool RequestTile(UINT tileX, UINT tileZ);
+
+    // Prefetches around cameraPos and along its motion since the last call.
+    void Update(const DirectX::XMFLOAT3& cameraPos, float deltaTime);
+
+    void WaitForRequests();
+
+    size_t GetResidentTileCount()const;
+    size_t GetResidentBytes()const { return GetResidentTileCount() * m_tileBytes; }
+    size_t GetTileCapacity()const { return m_capacity; }
+
+    HeightTileStreamStats GetStats()const;
+
+private:
+    std::shared_ptr<const HeightTile> ReadTile(UINT tileX, UINT tileZ)const;
+
+    // Bilinear sample. Missing tiles are read when read is set, otherwise the
+    // sample fails. hint caches the last tile used.
+    bool SampleHeight(float x, float z, bool read, std::shared_ptr<const HeightTile>& hint, float& height);
+
+    // Tiles overlapping the disc, nearest first.
+    void GatherTiles(float x, float z, float radius, std::vector<std::uint64_t>& keys)const;
+
+    static std::uint64_t TileKey(UINT tileX, UINT tileZ)
+    {
+        return ((std::uint64_t)tileX << 32) | tileZ;
+    }
+
+    HeightTileStreamDesc m_desc;
+    HeightTileFile m_file;
+    size_t m_tileBytes = 0;
+    size_t m_capacity = 0;
+
+    DirectX::XMFLOAT3 m_lastCameraPos = { 0.0f, 0.0f, 0.0f };
+    bool m_hasLastCameraPos = false;
+
+    // Bumped by reads on the worker threads.
+    mutable std::atomic<UINT64> m_tilesRead{ 0 };
+    mutable std::atomic<UINT64> m_readFailures{ 0 };
+
+    // Last, so reads still in flight are waited for before the file closes.
+    LruCache<HeightTile> m_cache;
+};
@@ -0,0 +1,139 @@
+#include "stdafx.h"
+#include "IndexBuffer.h"
+#include <emmintrin.h>
+
+std::uint32_t FindMaxIndex(const std::uint32_t* indices, size_t count)
+{
+    // SSE2 has no unsigned 32-bit max, so flip the sign bit and do a signed
+    // compare/select instead.
+    const __m128i bias = _mm_set1_epi32((int)0x80000000);
+    __m128i maxBiased = bias;
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + i)), bias);
+        __m128i greater = _mm_cmpgt_epi32(v, maxBiased);
+        maxBiased = _mm_or_si128(_mm_and_si128(greater, v), _mm_andnot_si128(greater, maxBiased));
+    }
+
+    alignas(16) std::uint32_t lanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), _mm_xor_si128(maxBiased, bias));
+
+    std::uint32_t maxIndex = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+    for (; i < count; ++i)
+    {
+        maxIndex = std::max(maxIndex, indices[i]);
+    }
+    return maxIndex;
+}
+
+DXGI_FORMAT SelectIndexFormat(const std::uint32_t* indices, size_t count)
+{
+    return FindMaxIndex(indices, count) <= 0xffff ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+}
+
+DXGI_FORMAT SelectIndexFormat(size_t vertexCount)
+{
+    return vertexCount <= 0x10000 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+}
+
+bool NarrowIndices(const std::uint32_t* src, size_t count, std::uint16_t* dst)
+{
+    // _mm_packs_epi32 saturates to signed 16 bits, so shift the range
+    // [0, 0xffff] down to [-0x8000, 0x7fff] before packing and flip the top
+    // bit of each 16-bit lane afterwards to undo it. Any index with bits
+    // above 16 set is accumulated into overflow and reported at the end.
+    const __m128i bias32 = _mm_set1_epi32(0x8000);
+    const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+    __m128i overflow = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 4));
+        overflow = _mm_or_si128(overflow, _mm_srli_epi32(_mm_or_si128(a, b), 16));
+
+        __m128i packed = _mm_packs_epi32(_mm_sub_epi32(a, bias32), _mm_sub_epi32(b, bias32));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(packed, bias16));
+    }
+
+    std::uint32_t tailOverflow = 0;
+    for (; i < count; ++i)
+    {
+        tailOverflow |= src[i] >> 16;
+        dst[i] = static_cast<std::uint16_t>(src[i]);
+    }
+
+    return tailOverflow == 0 && _mm_movemask_epi8(_mm_cmpeq_epi32(overflow, _mm_setzero_si128())) == 0xffff;
+}
+
+IndexBuffer::IndexBuffer(std::vector<std::uint32_t>&& indices)
+    :m_count((UINT)indices.size())
+{
+    m_indices16.resize(indices.size());
+    if (NarrowIndices(indices.data(), indices.size(), m_indices16.data()))
+    {
+        m_format = DXGI_FORMAT_R16_UINT;
+
+        // Release the wide copy rather than just clearing it.
+        std::vector<std::uint32_t>().swap(indices);
+    }
+    else
+    {
+        m_format = DXGI_FORMAT_R32_UINT;
+        std::vector<std::uint16_t>().swap(m_indices16);
+        m_indices32 = std::move(indices);
+    }
+}
+
+IndexBuffer::IndexBuffer(const std::uint32_t* indices, size_t count)
+    :m_count((UINT)count)
+{
+    m_format = SelectIndexFormat(indices, count);
+    if (m_format == DXGI_FORMAT_R16_UINT)
+    {
+        m_indices16.resize(count);
+        NarrowIndices(indices, count, m_indices16.data());
+    }
+    else
+    {
+        m_indices32.assign(indices, indices + count);
+    }
+}
+
+const void* IndexBuffer::Data()const
+{
+    return m_format == DXGI_FORMAT_R16_UINT ?
+        static_cast<const void*>(m_indices16.data()) :
+        static_cast<const void*>(m_indices32.data());
+}
+
+#if defined(_WIN32)
+void IndexBuffer::CreateBuffers(MeshGeometry& geo, ID3D12Device* device, ID3D12GraphicsCommandList* cmdList)const
+{
+    const UINT ibByteSize = ByteSize();
+
+    ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo.IndexBufferCPU));
+    CopyMemory(geo.IndexBufferCPU->GetBufferPointer(), Data(), ibByteSize);
+
+    geo.IndexBufferGPU = CreateDefaultBuffer(device, cmdList, Data(), ibByteSize, geo.IndexBufferUploader);
+
+    geo.IndexFormat = m_format;
+    geo.IndexBufferByteSize = ibByteSize;
+}
+
+void IndexBuffer::CreateBuffers(MeshGeometry& geo, UploadBatch& batch)const
+{
+    const UINT ibByteSize = ByteSize();
+
+    ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo.IndexBufferCPU));
+    CopyMemory(geo.IndexBufferCPU->GetBufferPointer(), Data(), ibByteSize);
+
+    geo.IndexBufferGPU = batch.CreateBuffer(Data(), ibByteSize);
+
+    geo.IndexFormat = m_format;
+    geo.IndexBufferByteSize = ibByteSize;
+}
+#endif
@@ -0,0 +1,71 @@
+// Index data stored in the narrowest format that can address every vertex it
+// references.
+//
+// Meshes are generated with 32-bit indices. Most of them never reference more
+// than 65535 vertices, so IndexBuffer narrows them to 16 bits with SSE2 and
+// drops the wide copy, halving index memory both on the CPU and on the GPU.
+// Meshes that do not fit stay 32-bit; nothing is ever truncated.
+#pragma once
+#include "stdafx.h"
+#include "D3DUtil.h"
+
+#if defined(_WIN32)
+#include "UploadBatch.h"
+#endif
+
+// Largest value in indices[0, count). Returns 0 for an empty range.
+std::uint32_t FindMaxIndex(const std::uint32_t* indices, size_t count);
+
+// Narrowest index format for a mesh or submesh range.
+DXGI_FORMAT SelectIndexFormat(const std::uint32_t* indices, size_t count);
+
+// Narrowest index format able to address vertexCount vertices. Use this when
+// generating straight into a buffer before the indices exist.
+DXGI_FORMAT SelectIndexFormat(size_t vertexCount);
+
+inline UINT IndexFormatByteSize(DXGI_FORMAT format)
+{
+    return format == DXGI_FORMAT_R32_UINT ? 4 : 2;
+}
+
+// Narrows count 32-bit indices into dst. Returns false if any index does not
+// fit in 16 bits; dst is then left partially written.
+bool NarrowIndices(const std::uint32_t* src, size_t count, std::uint16_t* dst);
+
+class IndexBuffer
+{
+public:
+    IndexBuffer() = default;
+
+    // Takes ownership of the wide indices. When they fit in 16 bits they are
+    // narrowed and the 32-bit storage is released.
+    explicit IndexBuffer(std::vector<std::uint32_t>&& indices);
+
+    // Copies the range, keeping only the narrowest representation.
+    IndexBuffer(const std::uint32_t* indices, size_t count);
+
+    DXGI_FORMAT Format()const { return m_format; }
+    UINT Count()const { return m_count; }
+    UINT ByteSize()const { return m_count * IndexFormatByteSize(m_format); }
+    const void* Data()const;
+
+    // 16-bit view; empty when Format() is DXGI_FORMAT_R32_UINT.
+    const std::vector<std::uint16_t>& Indices16()const { return m_indices16; }
+    // 32-bit view; empty when Format() is DXGI_FORMAT_R16_UINT.
+    const std::vector<std::uint32_t>& Indices32()const { return m_indices32; }
+
+#if defined(_WIN32)
+    // Creates the CPU blob and the default heap buffer of geo from this data
+    // and sets geo.IndexFormat/IndexBufferByteSize to match.
+    void CreateBuffers(MeshGeometry& geo, ID3D12Device* device, ID3D12GraphicsCommandList* cmdList)const;
+
+    // Same, staging the data in batch; geo gets no uploader to dispose.
+    void CreateBuffers(MeshGeometry& geo, UploadBatch& batch)const;
+#endif
+
+private:
+    DXGI_FORMAT m_format = DXGI_FORMAT_R16_UINT;
+    UINT m_count = 0;
+    std::vector<std::uint16_t> m_indices16;
+    std::vector<std::uint32_t> m_indices32;
+};
@@ -14,6 +14,10 @@ LandAndWavesApp::~LandAndWavesApp()
     if (m_device != nullptr)
     {
         FlushCommandQueue();
+
+        // The backend waits for the copy queue, before the heights go.
+        m_streamer = nullptr;
+        m_streamingBackend = nullptr;
     }
 }
 
@@ -47,6 +51,31 @@ void LandAndWavesApp::BuildRootSignature()
         serializedRootSig->GetBufferSize(),
         IID_PPV_ARGS(&m_rootSignature)
     ));
+
+    // The terrain takes its few constants as root constants and reads the
+    // height field through a root SRV, so it needs no descriptor heap.
+    CD3DX12_ROOT_PARAMETER terrainRootParameter[3];
+    terrainRootParameter[0].InitAsConstants(sizeof(TerrainLodConstants) / 4, 0);
+    terrainRootParameter[1].InitAsConstantBufferView(1);
+    terrainRootParameter[2].InitAsShaderResourceView(0);
+
+    CD3DX12_ROOT_SIGNATURE_DESC terrainRootSignatureDesc(3, terrainRootParameter, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+
+    serializedRootSig = nullptr;
+    errorBlob = nullptr;
+    hr = D3D12SerializeRootSignature(&terrainRootSignatureDesc, D3D_ROOT_SIGNATURE_VERSION_1, &serializedRootSig, &errorBlob);
+
+    if (errorBlob != nullptr)
+    {
+        ::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+    }
+    ThrowIfFailed(hr);
+
+    ThrowIfFailed(m_device->CreateRootSignature(
+        0, serializedRootSig->GetBufferPointer(),
+        serializedRootSig->GetBufferSize(),
+        IID_PPV_ARGS(&m_terrainRootSignature)
+    ));
 }
 
 void LandAndWavesApp::BuildShadersAndInputLayout()
@@ -57,121 +86,198 @@ void LandAndWavesApp::BuildShadersAndInputLayout()
 #else
     UINT compileFlags = 0;
 #endif
-    ThrowIfFailed(D3DCompileFromFile(L"Shapes.hlsl", nullptr, nullptr, 
+    // The only opaque render item is the water.
+    ThrowIfFailed(D3DCompileFromFile(L"Water.hlsl", nullptr, nullptr, 
         "VSMain", "vs_5_0", compileFlags, 0, &m_shaders["standardVS"], nullptr));
-    ThrowIfFailed(D3DCompileFromFile(L"Shapes.hlsl", nullptr, nullptr,
+    ThrowIfFailed(D3DCompileFromFile(L"Water.hlsl", nullptr, nullptr,
         "PSMain", "ps_5_0", compileFlags, 0, &m_shaders["opaquePS"], nullptr
     ));
+    ThrowIfFailed(D3DCompileFromFile(L"TerrainLod.hlsl", nullptr, nullptr,
+        "VSMain", "vs_5_0", compileFlags, 0, &m_shaders["terrainVS"], nullptr));
+    ThrowIfFailed(D3DCompileFromFile(L"TerrainLod.hlsl", nullptr, nullptr,
+        "PSMain", "ps_5_0", compileFlags, 0, &m_shaders["terrainPS"], nullptr));
     m_inputLayout =
     {
         {"POSITION",0,DXGI_FORMAT_R32G32B32_FLOAT,0,0,D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,0},
-        {"COLOR",0,DXGI_FORMAT_R32G32B32A32_FLOAT,0,12,D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,0}
+        {"COLOR",0,DXGI_FORMAT_R32G32B32A32_FLOAT,0,12,D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,0},
+        {"NORMAL",0,DXGI_FORMAT_R32G32B32_FLOAT,0,28,D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,0}
     };
-}
 
-float LandAndWavesApp::GetHillsHeight(float x, float z) const
-{
-    return 0.3f * (z * sinf(0.1f * x) + x * cosf(0.1f * z));
+    // Slot 0 is the shared patch mesh, slot 1 one CdlodPatch per instance.
+    m_terrainInputLayout =
+    {
+        {"GRID",0,DXGI_FORMAT_R32G32B32_FLOAT,0,0,D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,0},
+        {"PATCH",0,DXGI_FORMAT_R32G32B32_FLOAT,1,0,D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA,1},
+        {"MORPH",0,DXGI_FORMAT_R32G32_FLOAT,1,16,D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA,1}
+    };
 }
 
-XMFLOAT3 LandAndWavesApp::GetHillsNormal(float x, float z)const
+void LandAndWavesApp::BakeLandHeightMap(const std::wstring& fileName, const CdlodDesc& lodDesc)
 {
-    // n=(-df/dx,1,-df/dz)
-    XMFLOAT3 n(
-        -0.03f * z * cosf(0.1f * x) - 0.3f * cosf(0.1f * z),
-        1.0f,
-        -0.3f * sinf(0.1f * x) + 0.03f * x * sinf(0.1f * z)
-    );
-
-    XMVECTOR unitNormal = XMVector3Normalize(XMLoadFloat3(&n));
-    XMStoreFloat3(&n, unitNormal);
-    return n;
+    TerrainDesc desc;
+    desc.HillsScale = 1.0f;
+    desc.Noise = { 4, 1.0f / 40.0f, 4.0f, 2.0f, 0.5f };
+    Terrain terrain(desc);
+
+    // The quadtree's own sampling gives the grid and its height range; the
+    // tiles past its far edges repeat the last row and column.
+    CdlodQuadtree grid(terrain, lodDesc);
+    const std::vector<float>& heights = grid.GetHeights();
+    const UINT resolution = grid.GetResolution();
+    auto range = std::minmax_element(heights.begin(), heights.end());
+
+    HeightTileFileDesc fileDesc;
+    fileDesc.TileSize = 256;
+    fileDesc.TilesX = fileDesc.TilesZ = (resolution + fileDesc.TileSize - 1) / fileDesc.TileSize;
+    fileDesc.OriginX = lodDesc.Origin.x;
+    fileDesc.OriginZ = lodDesc.Origin.y;
+    fileDesc.Spacing = lodDesc.Spacing;
+    fileDesc.MinHeight = *range.first;
+    fileDesc.MaxHeight = *range.second;
+
+    const UINT tileSize = fileDesc.TileSize;
+    bool written = WriteHeightTileFile(fileName, fileDesc, [&](UINT tileX, UINT tileZ, float* tileHeights)
+    {
+        for (UINT j = 0; j < tileSize; ++j)
+        {
+            UINT row = std::min(tileZ * tileSize + j, resolution - 1);
+            for (UINT i = 0; i < tileSize; ++i)
+            {
+                UINT column = std::min(tileX * tileSize + i, resolution - 1);
+                tileHeights[(size_t)j * tileSize + i] = heights[(size_t)row * resolution + column];
+            }
+        }
+    });
+    if (!written)
+    {
+        throw std::runtime_error("LandAndWavesApp::BakeLandHeightMap: the height map could not be written.");
+    }
 }
 
 void LandAndWavesApp::BuildLandGeometry()
 {
-    GeometryGenerator geoGen;
-    GeometryGenerator::MeshData grid = geoGen.CreateGrid(200.0f, 200.0f, 100, 100);
-
-    // Extract the vertex elements we are interested and apply the height function to 
-    // each vertex. In addition, color the vertices based on their height so we have sandy looking 
-    // beaches, grassy low hills, and snow mountain peaks.
-    const UINT numGridVertices = grid.Vertices.size();
-    std::vector<Vertex> vertices(numGridVertices);
-    for (size_t i = 0; i < numGridVertices; ++i)
-    {
-        XMFLOAT3& p = grid.Vertices[i].Position;
-        vertices[i].Pos = p;
-        vertices[i].Pos.y = GetHillsHeight(p.x, p.z);
-
-        // Color the vertex based on its height.
-        if (vertices[i].Pos.y < -10.0f)
-        {
-            // Sandy beach color.
-            vertices[i].Color = XMFLOAT4(1.0f, 0.96f, 0.62f, 1.0f);
-        }
-        else if (vertices[i].Pos.y<5.0f)
-        {
-            // Light yellow-green.
-            vertices[i].Color = XMFLOAT4(0.48f, 0.77f, 0.46f, 1.0f);
-        }
-        else if (vertices[i].Pos.y < 12.0f)
-        {
-            // Dark yellow green.
-            vertices[i].Color = XMFLOAT4(0.1f, 0.48f, 0.19f, 1.0f);
-        }
-        else if (vertices[i].Pos.y < 20.0f)
-        {
-            // Dark brown.
-            vertices[i].Color = XMFLOAT4(0.45f, 0.39f, 0.34f, 1.0f);
-        }
-        else
+    // 512x512 world units at half-unit spacing, centered on the origin.
+    CdlodDesc lodDesc;
+    lodDesc.PatchQuads = 16;
+    lodDesc.LodCount = 7;
+    lodDesc.Spacing = 0.5f;
+    lodDesc.Origin = XMFLOAT2(-256.0f, -256.0f);
+
+    // The land is read from a tiled height map, baked from the procedural
+    // terrain when there is none yet; replace Land.htl to load other land.
+    const std::wstring heightMapName = GetAssetFullPath(L"Land.htl");
+    HeightTileStream landHeights;
+    if (!landHeights.Open(heightMapName))
+    {
+        BakeLandHeightMap(heightMapName, lodDesc);
+        if (!landHeights.Open(heightMapName))
         {
-            // White snow.
-            vertices[i].Color = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+            throw std::runtime_error("LandAndWavesApp::BuildLandGeometry: the height map could not be opened.");
         }
     }
-
-    const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-
-    std::vector<std::uint16_t> indices = grid.GetIndices16();
-    const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+    m_terrainLod = std::make_unique<CdlodQuadtree>(
+        [&landHeights](const float* x, const float* z, size_t count, float* heights)
+        {
+            landHeights.GetHeights(x, z, count, heights);
+        }, lodDesc);
+
+    const std::vector<float>& heights = m_terrainLod->GetHeights();
+
+    HeightFieldDesc heightField;
+    heightField.Data = heights.data();
+    heightField.RowStride = m_terrainLod->GetResolution() * sizeof(float);
+    heightField.Columns = heightField.Rows = m_terrainLod->GetResolution();
+    heightField.OriginX = lodDesc.Origin.x;
+    heightField.OriginZ = lodDesc.Origin.y;
+    heightField.SpacingX = heightField.SpacingZ = lodDesc.Spacing;
+    m_landPyramid = std::make_unique<HeightFieldPyramid>(heightField);
+
+    const UINT64 heightsByteSize = (UINT64)heights.size() * sizeof(float);
+    ThrowIfFailed(m_device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(heightsByteSize),
+        D3D12_RESOURCE_STATE_COMMON,
+        nullptr,
+        IID_PPV_ARGS(&m_terrainHeights)));
+
+    const BYTE* heightBytes = reinterpret_cast<const BYTE*>(heights.data());
+    m_streamer->RequestBuffer(m_terrainHeights.Get(), 0,
+        std::vector<BYTE>(heightBytes, heightBytes + heightsByteSize), 0,
+        [this]() { m_terrainHeightsReady = true; });
 
     std::unique_ptr<MeshGeometry> geo = std::make_unique<MeshGeometry>();
     geo->Name = "landGeo";
 
-    ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-    CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-
-    ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-    CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
-    geo->VertexBufferGPU = CreateDefaultBuffer(m_device.Get(), m_commandList.Get(), 
-        vertices.data(), 
-        vbByteSize, geo->VertexBufferUploader);
+    // The patch mesh is the land's only static mesh; the heights are
+    // sampled from the streamed buffer. Each region is stored as a submesh.
+    MeshCacheKey key("LandAndWavesApp::landGeo/cdlod-patch-v1");
+    key.Add(lodDesc.PatchQuads).Add((std::uint32_t)sizeof(CdlodPatchVertex));
+
+    UINT vbByteSize = 0;
+    UINT ibByteSize = 0;
+    MappedMeshFile cachedFile;
+    if (m_meshCache->Map(key.Value(), cachedFile) &&
+        cachedFile.Header().VertexByteStride == sizeof(CdlodPatchVertex) &&
+        cachedFile.Header().IndexFormat == DXGI_FORMAT_R16_UINT &&
+        cachedFile.Header().SubmeshCount == (UINT)CdlodRegion::Count)
+    {
+        const MeshFileHeader& header = cachedFile.Header();
+        std::vector<std::pair<std::string, SubmeshGeometry>> submeshes = MeshCache::ReadSubmeshes(cachedFile);
+        for (UINT r = 0; r < (UINT)CdlodRegion::Count; ++r)
+        {
+            m_terrainPatchRanges[r].StartIndex = submeshes[r].second.StartIndexCount;
+            m_terrainPatchRanges[r].IndexCount = submeshes[r].second.IndexCount;
+        }
 
-    geo->IndexBufferGPU = CreateDefaultBuffer(m_device.Get(), m_commandList.Get(),
-        indices.data(), ibByteSize, geo->IndexBufferUploader);
+        vbByteSize = header.VertexCount * sizeof(CdlodPatchVertex);
+        ibByteSize = header.IndexCount * sizeof(std::uint16_t);
+        geo->VertexBufferGPU = m_uploadBatch->CreateBuffer(cachedFile.VertexData(), vbByteSize);
+        geo->IndexBufferGPU = m_uploadBatch->CreateBuffer(cachedFile.IndexData(), ibByteSize);
+    }
+    else
+    {
+        std::vector<CdlodPatchVertex> vertices;
+        std::vector<std::uint16_t> indices;
+        m_terrainLod->BuildPatchMesh(vertices, indices, m_terrainPatchRanges);
+
+        vbByteSize = (UINT)vertices.size() * sizeof(CdlodPatchVertex);
+        ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+        geo->VertexBufferGPU = m_uploadBatch->CreateBuffer(vertices.data(), vbByteSize);
+        geo->IndexBufferGPU = m_uploadBatch->CreateBuffer(indices.data(), ibByteSize);
+
+        MeshCacheEntry entry;
+        entry.VertexData = vertices.data();
+        entry.VertexByteStride = sizeof(CdlodPatchVertex);
+        entry.VertexCount = (UINT)vertices.size();
+        entry.IndexData = indices.data();
+        entry.IndexFormat = DXGI_FORMAT_R16_UINT;
+        entry.IndexCount = (UINT)indices.size();
+        for (UINT r = 0; r < (UINT)CdlodRegion::Count; ++r)
+        {
+            SubmeshGeometry region;
+            region.StartIndexCount = m_terrainPatchRanges[r].StartIndex;
+            region.IndexCount = m_terrainPatchRanges[r].IndexCount;
+            entry.Submeshes.push_back(std::make_pair("region" + std::to_string(r), region));
+        }
+        m_meshCache->Store(key.Value(), entry);
+    }
 
-    geo->VertexByteStride = sizeof(Vertex);
+    geo->VertexByteStride = sizeof(CdlodPatchVertex);
     geo->VertexBufferByteSize = vbByteSize;
     geo->IndexFormat = DXGI_FORMAT_R16_UINT;
     geo->IndexBufferByteSize = ibByteSize;
 
     SubmeshGeometry subMesh;
-    subMesh.BaseVertexLocation = 0;
-    subMesh.StartIndexCount = 0;
-    subMesh.IndexCount = (UINT)indices.size();
-
-    geo->DrawArags["grid"] = subMesh;
+    subMesh.IndexCount = m_terrainPatchRanges[(UINT)CdlodRegion::Full].IndexCount;
+    geo->DrawArags["patch"] = subMesh;
 
     m_geometries["landGeo"] = std::move(geo);
 }
 
 void LandAndWavesApp::BuildWaveGeometryBuffers()
 {
-    std::vector<std::uint16_t> indices((UINT64)3 * m_waves->GetTriangleCount());
-    assert(m_waves->GetVertexCount() < 0x0000ffff);
+    std::vector<std::uint32_t> indices((UINT64)3 * m_waves->GetTriangleCount());
 
     // Iterate over each quad.
     int m = m_waves->GetRowCount();
@@ -193,7 +299,9 @@ void LandAndWavesApp::BuildWaveGeometryBuffers()
     }
 
     UINT vbByteSize = m_waves->GetVertexCount() * sizeof(Vertex);
-    UINT ibByteSize = indices.size() * sizeof(std::uint16_t);
+
+    // Narrows to 16 bits when the wave grid allows it, otherwise stays 32-bit.
+    IndexBuffer indexBuffer(std::move(indices));
 
     std::unique_ptr<MeshGeometry> geo = std::make_unique<MeshGeometry>();
     geo->Name = "waterGeo";
@@ -202,19 +310,14 @@ void LandAndWavesApp::BuildWaveGeometryBuffers()
     geo->VertexBufferCPU = nullptr;
     geo->VertexBufferGPU = nullptr;
 
-    ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-    CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
-    geo->IndexBufferGPU = CreateDefaultBuffer(m_device.Get(), m_commandList.Get(), indices.data(),
-        ibByteSize, geo->IndexBufferUploader);
+    indexBuffer.CreateBuffers(*geo, *m_uploadBatch);
 
     geo->VertexByteStride = sizeof(Vertex);
     geo->VertexBufferByteSize = vbByteSize;
-    geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-    geo->IndexBufferByteSize = ibByteSize;
 
     SubmeshGeometry submesh;
-    submesh.IndexCount = (UINT)indices.size();
+    submesh.IndexCount = indexBuffer.Count();
+    submesh.SetBounds(m_waves->GetBounds());
     submesh.StartIndexCount = 0;
     submesh.BaseVertexLocation = 0;
 
@@ -223,6 +326,53 @@ void LandAndWavesApp::BuildWaveGeometryBuffers()
     m_geometries["waterGeo"] = std::move(geo);
 }
 
+void LandAndWavesApp::BuildProjectedWaterGeometry()
+{
+    ProjectedGridDesc gridDesc;
+    gridDesc.Columns = 160;
+    gridDesc.Rows = 96;
+    m_projectedGrid = std::make_unique<ProjectedGrid>(gridDesc);
+    m_projectedPositions.resize(m_projectedGrid->GetVertexCount());
+
+    m_waveSpectrum = WaveSpectrum({
+        { XMFLOAT2(1.0f, 0.3f), 24.0f, 0.25f, 6.0f, 0.0f },
+        { XMFLOAT2(-0.4f, 1.0f), 11.0f, 0.12f, 4.0f, 1.3f },
+        { XMFLOAT2(0.7f, -0.8f), 5.0f, 0.05f, 2.5f, 2.1f },
+    });
+
+    std::vector<std::uint32_t> indices;
+    m_projectedGrid->BuildIndices(indices);
+
+    // The grid is displaced every frame but its triangles never change, so
+    // the adjacency for its normals is built once here.
+    m_projectedNormalRecomputer = std::make_unique<NormalRecomputer>(indices.data(), indices.size(),
+        m_projectedGrid->GetVertexCount());
+    m_projectedNormals.assign(m_projectedGrid->GetVertexCount(), XMFLOAT3(0.0f, 1.0f, 0.0f));
+
+    IndexBuffer indexBuffer(std::move(indices));
+
+    std::unique_ptr<MeshGeometry> geo = std::make_unique<MeshGeometry>();
+    geo->Name = "projectedWaterGeo";
+
+    // Set dynamically.
+    geo->VertexBufferCPU = nullptr;
+    geo->VertexBufferGPU = nullptr;
+
+    indexBuffer.CreateBuffers(*geo, *m_uploadBatch);
+
+    geo->VertexByteStride = sizeof(Vertex);
+    geo->VertexBufferByteSize = m_projectedGrid->GetVertexCount() * sizeof(Vertex);
+
+    SubmeshGeometry submesh;
+    submesh.IndexCount = indexBuffer.Count();
+    submesh.StartIndexCount = 0;
+    submesh.BaseVertexLocation = 0;
+
+    geo->DrawArags["grid"] = submesh;
+
+    m_geometries["projectedWaterGeo"] = std::move(geo);
+}
+
 void LandAndWavesApp::BuildPSOs()
 {
     D3D12_GRAPHICS_PIPELINE_STATE_DESC opaquePsoDesc;
@@ -250,6 +400,18 @@ void LandAndWavesApp::BuildPSOs()
     D3D12_GRAPHICS_PIPELINE_STATE_DESC opaqueWireframePsoDesc = opaquePsoDesc;
     opaqueWireframePsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
     ThrowIfFailed(m_device->CreateGraphicsPipelineState(&opaqueWireframePsoDesc, IID_PPV_ARGS(&m_PSOs["opaque_wireframe"])));
+
+    // PSOs for the CDLOD terrain.
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC terrainPsoDesc = opaquePsoDesc;
+    terrainPsoDesc.InputLayout = { m_terrainInputLayout.data(),(UINT)m_terrainInputLayout.size() };
+    terrainPsoDesc.pRootSignature = m_terrainRootSignature.Get();
+    terrainPsoDesc.VS = CD3DX12_SHADER_BYTECODE(m_shaders["terrainVS"].Get());
+    terrainPsoDesc.PS = CD3DX12_SHADER_BYTECODE(m_shaders["terrainPS"].Get());
+    ThrowIfFailed(m_device->CreateGraphicsPipelineState(&terrainPsoDesc, IID_PPV_ARGS(&m_PSOs["terrain"])));
+
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC terrainWireframePsoDesc = terrainPsoDesc;
+    terrainWireframePsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
+    ThrowIfFailed(m_device->CreateGraphicsPipelineState(&terrainWireframePsoDesc, IID_PPV_ARGS(&m_PSOs["terrain_wireframe"])));
 }
 
 void LandAndWavesApp::BuildRenderItems()
@@ -266,27 +428,25 @@ void LandAndWavesApp::BuildRenderItems()
     m_waveRenderItem = wavesRenderItem.get();
     m_renderItemLayer[(int)RenderLayer::Opaque].push_back(wavesRenderItem.get());
 
-    std::unique_ptr<RenderItem> gridRenderItem = std::make_unique<RenderItem>();
-    gridRenderItem->World = DirectX::XMMatrixIdentity();
-    gridRenderItem->ObjectConstantBufferIndex = 1;
-    gridRenderItem->Geo = m_geometries["landGeo"].get();
-    gridRenderItem->IndexCount = gridRenderItem->Geo->DrawArags["grid"].IndexCount;
-    gridRenderItem->StartIndexLocation = gridRenderItem->Geo->DrawArags["grid"].StartIndexCount;
-    gridRenderItem->BaseVertexLocation = gridRenderItem->Geo->DrawArags["grid"].BaseVertexLocation;
-
-    m_renderItemLayer[(int)RenderLayer::Opaque].push_back(gridRenderItem.get());
-
     m_allRenderItems.push_back(std::move(wavesRenderItem));
-    m_allRenderItems.push_back(std::move(gridRenderItem));
 }
 
 void LandAndWavesApp::BuildFrameResources()
 {
     for (int i = 0; i < gNumFrameResources; ++i)
     {
-        m_frameResources.push_back(std::make_unique<FrameResource>(m_device.Get(), 1,
-            (UINT)m_allRenderItems.size(), m_waves->GetVertexCount()));
+        m_frameResources.push_back(std::make_unique<FrameResource>(m_device.Get(), 0, 0, 0, 0, 0));
     }
+
+    // Start with room for every frame in flight at the largest expected
+    // size; the ring grows if that is ever exceeded.
+    UINT waterVertexCount = std::max((UINT)m_waves->GetVertexCount(), m_projectedGrid->GetVertexCount());
+    UINT64 frameBytes = CalculateConstantBufferByteSize(sizeof(PassConstants)) +
+        (UINT64)m_allRenderItems.size() * CalculateConstantBufferByteSize(sizeof(ObjectConstants)) +
+        (UINT64)waterVertexCount * sizeof(Vertex) +
+        (UINT64)m_terrainLod->GetMaxPatchCount() * sizeof(CdlodPatch) +
+        2 * D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+    m_uploadRing = std::make_unique<UploadRing>(m_device.Get(), gNumFrameResources * frameBytes);
 }
 
 bool LandAndWavesApp::Initialize()
@@ -296,27 +456,31 @@ bool LandAndWavesApp::Initialize()
         return false;
     }
 
-    // Reset the command list to prep for initialization commands.
-    ThrowIfFailed(m_commandList->Reset(m_commandAllocator.Get(), nullptr));
+    // Initialization only uploads buffers, so it records nothing on the
+    // direct queue.
+    m_uploadBatch = std::make_unique<UploadBatch>(m_device.Get());
+
+    // A 2MB ring streaming 1MB a frame.
+    StreamingUploaderDesc streamingDesc;
+    streamingDesc.MaxBytesPerFrame = 1024 * 1024;
+    m_streamingBackend = std::make_unique<D3D12StreamingBackend>(m_device.Get(), 2 * streamingDesc.MaxBytesPerFrame);
+    m_streamer = std::make_unique<StreamingUploader>(*m_streamingBackend, streamingDesc);
 
     m_waves = std::make_unique<Waves>(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
+    m_wavesPyramid = std::make_unique<HeightFieldPyramid>(m_waves->GetHeightField());
 
     BuildRootSignature();
     BuildShadersAndInputLayout();
     BuildLandGeometry();
     BuildWaveGeometryBuffers();
-    BuildRenderItems();
+    BuildProjectedWaterGeometry();
     BuildRenderItems();
     BuildFrameResources();
     BuildPSOs();
 
-    // Execute the initialize commands.
-    ThrowIfFailed(m_commandList->Close());
-    ID3D12CommandList* cmdLists[] = { m_commandList.Get() };
-    m_commandQueue->ExecuteCommandLists(_countof(cmdLists), cmdLists);
-
-    // Wait until initialization is completed.
-    FlushCommandQueue();
+    // The first frame waits for the copies on the GPU instead of the CPU
+    // waiting here.
+    m_uploadBatch->Submit(m_commandQueue.Get());
 
     return true;
 }
@@ -334,6 +498,11 @@ void LandAndWavesApp::OnMouseDown(WPARAM btnState, int x, int y)
     m_lastMousePos.x = x;
     m_lastMousePos.y = y;
 
+    if ((btnState & MK_MBUTTON) != 0)
+    {
+        Pick(x, y);
+    }
+
     SetCapture(m_hMainWnd);
 }
 
@@ -392,25 +561,30 @@ void LandAndWavesApp::OnKeyboardInput(const GameTimer& gt)
     {
         m_isWireFrame = false;
     }
+
+    bool projectedWaterKeyDown = (GetAsyncKeyState('2') & 0x8000) != 0;
+    if (projectedWaterKeyDown && !m_projectedWaterKeyDown)
+    {
+        m_isProjectedWater = !m_isProjectedWater;
+
+        const char* geoName = m_isProjectedWater ? "projectedWaterGeo" : "waterGeo";
+        m_waveRenderItem->Geo = m_geometries[geoName].get();
+        m_waveRenderItem->IndexCount = m_waveRenderItem->Geo->DrawArags["grid"].IndexCount;
+    }
+    m_projectedWaterKeyDown = projectedWaterKeyDown;
 }
 
 void LandAndWavesApp::UpdateObjectConstantBuffers(const GameTimer& gt)
 {
-    auto currentObjectCB = m_currentFrameResource->m_objCB.get();
+    // Ring allocations only live for one frame, so every object's constants
+    // are written each frame and render items can come and go freely.
+    m_objectCBAddresses.resize(m_allRenderItems.size());
     for (auto& e : m_allRenderItems)
     {
-        // Only update the cbuffer data if the constants have changed.
-        // This needs to be tracked per frame resource.
-        if (e->NumFrameDirty > 0)
-        {
-            ObjectConstants obj;
-            obj.World = XMMatrixTranspose(e->World);
-
-            currentObjectCB->CopyData(e->ObjectConstantBufferIndex, obj);
+        ObjectConstants obj;
+        obj.World = XMMatrixTranspose(e->World);
 
-            // Next frame resource need to be updated too.
-            e->NumFrameDirty--;
-        }
+        m_objectCBAddresses[e->ObjectConstantBufferIndex] = m_uploadRing->AllocateConstants(obj);
     }
 }
 
@@ -436,8 +610,7 @@ void LandAndWavesApp::UpdateMainPassConstantBuffer(const GameTimer& gt)
     m_mainPassConstantBuffer.DeltaTime = gt.DeltaTime();
     m_mainPassConstantBuffer.TotalTime = gt.TotalTime();
 
-    UploadBuffer<PassConstants>* currentPassConstantBuffer = m_currentFrameResource->m_passCB.get();
-    currentPassConstantBuffer->CopyData(0, m_mainPassConstantBuffer);
+    m_passCBAddress = m_uploadRing->AllocateConstants(m_mainPassConstantBuffer);
 }
 
 void LandAndWavesApp::UpdateWaves(const GameTimer& gt)
@@ -458,8 +631,27 @@ void LandAndWavesApp::UpdateWaves(const GameTimer& gt)
     // Update the wave simulation.
     m_waves->Update(gt.DeltaTime());
 
+    // Refit the picking pyramid over just the rows that changed.
+    int firstRow = 0;
+    int endRow = 0;
+    if (m_waves->TakeDirtyRows(firstRow, endRow))
+    {
+        m_wavesPyramid->UpdateRows(m_waves->GetHeightField().Data, firstRow, endRow);
+    }
+
+    if (m_isProjectedWater)
+    {
+        UpdateProjectedWater(gt);
+        return;
+    }
+    m_isWaterVisible = true;
+
+    // The simulation tracks its height range as it goes, so this is cheap.
+    m_waveRenderItem->Geo->DrawArags["grid"].SetBounds(m_waves->GetBounds());
+
     // Update the wave vertex buffer with the new solution.
-    UploadBuffer<Vertex>* currentWavesVB = m_currentFrameResource->m_wavesVB.get();
+    UploadAllocation wavesVB = m_uploadRing->Allocate((UINT64)m_waves->GetVertexCount() * sizeof(Vertex), 16);
+    Vertex* vertices = static_cast<Vertex*>(wavesVB.CPU);
 
     for (int i = 0; i < m_waves->GetVertexCount(); ++i)
     {
@@ -467,12 +659,110 @@ void LandAndWavesApp::UpdateWaves(const GameTimer& gt)
 
         v.Pos = m_waves->Position(i);
         v.Color = XMFLOAT4(DirectX::Colors::Blue);
+        v.Normal = m_waves->Normal(i);
 
-        currentWavesVB->CopyData(i, v);
+        vertices[i] = v;
     }
 
-    // Set the dynamic VB of the wave render item to the current frame VB.
-    m_waveRenderItem->Geo->VertexBufferGPU = currentWavesVB->Resource();
+    // Point the dynamic VB of the wave render item at this frame's vertices.
+    m_waveRenderItem->Geo->VertexBufferGPU = wavesVB.Resource;
+    m_waveRenderItem->Geo->VertexBufferOffset = wavesVB.Offset;
+}
+
+void LandAndWavesApp::UpdateProjectedWater(const GameTimer& gt)
+{
+    XMMATRIX viewProj = XMMatrixMultiply(m_view, m_proj);
+    XMMATRIX invViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
+
+    // The simulated pool sits inside the open water; its boundary is pinned
+    // at zero, so adding the spectrum everywhere leaves no seam.
+    m_waveSpectrum.SetTime(gt.TotalTime());
+    const HeightFieldPyramid& pool = *m_wavesPyramid;
+    const WaveSpectrum& spectrum = m_waveSpectrum;
+    auto heights = [&pool, &spectrum](const float* x, const float* z, size_t count, float* h)
+    {
+        spectrum.GetHeights(x, z, count, h);
+        for (size_t i = 0; i < count; ++i)
+        {
+            float poolHeight = 0.0f;
+            if (pool.GetHeight(x[i], z[i], poolHeight))
+            {
+                h[i] += poolHeight;
+            }
+        }
+    };
+    m_isWaterVisible = m_projectedGrid->Project(invViewProj, heights, m_projectedPositions.data());
+    if (!m_isWaterVisible)
+    {
+        return;
+    }
+    m_waveRenderItem->Geo->DrawArags["grid"].SetBounds(m_projectedGrid->GetBounds());
+
+    m_projectedNormalRecomputer->ComputeNormals(m_projectedPositions.data(), sizeof(XMFLOAT3),
+        m_projectedNormals.data(), sizeof(XMFLOAT3));
+
+    UploadAllocation wavesVB = m_uploadRing->Allocate(m_projectedPositions.size() * sizeof(Vertex), 16);
+    Vertex* vertices = static_cast<Vertex*>(wavesVB.CPU);
+    for (size_t i = 0; i < m_projectedPositions.size(); ++i)
+    {
+        Vertex v;
+        v.Pos = m_projectedPositions[i];
+        v.Color = XMFLOAT4(DirectX::Colors::Blue);
+        v.Normal = m_projectedNormals[i];
+        vertices[i] = v;
+    }
+
+    m_waveRenderItem->Geo->VertexBufferGPU = wavesVB.Resource;
+    m_waveRenderItem->Geo->VertexBufferOffset = wavesVB.Offset;
+}
+
+void LandAndWavesApp::Pick(int x, int y)
+{
+    XMFLOAT4X4 proj;
+    XMStoreFloat4x4(&proj, m_proj);
+
+    // Ray through the pixel in view space, then in world space.
+    float vx = (2.0f * x / m_width - 1.0f) / proj(0, 0);
+    float vy = (-2.0f * y / m_height + 1.0f) / proj(1, 1);
+
+    XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(m_view), m_view);
+    XMVECTOR origin = XMVector3TransformCoord(XMVectorZero(), invView);
+    XMVECTOR direction = XMVector3Normalize(XMVector3TransformNormal(XMVectorSet(vx, vy, 1.0f, 0.0f), invView));
+
+    const float maxDistance = 1000.0f;
+    HeightFieldHit landHit;
+    HeightFieldHit waterHit;
+    m_landPyramid->Intersect(origin, direction, maxDistance, landHit);
+    m_wavesPyramid->Intersect(origin, direction, maxDistance, waterHit);
+
+    // Land in front of the water blocks the pick.
+    if (waterHit.Hit && (!landHit.Hit || waterHit.T < landHit.T))
+    {
+        // Disturb keeps two rows and columns clear of the pinned boundary.
+        int i = std::min(std::max((int)waterHit.Row, 2), m_waves->GetRowCount() - 3);
+        int j = std::min(std::max((int)waterHit.Column, 2), m_waves->GetColumnCount() - 3);
+        m_waves->Disturb(i, j, 1.0f);
+    }
+}
+
+void LandAndWavesApp::UpdateTerrainLod(const GameTimer& gt)
+{
+    // Select against the world-space view frustum.
+    XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(m_view), m_view);
+    BoundingFrustum frustum(m_proj);
+    frustum.Transform(frustum, invView);
+
+    XMVECTOR eyePos = XMLoadFloat3(&m_cameraPos);
+    m_terrainLod->Select(eyePos, frustum, m_terrainSelection);
+
+    m_terrainPatchAllocation = UploadAllocation();
+    if (!m_terrainSelection.Patches.empty())
+    {
+        m_terrainPatchAllocation = m_uploadRing->Allocate(m_terrainSelection.Patches.size() * sizeof(CdlodPatch), 16);
+        StreamToUploadHeap(m_terrainPatchAllocation.CPU, m_terrainSelection.Patches.data(),
+            (size_t)m_terrainPatchAllocation.Size);
+        _mm_sfence();
+    }
 }
 
 void LandAndWavesApp::Update(const GameTimer& gt)
@@ -486,43 +776,87 @@ void LandAndWavesApp::Update(const GameTimer& gt)
 
     // Has the GPU finished processing the commands of the current frame resource?
     // If not, wait until the GPU has completed commands up to this fence point.
-    if (m_currentFrameResource->m_fence != 0 && m_fence->GetCompletedValue() < m_currentFrameResource->m_fence)
+    if (m_currentFrameResource->m_fence != 0)
     {
-        HANDLE eventHandle = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
-        ThrowIfFailed(m_fence->SetEventOnCompletion(m_currentFrameResource->m_fence, eventHandle));
-        WaitForSingleObject(eventHandle, INFINITE);
-        CloseHandle(eventHandle);
+        WaitForFence(m_currentFrameResource->m_fence);
     }
 
+    // Hands back the ring space of every frame the GPU has finished.
+    m_uploadRing->BeginFrame(m_fence->GetCompletedValue());
+    m_uploadBatch->ReleaseCompleted();
+    m_streamer->Update();
+
     UpdateObjectConstantBuffers(gt);
     UpdateMainPassConstantBuffer(gt);
     UpdateWaves(gt);
+    UpdateTerrainLod(gt);
 }
 
 void LandAndWavesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& RenderItems)
 {
-    UINT objCBByteSize = CalculateConstantBufferByteSize(sizeof(ObjectConstants));
-
-    ID3D12Resource* objectCB = m_currentFrameResource->m_objCB->Resource();
-
     // For each render item.
     for (size_t i = 0; i < RenderItems.size(); ++i)
     {
         RenderItem* ri = RenderItems[i];
+        if (ri == m_waveRenderItem && !m_isWaterVisible)
+        {
+            continue;
+        }
 
         cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
         cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
         cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
 
-        D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress();
-        objCBAddress += (UINT64)ri->ObjectConstantBufferIndex * objCBByteSize;
-
-        cmdList->SetGraphicsRootConstantBufferView(0, objCBAddress);
+        cmdList->SetGraphicsRootConstantBufferView(0, m_objectCBAddresses[ri->ObjectConstantBufferIndex]);
 
         cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
     }
 }
 
+void LandAndWavesApp::DrawTerrain(ID3D12GraphicsCommandList* cmdList)
+{
+    if (m_terrainSelection.Patches.empty() || !m_terrainHeightsReady)
+    {
+        return;
+    }
+
+    const CdlodDesc& lodDesc = m_terrainLod->GetDesc();
+    TerrainLodConstants constants;
+    constants.HeightOrigin = lodDesc.Origin;
+    constants.HeightSpacing = lodDesc.Spacing;
+    constants.HeightResolution = m_terrainLod->GetResolution();
+    constants.PatchQuads = (float)lodDesc.PatchQuads;
+    constants.SkirtDepth = lodDesc.SkirtDepth;
+
+    cmdList->SetPipelineState(m_PSOs[m_isWireFrame ? "terrain_wireframe" : "terrain"].Get());
+    cmdList->SetGraphicsRootSignature(m_terrainRootSignature.Get());
+    cmdList->SetGraphicsRoot32BitConstants(0, sizeof(TerrainLodConstants) / 4, &constants, 0);
+    cmdList->SetGraphicsRootConstantBufferView(1, m_passCBAddress);
+    cmdList->SetGraphicsRootShaderResourceView(2, m_terrainHeights->GetGPUVirtualAddress());
+
+    MeshGeometry* landGeo = m_geometries["landGeo"].get();
+
+    D3D12_VERTEX_BUFFER_VIEW vertexBuffers[2];
+    vertexBuffers[0] = landGeo->VertexBufferView();
+    vertexBuffers[1] = m_terrainPatchAllocation.VertexBufferView(sizeof(CdlodPatch));
+
+    cmdList->IASetVertexBuffers(0, 2, vertexBuffers);
+    cmdList->IASetIndexBuffer(&landGeo->IndexBufferView());
+    cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+    // One instanced draw per region of the patch mesh.
+    for (UINT r = 0; r < (UINT)CdlodRegion::Count; ++r)
+    {
+        UINT instanceCount = m_terrainSelection.RegionCount((CdlodRegion)r);
+        if (instanceCount > 0)
+        {
+            const CdlodIndexRange& range = m_terrainPatchRanges[r];
+            cmdList->DrawIndexedInstanced(range.IndexCount, instanceCount, range.StartIndex, 0,
+                m_terrainSelection.RegionStart[r]);
+        }
+    }
+}
+
 void LandAndWavesApp::Draw(const GameTimer& gt)
 {
     // Reuse the memory associated with command recording.
@@ -546,9 +880,8 @@ void LandAndWavesApp::Draw(const GameTimer& gt)
     m_commandList->RSSetScissorRects(1, &m_scissorRect);
 
     // Indicate a state transition on the resource usage.
-    m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-        CurrentBackBuffer(), D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET
-    ));
+    m_barriers.Transition(CurrentBackBuffer(), D3D12_RESOURCE_STATE_RENDER_TARGET);
+    m_barriers.FlushBarriers(m_commandList.Get());
 
     // Clear the back buffer and depth buffer.
     m_commandList->ClearRenderTargetView(CurrentBackBufferView(), Colors::GhostWhite, 0, nullptr);
@@ -560,22 +893,16 @@ void LandAndWavesApp::Draw(const GameTimer& gt)
     m_commandList->SetGraphicsRootSignature(m_rootSignature.Get());
 
     // Bind per-pass constant buffer. We only need to do this once per-pass.
-    auto passCB = m_currentFrameResource->m_passCB->Resource();
-    m_commandList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress());
+    m_commandList->SetGraphicsRootConstantBufferView(1, m_passCBAddress);
 
     DrawRenderItems(m_commandList.Get(), m_renderItemLayer[(int)RenderLayer::Opaque]);
+    DrawTerrain(m_commandList.Get());
 
     // Indicate a state transition on the resource usage.
-    m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-        CurrentBackBuffer(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT
-    ));
+    m_barriers.Transition(CurrentBackBuffer(), D3D12_RESOURCE_STATE_PRESENT);
 
-    // Done recording commands.
-    ThrowIfFailed(m_commandList->Close());
-
-    // Add the command list to the queue for execution.
-    ID3D12CommandList* cmdLists[] = { m_commandList.Get() };
-    m_commandQueue->ExecuteCommandLists(_countof(cmdLists), cmdLists);
+    // Done recording commands; execute them after the barriers they start with.
+    ExecuteCommandList(m_commandList.Get(), m_barriers);
 
     // Swap the back and front buffers.
     ThrowIfFailed(m_swapchain->Present(0, 0));
@@ -588,5 +915,8 @@ void LandAndWavesApp::Draw(const GameTimer& gt)
     // Because we are on the GPU timeline, the new fence point won't be set
     // the GPU finishes processing all the commands prior to this signal().
     m_commandQueue->Signal(m_fence.Get(), m_currentFence);
+
+    // This frame's ring allocations are in use until the fence passes.
+    m_uploadRing->EndFrame(m_currentFence);
 }
 #endif
\ No newline at end of file
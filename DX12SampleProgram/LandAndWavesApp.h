@@ -5,6 +5,14 @@
 #include "UploadBuffer.h"
 #include "FrameResource.h"
 #include "Waves.h"
+#include "TerrainLod.h"
+#include "HeightTiles.h"
+#include "HeightFieldPyramid.h"
+#include "ProjectedGrid.h"
+#include "MeshNormals.h"
+#include "UploadRing.h"
+#include "UploadBatch.h"
+#include "StreamingUploader.h"
 
 #ifndef IS_ENABLE_LAND_APP
 #define IS_ENABLE_LAND_APP 1
@@ -35,31 +43,56 @@ private:
     void UpdateObjectConstantBuffers(const GameTimer& gt);
     void UpdateMainPassConstantBuffer(const GameTimer& gt);
     void UpdateWaves(const GameTimer& gt);
+    void UpdateProjectedWater(const GameTimer& gt);
+    void UpdateTerrainLod(const GameTimer& gt);
+
+    // Casts the ray under pixel (x, y) against the land and the water; a hit
+    // on the water disturbs it.
+    void Pick(int x, int y);
 
     void BuildRootSignature();
     void BuildShadersAndInputLayout();
     void BuildLandGeometry();
+    void BakeLandHeightMap(const std::wstring& fileName, const CdlodDesc& lodDesc);
     void BuildWaveGeometryBuffers();
+    void BuildProjectedWaterGeometry();
     void BuildPSOs();
     void BuildFrameResources();
     void BuildRenderItems();
     void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& RenderItems);
-
-    float GetHillsHeight(float x, float z)const;
-    DirectX::XMFLOAT3 GetHillsNormal(float x, float z)const;
+    void DrawTerrain(ID3D12GraphicsCommandList* cmdList);
 
 private:
     std::vector<std::unique_ptr<FrameResource>> m_frameResources;
     FrameResource* m_currentFrameResource = nullptr;
     UINT m_currentFrameResourceIndex = 0;
 
+    // Constants, water vertices and terrain patches are written to the ring
+    // each frame; the frame resources only hold the command allocators.
+    std::unique_ptr<UploadRing> m_uploadRing;
+
+    // Static geometry is uploaded on a copy queue; the staging memory goes
+    // away on its own once the copies are done.
+    std::unique_ptr<UploadBatch> m_uploadBatch;
+
+    // The terrain heights stream in on their own copy queue over the first
+    // frames; the land is not drawn until they are in.
+    std::unique_ptr<D3D12StreamingBackend> m_streamingBackend;
+    std::unique_ptr<StreamingUploader> m_streamer;
+    bool m_terrainHeightsReady = false;
+    D3D12_GPU_VIRTUAL_ADDRESS m_passCBAddress = 0;
+    std::vector<D3D12_GPU_VIRTUAL_ADDRESS> m_objectCBAddresses;
+    UploadAllocation m_terrainPatchAllocation;
+
     ComPtr<ID3D12RootSignature> m_rootSignature = nullptr;
+    ComPtr<ID3D12RootSignature> m_terrainRootSignature = nullptr;
 
     std::unordered_map<std::string, std::unique_ptr<MeshGeometry>>  m_geometries;
     std::unordered_map<std::string, ComPtr<ID3DBlob>>   m_shaders;
     std::unordered_map<std::string, ComPtr<ID3D12PipelineState>>    m_PSOs;
 
     std::vector<D3D12_INPUT_ELEMENT_DESC>   m_inputLayout;
+    std::vector<D3D12_INPUT_ELEMENT_DESC>   m_terrainInputLayout;
 
     RenderItem* m_waveRenderItem = nullptr;
 
@@ -71,6 +104,33 @@ private:
 
     std::unique_ptr<Waves>  m_waves;
 
+    // The land is drawn with CDLOD: the patches selected each frame are
+    // instances of the shared patch mesh in m_geometries["landGeo"].
+    std::unique_ptr<CdlodQuadtree>  m_terrainLod;
+    CdlodIndexRange m_terrainPatchRanges[(UINT)CdlodRegion::Count];
+    CdlodSelection  m_terrainSelection;
+    ComPtr<ID3D12Resource>  m_terrainHeights = nullptr;
+
+    // Min/max pyramids for picking. The waves one is refitted after every
+    // simulation step.
+    std::unique_ptr<HeightFieldPyramid> m_landPyramid;
+    std::unique_ptr<HeightFieldPyramid> m_wavesPyramid;
+
+    // Projected-grid water, toggled with '2': the wave render item then draws
+    // m_geometries["projectedWaterGeo"], a screen-space grid projected onto
+    // the water plane, with the Waves heights plus a sine spectrum.
+    std::unique_ptr<ProjectedGrid>  m_projectedGrid;
+    WaveSpectrum    m_waveSpectrum;
+    std::vector<DirectX::XMFLOAT3>  m_projectedPositions;
+    std::unique_ptr<NormalRecomputer>   m_projectedNormalRecomputer;
+    std::vector<DirectX::XMFLOAT3>  m_projectedNormals;
+    bool m_isProjectedWater = false;
+    bool m_projectedWaterKeyDown = false;
+
+    // False while the projected grid sees no water; the wave render item is
+    // then skipped.
+    bool m_isWaterVisible = true;
+
     PassConstants m_mainPassConstantBuffer;
 
     bool m_isWireFrame = false;
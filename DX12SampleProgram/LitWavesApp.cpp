@@ -72,67 +72,157 @@ void LitWavesApp::BuildShadersAndInputLayout()
         { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
         { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
     };
+
+    ThrowIfFailed(D3DCompileFromFile(L"BakedLighting.hlsl", nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE,
+        "VSMain", "vs_5_0", compileFlag, 0, &m_shaders["bakedVS"], nullptr));
+    ThrowIfFailed(D3DCompileFromFile(L"BakedLighting.hlsl", nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE,
+        "PSMain", "ps_5_0", compileFlag, 0, &m_shaders["bakedPS"], nullptr));
+
+    // Positions from the land's vertex buffer, baked colors from slot 1.
+    m_bakedInputLayout =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+    };
 }
 
 void LitWavesApp::BuildLandGeometry()
 {
-    GeometryGenerator geoGen;
-    GeometryGenerator::MeshData grid = geoGen.CreateGrid(160.0f, 160.0f, 50, 50);
-
-    // Extract the vertex elements we are interested and apply the height function to 
-    // each vertex. In addition, color the vertices based on their height so we have 
-    // sandy looking beaches, grassy low hills, and snow mountain peaks.
+    const float gridWidth = 160.0f;
+    const float gridDepth = 160.0f;
+    const UINT gridRows = 50;
+    const UINT gridColumns = 50;
 
-    std::vector<Vertex> vertices;
-    const size_t verticesSize = (size_t)grid.Vertices.size();
-    for (size_t i = 0; i < verticesSize; ++i)
-    {
-        XMFLOAT3& p = grid.Vertices[i].Position;
-        vertices[i].Pos = p;
-        vertices[i].Pos.y = GetHillsHeight(p.x, p.z);
-        vertices[i].Normal = GetHillsNormal(p.x, p.z);
-    }
-
-    const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+    GeometryGenerator geoGen;
+    GeometryGenerator::MeshCounts gridCounts = geoGen.GridCounts(gridRows, gridColumns);
 
-    std::vector<std::uint16_t> indices = grid.GetIndices16();
-    const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+    const DXGI_FORMAT indexFormat = SelectIndexFormat(gridCounts.VertexCount);
+    const UINT vbByteSize = gridCounts.VertexCount * sizeof(Vertex);
+    const UINT ibByteSize = gridCounts.IndexCount * IndexFormatByteSize(indexFormat);
 
     std::unique_ptr<MeshGeometry> geo = std::make_unique<MeshGeometry>();
     geo->Name = "landGeo";
 
     ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-    CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-
     ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-    CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+    void* vertices = geo->VertexBufferCPU->GetBufferPointer();
+    void* indices = geo->IndexBufferCPU->GetBufferPointer();
+
+    // Generate the grid straight into the blobs. The vertex writer extracts the
+    // elements we are interested in and applies the height function to each vertex.
+    GeometryGenerator::MeshWriter writer;
+    writer.VertexData = vertices;
+    writer.VertexStride = sizeof(Vertex);
+    writer.Context = this;
+    writer.IndexData = indices;
+    writer.IndexByteWidth = IndexFormatByteSize(indexFormat);
+    writer.WriteVertex = [](void* dst, const GeometryGenerator::Vertex& v, void* context)
+    {
+        const LitWavesApp* app = static_cast<const LitWavesApp*>(context);
+        Vertex* vertex = static_cast<Vertex*>(dst);
+        *vertex = Vertex();
+        vertex->Pos = v.Position;
+        vertex->Pos.y = app->GetHillsHeight(v.Position.x, v.Position.z);
+        vertex->Normal = app->GetHillsNormal(v.Position.x, v.Position.z);
+    };
+    geoGen.GenerateGrid(gridWidth, gridDepth, gridRows, gridColumns, writer);
 
     geo->VertexBufferGPU = CreateDefaultBuffer(m_device.Get(), m_commandList.Get(),
-        vertices.data(), vbByteSize, geo->VertexBufferUploader);
+        vertices, vbByteSize, geo->VertexBufferUploader);
 
-    geo->IndexBufferGPU = CreateDefaultBuffer(m_device.Get(), m_commandList.Get(), indices.data(),
+    geo->IndexBufferGPU = CreateDefaultBuffer(m_device.Get(), m_commandList.Get(), indices,
         ibByteSize, geo->IndexBufferUploader);
 
+    // The uploaders go once the initialization commands have run.
+    DeferRelease(geo->VertexBufferUploader);
+    DeferRelease(geo->IndexBufferUploader);
+    geo->DisposeUploaders();
+
     geo->VertexByteStride = sizeof(Vertex);
     geo->VertexBufferByteSize = vbByteSize;
-    geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+    geo->IndexFormat = indexFormat;
     geo->IndexBufferByteSize = ibByteSize;
 
     SubmeshGeometry submesh;
     submesh.BaseVertexLocation = 0;
     submesh.StartIndexCount = 0;
-    submesh.IndexCount = (UINT)indices.size();
+    submesh.IndexCount = gridCounts.IndexCount;
+    submesh.SetBounds(ComputeVertexBounds(vertices, sizeof(Vertex), gridCounts.VertexCount));
 
     geo->DrawArags["grid"] = submesh;
 
     m_geometries["landGeo"] = std::move(geo);
+
+    // GenerateGrid lays rows out from +z towards -z.
+    HeightFieldDesc heightField;
+    heightField.Data = &static_cast<const Vertex*>(vertices)->Pos.y;
+    heightField.ColumnStride = sizeof(Vertex);
+    heightField.RowStride = gridColumns * sizeof(Vertex);
+    heightField.Columns = gridColumns;
+    heightField.Rows = gridRows;
+    heightField.OriginX = -0.5f * gridWidth;
+    heightField.OriginZ = 0.5f * gridDepth;
+    heightField.SpacingX = gridWidth / (gridColumns - 1);
+    heightField.SpacingZ = -gridDepth / (gridRows - 1);
+    m_landHeights = std::make_unique<HeightFieldPyramid>(heightField);
+
+    StaticLightingVertices landVertices;
+    landVertices.Positions = &static_cast<const Vertex*>(vertices)->Pos;
+    landVertices.Normals = &static_cast<const Vertex*>(vertices)->Normal;
+    landVertices.Stride = sizeof(Vertex);
+    landVertices.Count = gridCounts.VertexCount;
+
+    HorizonOcclusionDesc occlusionDesc;
+    occlusionDesc.Radius = 24.0f;
+    m_landVisibility.resize(gridCounts.VertexCount);
+    ComputeHorizonOcclusion(*m_landHeights, occlusionDesc, landVertices, m_landVisibility.data());
+}
+
+Light LitWavesApp::GetSunLight()const
+{
+    Light sun;
+    XMVECTOR lightDir = -myMathLibrary::SphericalToCartesian(1.0f, m_sunTheta, m_sunPhi);
+    XMStoreFloat3(&sun.Direction, lightDir);
+    sun.Strength = { 1.0f,1.0f,0.9f };
+    return sun;
+}
+
+void LitWavesApp::BakeLandLighting()
+{
+    const MeshGeometry* geo = m_geometries["landGeo"].get();
+    const Vertex* vertices = static_cast<const Vertex*>(geo->VertexBufferCPU->GetBufferPointer());
+
+    StaticLightingVertices landVertices;
+    landVertices.Positions = &vertices->Pos;
+    landVertices.Normals = &vertices->Normal;
+    landVertices.Stride = sizeof(Vertex);
+    landVertices.Count = m_landVisibility.size();
+
+    // Same lights as the pass constants. Highlights follow the viewer, so
+    // only the diffuse and ambient terms are baked.
+    StaticLightingDesc desc;
+    desc.AmbientLight = m_mainPassCB.AmbientLight;
+    desc.Lights[0] = GetSunLight();
+    desc.DirectionalLightCount = 1;
+
+    const Material* grass = m_materials["grass"].get();
+    MaterialConstants material;
+    material.DiffuseAlbedo = grass->DiffuseAlbedo;
+    material.FresnelR0 = grass->FresnelR0;
+    material.Roughness = grass->Roughness;
+
+    m_landColors.resize(landVertices.Count);
+    BakeVertexLighting(desc, material, landVertices, m_landVisibility.data(), m_landColors.data());
+    m_landColorsFramesDirty = gNumFrameResources;
+
+    m_bakedSunTheta = m_sunTheta;
+    m_bakedSunPhi = m_sunPhi;
 }
 
 void LitWavesApp::BuildWavesGeometryBuffers()
 {
     // 3 indices per face.
-    std::vector<std::uint16_t> indices((size_t)3 * m_waves->GetTriangleCount());
-    assert(m_waves->GetVertexCount() < 0x0000ffff);
+    std::vector<std::uint32_t> indices((size_t)3 * m_waves->GetTriangleCount());
 
     // Iterate over each quad.
     int m = m_waves->GetRowCount();
@@ -155,7 +245,9 @@ void LitWavesApp::BuildWavesGeometryBuffers()
     }
 
     UINT vbByteSize = m_waves->GetVertexCount() * sizeof(Vertex);
-    UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+
+    // Narrows to 16 bits when the wave grid allows it, otherwise stays 32-bit.
+    IndexBuffer indexBuffer(std::move(indices));
 
     std::unique_ptr<MeshGeometry> geo = std::make_unique<MeshGeometry>();
     geo->Name = "waterGeo";
@@ -164,19 +256,19 @@ void LitWavesApp::BuildWavesGeometryBuffers()
     geo->VertexBufferGPU = nullptr;
     geo->VertexBufferCPU = nullptr;
 
-    ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-    CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+    indexBuffer.CreateBuffers(*geo, m_device.Get(), m_commandList.Get());
 
-    geo->IndexBufferGPU = CreateDefaultBuffer(m_device.Get(), m_commandList.Get(),
-        indices.data(), ibByteSize, geo->IndexBufferUploader);
+    // As for the land, the uploader goes once the initialization commands
+    // have run.
+    DeferRelease(geo->IndexBufferUploader);
+    geo->DisposeUploaders();
 
     geo->VertexByteStride = sizeof(Vertex);
     geo->VertexBufferByteSize = vbByteSize;
-    geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-    geo->IndexBufferByteSize = ibByteSize;
 
     SubmeshGeometry submesh;
-    submesh.IndexCount = (UINT)indices.size();
+    submesh.IndexCount = indexBuffer.Count();
+    submesh.SetBounds(m_waves->GetBounds());
     submesh.StartIndexCount = 0;
     submesh.BaseVertexLocation = 0;
 
@@ -233,6 +325,7 @@ void LitWavesApp::BuildRenderItems()
     gridRenderItem->BaseVertexLocation = gridRenderItem->Geo->DrawArags["grid"].BaseVertexLocation;
     gridRenderItem->StartIndexLocation = gridRenderItem->Geo->DrawArags["grid"].StartIndexCount;
 
+    m_landItem = gridRenderItem.get();
     m_renderItemLayer[(int)RenderLayer::Opaque].push_back(gridRenderItem.get());
 
     m_allRenderItems.push_back(std::move(wavesRenderItem));
@@ -245,6 +338,8 @@ void LitWavesApp::BuildFrameResources()
     {
         m_frameResources.push_back(std::make_unique<FrameResource>(m_device.Get(),
             1, (UINT)m_allRenderItems.size(), (UINT)m_waves->GetVertexCount(), (UINT)m_materials.size()));
+        m_landBakedColors.push_back(std::make_unique<UploadBuffer<XMFLOAT4>>(m_device.Get(),
+            (UINT)m_landVisibility.size(), false));
     }
 }
 
@@ -274,6 +369,17 @@ void LitWavesApp::BuildPSOs()
     D3D12_GRAPHICS_PIPELINE_STATE_DESC opaqueWireframePsoDesc = opaquePsoDesc;
     opaqueWireframePsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
     ThrowIfFailed(m_device->CreateGraphicsPipelineState(&opaqueWireframePsoDesc, IID_PPV_ARGS(&m_PSOs["opaque_wireframe"])));
+
+    // PSOs for the baked lighting variant.
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC bakedPsoDesc = opaquePsoDesc;
+    bakedPsoDesc.InputLayout = { m_bakedInputLayout.data(),(UINT)m_bakedInputLayout.size() };
+    bakedPsoDesc.VS = CD3DX12_SHADER_BYTECODE(m_shaders["bakedVS"].Get());
+    bakedPsoDesc.PS = CD3DX12_SHADER_BYTECODE(m_shaders["bakedPS"].Get());
+    ThrowIfFailed(m_device->CreateGraphicsPipelineState(&bakedPsoDesc, IID_PPV_ARGS(&m_PSOs["baked"])));
+
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC bakedWireframePsoDesc = bakedPsoDesc;
+    bakedWireframePsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
+    ThrowIfFailed(m_device->CreateGraphicsPipelineState(&bakedWireframePsoDesc, IID_PPV_ARGS(&m_PSOs["baked_wireframe"])));
 }
 
 bool LitWavesApp::Initialize()
@@ -297,6 +403,9 @@ bool LitWavesApp::Initialize()
     BuildFrameResources();
     BuildPSOs();
 
+    m_mainPassCB.AmbientLight = { 0.25f,0.25f,0.35f,1.0f };
+    BakeLandLighting();
+
     // Execute the initialization commands.
     ThrowIfFailed(m_commandList->Close());
     ID3D12CommandList* cmdLists[] = { m_commandList.Get() };
@@ -348,6 +457,18 @@ void LitWavesApp::OnKeyboardInput(const GameTimer& gt)
     {
         m_isWireFrame = false;
     }
+
+    bool bakedLightingKeyDown = (GetAsyncKeyState('2') & 0x8000) != 0;
+    if (bakedLightingKeyDown && !m_bakedLightingKeyDown)
+    {
+        m_isBakedLighting = !m_isBakedLighting;
+    }
+    m_bakedLightingKeyDown = bakedLightingKeyDown;
+
+    if (m_isBakedLighting && (m_sunTheta != m_bakedSunTheta || m_sunPhi != m_bakedSunPhi))
+    {
+        BakeLandLighting();
+    }
 }
 
 void LitWavesApp::UpdateCamera(const GameTimer& gt)
@@ -370,7 +491,11 @@ void LitWavesApp::UpdateCamera(const GameTimer& gt)
 
 void LitWavesApp::UpdateObjectConstantBuffers(const GameTimer& gt)
 {
-    UploadBuffer<ObjectConstants>* currentObjectCB = m_currentFrameResource->m_objCB.get();
+    // Gather the dirty objects and write them out in one scatter.
+    std::vector<UINT>& indices = m_dirtyIndices;
+    std::vector<ObjectConstants>& constants = m_dirtyObjectConstants;
+    indices.clear();
+    constants.clear();
     for (auto& e : m_allRenderItems)
     {
         // Only update the cbuffer data if the constants have changed.
@@ -382,17 +507,22 @@ void LitWavesApp::UpdateObjectConstantBuffers(const GameTimer& gt)
 
             e->TexTransform = XMMatrixIdentity();
 
-            currentObjectCB->CopyData(e->ObjectConstantBufferIndex, objConstants);
+            indices.push_back(e->ObjectConstantBufferIndex);
+            constants.push_back(objConstants);
 
             // Next FrameResource need to be updated too.
             e->NumFrameDirty--;
         }
     }
+    m_currentFrameResource->m_objCB->CopyScatter(indices.data(), constants.data(), (UINT)indices.size());
 }
 
 void LitWavesApp::UpdateMaterialConstantBuffers(const GameTimer& gt)
 {
-    auto currentMaterialCB = m_currentFrameResource->m_materialCB.get();
+    std::vector<UINT>& indices = m_dirtyIndices;
+    std::vector<MaterialConstants>& constants = m_dirtyMaterialConstants;
+    indices.clear();
+    constants.clear();
     for (auto& e : m_materials)
     {
         // Only update the cbuffer data if the constants have changed.
@@ -405,12 +535,14 @@ void LitWavesApp::UpdateMaterialConstantBuffers(const GameTimer& gt)
             matConstants.FresnelR0 = mat->FresnelR0;
             matConstants.Roughness = mat->Roughness;
 
-            currentMaterialCB->CopyData(mat->MaterialConstantBufferIndex, matConstants);
+            indices.push_back(mat->MaterialConstantBufferIndex);
+            constants.push_back(matConstants);
 
             // Next FrameResource need to be updated too.
             mat->NumFramesDirty--;
         }
     }
+    m_currentFrameResource->m_materialCB->CopyScatter(indices.data(), constants.data(), (UINT)indices.size());
 }
 
 void LitWavesApp::UpdateMainPassConstantBuffer(const GameTimer& gt)
@@ -436,9 +568,7 @@ void LitWavesApp::UpdateMainPassConstantBuffer(const GameTimer& gt)
     m_mainPassCB.DeltaTime = gt.DeltaTime();
     m_mainPassCB.AmbientLight = { 0.25f,0.25f,0.35f,1.0f };
 
-    XMVECTOR lightDir = -myMathLibrary::SphericalToCartesian(1.0f, m_sunTheta, m_sunPhi);
-    XMStoreFloat3(&m_mainPassCB.Lights[0].Direction, lightDir);
-    m_mainPassCB.Lights[0].Strength = { 1.0f,1.0f,0.9f };
+    m_mainPassCB.Lights[0] = GetSunLight();
 
     auto currentPassCB = m_currentFrameResource->m_passCB.get();
     currentPassCB->CopyData(0, m_mainPassCB);
@@ -463,16 +593,19 @@ void LitWavesApp::UpdateWaves(const GameTimer& gt)
     // Update the wave simulation.
     m_waves->Update(gt.DeltaTime());
 
+    // The simulation tracks its height range as it goes, so this is cheap.
+    m_wavesItem->Geo->DrawArags["grid"].SetBounds(m_waves->GetBounds());
+
     // Update the wave vertex buffer with the new solution.
     UploadBuffer<Vertex>* currentWaveCB = m_currentFrameResource->m_wavesVB.get();
-    for (int i = 0; i < m_waves->GetVertexCount(); ++i)
+    currentWaveCB->Generate(0, (UINT)m_waves->GetVertexCount(), [this](Vertex* vertices, UINT first, UINT count)
     {
-        Vertex v;
-        v.Pos = m_waves->Position(i);
-        v.Normal = m_waves->Normal(i);
-
-        currentWaveCB->CopyData(i, v);
-    }
+        for (UINT i = 0; i < count; ++i)
+        {
+            vertices[i].Pos = m_waves->Position(first + i);
+            vertices[i].Normal = m_waves->Normal(first + i);
+        }
+    });
 
     // Set the dynamic VB of the wave renderitem to the current frame VB.
     m_wavesItem->Geo->VertexBufferGPU = currentWaveCB->Resource();
@@ -489,18 +622,26 @@ void LitWavesApp::Update(const GameTimer& gt)
 
     // Has the GPU finished processing the commands of the current frame resource.
     // If not, wait until the GPU has completed commands up to this fence point.
-    if (m_currentFrameResource->m_fence != 0 && m_fence->GetCompletedValue() < m_currentFrameResource->m_fence)
+    if (m_currentFrameResource->m_fence != 0)
     {
-        HANDLE eventHandle = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
-        ThrowIfFailed(m_fence->SetEventOnCompletion(m_currentFrameResource->m_fence, eventHandle));
-        WaitForSingleObject(eventHandle,INFINITE);
-        CloseHandle(eventHandle);
+        WaitForFence(m_currentFrameResource->m_fence);
     }
 
     UpdateObjectConstantBuffers(gt);
     UpdateMaterialConstantBuffers(gt);
     UpdateMainPassConstantBuffer(gt);
     UpdateWaves(gt);
+    UpdateBakedLandColors();
+}
+
+void LitWavesApp::UpdateBakedLandColors()
+{
+    // Each frame resource's buffer takes the new colors when its turn comes.
+    if (m_landColorsFramesDirty > 0)
+    {
+        m_landBakedColors[m_currentFrameResourceIndex]->CopyRange(0, m_landColors.data(), (UINT)m_landColors.size());
+        m_landColorsFramesDirty--;
+    }
 }
 
 void LitWavesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& renderItems)
@@ -530,6 +671,27 @@ void LitWavesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std:
     }
 }
 
+void LitWavesApp::DrawBakedLand(ID3D12GraphicsCommandList* cmdList)
+{
+    cmdList->SetPipelineState(m_PSOs[m_isWireFrame ? "baked_wireframe" : "baked"].Get());
+
+    D3D12_VERTEX_BUFFER_VIEW vertexBuffers[2] = { m_landItem->Geo->VertexBufferView() };
+    vertexBuffers[1].BufferLocation = m_landBakedColors[m_currentFrameResourceIndex]->Resource()->GetGPUVirtualAddress();
+    vertexBuffers[1].StrideInBytes = sizeof(XMFLOAT4);
+    vertexBuffers[1].SizeInBytes = (UINT)m_landVisibility.size() * sizeof(XMFLOAT4);
+
+    cmdList->IASetVertexBuffers(0, _countof(vertexBuffers), vertexBuffers);
+    cmdList->IASetIndexBuffer(&m_landItem->Geo->IndexBufferView());
+    cmdList->IASetPrimitiveTopology(m_landItem->PrimitiveType);
+
+    UINT objCBByteSize = CalculateConstantBufferByteSize(sizeof(ObjectConstants));
+    D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = m_currentFrameResource->m_objCB->Resource()->GetGPUVirtualAddress() +
+        m_landItem->ObjectConstantBufferIndex * (UINT64)objCBByteSize;
+    cmdList->SetGraphicsRootConstantBufferView(0, objCBAddress);
+
+    cmdList->DrawIndexedInstanced(m_landItem->IndexCount, 1, m_landItem->StartIndexLocation, m_landItem->BaseVertexLocation, 0);
+}
+
 void LitWavesApp::Draw(const GameTimer& gt)
 {
     // Reuse the memory associated with command recording.
@@ -553,11 +715,8 @@ void LitWavesApp::Draw(const GameTimer& gt)
     m_commandList->RSSetScissorRects(1, &m_scissorRect);
 
     // Indicate a state transition on the resouce usage.
-    m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-        CurrentBackBuffer(),
-        D3D12_RESOURCE_STATE_PRESENT,
-        D3D12_RESOURCE_STATE_RENDER_TARGET
-    ));
+    m_barriers.Transition(CurrentBackBuffer(), D3D12_RESOURCE_STATE_RENDER_TARGET);
+    m_barriers.FlushBarriers(m_commandList.Get());
 
     // Clear the back buffer and depth buffer.
     m_commandList->ClearRenderTargetView(CurrentBackBufferView(), Colors::LightBlue, 0, nullptr);
@@ -571,21 +730,30 @@ void LitWavesApp::Draw(const GameTimer& gt)
     ID3D12Resource* passCB = m_currentFrameResource->m_passCB->Resource();
     m_commandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
 
-    DrawRenderItems(m_commandList.Get(), m_renderItemLayer[(int)RenderLayer::Opaque]);
+    if (m_isBakedLighting)
+    {
+        // Everything else as usual, then the land with the baked variant.
+        std::vector<RenderItem*> renderItems;
+        for (RenderItem* ri : m_renderItemLayer[(int)RenderLayer::Opaque])
+        {
+            if (ri != m_landItem)
+            {
+                renderItems.push_back(ri);
+            }
+        }
+        DrawRenderItems(m_commandList.Get(), renderItems);
+        DrawBakedLand(m_commandList.Get());
+    }
+    else
+    {
+        DrawRenderItems(m_commandList.Get(), m_renderItemLayer[(int)RenderLayer::Opaque]);
+    }
 
     // Indicate a state transition on the resource usage.
-    m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-        CurrentBackBuffer(),
-        D3D12_RESOURCE_STATE_RENDER_TARGET,
-        D3D12_RESOURCE_STATE_PRESENT
-    ));
+    m_barriers.Transition(CurrentBackBuffer(), D3D12_RESOURCE_STATE_PRESENT);
 
-    // Done recording commands.
-    ThrowIfFailed(m_commandList->Close());
-
-    // Add the command list to the queue for execution.
-    ID3D12CommandList* cmdLists[] = { m_commandList.Get() };
-    m_commandQueue->ExecuteCommandLists(_countof(cmdLists), cmdLists);
+    // Done recording commands; execute them after the barriers they start with.
+    ExecuteCommandList(m_commandList.Get(), m_barriers);
 
     // Swap the back and front buffers.
     ThrowIfFailed(m_swapchain->Present(0, 0));
@@ -1,4 +1,4 @@
-// Use arrow keys to move light positions.
+// Use arrow keys to move light positions, 2 to toggle baked land lighting.
 #pragma once
 #include "stdafx.h"
 #include "D3DAppBase.h"
@@ -6,6 +6,7 @@
 #include "GeometryGenerator.h"
 #include "Waves.h"
 #include "FrameResource.h"
+#include "StaticLighting.h"
 
 #ifndef IS_ENABLE_LITLAND_APP
 #define IS_ENABLE_LITLAND_APP 0
@@ -37,6 +38,7 @@ private:
     void UpdateMainPassConstantBuffer(const GameTimer& gt);
     void UpdateWaves(const GameTimer& gt);
     void UpdateMaterialConstantBuffers(const GameTimer& gt);
+    void UpdateBakedLandColors();
 
     void BuildRootSignature();
     void BuildShadersAndInputLayout();
@@ -48,6 +50,14 @@ private:
     void BuildRenderItems();
     void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& renderItems);
 
+    // The sun as UpdateMainPassConstantBuffer passes it to the shaders.
+    Light GetSunLight()const;
+
+    // Bakes the land's lighting for the current sun into m_landColors, to be
+    // copied to each frame resource's m_landBakedColors in turn.
+    void BakeLandLighting();
+    void DrawBakedLand(ID3D12GraphicsCommandList* cmdList);
+
     float GetHillsHeight(float x, float z)const;
     DirectX::XMFLOAT3 GetHillsNormal(float x, float z)const;
 
@@ -65,8 +75,10 @@ private:
     std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> m_PSOs;
 
     std::vector<D3D12_INPUT_ELEMENT_DESC> m_inputLayout;
+    std::vector<D3D12_INPUT_ELEMENT_DESC> m_bakedInputLayout;
 
     RenderItem* m_wavesItem = nullptr;
+    RenderItem* m_landItem = nullptr;
 
     // List of all the render items.
     std::vector<std::unique_ptr<RenderItem>>    m_allRenderItems;
@@ -74,6 +86,12 @@ private:
     // Render items divided by PSO.
     std::vector<RenderItem*>    m_renderItemLayer[(int)RenderLayer::Count];
 
+    // Dirty objects and materials gathered each frame, kept to reuse the
+    // storage.
+    std::vector<UINT>   m_dirtyIndices;
+    std::vector<ObjectConstants>    m_dirtyObjectConstants;
+    std::vector<MaterialConstants>  m_dirtyMaterialConstants;
+
     std::unique_ptr<Waves> m_waves = nullptr;
 
     PassConstants m_mainPassCB;
@@ -94,4 +112,19 @@ private:
     POINT m_lastMousePos = { LONG(0),LONG(0) };
 
     bool m_isWireFrame = false;
+
+    // Static lighting of the land, toggled with '2'. The colors are a second
+    // vertex stream drawn with BakedLighting.hlsl; ambient occlusion comes
+    // from the land's height field. Moving the sun while baked rebakes.
+    // Frames in flight may still read the old colors, so each frame resource
+    // has a buffer of its own, updated like a dirty material.
+    std::unique_ptr<HeightFieldPyramid> m_landHeights;
+    std::vector<float> m_landVisibility;
+    std::vector<DirectX::XMFLOAT4> m_landColors;
+    std::vector<std::unique_ptr<UploadBuffer<DirectX::XMFLOAT4>>> m_landBakedColors;
+    UINT m_landColorsFramesDirty = 0;
+    bool m_isBakedLighting = false;
+    bool m_bakedLightingKeyDown = false;
+    float m_bakedSunTheta = 0.0f;
+    float m_bakedSunPhi = 0.0f;
 };
\ No newline at end of file
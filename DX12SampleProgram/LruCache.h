@@ -0,0 +1,187 @@
+// A thread-safe LRU cache of immutable values produced on worker threads.
+//
+// Values are shared_ptrs keyed by a 64-bit key; evicting one only drops the
+// cache's reference, so callers holding it keep it alive. Request queues a
+// fetch on a task group and marks the key pending until the value is
+// inserted, so a key is never fetched twice at once. Terrain caches its
+// chunks and HeightTileStream its tiles in one.
+#pragma once
+#include "stdafx.h"
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ppl.h>
+#include <unordered_set>
+
+enum class LruCacheRequest
+{
+    // A fetch was queued.
+    Queued,
+    // The value is cached or a fetch is already queued.
+    Present,
+    // maxPending fetches are already in flight.
+    Busy,
+};
+
+template<typename T>
+class LruCache
+{
+public:
+    using ValuePtr = std::shared_ptr<const T>;
+    using Fetch = std::function<ValuePtr()>;
+
+    explicit LruCache(size_t capacity = 1) :
+        m_capacity(capacity)
+    {
+        assert(capacity > 0);
+    }
+
+    LruCache(const LruCache& rhs) = delete;
+    LruCache& operator=(const LruCache& rhs) = delete;
+
+    ~LruCache()
+    {
+        m_requests.wait();
+    }
+
+    // Evicts the least recently used values beyond capacity.
+    void SetCapacity(size_t capacity)
+    {
+        assert(capacity > 0);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_capacity = capacity;
+        Trim();
+    }
+
+    size_t GetCapacity()const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_capacity;
+    }
+
+    size_t GetCount()const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_entries.size();
+    }
+
+    // Cached value, now the most recently used, or null.
+    ValuePtr Lookup(std::uint64_t key)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it = m_entries.find(key);
+        if (it == m_entries.end())
+        {
+            return nullptr;
+        }
+        m_lru.splice(m_lru.begin(), m_lru, it->second.LruPosition);
+        return it->second.Value;
+    }
+
+    // Caches value as the most recently used, replacing any value of key.
+    void Insert(std::uint64_t key, const ValuePtr& value)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        InsertLocked(key, value);
+    }
+
+    // Cached value, fetched on the calling thread if it is not.
+    ValuePtr GetOrFetch(std::uint64_t key, const Fetch& fetch)
+    {
+        ValuePtr value = Lookup(key);
+        if (value == nullptr)
+        {
+            value = fetch();
+            Insert(key, value);
+        }
+        return value;
+    }
+
+    // Queues fetch on a worker thread unless key is cached or pending, or
+    // maxPending fetches are already in flight.
+    LruCacheRequest Request(std::uint64_t key, const Fetch& fetch, size_t maxPending = SIZE_MAX)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_entries.count(key) != 0 || m_pending.count(key) != 0)
+            {
+                return LruCacheRequest::Present;
+            }
+            if (m_pending.size() >= maxPending)
+            {
+                return LruCacheRequest::Busy;
+            }
+            m_pending.insert(key);
+        }
+
+        m_requests.run([this, key, fetch]()
+        {
+            ValuePtr value = fetch();
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            InsertLocked(key, value);
+            m_pending.erase(key);
+        });
+        return LruCacheRequest::Queued;
+    }
+
+    // Blocks until every requested value is cached.
+    void WaitForRequests()
+    {
+        m_requests.wait();
+    }
+
+    // Waits for the requests in flight, then drops every value.
+    void Clear()
+    {
+        m_requests.wait();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.clear();
+        m_lru.clear();
+        m_pending.clear();
+    }
+
+private:
+    struct Entry
+    {
+        ValuePtr Value;
+        std::list<std::uint64_t>::iterator LruPosition;
+    };
+
+    void InsertLocked(std::uint64_t key, const ValuePtr& value)
+    {
+        auto it = m_entries.find(key);
+        if (it != m_entries.end())
+        {
+            it->second.Value = value;
+            m_lru.splice(m_lru.begin(), m_lru, it->second.LruPosition);
+            return;
+        }
+
+        m_lru.push_front(key);
+        m_entries[key] = Entry{ value, m_lru.begin() };
+        Trim();
+    }
+
+    void Trim()
+    {
+        while (m_entries.size() > m_capacity)
+        {
+            m_entries.erase(m_lru.back());
+            m_lru.pop_back();
+        }
+    }
+
+    // Guards everything below but the task group.
+    mutable std::mutex m_mutex;
+    size_t m_capacity = 1;
+    std::unordered_map<std::uint64_t, Entry> m_entries;
+    // Most recently used at the front.
+    std::list<std::uint64_t> m_lru;
+    std::unordered_set<std::uint64_t> m_pending;
+
+    concurrency::task_group m_requests;
+};
@@ -0,0 +1,284 @@
+#include "stdafx.h"
+#include "MeshCache.h"
+#include "FileUtil.h"
+#include "IndexBuffer.h"
+
+using Microsoft::WRL::ComPtr;
+using namespace DirectX;
+
+namespace
+{
+    void StoreBounds(const BoundingBox& box, float center[3], float extents[3])
+    {
+        center[0] = box.Center.x;
+        center[1] = box.Center.y;
+        center[2] = box.Center.z;
+        extents[0] = box.Extents.x;
+        extents[1] = box.Extents.y;
+        extents[2] = box.Extents.z;
+    }
+
+    BoundingBox LoadBounds(const float center[3], const float extents[3])
+    {
+        return BoundingBox(XMFLOAT3(center[0], center[1], center[2]),
+            XMFLOAT3(extents[0], extents[1], extents[2]));
+    }
+
+    // Whether [offset, offset + byteSize) lies within fileSize bytes,
+    // without a sum that a corrupt header could make wrap.
+    bool SectionFits(std::uint64_t offset, std::uint64_t byteSize, std::uint64_t fileSize)
+    {
+        return byteSize <= fileSize && offset <= fileSize - byteSize;
+    }
+
+    bool WritePadding(HANDLE file, std::uint64_t byteSize)
+    {
+        static const BYTE zeros[MeshFileSectionAlignment] = {};
+        return WriteAll(file, zeros, byteSize);
+    }
+}
+
+MeshCacheKey::MeshCacheKey(const char* generatorName)
+{
+    Add(MeshFileVersion);
+    Add(generatorName);
+}
+
+MeshCacheKey& MeshCacheKey::Add(const void* data, size_t byteSize)
+{
+    const BYTE* p = static_cast<const BYTE*>(data);
+    for (size_t i = 0; i < byteSize; ++i)
+    {
+        m_hash ^= p[i];
+        m_hash *= 0x100000001b3ull;
+    }
+    return *this;
+}
+
+MeshCacheKey& MeshCacheKey::Add(const char* str)
+{
+    // Include the terminator so "ab"+"c" and "a"+"bc" hash differently.
+    return Add(str, strlen(str) + 1);
+}
+
+MappedMeshFile::~MappedMeshFile()
+{
+    Close();
+}
+
+bool MappedMeshFile::Open(const std::wstring& fileName)
+{
+    Close();
+
+    m_file = CreateFile(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size) || size.QuadPart < (LONGLONG)sizeof(MeshFileHeader))
+    {
+        Close();
+        return false;
+    }
+    m_fileSize = static_cast<std::uint64_t>(size.QuadPart);
+
+    m_mapping = CreateFileMapping(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    m_view = static_cast<const BYTE*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (m_view == nullptr || !Validate())
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void MappedMeshFile::Close()
+{
+    if (m_view != nullptr)
+    {
+        UnmapViewOfFile(m_view);
+        m_view = nullptr;
+    }
+    if (m_mapping != nullptr)
+    {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+    if (m_file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+    m_fileSize = 0;
+}
+
+bool MappedMeshFile::Validate()const
+{
+    const MeshFileHeader& header = Header();
+    if (header.Magic != MeshFileMagic || header.Version != MeshFileVersion)
+    {
+        return false;
+    }
+
+    // Once each section is known to fit, the sums below cannot wrap.
+    std::uint64_t tableEnd = sizeof(MeshFileHeader) + (std::uint64_t)header.SubmeshCount * sizeof(MeshFileSubmesh);
+    return SectionFits(header.VertexDataOffset, header.VertexDataByteSize, m_fileSize) &&
+        SectionFits(header.IndexDataOffset, header.IndexDataByteSize, m_fileSize) &&
+        tableEnd <= header.VertexDataOffset &&
+        header.VertexDataOffset + header.VertexDataByteSize <= header.IndexDataOffset &&
+        header.VertexDataByteSize == (std::uint64_t)header.VertexCount * header.VertexByteStride &&
+        header.IndexDataByteSize == (std::uint64_t)header.IndexCount * IndexFormatByteSize((DXGI_FORMAT)header.IndexFormat);
+}
+
+MeshCache::MeshCache(const std::wstring& directory)
+    :m_directory(directory)
+{
+    if (!m_directory.empty() && m_directory.back() != L'\\' && m_directory.back() != L'/')
+    {
+        m_directory += L'\\';
+    }
+
+    // It is fine if the directory already exists.
+    CreateDirectory(m_directory.c_str(), nullptr);
+}
+
+std::wstring MeshCache::GetFileName(std::uint64_t key)const
+{
+    WCHAR name[32];
+    swprintf_s(name, L"%016llx.mesh", static_cast<unsigned long long>(key));
+    return m_directory + name;
+}
+
+bool MeshCache::Contains(std::uint64_t key)const
+{
+    MappedMeshFile file;
+    return Map(key, file);
+}
+
+bool MeshCache::Store(std::uint64_t key, const MeshCacheEntry& entry)const
+{
+    MeshFileHeader header;
+    header.Key = key;
+    header.VertexByteStride = entry.VertexByteStride;
+    header.VertexCount = entry.VertexCount;
+    header.IndexFormat = entry.IndexFormat;
+    header.IndexCount = entry.IndexCount;
+    header.SubmeshCount = (std::uint32_t)entry.Submeshes.size();
+
+    std::uint64_t tableEnd = sizeof(MeshFileHeader) + (std::uint64_t)header.SubmeshCount * sizeof(MeshFileSubmesh);
+    header.VertexDataOffset = AlignUp(tableEnd, MeshFileSectionAlignment);
+    header.VertexDataByteSize = (std::uint64_t)entry.VertexCount * entry.VertexByteStride;
+    header.IndexDataOffset = AlignUp(header.VertexDataOffset + header.VertexDataByteSize, MeshFileSectionAlignment);
+    header.IndexDataByteSize = (std::uint64_t)entry.IndexCount * IndexFormatByteSize(entry.IndexFormat);
+
+    std::vector<MeshFileSubmesh> table(entry.Submeshes.size());
+    BoundingBox meshBounds;
+    for (size_t i = 0; i < entry.Submeshes.size(); ++i)
+    {
+        const std::string& name = entry.Submeshes[i].first;
+        const SubmeshGeometry& submesh = entry.Submeshes[i].second;
+        if (name.size() >= MeshFileMaxSubmeshNameLength)
+        {
+            return false;
+        }
+
+        memcpy(table[i].Name, name.c_str(), name.size());
+        table[i].IndexCount = submesh.IndexCount;
+        table[i].StartIndexLocation = submesh.StartIndexCount;
+        table[i].BaseVertexLocation = submesh.BaseVertexLocation;
+        StoreBounds(submesh.Bounds, table[i].BoundsCenter, table[i].BoundsExtents);
+        table[i].SphereCenter[0] = submesh.SphereBounds.Center.x;
+        table[i].SphereCenter[1] = submesh.SphereBounds.Center.y;
+        table[i].SphereCenter[2] = submesh.SphereBounds.Center.z;
+        table[i].SphereRadius = submesh.SphereBounds.Radius;
+
+        if (i == 0)
+        {
+            meshBounds = submesh.Bounds;
+        }
+        else
+        {
+            BoundingBox::CreateMerged(meshBounds, meshBounds, submesh.Bounds);
+        }
+    }
+    StoreBounds(meshBounds, header.BoundsCenter, header.BoundsExtents);
+
+    return WriteFileAtomic(GetFileName(key), [&](HANDLE file)
+    {
+        return WriteAll(file, &header, sizeof(header)) &&
+            WriteAll(file, table.data(), table.size() * sizeof(MeshFileSubmesh)) &&
+            WritePadding(file, header.VertexDataOffset - tableEnd) &&
+            WriteAll(file, entry.VertexData, header.VertexDataByteSize) &&
+            WritePadding(file, header.IndexDataOffset - (header.VertexDataOffset + header.VertexDataByteSize)) &&
+            WriteAll(file, entry.IndexData, header.IndexDataByteSize);
+    });
+}
+
+bool MeshCache::Map(std::uint64_t key, MappedMeshFile& file)const
+{
+    return file.Open(GetFileName(key)) && file.Header().Key == key;
+}
+
+std::vector<std::pair<std::string, SubmeshGeometry>> MeshCache::ReadSubmeshes(const MappedMeshFile& file)
+{
+    const MeshFileSubmesh* table = file.Submeshes();
+    std::vector<std::pair<std::string, SubmeshGeometry>> submeshes(file.Header().SubmeshCount);
+    for (std::uint32_t i = 0; i < file.Header().SubmeshCount; ++i)
+    {
+        SubmeshGeometry& submesh = submeshes[i].second;
+        submesh.IndexCount = table[i].IndexCount;
+        submesh.StartIndexCount = table[i].StartIndexLocation;
+        submesh.BaseVertexLocation = table[i].BaseVertexLocation;
+        submesh.Bounds = LoadBounds(table[i].BoundsCenter, table[i].BoundsExtents);
+        submesh.SphereBounds = BoundingSphere(
+            XMFLOAT3(table[i].SphereCenter[0], table[i].SphereCenter[1], table[i].SphereCenter[2]),
+            table[i].SphereRadius);
+
+        // Names are zero padded, but guard against a corrupt table anyway.
+        submeshes[i].first.assign(table[i].Name, strnlen(table[i].Name, MeshFileMaxSubmeshNameLength));
+    }
+    return submeshes;
+}
+
+std::unique_ptr<MeshGeometry> MeshCache::Load(std::uint64_t key, const std::string& name,
+    ID3D12Device* device, ID3D12GraphicsCommandList* cmdList)const
+{
+    MappedMeshFile file;
+    if (!Map(key, file))
+    {
+        return nullptr;
+    }
+
+    const MeshFileHeader& header = file.Header();
+
+    std::unique_ptr<MeshGeometry> geo = std::make_unique<MeshGeometry>();
+    geo->Name = name;
+
+    // UpdateSubresources copies the mapped pages into the upload heap while the
+    // commands are recorded, so the file can be unmapped as soon as we return.
+    geo->VertexBufferGPU = CreateDefaultBuffer(device, cmdList, file.VertexData(),
+        header.VertexDataByteSize, geo->VertexBufferUploader);
+    geo->IndexBufferGPU = CreateDefaultBuffer(device, cmdList, file.IndexData(),
+        header.IndexDataByteSize, geo->IndexBufferUploader);
+
+    geo->VertexByteStride = header.VertexByteStride;
+    geo->VertexBufferByteSize = (UINT)header.VertexDataByteSize;
+    geo->IndexFormat = (DXGI_FORMAT)header.IndexFormat;
+    geo->IndexBufferByteSize = (UINT)header.IndexDataByteSize;
+
+    for (const auto& submesh : ReadSubmeshes(file))
+    {
+        geo->DrawArags[submesh.first] = submesh.second;
+    }
+
+    return geo;
+}
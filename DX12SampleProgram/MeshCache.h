@@ -0,0 +1,161 @@
+// Persistent on-disk cache for built geometry.
+//
+// A cached mesh is stored in a single binary container laid out as:
+//
+//   MeshFileHeader
+//   MeshFileSubmesh[SubmeshCount]
+//   <pad to MeshFileSectionAlignment>
+//   vertex data  (VertexCount * VertexByteStride bytes)
+//   <pad to MeshFileSectionAlignment>
+//   index data   (IndexCount * sizeof(index) bytes)
+//
+// The vertex and index sections are stored exactly as the GPU consumes them,
+// so a loaded file is mapped into memory and the mapped view is handed
+// straight to CreateDefaultBuffer without any intermediate vectors or blobs.
+#pragma once
+#include "stdafx.h"
+#include "D3DUtil.h"
+
+// Bump this whenever the container layout changes; old files are then ignored.
+const std::uint32_t MeshFileVersion = 2;
+const std::uint32_t MeshFileMagic = 0x3148534D; // "MSH1"
+
+// Every section starts on this boundary so the mapped view can be copied
+// into an upload heap with aligned, wide copies.
+const std::uint64_t MeshFileSectionAlignment = 256;
+
+const size_t MeshFileMaxSubmeshNameLength = 32;
+
+#pragma pack(push, 4)
+struct MeshFileHeader
+{
+    std::uint32_t Magic = MeshFileMagic;
+    std::uint32_t Version = MeshFileVersion;
+
+    // Hash of the generator parameters this mesh was built from.
+    std::uint64_t Key = 0;
+
+    std::uint32_t VertexByteStride = 0;
+    std::uint32_t VertexCount = 0;
+    std::uint32_t IndexFormat = DXGI_FORMAT_UNKNOWN;
+    std::uint32_t IndexCount = 0;
+    std::uint32_t SubmeshCount = 0;
+    std::uint32_t Reserved = 0;
+
+    std::uint64_t VertexDataOffset = 0;
+    std::uint64_t VertexDataByteSize = 0;
+    std::uint64_t IndexDataOffset = 0;
+    std::uint64_t IndexDataByteSize = 0;
+
+    // Bounds of the whole mesh.
+    float BoundsCenter[3] = { 0.0f,0.0f,0.0f };
+    float BoundsExtents[3] = { 0.0f,0.0f,0.0f };
+};
+
+struct MeshFileSubmesh
+{
+    char Name[MeshFileMaxSubmeshNameLength] = {};
+    std::uint32_t IndexCount = 0;
+    std::uint32_t StartIndexLocation = 0;
+    std::uint32_t BaseVertexLocation = 0;
+    float BoundsCenter[3] = { 0.0f,0.0f,0.0f };
+    float BoundsExtents[3] = { 0.0f,0.0f,0.0f };
+    float SphereCenter[3] = { 0.0f,0.0f,0.0f };
+    float SphereRadius = 0.0f;
+};
+#pragma pack(pop)
+
+// Builds a 64-bit cache key from the parameters a mesh was generated with.
+// Any parameter that changes the output (dimensions, tessellation, vertex
+// layout, colors...) must be fed in, otherwise stale data will be loaded.
+class MeshCacheKey
+{
+public:
+    explicit MeshCacheKey(const char* generatorName);
+
+    MeshCacheKey& Add(const void* data, size_t byteSize);
+    MeshCacheKey& Add(float value) { return Add(&value, sizeof(value)); }
+    MeshCacheKey& Add(std::uint32_t value) { return Add(&value, sizeof(value)); }
+    MeshCacheKey& Add(const char* str);
+
+    std::uint64_t Value()const { return m_hash; }
+
+private:
+    // 64-bit FNV-1a.
+    std::uint64_t m_hash = 0xcbf29ce484222325ull;
+};
+
+// Read-only memory mapping of a mesh container file. The view stays valid
+// for the lifetime of the object.
+class MappedMeshFile
+{
+public:
+    MappedMeshFile() = default;
+    MappedMeshFile(const MappedMeshFile& rhs) = delete;
+    MappedMeshFile& operator=(const MappedMeshFile& rhs) = delete;
+    ~MappedMeshFile();
+
+    // Returns false if the file is missing, truncated or of another version.
+    bool Open(const std::wstring& fileName);
+    void Close();
+
+    const MeshFileHeader& Header()const { return *reinterpret_cast<const MeshFileHeader*>(m_view); }
+    const MeshFileSubmesh* Submeshes()const { return reinterpret_cast<const MeshFileSubmesh*>(m_view + sizeof(MeshFileHeader)); }
+    const void* VertexData()const { return m_view + Header().VertexDataOffset; }
+    const void* IndexData()const { return m_view + Header().IndexDataOffset; }
+
+private:
+    bool Validate()const;
+
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+    const BYTE* m_view = nullptr;
+    std::uint64_t m_fileSize = 0;
+};
+
+// Describes a mesh that is about to be written to the cache. All pointers
+// must reference GPU-ready data (final vertex layout and index format).
+struct MeshCacheEntry
+{
+    const void* VertexData = nullptr;
+    UINT VertexByteStride = 0;
+    UINT VertexCount = 0;
+
+    const void* IndexData = nullptr;
+    DXGI_FORMAT IndexFormat = DXGI_FORMAT_R16_UINT;
+    UINT IndexCount = 0;
+
+    std::vector<std::pair<std::string, SubmeshGeometry>> Submeshes;
+};
+
+class MeshCache
+{
+public:
+    // Cache files are stored as <directory>\<key>.mesh.
+    explicit MeshCache(const std::wstring& directory);
+    MeshCache(const MeshCache& rhs) = delete;
+    MeshCache& operator=(const MeshCache& rhs) = delete;
+
+    bool Contains(std::uint64_t key)const;
+
+    // Writes the mesh to disk. Failure to write is not fatal: the mesh will
+    // simply be rebuilt next time, so this returns false instead of throwing.
+    bool Store(std::uint64_t key, const MeshCacheEntry& entry)const;
+
+    // Maps the cached file for key into file. Returns false on a cache miss.
+    bool Map(std::uint64_t key, MappedMeshFile& file)const;
+
+    // Submesh table of a mapped file, in the order it was stored.
+    static std::vector<std::pair<std::string, SubmeshGeometry>> ReadSubmeshes(const MappedMeshFile& file);
+
+    // Maps the cached file and creates the GPU buffers straight from the mapped
+    // view. Returns nullptr on a cache miss. The CPU blobs of the returned
+    // geometry are left empty; keep the mesh on disk instead.
+    std::unique_ptr<MeshGeometry> Load(std::uint64_t key, const std::string& name,
+        ID3D12Device* device, ID3D12GraphicsCommandList* cmdList)const;
+
+    std::wstring GetFileName(std::uint64_t key)const;
+
+private:
+    std::wstring m_directory;
+};
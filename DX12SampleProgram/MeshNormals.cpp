@@ -0,0 +1,211 @@
+#include "stdafx.h"
+#include "MeshNormals.h"
+#include <ppl.h>
+
+using namespace DirectX;
+
+namespace
+{
+    // Elements per parallel task.
+    const size_t NormalBlockSize = 4096;
+
+    template<typename T>
+    T* StridedAt(void* base, UINT stride, size_t i)
+    {
+        return reinterpret_cast<T*>(static_cast<BYTE*>(base) + i * stride);
+    }
+
+    template<typename T>
+    const T* StridedAt(const void* base, UINT stride, size_t i)
+    {
+        return reinterpret_cast<const T*>(static_cast<const BYTE*>(base) + i * stride);
+    }
+
+    // Some unit vector perpendicular to n, for vertices whose accumulated
+    // tangent vanished (no usable texture coordinates).
+    XMVECTOR AnyPerpendicular(FXMVECTOR n)
+    {
+        XMVECTOR axis = fabsf(XMVectorGetX(n)) < 0.9f ? g_XMIdentityR0 : g_XMIdentityR1;
+        return XMVector3Normalize(XMVector3Cross(axis, n));
+    }
+}
+
+VertexTriangleAdjacency::VertexTriangleAdjacency(const std::uint32_t* indices, size_t indexCount,
+    std::uint32_t vertexCount)
+{
+    assert(indexCount % 3 == 0);
+
+    // Counting sort of the corners by vertex. Corners are scattered in
+    // increasing order, so every list comes out sorted.
+    m_offsets.assign((size_t)vertexCount + 1, 0);
+    for (size_t c = 0; c < indexCount; ++c)
+    {
+        assert(indices[c] < vertexCount);
+        ++m_offsets[indices[c] + 1];
+    }
+    for (std::uint32_t v = 0; v < vertexCount; ++v)
+    {
+        m_offsets[v + 1] += m_offsets[v];
+    }
+
+    m_corners.resize(indexCount);
+    std::vector<std::uint32_t> cursor(m_offsets.begin(), m_offsets.end() - 1);
+    for (size_t c = 0; c < indexCount; ++c)
+    {
+        m_corners[cursor[indices[c]]++] = (std::uint32_t)c;
+    }
+}
+
+NormalRecomputer::NormalRecomputer(const std::uint32_t* indices, size_t indexCount, std::uint32_t vertexCount) :
+    m_indices(indices, indices + indexCount),
+    m_adjacency(indices, indexCount, vertexCount)
+{
+    m_faceNormals.resize(indexCount / 3);
+}
+
+NormalRecomputer::NormalRecomputer(const GeometryGenerator::MeshData& meshData) :
+    NormalRecomputer(meshData.Indices32.data(), meshData.Indices32.size(), (std::uint32_t)meshData.Vertices.size())
+{
+}
+
+void NormalRecomputer::ComputeNormals(const void* positions, UINT positionStride, void* normals, UINT normalStride)
+{
+    ComputeFaces(positions, positionStride, nullptr, 0);
+    GatherVertices(normals, normalStride, nullptr, 0);
+}
+
+void NormalRecomputer::Compute(GeometryGenerator::MeshData& meshData)
+{
+    assert(meshData.Vertices.size() == m_adjacency.GetVertexCount());
+    if (meshData.Vertices.empty())
+    {
+        return;
+    }
+
+    const UINT stride = sizeof(GeometryGenerator::Vertex);
+    GeometryGenerator::Vertex& first = meshData.Vertices[0];
+    ComputeFaces(&first.Position, stride, &first.TexC, stride);
+    GatherVertices(&first.Normal, stride, &first.TangentU, stride);
+}
+
+void NormalRecomputer::ComputeFaces(const void* positions, UINT positionStride,
+    const void* texCoords, UINT texCoordStride)
+{
+    const size_t triangleCount = m_faceNormals.size();
+    const bool angleWeights = m_weighting == NormalWeighting::Angle;
+    if (angleWeights)
+    {
+        m_cornerWeights.resize(triangleCount * 3);
+    }
+    if (texCoords != nullptr)
+    {
+        m_faceTangents.resize(triangleCount);
+    }
+
+    concurrency::parallel_for(size_t(0), triangleCount, NormalBlockSize, [&](size_t start)
+    {
+        size_t end = std::min(triangleCount, start + NormalBlockSize);
+        for (size_t t = start; t < end; ++t)
+        {
+            const std::uint32_t* tri = &m_indices[t * 3];
+            XMVECTOR p0 = XMLoadFloat3(StridedAt<XMFLOAT3>(positions, positionStride, tri[0]));
+            XMVECTOR p1 = XMLoadFloat3(StridedAt<XMFLOAT3>(positions, positionStride, tri[1]));
+            XMVECTOR p2 = XMLoadFloat3(StridedAt<XMFLOAT3>(positions, positionStride, tri[2]));
+
+            XMVECTOR e1 = XMVectorSubtract(p1, p0);
+            XMVECTOR e2 = XMVectorSubtract(p2, p0);
+            XMVECTOR n = XMVector3Cross(e1, e2);
+            XMStoreFloat3(&m_faceNormals[t], n);
+
+            // Twice the triangle area, the weight of the face for Area and
+            // of its tangent in both modes.
+            XMVECTOR length = XMVector3Length(n);
+
+            if (angleWeights)
+            {
+                // Angle at each corner over |n|, so that multiplying the stored
+                // face normal by it yields unit normal * angle.
+                XMVECTOR e3 = XMVectorSubtract(p2, p1);
+                XMVECTOR angles = XMVectorSet(
+                    XMVectorGetX(XMVector3AngleBetweenVectors(e1, e2)),
+                    XMVectorGetX(XMVector3AngleBetweenVectors(XMVectorNegate(e1), e3)),
+                    XMVectorGetX(XMVector3AngleBetweenVectors(XMVectorNegate(e2), XMVectorNegate(e3))),
+                    0.0f);
+                XMVECTOR weights = XMVectorSelect(XMVectorDivide(angles, length), XMVectorZero(),
+                    XMVectorEqual(length, XMVectorZero()));
+                m_cornerWeights[t * 3 + 0] = XMVectorGetX(weights);
+                m_cornerWeights[t * 3 + 1] = XMVectorGetY(weights);
+                m_cornerWeights[t * 3 + 2] = XMVectorGetZ(weights);
+            }
+
+            if (texCoords != nullptr)
+            {
+                XMVECTOR uv0 = XMLoadFloat2(StridedAt<XMFLOAT2>(texCoords, texCoordStride, tri[0]));
+                XMVECTOR uv1 = XMLoadFloat2(StridedAt<XMFLOAT2>(texCoords, texCoordStride, tri[1]));
+                XMVECTOR uv2 = XMLoadFloat2(StridedAt<XMFLOAT2>(texCoords, texCoordStride, tri[2]));
+                XMFLOAT2 d1, d2;
+                XMStoreFloat2(&d1, XMVectorSubtract(uv1, uv0));
+                XMStoreFloat2(&d2, XMVectorSubtract(uv2, uv0));
+
+                // dP/du, up to the sign of the uv determinant; faces without a
+                // usable mapping contribute nothing.
+                float det = d1.x * d2.y - d2.x * d1.y;
+                XMVECTOR tangent = XMVectorZero();
+                if (det != 0.0f)
+                {
+                    tangent = XMVectorSubtract(XMVectorScale(e1, d2.y), XMVectorScale(e2, d1.y));
+                    tangent = XMVectorScale(tangent, det > 0.0f ? 1.0f : -1.0f);
+                    tangent = XMVectorMultiply(XMVector3Normalize(tangent), length);
+                }
+                XMStoreFloat3(&m_faceTangents[t], tangent);
+            }
+        }
+    });
+}
+
+void NormalRecomputer::GatherVertices(void* normals, UINT normalStride, void* tangents, UINT tangentStride)
+{
+    const std::uint32_t vertexCount = m_adjacency.GetVertexCount();
+    const bool angleWeights = m_weighting == NormalWeighting::Angle;
+
+    concurrency::parallel_for(size_t(0), (size_t)vertexCount, NormalBlockSize, [&](size_t start)
+    {
+        std::uint32_t end = (std::uint32_t)std::min((size_t)vertexCount, start + NormalBlockSize);
+        for (std::uint32_t v = (std::uint32_t)start; v < end; ++v)
+        {
+            const std::uint32_t* begin = m_adjacency.CornersBegin(v);
+            const std::uint32_t* last = m_adjacency.CornersEnd(v);
+            if (begin == last)
+            {
+                continue;
+            }
+
+            XMVECTOR n = XMVectorZero();
+            XMVECTOR tangent = XMVectorZero();
+            for (const std::uint32_t* c = begin; c != last; ++c)
+            {
+                std::uint32_t t = *c / 3;
+                XMVECTOR faceNormal = XMLoadFloat3(&m_faceNormals[t]);
+                n = angleWeights ?
+                    XMVectorMultiplyAdd(faceNormal, XMVectorReplicate(m_cornerWeights[*c]), n) :
+                    XMVectorAdd(n, faceNormal);
+                if (tangents != nullptr)
+                {
+                    tangent = XMVectorAdd(tangent, XMLoadFloat3(&m_faceTangents[t]));
+                }
+            }
+
+            n = XMVector3Normalize(n);
+            XMStoreFloat3(StridedAt<XMFLOAT3>(normals, normalStride, v), n);
+
+            if (tangents != nullptr)
+            {
+                // Gram-Schmidt against the new normal.
+                tangent = XMVectorSubtract(tangent, XMVectorMultiply(n, XMVector3Dot(n, tangent)));
+                tangent = XMVector3LessOrEqual(XMVector3LengthSq(tangent), XMVectorReplicate(1.0e-20f)) ?
+                    AnyPerpendicular(n) : XMVector3Normalize(tangent);
+                XMStoreFloat3(StridedAt<XMFLOAT3>(tangents, tangentStride, v), tangent);
+            }
+        }
+    });
+}
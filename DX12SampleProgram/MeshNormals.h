@@ -0,0 +1,78 @@
+// Normal and tangent recomputation for meshes deformed on the CPU.
+//
+// The vertex-to-triangle adjacency is built once per topology in compressed
+// sparse row form. Each recompute is then two parallel passes: one over the
+// triangles computing face normals (and tangents) into scratch arrays, and
+// one over the vertices gathering them through the adjacency. Every vertex is
+// written by exactly one task, so no atomics are needed, and the sums are
+// taken in a fixed order, so the results do not depend on scheduling.
+#pragma once
+#include "stdafx.h"
+#include "GeometryGenerator.h"
+
+enum class NormalWeighting
+{
+    // Face normals weighted by triangle area. Cheapest; fine for even meshes.
+    Area,
+    // Face normals weighted by the angle at the vertex. Independent of how a
+    // surface is triangulated.
+    Angle,
+};
+
+// CSR adjacency: the corners (triangle * 3 + k) that reference vertex v are
+// stored contiguously, in increasing order.
+class VertexTriangleAdjacency
+{
+public:
+    VertexTriangleAdjacency() = default;
+    VertexTriangleAdjacency(const std::uint32_t* indices, size_t indexCount, std::uint32_t vertexCount);
+
+    std::uint32_t GetVertexCount()const { return m_offsets.empty() ? 0 : (std::uint32_t)m_offsets.size() - 1; }
+    size_t GetCornerCount()const { return m_corners.size(); }
+
+    const std::uint32_t* CornersBegin(std::uint32_t v)const { return m_corners.data() + m_offsets[v]; }
+    const std::uint32_t* CornersEnd(std::uint32_t v)const { return m_corners.data() + m_offsets[v + 1]; }
+
+private:
+    std::vector<std::uint32_t> m_offsets;
+    std::vector<std::uint32_t> m_corners;
+};
+
+class NormalRecomputer
+{
+public:
+    // indices is a triangle list; it is copied, so the caller's buffer need
+    // not outlive this object. Rebuild the recomputer when the topology changes.
+    NormalRecomputer(const std::uint32_t* indices, size_t indexCount, std::uint32_t vertexCount);
+    explicit NormalRecomputer(const GeometryGenerator::MeshData& meshData);
+    NormalRecomputer(const NormalRecomputer& rhs) = delete;
+    NormalRecomputer& operator=(const NormalRecomputer& rhs) = delete;
+
+    void SetWeighting(NormalWeighting weighting) { m_weighting = weighting; }
+    const VertexTriangleAdjacency& GetAdjacency()const { return m_adjacency; }
+
+    // Recomputes unit normals from strided position and normal streams, for
+    // example &vertices[0].Pos and &vertices[0].Normal with sizeof(Vertex).
+    // Vertices no triangle uses keep their normal.
+    void ComputeNormals(const void* positions, UINT positionStride, void* normals, UINT normalStride);
+
+    // Recomputes Normal and TangentU of meshData in place. Tangents follow the
+    // u direction of TexC and are orthogonalized against the normal.
+    void Compute(GeometryGenerator::MeshData& meshData);
+
+private:
+    // texCoords may be null to skip the tangents.
+    void ComputeFaces(const void* positions, UINT positionStride, const void* texCoords, UINT texCoordStride);
+    // tangents may be null to skip them.
+    void GatherVertices(void* normals, UINT normalStride, void* tangents, UINT tangentStride);
+
+    NormalWeighting m_weighting = NormalWeighting::Area;
+    std::vector<std::uint32_t> m_indices;
+    VertexTriangleAdjacency m_adjacency;
+
+    // Scratch, sized once. m_faceNormals holds the unnormalized cross product
+    // (twice the area); m_cornerWeights the per-corner factor for Angle.
+    std::vector<DirectX::XMFLOAT3> m_faceNormals;
+    std::vector<DirectX::XMFLOAT3> m_faceTangents;
+    std::vector<float> m_cornerWeights;
+};
@@ -0,0 +1,243 @@
+#include "stdafx.h"
+#include "ProjectedGrid.h"
+#include <ppl.h>
+
+using namespace DirectX;
+
+ProjectedGrid::ProjectedGrid(const ProjectedGridDesc& desc) :
+    m_desc(desc)
+{
+    assert(desc.Columns >= 2 && desc.Rows >= 2);
+
+    const float left = -1.0f - m_desc.Margin;
+    const float right = 1.0f + m_desc.Margin;
+    m_paddedColumns = (desc.Columns + 3) & ~3u;
+    m_ndcX.resize(m_paddedColumns);
+    for (UINT j = 0; j < m_paddedColumns; ++j)
+    {
+        m_ndcX[j] = left + (right - left) * (float)std::min(j, desc.Columns - 1) / (float)(desc.Columns - 1);
+    }
+
+    const size_t scratchSize = (size_t)desc.Rows * m_paddedColumns;
+    m_x.resize(scratchSize);
+    m_z.resize(scratchSize);
+    m_heights.resize(scratchSize);
+    m_rowMin.resize(desc.Rows);
+    m_rowMax.resize(desc.Rows);
+}
+
+void ProjectedGrid::BuildIndices(std::vector<std::uint32_t>& indices)const
+{
+    const UINT m = m_desc.Rows;
+    const UINT n = m_desc.Columns;
+    indices.resize((size_t)3 * GetTriangleCount());
+
+    size_t k = 0;
+    for (UINT i = 0; i < m - 1; ++i)
+    {
+        for (UINT j = 0; j < n - 1; ++j)
+        {
+            indices[k] = i * n + j;
+            indices[k + 1] = i * n + j + 1;
+            indices[k + 2] = (i + 1) * n + j;
+
+            indices[k + 3] = (i + 1) * n + j;
+            indices[k + 4] = i * n + j + 1;
+            indices[k + 5] = (i + 1) * n + j + 1;
+            k += 6;
+        }
+    }
+}
+
+bool ProjectedGrid::Project(FXMMATRIX invViewProj, const WaterHeightSource& source, XMFLOAT3* positions)
+{
+    const UINT columns = m_desc.Columns;
+    const UINT rows = m_desc.Rows;
+    const float level = m_desc.WaterLevel;
+    const float left = -1.0f - m_desc.Margin;
+    const float right = 1.0f + m_desc.Margin;
+    const float bottom = -1.0f - m_desc.Margin;
+    const float top = 1.0f + m_desc.Margin;
+
+    XMFLOAT4X4 m;
+    XMStoreFloat4x4(&m, invViewProj);
+
+    // Height of the far-plane point at NDC (x, y).
+    auto farHeight = [&m](float x, float y)
+    {
+        float h = x * m._12 + y * m._22 + m._32 + m._42;
+        float w = x * m._14 + y * m._24 + m._34 + m._44;
+        return h / w;
+    };
+
+    // From above, the water is visible up to the screen row where the far
+    // plane meets it; above that row rays pass over the far edge. From
+    // below the whole screen may see it.
+    XMFLOAT3 eye;
+    XMStoreFloat3(&eye, XMVector3TransformCoord(XMVectorZero(), invViewProj));
+    bool visible = true;
+    float gridTop = top;
+    if (eye.y >= level)
+    {
+        gridTop = bottom;
+        const float edges[2] = { left, right };
+        for (float x : edges)
+        {
+            if (farHeight(x, bottom) >= level)
+            {
+                continue;
+            }
+            if (farHeight(x, top) < level)
+            {
+                gridTop = top;
+                break;
+            }
+
+            // The far height is a ratio of linear functions of y, so the
+            // crossing has a closed form.
+            float num = level * (x * m._14 + m._34 + m._44) - (x * m._12 + m._32 + m._42);
+            float den = m._22 - level * m._24;
+            if (den != 0.0f)
+            {
+                gridTop = std::max(gridTop, std::min(num / den, top));
+            }
+        }
+
+        if (gridTop <= bottom)
+        {
+            visible = false;
+            gridTop = top;
+        }
+    }
+
+    const UINT paddedColumns = m_paddedColumns;
+    const __m128 r0[4] = { _mm_set1_ps(m._11), _mm_set1_ps(m._12), _mm_set1_ps(m._13), _mm_set1_ps(m._14) };
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 waterLevel = _mm_set1_ps(level);
+
+    concurrency::parallel_for(0u, rows, [&](UINT row)
+    {
+        const float y = gridTop - (gridTop - bottom) * (float)row / (float)(rows - 1);
+
+        // Clip-space points on the near (z = 0) and far (z = 1) planes are
+        // linear in NDC x: H = x * r0 + base.
+        __m128 nearBase[4];
+        __m128 farBase[4];
+        const float* r1 = &m._21;
+        const float* r2 = &m._31;
+        const float* r3 = &m._41;
+        for (int c = 0; c < 4; ++c)
+        {
+            nearBase[c] = _mm_set1_ps(y * r1[c] + r3[c]);
+            farBase[c] = _mm_set1_ps(y * r1[c] + r2[c] + r3[c]);
+        }
+
+        float* x = &m_x[(size_t)row * paddedColumns];
+        float* z = &m_z[(size_t)row * paddedColumns];
+        float* heights = &m_heights[(size_t)row * paddedColumns];
+        for (UINT j = 0; j < paddedColumns; j += 4)
+        {
+            __m128 xs = _mm_loadu_ps(&m_ndcX[j]);
+
+            __m128 nearW = _mm_add_ps(_mm_mul_ps(xs, r0[3]), nearBase[3]);
+            __m128 farW = _mm_add_ps(_mm_mul_ps(xs, r0[3]), farBase[3]);
+            __m128 nearX = _mm_div_ps(_mm_add_ps(_mm_mul_ps(xs, r0[0]), nearBase[0]), nearW);
+            __m128 nearY = _mm_div_ps(_mm_add_ps(_mm_mul_ps(xs, r0[1]), nearBase[1]), nearW);
+            __m128 nearZ = _mm_div_ps(_mm_add_ps(_mm_mul_ps(xs, r0[2]), nearBase[2]), nearW);
+            __m128 farX = _mm_div_ps(_mm_add_ps(_mm_mul_ps(xs, r0[0]), farBase[0]), farW);
+            __m128 farY = _mm_div_ps(_mm_add_ps(_mm_mul_ps(xs, r0[1]), farBase[1]), farW);
+            __m128 farZ = _mm_div_ps(_mm_add_ps(_mm_mul_ps(xs, r0[2]), farBase[2]), farW);
+
+            // Where the near-far segment crosses the plane; rays that miss
+            // it before the far plane (including NaNs) stop at the far point.
+            __m128 t = _mm_div_ps(_mm_sub_ps(waterLevel, nearY), _mm_sub_ps(farY, nearY));
+            __m128 hit = _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmple_ps(t, one));
+            t = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, one));
+
+            _mm_storeu_ps(&x[j], _mm_add_ps(nearX, _mm_mul_ps(t, _mm_sub_ps(farX, nearX))));
+            _mm_storeu_ps(&z[j], _mm_add_ps(nearZ, _mm_mul_ps(t, _mm_sub_ps(farZ, nearZ))));
+        }
+
+        if (source)
+        {
+            source(x, z, columns, heights);
+        }
+        else
+        {
+            std::fill(heights, heights + columns, 0.0f);
+        }
+
+        XMFLOAT3* dest = positions + (size_t)row * columns;
+        for (UINT j = 0; j < columns; ++j)
+        {
+            dest[j] = XMFLOAT3(x[j], level + heights[j], z[j]);
+        }
+
+        XMVECTOR rowMin, rowMax;
+        ComputeMinMax(dest, sizeof(XMFLOAT3), columns, rowMin, rowMax);
+        XMStoreFloat3(&m_rowMin[row], rowMin);
+        XMStoreFloat3(&m_rowMax[row], rowMax);
+    });
+
+    XMVECTOR vMin = XMLoadFloat3(&m_rowMin[0]);
+    XMVECTOR vMax = XMLoadFloat3(&m_rowMax[0]);
+    for (UINT row = 1; row < rows; ++row)
+    {
+        vMin = XMVectorMin(vMin, XMLoadFloat3(&m_rowMin[row]));
+        vMax = XMVectorMax(vMax, XMLoadFloat3(&m_rowMax[row]));
+    }
+    m_bounds = MakeVertexBounds(vMin, vMax);
+
+    return visible;
+}
+
+WaveSpectrum::WaveSpectrum(const std::vector<WaveSpectrumComponent>& components)
+{
+    for (const WaveSpectrumComponent& component : components)
+    {
+        float length = std::sqrt(component.Direction.x * component.Direction.x +
+            component.Direction.y * component.Direction.y);
+        if (length == 0.0f || component.WaveLength <= 0.0f)
+        {
+            continue;
+        }
+
+        Wave wave;
+        wave.DirectionX = component.Direction.x / length;
+        wave.DirectionZ = component.Direction.y / length;
+        wave.WaveNumber = XM_2PI / component.WaveLength;
+        wave.AngularSpeed = wave.WaveNumber * component.Speed;
+        wave.Amplitude = component.Amplitude;
+        wave.Phase = component.Phase;
+        m_waves.push_back(wave);
+    }
+}
+
+__m128 WaveSpectrum::Heights4(__m128 x, __m128 z)const
+{
+    XMVECTOR height = XMVectorZero();
+    for (const Wave& wave : m_waves)
+    {
+        // A * sin(k * (d . p) - w * t + phase)
+        XMVECTOR along = XMVectorMultiplyAdd(x, XMVectorReplicate(wave.DirectionX),
+            XMVectorMultiply(z, XMVectorReplicate(wave.DirectionZ)));
+        XMVECTOR angle = XMVectorMultiplyAdd(along, XMVectorReplicate(wave.WaveNumber),
+            XMVectorReplicate(wave.Phase - wave.AngularSpeed * m_time));
+        height = XMVectorMultiplyAdd(XMVectorSin(angle), XMVectorReplicate(wave.Amplitude), height);
+    }
+    return height;
+}
+
+void WaveSpectrum::GetHeights(const float* x, const float* z, size_t count, float* heights)const
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_ps(heights + i, Heights4(_mm_loadu_ps(x + i), _mm_loadu_ps(z + i)));
+    }
+    for (; i < count; ++i)
+    {
+        heights[i] = _mm_cvtss_f32(Heights4(_mm_set1_ps(x[i]), _mm_set1_ps(z[i])));
+    }
+}
@@ -0,0 +1,119 @@
+// Projected-grid water.
+//
+// Instead of a fixed world-space mesh, the water is a regular grid laid out
+// in screen space and projected onto the water plane through the inverse
+// view-projection matrix each frame. Grid lines are evenly spaced on screen,
+// so vertices crowd together near the camera and thin out towards the
+// horizon, and none are spent on water outside the view. The grid only spans
+// the screen rows below the horizon; rows that would still miss the plane are
+// clamped to the far plane. Heights are then sampled at the projected points
+// from a WaterHeightSource, e.g. the Waves solution, a WaveSpectrum or both.
+//
+// Projection runs on the CPU, four vertices at a time, one task per grid row.
+// The per-row scratch is sized once at construction, so projecting a frame
+// allocates nothing.
+#pragma once
+#include "stdafx.h"
+#include "BoundingVolume.h"
+#include <functional>
+
+// Fills heights[i] for the points (x[i], z[i]). Called from several threads.
+using WaterHeightSource = std::function<void(const float* x, const float* z, size_t count, float* heights)>;
+
+struct ProjectedGridDesc
+{
+    // Grid vertices across and up the screen.
+    UINT Columns = 128;
+    UINT Rows = 128;
+
+    // Height of the undisturbed water plane.
+    float WaterLevel = 0.0f;
+
+    // How far the grid reaches past the screen edges, in NDC units, so that
+    // displaced vertices near the border still cover it.
+    float Margin = 0.1f;
+};
+
+class ProjectedGrid
+{
+public:
+    explicit ProjectedGrid(const ProjectedGridDesc& desc);
+    ProjectedGrid(const ProjectedGrid& rhs) = delete;
+    ProjectedGrid& operator=(const ProjectedGrid& rhs) = delete;
+
+    const ProjectedGridDesc& GetDesc()const { return m_desc; }
+    UINT GetVertexCount()const { return m_desc.Columns * m_desc.Rows; }
+    UINT GetTriangleCount()const { return (m_desc.Columns - 1) * (m_desc.Rows - 1) * 2; }
+
+    // Two triangles per quad, wound like the Waves grid. Row 0 is the top of
+    // the grid, the rows farthest from the camera.
+    void BuildIndices(std::vector<std::uint32_t>& indices)const;
+
+    // Projects the grid seen through invViewProj onto the water plane and
+    // adds the heights of source, which may be empty for flat water. Writes
+    // GetVertexCount() world-space positions row by row. Returns false if no
+    // water is in view; the positions are then degenerate and should not be
+    // drawn.
+    bool Project(DirectX::FXMMATRIX invViewProj, const WaterHeightSource& source, DirectX::XMFLOAT3* positions);
+
+    // Bounds of the positions written by the last Project.
+    const VertexBounds& GetBounds()const { return m_bounds; }
+
+private:
+    ProjectedGridDesc m_desc;
+
+    // NDC x of every column, padded to whole groups of four.
+    UINT m_paddedColumns = 0;
+    std::vector<float> m_ndcX;
+
+    // Per-row scratch, m_paddedColumns floats a row, so rows projected in
+    // parallel never share a slice.
+    std::vector<float> m_x;
+    std::vector<float> m_z;
+    std::vector<float> m_heights;
+
+    // Per-row extents, merged into m_bounds once every row is done.
+    std::vector<DirectX::XMFLOAT3> m_rowMin;
+    std::vector<DirectX::XMFLOAT3> m_rowMax;
+    VertexBounds m_bounds;
+};
+
+struct WaveSpectrumComponent
+{
+    // Direction of travel in xz; normalized by WaveSpectrum.
+    DirectX::XMFLOAT2 Direction = { 1.0f, 0.0f };
+    float WaveLength = 10.0f;
+    float Amplitude = 0.1f;
+    float Speed = 2.0f;
+    float Phase = 0.0f;
+};
+
+// Sum of directional sine waves.
+class WaveSpectrum
+{
+public:
+    WaveSpectrum() = default;
+    explicit WaveSpectrum(const std::vector<WaveSpectrumComponent>& components);
+
+    void SetTime(float time) { m_time = time; }
+
+    // Heights of count points at the current time; x and z are read four at a
+    // time. Matches WaterHeightSource.
+    void GetHeights(const float* x, const float* z, size_t count, float* heights)const;
+
+private:
+    __m128 Heights4(__m128 x, __m128 z)const;
+
+    struct Wave
+    {
+        float DirectionX;
+        float DirectionZ;
+        float WaveNumber;
+        float AngularSpeed;
+        float Amplitude;
+        float Phase;
+    };
+
+    std::vector<Wave> m_waves;
+    float m_time = 0.0f;
+};
@@ -0,0 +1,355 @@
+#include "stdafx.h"
+#include "RangeAllocator.h"
+#include "D3DUtil.h"
+#include <intrin.h>
+
+namespace
+{
+    int HighestBit(UINT64 value)
+    {
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return (int)index;
+    }
+
+    int LowestBit(UINT64 value)
+    {
+        unsigned long index;
+        _BitScanForward64(&index, value);
+        return (int)index;
+    }
+}
+
+RangeAllocator::RangeAllocator(UINT64 size)
+{
+    Reset(size);
+}
+
+void RangeAllocator::Reset(UINT64 size)
+{
+    m_size = 0;
+    m_usedSize = 0;
+    m_freeBlockCount = 0;
+
+    m_blocks.clear();
+    m_unusedBlocks.clear();
+    m_allocated.clear();
+    m_firstBlock = NullBlock;
+    m_lastBlock = NullBlock;
+
+    m_firstLevelBitmap = 0;
+    for (int fl = 0; fl < FirstLevelCount; ++fl)
+    {
+        m_secondLevelBitmap[fl] = 0;
+        for (int sl = 0; sl < SecondLevelCount; ++sl)
+        {
+            m_freeHeads[fl][sl] = NullBlock;
+        }
+    }
+
+    Grow(size);
+}
+
+void RangeAllocator::Grow(UINT64 newSize)
+{
+    if (newSize <= m_size)
+    {
+        return;
+    }
+
+    UINT64 extra = newSize - m_size;
+    if (m_lastBlock != NullBlock && m_blocks[m_lastBlock].IsFree)
+    {
+        RemoveFree(m_lastBlock);
+        m_blocks[m_lastBlock].Size += extra;
+        InsertFree(m_lastBlock);
+    }
+    else
+    {
+        UINT32 block = NewBlock();
+        m_blocks[block].Offset = m_size;
+        m_blocks[block].Size = extra;
+        m_blocks[block].PrevPhysical = m_lastBlock;
+        if (m_lastBlock != NullBlock)
+        {
+            m_blocks[m_lastBlock].NextPhysical = block;
+        }
+        else
+        {
+            m_firstBlock = block;
+        }
+        m_lastBlock = block;
+        InsertFree(block);
+    }
+    m_size = newSize;
+}
+
+void RangeAllocator::Mapping(UINT64 size, int& fl, int& sl)
+{
+    if (size < SecondLevelCount)
+    {
+        // Small sizes get one exact bin each.
+        fl = 0;
+        sl = (int)size;
+    }
+    else
+    {
+        int msb = HighestBit(size);
+        fl = msb - SecondLevelBits + 1;
+        sl = (int)((size >> (msb - SecondLevelBits)) ^ SecondLevelCount);
+    }
+}
+
+UINT32 RangeAllocator::NewBlock()
+{
+    if (!m_unusedBlocks.empty())
+    {
+        UINT32 block = m_unusedBlocks.back();
+        m_unusedBlocks.pop_back();
+        m_blocks[block] = Block();
+        return block;
+    }
+    m_blocks.push_back(Block());
+    return (UINT32)m_blocks.size() - 1;
+}
+
+void RangeAllocator::DeleteBlock(UINT32 block)
+{
+    m_unusedBlocks.push_back(block);
+}
+
+void RangeAllocator::InsertFree(UINT32 block)
+{
+    int fl, sl;
+    Mapping(m_blocks[block].Size, fl, sl);
+
+    Block& b = m_blocks[block];
+    b.IsFree = true;
+    b.PrevFree = NullBlock;
+    b.NextFree = m_freeHeads[fl][sl];
+    if (b.NextFree != NullBlock)
+    {
+        m_blocks[b.NextFree].PrevFree = block;
+    }
+    m_freeHeads[fl][sl] = block;
+
+    m_firstLevelBitmap |= 1ull << fl;
+    m_secondLevelBitmap[fl] |= 1u << sl;
+    ++m_freeBlockCount;
+}
+
+void RangeAllocator::RemoveFree(UINT32 block)
+{
+    int fl, sl;
+    Mapping(m_blocks[block].Size, fl, sl);
+
+    Block& b = m_blocks[block];
+    if (b.PrevFree != NullBlock)
+    {
+        m_blocks[b.PrevFree].NextFree = b.NextFree;
+    }
+    else
+    {
+        m_freeHeads[fl][sl] = b.NextFree;
+    }
+    if (b.NextFree != NullBlock)
+    {
+        m_blocks[b.NextFree].PrevFree = b.PrevFree;
+    }
+    b.PrevFree = NullBlock;
+    b.NextFree = NullBlock;
+    b.IsFree = false;
+
+    if (m_freeHeads[fl][sl] == NullBlock)
+    {
+        m_secondLevelBitmap[fl] &= ~(1u << sl);
+        if (m_secondLevelBitmap[fl] == 0)
+        {
+            m_firstLevelBitmap &= ~(1ull << fl);
+        }
+    }
+    --m_freeBlockCount;
+}
+
+UINT32 RangeAllocator::FindFree(UINT64 size)const
+{
+    // Round the request up to the next bin boundary so that any block in the
+    // bin found is large enough (good fit rather than best fit).
+    if (size >= SecondLevelCount)
+    {
+        UINT64 round = (1ull << (HighestBit(size) - SecondLevelBits)) - 1;
+        if (size > ~0ull - round)
+        {
+            return NullBlock;
+        }
+        size += round;
+    }
+
+    int fl, sl;
+    Mapping(size, fl, sl);
+
+    UINT32 slMap = m_secondLevelBitmap[fl] & (~0u << sl);
+    if (slMap == 0)
+    {
+        UINT64 flMap = fl + 1 < 64 ? (m_firstLevelBitmap & (~0ull << (fl + 1))) : 0;
+        if (flMap == 0)
+        {
+            return NullBlock;
+        }
+        fl = LowestBit(flMap);
+        slMap = m_secondLevelBitmap[fl];
+    }
+    sl = LowestBit(slMap);
+    return m_freeHeads[fl][sl];
+}
+
+UINT32 RangeAllocator::SplitFront(UINT32 block, UINT64 size)
+{
+    if (m_blocks[block].Size <= size)
+    {
+        return NullBlock;
+    }
+
+    UINT32 rest = NewBlock();
+
+    // NewBlock may reallocate m_blocks, so take references afterwards.
+    Block& b = m_blocks[block];
+    Block& r = m_blocks[rest];
+    r.Offset = b.Offset + size;
+    r.Size = b.Size - size;
+    r.PrevPhysical = block;
+    r.NextPhysical = b.NextPhysical;
+    if (r.NextPhysical != NullBlock)
+    {
+        m_blocks[r.NextPhysical].PrevPhysical = rest;
+    }
+    else
+    {
+        m_lastBlock = rest;
+    }
+    b.Size = size;
+    b.NextPhysical = rest;
+    return rest;
+}
+
+void RangeAllocator::MergeWithNext(UINT32 block)
+{
+    UINT32 next = m_blocks[block].NextPhysical;
+    Block& b = m_blocks[block];
+    const Block& n = m_blocks[next];
+
+    b.Size += n.Size;
+    b.NextPhysical = n.NextPhysical;
+    if (b.NextPhysical != NullBlock)
+    {
+        m_blocks[b.NextPhysical].PrevPhysical = block;
+    }
+    else
+    {
+        m_lastBlock = block;
+    }
+    DeleteBlock(next);
+}
+
+UINT64 RangeAllocator::Allocate(UINT64 size, UINT64 alignment)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    if (size == 0)
+    {
+        size = 1;
+    }
+
+    // Over-ask by the worst case padding so the aligned range always fits.
+    UINT32 block = FindFree(size + alignment - 1);
+    if (block == NullBlock)
+    {
+        return InvalidOffset;
+    }
+    RemoveFree(block);
+
+    UINT64 alignedOffset = AlignUp(m_blocks[block].Offset, alignment);
+    UINT64 padding = alignedOffset - m_blocks[block].Offset;
+    if (padding > 0)
+    {
+        UINT32 aligned = SplitFront(block, padding);
+        InsertFree(block);
+        block = aligned;
+    }
+
+    UINT32 rest = SplitFront(block, size);
+    if (rest != NullBlock)
+    {
+        InsertFree(rest);
+    }
+
+    m_blocks[block].IsFree = false;
+    m_allocated[alignedOffset] = block;
+    m_usedSize += size;
+    return alignedOffset;
+}
+
+void RangeAllocator::Free(UINT64 offset)
+{
+    auto it = m_allocated.find(offset);
+    assert(it != m_allocated.end() && "Freeing an offset that was not allocated.");
+    if (it == m_allocated.end())
+    {
+        return;
+    }
+
+    UINT32 block = it->second;
+    m_allocated.erase(it);
+    m_usedSize -= m_blocks[block].Size;
+
+    UINT32 next = m_blocks[block].NextPhysical;
+    if (next != NullBlock && m_blocks[next].IsFree)
+    {
+        RemoveFree(next);
+        MergeWithNext(block);
+    }
+
+    UINT32 prev = m_blocks[block].PrevPhysical;
+    if (prev != NullBlock && m_blocks[prev].IsFree)
+    {
+        RemoveFree(prev);
+        MergeWithNext(prev);
+        block = prev;
+    }
+
+    InsertFree(block);
+}
+
+UINT64 RangeAllocator::GetAllocationSize(UINT64 offset)const
+{
+    auto it = m_allocated.find(offset);
+    return it != m_allocated.end() ? m_blocks[it->second].Size : 0;
+}
+
+UINT64 RangeAllocator::GetLargestFreeBlock()const
+{
+    if (m_firstLevelBitmap == 0)
+    {
+        return 0;
+    }
+
+    // The largest block lives in the highest non-empty bin, but sizes within a
+    // bin differ, so walk that one list.
+    int fl = HighestBit(m_firstLevelBitmap);
+    int sl = HighestBit(m_secondLevelBitmap[fl]);
+    UINT64 largest = 0;
+    for (UINT32 i = m_freeHeads[fl][sl]; i != NullBlock; i = m_blocks[i].NextFree)
+    {
+        largest = std::max(largest, m_blocks[i].Size);
+    }
+    return largest;
+}
+
+float RangeAllocator::GetFragmentation()const
+{
+    UINT64 freeSize = GetFreeSize();
+    if (freeSize == 0)
+    {
+        return 0.0f;
+    }
+    return 1.0f - (float)((double)GetLargestFreeBlock() / (double)freeSize);
+}
@@ -0,0 +1,109 @@
+// Two-level segregated fit (TLSF) allocator over an abstract range of units.
+//
+// The allocator never touches memory: it hands out offsets into [0, size) and
+// the caller decides what a unit is (bytes of a heap, vertices of a buffer,
+// descriptors of a heap...). Allocation and free are O(1): free blocks are
+// binned by a first level (power of two) and a second level (linear split of
+// that power of two), with a bitmap per level to find a non-empty bin with
+// two bit scans. Adjacent free blocks are merged on free.
+#pragma once
+#include "stdafx.h"
+
+class RangeAllocator
+{
+public:
+    static const UINT64 InvalidOffset = ~0ull;
+
+    explicit RangeAllocator(UINT64 size = 0);
+    RangeAllocator(const RangeAllocator& rhs) = delete;
+    RangeAllocator& operator=(const RangeAllocator& rhs) = delete;
+
+    // Forgets every allocation and manages [0, size).
+    void Reset(UINT64 size);
+
+    // Extends the managed range to [0, newSize). Existing offsets stay valid.
+    void Grow(UINT64 newSize);
+
+    // Returns the offset of a free range of size units whose offset is a
+    // multiple of alignment (a power of two), or InvalidOffset if no free
+    // block is large enough.
+    UINT64 Allocate(UINT64 size, UINT64 alignment = 1);
+
+    // offset must come from Allocate and not have been freed yet.
+    void Free(UINT64 offset);
+
+    // Size of the allocation starting at offset, 0 if there is none.
+    UINT64 GetAllocationSize(UINT64 offset)const;
+
+    UINT64 GetSize()const { return m_size; }
+    UINT64 GetUsedSize()const { return m_usedSize; }
+    UINT64 GetFreeSize()const { return m_size - m_usedSize; }
+    UINT GetAllocationCount()const { return (UINT)m_allocated.size(); }
+    UINT GetFreeBlockCount()const { return m_freeBlockCount; }
+
+    // Largest single allocation that would currently succeed (alignment 1).
+    UINT64 GetLargestFreeBlock()const;
+
+    // 0 when all free space is one block, approaching 1 as it splinters.
+    float GetFragmentation()const;
+
+    // Calls fn(offset, size) for every live allocation in address order.
+    template<typename Fn>
+    void ForEachAllocation(Fn fn)const
+    {
+        for (UINT32 i = m_firstBlock; i != NullBlock; i = m_blocks[i].NextPhysical)
+        {
+            if (!m_blocks[i].IsFree)
+            {
+                fn(m_blocks[i].Offset, m_blocks[i].Size);
+            }
+        }
+    }
+
+private:
+    static const UINT32 NullBlock = 0xffffffff;
+    static const int SecondLevelBits = 4;
+    static const int SecondLevelCount = 1 << SecondLevelBits;
+    static const int FirstLevelCount = 64 - SecondLevelBits + 1;
+
+    struct Block
+    {
+        UINT64 Offset = 0;
+        UINT64 Size = 0;
+        UINT32 PrevPhysical = NullBlock;
+        UINT32 NextPhysical = NullBlock;
+        UINT32 PrevFree = NullBlock;
+        UINT32 NextFree = NullBlock;
+        bool IsFree = false;
+    };
+
+    static void Mapping(UINT64 size, int& fl, int& sl);
+
+    UINT32 NewBlock();
+    void DeleteBlock(UINT32 block);
+
+    void InsertFree(UINT32 block);
+    void RemoveFree(UINT32 block);
+    UINT32 FindFree(UINT64 size)const;
+
+    // Splits size units off the front of block; the remainder becomes a new
+    // free block. Returns the remainder or NullBlock.
+    UINT32 SplitFront(UINT32 block, UINT64 size);
+    void MergeWithNext(UINT32 block);
+
+    UINT64 m_size = 0;
+    UINT64 m_usedSize = 0;
+    UINT m_freeBlockCount = 0;
+
+    std::vector<Block> m_blocks;
+    std::vector<UINT32> m_unusedBlocks;
+    UINT32 m_firstBlock = NullBlock;
+    UINT32 m_lastBlock = NullBlock;
+
+    UINT64 m_firstLevelBitmap = 0;
+    UINT32 m_secondLevelBitmap[FirstLevelCount] = {};
+    UINT32 m_freeHeads[FirstLevelCount][SecondLevelCount];
+
+    // Offset of each live allocation to its block.
+    std::unordered_map<UINT64, UINT32> m_allocated;
+};
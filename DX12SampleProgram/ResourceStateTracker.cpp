@@ -0,0 +1,163 @@
+#include "stdafx.h"
+#include "ResourceStateTracker.h"
+
+namespace
+{
+    // States that only read; a resource in several of them at once can be
+    // used as any one without a barrier.
+    const D3D12_RESOURCE_STATES ReadOnlyStates = D3D12_RESOURCE_STATE_GENERIC_READ |
+        D3D12_RESOURCE_STATE_DEPTH_READ | D3D12_RESOURCE_STATE_RESOLVE_SOURCE;
+}
+
+void ResourceStateRegistry::Register(ID3D12Resource* resource, D3D12_RESOURCE_STATES state)
+{
+    assert(resource != nullptr);
+    m_states[resource] = state;
+}
+
+void ResourceStateRegistry::Unregister(ID3D12Resource* resource)
+{
+    m_states.erase(resource);
+}
+
+bool ResourceStateRegistry::GetState(ID3D12Resource* resource, D3D12_RESOURCE_STATES& state)const
+{
+    auto it = m_states.find(resource);
+    if (it == m_states.end())
+    {
+        return false;
+    }
+    state = it->second;
+    return true;
+}
+
+ResourceStateTracker::ResourceStateTracker(ResourceStateRegistry& registry) :
+    m_registry(registry)
+{
+}
+
+bool ResourceStateTracker::Includes(D3D12_RESOURCE_STATES current, D3D12_RESOURCE_STATES requested)
+{
+    if (current == requested)
+    {
+        return true;
+    }
+
+    // COMMON is zero, so it is never part of another state.
+    return requested != D3D12_RESOURCE_STATE_COMMON &&
+        (current & ~ReadOnlyStates) == 0 &&
+        (current & requested) == requested;
+}
+
+void ResourceStateTracker::Transition(ID3D12Resource* resource, D3D12_RESOURCE_STATES state)
+{
+    assert(resource != nullptr);
+    ++m_stats.TransitionsRequested;
+
+    auto it = m_local.find(resource);
+    if (it == m_local.end())
+    {
+        // First use in this list; Submit works out how to get here.
+        LocalState local;
+        local.State = state;
+        m_local.emplace(resource, local);
+        m_initial.emplace_back(resource, state);
+        return;
+    }
+
+    LocalState& local = it->second;
+    if (Includes(local.State, state))
+    {
+        ++m_stats.BarriersElided;
+        return;
+    }
+
+    if (local.PendingBatch == m_batch)
+    {
+        // Nothing has used the intermediate state yet.
+        m_pending[local.PendingIndex].Transition.StateAfter = state;
+        ++m_stats.BarriersMerged;
+    }
+    else
+    {
+        local.PendingIndex = (UINT)m_pending.size();
+        local.PendingBatch = m_batch;
+        m_pending.push_back(CD3DX12_RESOURCE_BARRIER::Transition(resource, local.State, state));
+    }
+    local.State = state;
+}
+
+void ResourceStateTracker::FlushBarriers(ID3D12GraphicsCommandList* cmdList)
+{
+    UINT count = 0;
+    for (const D3D12_RESOURCE_BARRIER& barrier : m_pending)
+    {
+        if (barrier.Transition.StateBefore != barrier.Transition.StateAfter)
+        {
+            m_pending[count++] = barrier;
+        }
+    }
+
+    if (count > 0)
+    {
+        cmdList->ResourceBarrier(count, m_pending.data());
+        m_stats.BarriersEmitted += count;
+        ++m_stats.BarrierCalls;
+    }
+
+    m_pending.clear();
+    ++m_batch;
+}
+
+UINT ResourceStateTracker::Submit(std::vector<D3D12_RESOURCE_BARRIER>& initialBarriers)
+{
+    assert(m_pending.empty() && "FlushBarriers was not called before closing the command list.");
+
+    UINT count = 0;
+    for (const auto& initial : m_initial)
+    {
+        D3D12_RESOURCE_STATES before = D3D12_RESOURCE_STATE_COMMON;
+        if (!m_registry.GetState(initial.first, before))
+        {
+            // Its state before the list cannot be known, and guessing one
+            // gives the debug layer a barrier that does not match.
+            initialBarriers.resize(initialBarriers.size() - count);
+            Reset();
+            throw std::runtime_error("ResourceStateTracker::Submit: a resource was used without being registered.");
+        }
+
+        // Only an exact match is left alone: the barriers recorded in the
+        // list name this state as their before state.
+        if (before == initial.second)
+        {
+            ++m_stats.BarriersElided;
+            continue;
+        }
+
+        initialBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(initial.first, before, initial.second));
+        ++count;
+    }
+
+    for (const auto& local : m_local)
+    {
+        m_registry.Register(local.first, local.second.State);
+    }
+
+    if (count > 0)
+    {
+        m_stats.BarriersEmitted += count;
+        m_stats.InitialBarriers += count;
+        ++m_stats.BarrierCalls;
+    }
+
+    Reset();
+    return count;
+}
+
+void ResourceStateTracker::Reset()
+{
+    m_local.clear();
+    m_initial.clear();
+    m_pending.clear();
+    ++m_batch;
+}
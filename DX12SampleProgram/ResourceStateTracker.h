@@ -0,0 +1,116 @@
+// Resource state tracking, so command lists ask for the state they need
+// instead of spelling out both sides of every barrier.
+//
+// ResourceStateRegistry holds the state each resource is left in by the
+// command lists submitted so far. A ResourceStateTracker belongs to one
+// command list while it records. Transition looks up the state the resource
+// has in this list, drops the request if the resource is already there (or
+// in a read state that includes it), and otherwise queues a barrier; a
+// barrier still queued for the same resource is changed in place rather than
+// followed by another, so A->B->C becomes A->C and A->B->A disappears.
+// FlushBarriers issues everything queued in one ResourceBarrier call, and is
+// called before the commands that depend on the new states.
+//
+// The first time a list uses a resource its state before the list is not
+// known, since lists may be recorded in any order. The tracker remembers the
+// state the list needs and leaves it to Submit, called in execution order,
+// to compare it with the registry: the barriers it returns go on a small
+// list executed just before this one, and the registry takes the states this
+// list leaves behind.
+//
+// Resources are tracked as a whole, keyed by pointer: register a resource
+// when it is created and unregister it before it is released. Submitting a
+// list that used a resource the registry does not know throws.
+#pragma once
+#include "stdafx.h"
+#include "D3DUtil.h"
+#include <unordered_map>
+
+class ResourceStateRegistry
+{
+public:
+    // Also updates the state of a resource already registered.
+    void Register(ID3D12Resource* resource, D3D12_RESOURCE_STATES state);
+    void Unregister(ID3D12Resource* resource);
+
+    // False if resource was never registered.
+    bool GetState(ID3D12Resource* resource, D3D12_RESOURCE_STATES& state)const;
+
+    UINT GetCount()const { return (UINT)m_states.size(); }
+
+private:
+    std::unordered_map<ID3D12Resource*, D3D12_RESOURCE_STATES> m_states;
+};
+
+struct ResourceStateTrackerStats
+{
+    UINT64 TransitionsRequested = 0;
+
+    // Barriers recorded, in FlushBarriers or on the list returned by Submit,
+    // and the ResourceBarrier calls they took.
+    UINT64 BarriersEmitted = 0;
+    UINT64 BarrierCalls = 0;
+    UINT64 InitialBarriers = 0;
+
+    // Requests that needed no barrier, and those folded into a barrier
+    // already queued.
+    UINT64 BarriersElided = 0;
+    UINT64 BarriersMerged = 0;
+};
+
+class ResourceStateTracker
+{
+public:
+    explicit ResourceStateTracker(ResourceStateRegistry& registry);
+    ResourceStateTracker(const ResourceStateTracker& rhs) = delete;
+    ResourceStateTracker& operator=(const ResourceStateTracker& rhs) = delete;
+
+    // resource is to be in state for the commands recorded after the next
+    // FlushBarriers.
+    void Transition(ID3D12Resource* resource, D3D12_RESOURCE_STATES state);
+
+    // Records the queued barriers on cmdList with a single call.
+    void FlushBarriers(ID3D12GraphicsCommandList* cmdList);
+
+    // Once the list is closed and about to be executed: appends to
+    // initialBarriers what must run before it, commits its final states to
+    // the registry and gets the tracker ready for the next recording.
+    // Returns the number of barriers appended. Throws, appending nothing, if
+    // the list used a resource that is not registered; the tracker is then
+    // still ready for the next recording, and the registry is unchanged.
+    UINT Submit(std::vector<D3D12_RESOURCE_BARRIER>& initialBarriers);
+
+    const ResourceStateTrackerStats& GetStats()const { return m_stats; }
+
+private:
+    struct LocalState
+    {
+        D3D12_RESOURCE_STATES State = D3D12_RESOURCE_STATE_COMMON;
+
+        // Index into m_pending of this resource's queued barrier, valid only
+        // while PendingBatch is the current batch.
+        UINT PendingIndex = 0;
+        UINT64 PendingBatch = 0;
+    };
+
+    // Whether a resource in current can be used as requested without a
+    // barrier.
+    static bool Includes(D3D12_RESOURCE_STATES current, D3D12_RESOURCE_STATES requested);
+
+    // Forgets the list just recorded.
+    void Reset();
+
+    ResourceStateRegistry& m_registry;
+
+    std::unordered_map<ID3D12Resource*, LocalState> m_local;
+
+    // First state needed by each resource, in the order of first use.
+    std::vector<std::pair<ID3D12Resource*, D3D12_RESOURCE_STATES>> m_initial;
+
+    // Queued barriers; one whose before and after states came to match is
+    // skipped when flushed. Batch 0 is never current.
+    std::vector<D3D12_RESOURCE_BARRIER> m_pending;
+    UINT64 m_batch = 1;
+
+    ResourceStateTrackerStats m_stats;
+};
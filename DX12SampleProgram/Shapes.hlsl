@@ -1,6 +1,14 @@
+// PackedVertexIn and DecodeVertex for the layout the app packs shapes in;
+// the app serves this file when it compiles the shader.
+#include "VertexDecode.hlsli"
+
 cbuffer cbPerObject :register(b0)
 {
     float4x4 gWorld;
+    float3 gPosScale;
+    float cbPerObjectPad0;
+    float3 gPosBias;
+    float cbPerObjectPad2;
 };
 
 cbuffer cbPass:register(b1)
@@ -21,24 +29,19 @@ cbuffer cbPass:register(b1)
     float  gDeltaTime;
 };
 
-struct VertexIn
-{
-    float3 PosL:POSITION;
-    float4 Color:COLOR;
-};
-
 struct VertexOut
 {
     float4 PosH:SV_POSITION;
     float4 Color:COLOR;
 };
 
-VertexOut VSMain(VertexIn vin)
+VertexOut VSMain(PackedVertexIn packed)
 {
     VertexOut vout;
+    DecodedVertex vin = DecodeVertex(packed, gPosScale, gPosBias);
 
     // Transform to homogeneous clip space.
-    float4 posW = mul(float4(vin.PosL.x,vin.PosL.y, vin.PosL.z, 1.0f), gWorld);
+    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
     vout.PosH = mul(posW, gViewProj);
 
     // Just pass vertex color into the pixel shader.
@@ -1,8 +1,25 @@
 #include "stdafx.h"
 #include "ShapesApp.h"
 #if IS_ENABLE_SHAPE_APP
+namespace
+{
+    // Shapes only need a position and a flat color: 16-bit positions over
+    // each shape's bounds and an 8-bit color make 12 bytes a vertex instead
+    // of the 28 of a float3 position and float4 color.
+    VertexLayoutDesc ShapesVertexLayout()
+    {
+        VertexLayoutDesc desc;
+        desc.Position = PositionEncoding::UNorm16;
+        desc.Normal = DirectionEncoding::None;
+        desc.Tangent = DirectionEncoding::None;
+        desc.TexCoord = TexCoordEncoding::None;
+        desc.Color = ColorEncoding::UNorm8;
+        return desc;
+    }
+}
+
 ShapesApp::ShapesApp(HINSTANCE hInstance)
-    :D3DAppBase(hInstance)
+    :D3DAppBase(hInstance), m_vertexFormat(ShapesVertexLayout())
 {}
 
 ShapesApp::~ShapesApp()
@@ -55,92 +72,169 @@ void ShapesApp::BuildShadersAndInputLayout()
 #else
     UINT compileFlags = 0;
 #endif
-    ThrowIfFailed(D3DCompileFromFile(L"Shapes.hlsl", nullptr, nullptr, "VSMain", "vs_5_0", compileFlags, 0, &m_shaders["standardVS"], nullptr));
-    ThrowIfFailed(D3DCompileFromFile(L"Shapes.hlsl", nullptr, nullptr, "PSMain", "ps_5_0", compileFlags, 0, &m_shaders["opaquePS"], nullptr));
+    // Shapes.hlsl includes the decode of m_vertexFormat.
+    VertexDecodeInclude decodeInclude(m_vertexFormat);
+    ThrowIfFailed(D3DCompileFromFile(L"Shapes.hlsl", nullptr, &decodeInclude, "VSMain", "vs_5_0", compileFlags, 0, &m_shaders["standardVS"], nullptr));
+    ThrowIfFailed(D3DCompileFromFile(L"Shapes.hlsl", nullptr, &decodeInclude, "PSMain", "ps_5_0", compileFlags, 0, &m_shaders["opaquePS"], nullptr));
+
+    m_inputLayout = m_vertexFormat.InputLayout();
+}
 
-    m_inputLayout =
+namespace
+{
+    struct ShapeVertexContext
     {
-        {"POSITION",0,DXGI_FORMAT_R32G32B32_FLOAT,0,0,D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,0},
-        {"COLOR",0,DXGI_FORMAT_R32G32B32A32_FLOAT,0,12,D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,0}
+        const VertexFormat* Format = nullptr;
+        PackedVertexRange Range;
+        XMFLOAT4 Color;
     };
+
+    // Packs the position of a generated vertex and paints it with the color
+    // of the shape.
+    void WriteShapeVertex(void* dst, const GeometryGenerator::Vertex& v, void* context)
+    {
+        const ShapeVertexContext* shape = static_cast<const ShapeVertexContext*>(context);
+        shape->Format->PackVertex(shape->Range, XMLoadFloat3(&v.Position), XMLoadFloat3(&v.Normal),
+            XMLoadFloat3(&v.TangentU), XMLoadFloat2(&v.TexC), XMLoadFloat4(&shape->Color), dst);
+    }
+}
+
+GeometryPool::Handle ShapesApp::AddShape(const MeshCacheKey& key, const GeometryGenerator::MeshCounts& counts,
+    XMFLOAT4 color, const VertexBounds& bounds,
+    const std::function<void(const GeometryGenerator::MeshWriter&)>& generate, SubmeshGeometry& submesh)
+{
+    const GeometryPoolDesc& poolDesc = m_geometryPool->GetDesc();
+
+    MappedMeshFile cachedFile;
+    if (m_meshCache->Map(key.Value(), cachedFile))
+    {
+        const MeshFileHeader& header = cachedFile.Header();
+        if (header.VertexByteStride == poolDesc.VertexByteStride &&
+            header.IndexFormat == (std::uint32_t)poolDesc.IndexFormat &&
+            header.SubmeshCount == 1)
+        {
+            // Straight from the mapped view into the pool's staging buffer.
+            GeometryPool::Handle handle = m_geometryPool->Add(m_commandList.Get(),
+                cachedFile.VertexData(), header.VertexCount, cachedFile.IndexData(), header.IndexCount);
+            submesh = m_geometryPool->Rebase(handle, MeshCache::ReadSubmeshes(cachedFile)[0].second);
+            return handle;
+        }
+    }
+
+    // Generate into scratch memory, which the cache file is written from.
+    // The pool's staging is write-combined and mapped write-only, so it is
+    // filled from the scratch and never read back.
+    std::vector<BYTE> vertexData((size_t)counts.VertexCount * m_vertexFormat.Stride());
+    std::vector<BYTE> indexData((size_t)counts.IndexCount * IndexFormatByteSize(poolDesc.IndexFormat));
+
+    // Positions are quantized over the bounds the caller knows analytically,
+    // which are also kept as the submesh bounds so a cache hit can rebuild
+    // the decode constants from them.
+    ShapeVertexContext context;
+    context.Format = &m_vertexFormat;
+    context.Range = m_vertexFormat.MakeRange(bounds.Box);
+    context.Color = color;
+
+    GeometryGenerator::MeshWriter writer;
+    writer.VertexData = vertexData.data();
+    writer.VertexStride = m_vertexFormat.Stride();
+    writer.WriteVertex = WriteShapeVertex;
+    writer.Context = &context;
+    writer.IndexData = indexData.data();
+    writer.IndexByteWidth = IndexFormatByteSize(poolDesc.IndexFormat);
+    generate(writer);
+
+    // Each shape is its own pool allocation, so it starts at zero locally and
+    // the pool supplies the real BaseVertexLocation/StartIndexLocation.
+    SubmeshGeometry localSubmesh;
+    localSubmesh.IndexCount = counts.IndexCount;
+    localSubmesh.StartIndexCount = 0;
+    localSubmesh.BaseVertexLocation = 0;
+    localSubmesh.SetBounds(bounds);
+
+    MeshCacheEntry entry;
+    entry.VertexData = vertexData.data();
+    entry.VertexByteStride = m_vertexFormat.Stride();
+    entry.VertexCount = counts.VertexCount;
+    entry.IndexData = indexData.data();
+    entry.IndexFormat = poolDesc.IndexFormat;
+    entry.IndexCount = counts.IndexCount;
+    entry.Submeshes.push_back(std::make_pair(std::string("shape"), localSubmesh));
+    m_meshCache->Store(key.Value(), entry);
+
+    GeometryPool::Handle handle = m_geometryPool->Add(m_commandList.Get(),
+        vertexData.data(), counts.VertexCount, indexData.data(), counts.IndexCount);
+    submesh = m_geometryPool->Rebase(handle, localSubmesh);
+    return handle;
 }
 
 void ShapesApp::BuildShapesGeometry()
 {
+    const float sphereRadius = 0.5f;
+    const UINT sphereSliceCount = 20;
+    const UINT sphereStackCount = 20;
+    const UINT pyramidStackCount = 10;
+    const UINT pyramidSliceCount = 10;
+    const float pyramidRadius = 0.5f;
+    const float pyramidHeight = 3.0f;
+    XMFLOAT4 sphereColor = XMFLOAT4(DirectX::Colors::DarkGreen);
+    XMFLOAT4 pyramidColor = XMFLOAT4(DirectX::Colors::ForestGreen);
+
+    // Everything that affects the final buffers goes into the keys.
+    const VertexLayoutDesc& layout = m_vertexFormat.Desc();
+    const std::uint32_t indexFormat = m_geometryPool->GetDesc().IndexFormat;
+
+    MeshCacheKey sphereKey("ShapesApp::sphere/v4");
+    sphereKey.Add(sphereRadius).Add(sphereSliceCount).Add(sphereStackCount);
+    sphereKey.Add(&sphereColor, sizeof(sphereColor)).Add(&layout, sizeof(layout)).Add(indexFormat);
+
+    MeshCacheKey pyramidKey("ShapesApp::pyramid/v4");
+    pyramidKey.Add(pyramidStackCount).Add(pyramidSliceCount).Add(pyramidRadius).Add(pyramidHeight);
+    pyramidKey.Add(&pyramidColor, sizeof(pyramidColor)).Add(&layout, sizeof(layout)).Add(indexFormat);
+
+    // The sphere is centered on the origin; the pyramid is a cylinder with a
+    // zero top radius, centered on the origin along y.
+    VertexBounds sphereBounds;
+    sphereBounds.Box = BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(sphereRadius, sphereRadius, sphereRadius));
+    sphereBounds.Sphere = BoundingSphere(XMFLOAT3(0.0f, 0.0f, 0.0f), sphereRadius);
+
+    VertexBounds pyramidBounds;
+    pyramidBounds.Box = BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f),
+        XMFLOAT3(pyramidRadius, 0.5f * pyramidHeight, pyramidRadius));
+    pyramidBounds.Sphere = BoundingSphere(XMFLOAT3(0.0f, 0.0f, 0.0f),
+        sqrtf(pyramidRadius * pyramidRadius + 0.25f * pyramidHeight * pyramidHeight));
+
     GeometryGenerator geoGen;
-    GeometryGenerator::MeshData sphere = geoGen.CreateSphere(0.5f, 20, 20);
-    GeometryGenerator::MeshData pyramid = geoGen.CreatePyramid(10, 10, 0.5f, 3.0f);
-    //GeometryGenerator::MeshData pyramid= geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20);
-    // We are concatenating all the geometry into one big vertex/index buffer.
-    // So define the regions in the buffer each submesh covers.
-
-    // Cache the vertex offsets to each object in the concatenated vertex buffer.
-    UINT sphereVertexOffset = 0;
-    UINT pyramidVertexOffset = (UINT)sphere.Vertices.size();
-    
-    // Cache the starting index for each object in the concatenated index buffer.
-    UINT sphereIndexOffset = 0;
-    UINT pyramidIndexOffset = (UINT)sphere.Indices32.size();
 
-    // Define the SubmeshGeometry that cover different 
-    // regions of the vertex/index buffers.
     SubmeshGeometry sphereSubmesh;
-    sphereSubmesh.IndexCount = (UINT)sphere.Indices32.size();
-    sphereSubmesh.StartIndexCount = sphereIndexOffset;
-    sphereSubmesh.BaseVertexLocation = sphereVertexOffset;
+    GeometryPool::Handle sphereHandle = AddShape(sphereKey,
+        geoGen.SphereCounts(sphereSliceCount, sphereStackCount), sphereColor, sphereBounds,
+        [&](const GeometryGenerator::MeshWriter& writer)
+        {
+            geoGen.GenerateSphere(sphereRadius, sphereSliceCount, sphereStackCount, writer);
+        },
+        sphereSubmesh);
 
     SubmeshGeometry pyramidSubmesh;
-    pyramidSubmesh.IndexCount = (UINT)pyramid.Indices32.size();
-    pyramidSubmesh.StartIndexCount = pyramidIndexOffset;
-    pyramidSubmesh.BaseVertexLocation = pyramidVertexOffset;
-
-    // Extract the vertex elements we are interested in and pack the 
-    // vertices of all the meshes into one vertex buffer.
-    auto totalVertexCount = sphere.Indices32.size() + pyramid.Indices32.size();
-
-    std::vector<Vertex> vertices(totalVertexCount);
-    UINT k = 0;
-    for (size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = sphere.Vertices[i].Position;
-        vertices[k].Color = XMFLOAT4(DirectX::Colors::DarkGreen);
-    }
-    for (size_t i=0;i<pyramid.Vertices.size();++i,++k)
+    GeometryPool::Handle pyramidHandle = AddShape(pyramidKey,
+        geoGen.PyramidCounts(pyramidStackCount, pyramidSliceCount), pyramidColor, pyramidBounds,
+        [&](const GeometryGenerator::MeshWriter& writer)
+        {
+            geoGen.GeneratePyramid(pyramidStackCount, pyramidSliceCount, pyramidRadius, pyramidHeight, writer);
+        },
+        pyramidSubmesh);
+
+    // Both shapes are drawn from one MeshGeometry, which binds a single page.
+    // They are far below the page size, so this only fails if the pool
+    // description is changed without splitting the geometry per page.
+    if (m_geometryPool->GetRange(sphereHandle).Page != m_geometryPool->GetRange(pyramidHandle).Page)
     {
-        vertices[k].Pos = pyramid.Vertices[i].Position;
-        vertices[k].Color = XMFLOAT4(DirectX::Colors::ForestGreen);
+        throw std::runtime_error("ShapesApp::BuildShapesGeometry: the shapes ended up in different pool pages.");
     }
 
-    std::vector<std::uint16_t> indices;
-    indices.insert(indices.end(), std::begin(sphere.GetIndices16()), std::end(sphere.GetIndices16()));
-    indices.insert(indices.end(), std::begin(pyramid.GetIndices16()), std::end(pyramid.GetIndices16()));
-
-    const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-    const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
-
     auto geo = std::make_unique<MeshGeometry>();
     geo->Name = "shapeGeo";
-
-    ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-    CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-
-    ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-    CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
-    geo->VertexBufferGPU = CreateDefaultBuffer(
-        m_device.Get(), m_commandList.Get(), vertices.data(),
-        vbByteSize, geo->VertexBufferUploader
-    );
-
-    geo->IndexBufferGPU = CreateDefaultBuffer(
-        m_device.Get(), m_commandList.Get(), indices.data(),
-        ibByteSize, geo->IndexBufferUploader
-    );
-
-    geo->VertexByteStride = sizeof(Vertex);
-    geo->VertexBufferByteSize = vbByteSize;
-    geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-    geo->IndexBufferByteSize = ibByteSize;
+    m_geometryPool->FillMeshGeometry(sphereHandle, *geo);
 
     geo->DrawArags["sphere"] = sphereSubmesh;
     geo->DrawArags["pyramid"] = pyramidSubmesh;
@@ -187,6 +281,7 @@ void ShapesApp::BuildRenderItems()
     sphereRenderItem->IndexCount = sphereRenderItem->Geo->DrawArags["sphere"].IndexCount;
     sphereRenderItem->BaseVertexLocation = sphereRenderItem->Geo->DrawArags["sphere"].BaseVertexLocation;
     sphereRenderItem->StartIndexLocation = sphereRenderItem->Geo->DrawArags["sphere"].StartIndexCount;
+    sphereRenderItem->VertexRange = m_vertexFormat.MakeRange(sphereRenderItem->Geo->DrawArags["sphere"].Bounds);
 
     m_allItems.push_back(std::move(sphereRenderItem));
 
@@ -198,6 +293,7 @@ void ShapesApp::BuildRenderItems()
     pyramidRenderItem->IndexCount = pyramidRenderItem->Geo->DrawArags["pyramid"].IndexCount;
     pyramidRenderItem->StartIndexLocation = pyramidRenderItem->Geo->DrawArags["pyramid"].StartIndexCount;
     pyramidRenderItem->BaseVertexLocation = pyramidRenderItem->Geo->DrawArags["pyramid"].BaseVertexLocation;
+    pyramidRenderItem->VertexRange = m_vertexFormat.MakeRange(pyramidRenderItem->Geo->DrawArags["pyramid"].Bounds);
     m_allItems.push_back(std::move(pyramidRenderItem));
 
     for (auto& e : m_allItems)
@@ -216,32 +312,20 @@ void ShapesApp::BuildFrameResources()
 
 void ShapesApp::BuildConstantDescriptorHeaps()
 {
-    UINT objCount = (UINT)m_opaqueRenderItems.size();
-
-    // Need a CBV descriptor for each object for each frame resource.
-    // +1 for the per pass CBV for each frame resource.
-    UINT numDescriptors = (objCount + 1) * gNumFrameResources;
-
-    // Save an offset to the start of the pass CBVs. These are the last 3 descriptors.
-    m_passCbvOffset = objCount * gNumFrameResources;
-
-    D3D12_DESCRIPTOR_HEAP_DESC cbvHeapDesc;
-    cbvHeapDesc.NumDescriptors = numDescriptors;
-    cbvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-    cbvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-    cbvHeapDesc.NodeMask = 0;
-    ThrowIfFailed(m_device->CreateDescriptorHeap(&cbvHeapDesc, IID_PPV_ARGS(&m_cbvHeap)));
+    m_descriptorBackend = std::make_unique<D3D12DescriptorBackend>(m_device.Get(), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    m_descriptors = std::make_unique<DescriptorAllocator>(*m_descriptorBackend);
 }
 
 void ShapesApp::BuildConstantBufferAndViews()
 {
     UINT objectCBByteSize = CalculateConstantBufferByteSize(sizeof(ObjectConstants));
-    UINT objCount = (UINT)m_opaqueRenderItems.size();
+    UINT objCount = (UINT)m_allItems.size();
 
     // Need a CBV descriptor for each object for each frame resources.
     for (UINT frameIndex = 0; frameIndex < gNumFrameResources; ++frameIndex)
     {
         auto objectCB = m_frameResources[frameIndex]->m_objCB->Resource();
+        m_objectCbvs[frameIndex].resize(objCount);
         for (UINT i = 0; i < objCount; ++i)
         {
             D3D12_GPU_VIRTUAL_ADDRESS cbAddress = objectCB->GetGPUVirtualAddress();
@@ -249,37 +333,28 @@ void ShapesApp::BuildConstantBufferAndViews()
             // Offset to the ith object constant buffer in the buffer.
             cbAddress += (UINT64)i * objectCBByteSize;
 
-            // Offset to the object cbv in the descriptor heap.
-            int heapIndex = frameIndex * objCount + i;
-            auto handle = CD3DX12_CPU_DESCRIPTOR_HANDLE(m_cbvHeap->GetCPUDescriptorHandleForHeapStart());
-            handle.Offset(heapIndex, m_cbvSrvUavDescriptorSize);
-
             D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc;
             cbvDesc.BufferLocation = cbAddress;
             cbvDesc.SizeInBytes = objectCBByteSize;
 
-            m_device->CreateConstantBufferView(&cbvDesc, handle);
+            m_objectCbvs[frameIndex][i] = m_descriptors->Allocate();
+            m_device->CreateConstantBufferView(&cbvDesc, m_objectCbvs[frameIndex][i].CPU);
         }
     }
 
     UINT passCBByteSize = CalculateConstantBufferByteSize(sizeof(PassConstants));
 
-    // Last three descriptors are the pass CBVs for each frame resource.
+    // And a pass CBV for each frame resource.
     for (UINT frameIndex = 0; frameIndex < gNumFrameResources; ++frameIndex)
     {
         auto passCB = m_frameResources[frameIndex]->m_passCB->Resource();
-        D3D12_GPU_VIRTUAL_ADDRESS cbAddress = passCB->GetGPUVirtualAddress();
-
-        // Offset to the pass cbv in the descriptor heap.
-        int heapIndex = m_passCbvOffset + frameIndex;
-        auto handle = CD3DX12_CPU_DESCRIPTOR_HANDLE(m_cbvHeap->GetCPUDescriptorHandleForHeapStart());
-        handle.Offset(heapIndex, m_cbvSrvUavDescriptorSize);
 
         D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc;
-        cbvDesc.BufferLocation = cbAddress;
+        cbvDesc.BufferLocation = passCB->GetGPUVirtualAddress();
         cbvDesc.SizeInBytes = passCBByteSize;
 
-        m_device->CreateConstantBufferView(&cbvDesc, handle);
+        m_passCbvs[frameIndex] = m_descriptors->Allocate();
+        m_device->CreateConstantBufferView(&cbvDesc, m_passCbvs[frameIndex].CPU);
     }
 }
 
@@ -295,6 +370,11 @@ bool ShapesApp::Initialize()
 
     BuildRootSignature();
     BuildShadersAndInputLayout();
+    GeometryPoolDesc poolDesc;
+    poolDesc.VertexByteStride = m_vertexFormat.Stride();
+    poolDesc.IndexFormat = DXGI_FORMAT_R16_UINT;
+    m_geometryPool = std::make_unique<GeometryPool>(m_device.Get(), poolDesc);
+
     BuildShapesGeometry();
     BuildRenderItems();
     BuildFrameResources();
@@ -307,6 +387,9 @@ bool ShapesApp::Initialize()
     ID3D12CommandList* cmdLists[] = { m_commandList.Get() };
     m_commandQueue->ExecuteCommandLists(_countof(cmdLists), cmdLists);
 
+    // The pool's staging buffers go once the copies are done.
+    m_geometryPool->RetireUploaders(m_currentFence + 1);
+
     // Wait until initialization is completed.
     FlushCommandQueue();
 
@@ -351,7 +434,11 @@ void ShapesApp::UpdateCamera(const GameTimer& gt)
 
 void ShapesApp::UpdateObjectCBs(const GameTimer& gt)
 {
-    auto currentObjectConstantBuffer = m_currentFrameResource->m_objCB.get();
+    // Gather the dirty objects and write them out in one scatter.
+    std::vector<UINT>& indices = m_dirtyIndices;
+    std::vector<ObjectConstants>& constants = m_dirtyObjectConstants;
+    indices.clear();
+    constants.clear();
     for (auto& e : m_allItems)
     {
         // Only update the cbuffer data if the constants have changed.
@@ -360,13 +447,17 @@ void ShapesApp::UpdateObjectCBs(const GameTimer& gt)
         {
             ObjectConstants objConstants;
             objConstants.World = XMMatrixTranspose(e->World);
+            objConstants.PosScale = e->VertexRange.PositionScale;
+            objConstants.PosBias = e->VertexRange.PositionBias;
 
-            currentObjectConstantBuffer->CopyData(e->ObjectConstantBufferIndex, objConstants);
+            indices.push_back(e->ObjectConstantBufferIndex);
+            constants.push_back(objConstants);
 
             // Next FrameResource need to be updated too.
             e->NumFrameDirty--;
         }
     }
+    m_currentFrameResource->m_objCB->CopyScatter(indices.data(), constants.data(), (UINT)indices.size());
 }
 
 void ShapesApp::UpdateMainPassCB(const GameTimer& gt)
@@ -407,14 +498,17 @@ void ShapesApp::Update(const GameTimer& gt)
 
     // Has the GPU finished processing the commands of the current frame resources?
     // If not, wait until the GPU has completed commands up to this fence point.
-    if (m_currentFrameResource->m_fence != 0 && m_fence->GetCompletedValue() < m_currentFrameResource->m_fence)
+    if (m_currentFrameResource->m_fence != 0)
     {
-        HANDLE eventHandle = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
-        ThrowIfFailed(m_fence->SetEventOnCompletion(m_currentFrameResource->m_fence, eventHandle));
-        WaitForSingleObject(eventHandle, INFINITE);
-        CloseHandle(eventHandle);
+        WaitForFence(m_currentFrameResource->m_fence);
     }
 
+    // Hands back the descriptor tables of every frame the GPU has finished.
+    m_descriptors->BeginFrame(m_fence->GetCompletedValue());
+
+    // And the pool's staging buffers whose copies are done.
+    m_geometryPool->ReleaseCompleted(m_fence->GetCompletedValue());
+
     UpdateObjectCBs(gt);
     UpdateMainPassCB(gt);
     result = XMVector3TransformCoord(XMVectorSet(-0.5f,-0.5f,-0.5f,1.0f), m_viewProj);
@@ -435,13 +529,9 @@ void ShapesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::v
         cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
         cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
 
-        // Offset to the CBV in the descriptor heap for this object 
-        // and for this frame resource.
-        UINT cbvIndex = m_currentFrameResourceIndex * (UINT)m_opaqueRenderItems.size() + ri->ObjectConstantBufferIndex;
-        auto cbvHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(m_cbvHeap->GetGPUDescriptorHandleForHeapStart());
-        cbvHandle.Offset(cbvIndex, m_cbvSrvUavDescriptorSize);
-
-        cmdList->SetGraphicsRootDescriptorTable(0, cbvHandle);
+        // The CBV of this object for this frame resource.
+        const DescriptorAllocation& cbv = m_objectCbvs[m_currentFrameResourceIndex][ri->ObjectConstantBufferIndex];
+        cmdList->SetGraphicsRootDescriptorTable(0, m_descriptors->CopyToTransient(cbv).GPU);
 
         cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
     }
@@ -470,11 +560,8 @@ void ShapesApp::Draw(const GameTimer& gt)
     m_commandList->RSSetScissorRects(1, &m_scissorRect);
 
     // Indicate a state transition on the resource usage.
-    m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-        CurrentBackBuffer(),
-        D3D12_RESOURCE_STATE_PRESENT,
-        D3D12_RESOURCE_STATE_RENDER_TARGET
-    ));
+    m_barriers.Transition(CurrentBackBuffer(), D3D12_RESOURCE_STATE_RENDER_TARGET);
+    m_barriers.FlushBarriers(m_commandList.Get());
 
     // Clear the back buffer and depth buffer.
     m_commandList->ClearRenderTargetView(CurrentBackBufferView(), Colors::LightPink, 0, nullptr);
@@ -485,31 +572,24 @@ void ShapesApp::Draw(const GameTimer& gt)
     m_commandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, 
         &m_dsvHeap->GetCPUDescriptorHandleForHeapStart());
 
-    ID3D12DescriptorHeap* descriptorHeaps[] = { m_cbvHeap.Get() };
+    ID3D12DescriptorHeap* descriptorHeaps[] = { m_descriptorBackend->GetHeap(DescriptorAllocator::ShaderVisibleHeapId) };
     m_commandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
 
     m_commandList->SetGraphicsRootSignature(m_rootSignature.Get());
 
-    UINT passCbvIndex = m_passCbvOffset + (UINT)m_currentFrameResourceIndex;
-    auto passCbvHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(m_cbvHeap->GetGPUDescriptorHandleForHeapStart());
-    passCbvHandle.Offset(passCbvIndex, m_cbvSrvUavDescriptorSize);
-    m_commandList->SetGraphicsRootDescriptorTable(1, passCbvHandle);
+    DescriptorTable passCbvTable = m_descriptors->CopyToTransient(m_passCbvs[m_currentFrameResourceIndex]);
+    m_commandList->SetGraphicsRootDescriptorTable(1, passCbvTable.GPU);
     
     DrawRenderItems(m_commandList.Get(), m_opaqueRenderItems);
 
     // Indicate a state transition on the resource usage.
-    m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-        CurrentBackBuffer(),
-        D3D12_RESOURCE_STATE_RENDER_TARGET,
-        D3D12_RESOURCE_STATE_PRESENT
-    ));
+    m_barriers.Transition(CurrentBackBuffer(), D3D12_RESOURCE_STATE_PRESENT);
 
-    // Done recording commands.
-    ThrowIfFailed(m_commandList->Close());
+    // The tables must be filled before the GPU can read them.
+    m_descriptors->FlushCopies();
 
-    // Add the command list to the queue for execution.
-    ID3D12CommandList* cmdLists[] = { m_commandList.Get() };
-    m_commandQueue->ExecuteCommandLists(_countof(cmdLists), cmdLists);
+    // Done recording commands; execute them after the barriers they start with.
+    ExecuteCommandList(m_commandList.Get(), m_barriers);
 
     // Swap the back and front buffers.
     ThrowIfFailed(m_swapchain->Present(0, 0));
@@ -522,6 +602,7 @@ void ShapesApp::Draw(const GameTimer& gt)
     // Because we are on the GPU time line, the new fence point won't be 
     // set until the GPU finishes processing all the commands prior to this Signal().
     m_commandQueue->Signal(m_fence.Get(), m_currentFence);
+    m_descriptors->EndFrame(m_currentFence);
 }
 
 void ShapesApp::OnMouseDown(WPARAM btnState, int x, int y)
@@ -4,6 +4,10 @@
 #include "UploadBuffer.h"
 #include "GeometryGenerator.h"
 #include "FrameResource.h"
+#include "GeometryPool.h"
+#include "DescriptorAllocator.h"
+#include "VertexFormat.h"
+#include <functional>
 
 #ifndef IS_ENABLE_SHAPE_APP
 #define IS_ENABLE_SHAPE_APP 1
@@ -46,6 +50,9 @@ private:
     void BuildRootSignature();
     void BuildShadersAndInputLayout();
     void BuildShapesGeometry();
+    GeometryPool::Handle AddShape(const MeshCacheKey& key, const GeometryGenerator::MeshCounts& counts,
+        XMFLOAT4 color, const VertexBounds& bounds,
+        const std::function<void(const GeometryGenerator::MeshWriter&)>& generate, SubmeshGeometry& submesh);
     void BuildPSOs();
     void BuildFrameResources();
     void BuildRenderItems();
@@ -57,9 +64,21 @@ private:
     int m_currentFrameResourceIndex = 0;
 
     ComPtr<ID3D12RootSignature> m_rootSignature = nullptr;
-    ComPtr<ID3D12DescriptorHeap> m_cbvHeap = nullptr;
     ComPtr<ID3D12DescriptorHeap> m_srvHeap = nullptr;
 
+    // The CBVs of every object and pass, one per frame resource, are
+    // persistent; each frame copies the ones it draws with into tables of
+    // the shader-visible ring.
+    std::unique_ptr<D3D12DescriptorBackend> m_descriptorBackend;
+    std::unique_ptr<DescriptorAllocator> m_descriptors;
+    std::vector<DescriptorAllocation> m_objectCbvs[gNumFrameResources];
+    DescriptorAllocation m_passCbvs[gNumFrameResources];
+
+    // Layout the shapes are packed in and Shapes.hlsl decodes.
+    VertexFormat m_vertexFormat;
+
+    // Shared VB/IB pages all shapes are sub-allocated from.
+    std::unique_ptr<GeometryPool> m_geometryPool;
     std::unordered_map<std::string, std::unique_ptr<MeshGeometry>>  m_geometries;
     std::unordered_map<std::string, ComPtr<ID3DBlob>>    m_shaders;
     std::unordered_map<std::string, ComPtr<ID3D12PipelineState>>    m_PSOs;
@@ -72,9 +91,11 @@ private:
     // Render items divided by PSO.
     std::vector<RenderItem*> m_opaqueRenderItems;
 
-    PassConstants m_mainPassCB;
+    // Dirty objects gathered by UpdateObjectCBs, kept to reuse the storage.
+    std::vector<UINT> m_dirtyIndices;
+    std::vector<ObjectConstants> m_dirtyObjectConstants;
 
-    UINT m_passCbvOffset = 0;
+    PassConstants m_mainPassCB;
 
     bool m_isWireFrame = false;
 
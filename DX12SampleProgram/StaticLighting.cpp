@@ -0,0 +1,296 @@
+#include "stdafx.h"
+#include "StaticLighting.h"
+
+using namespace DirectX;
+
+namespace
+{
+    // Vertices handed to each task.
+    const size_t VerticesPerTask = 256;
+
+    // Four vectors, one per SSE lane.
+    struct Vector3x4
+    {
+        __m128 X;
+        __m128 Y;
+        __m128 Z;
+    };
+
+    struct Color3x4
+    {
+        __m128 R;
+        __m128 G;
+        __m128 B;
+    };
+
+    // Loads vertices [first, first + 4); lanes past count repeat the last one.
+    Vector3x4 Load3x4(const BYTE* data, UINT stride, size_t first, size_t count)
+    {
+        float v[3][4];
+        for (size_t lane = 0; lane < 4; ++lane)
+        {
+            const float* p = reinterpret_cast<const float*>(data + (first + std::min(lane, count - first - 1)) * stride);
+            v[0][lane] = p[0];
+            v[1][lane] = p[1];
+            v[2][lane] = p[2];
+        }
+        return { _mm_loadu_ps(v[0]), _mm_loadu_ps(v[1]), _mm_loadu_ps(v[2]) };
+    }
+
+    Vector3x4 Splat3(const XMFLOAT3& v)
+    {
+        return { _mm_set1_ps(v.x), _mm_set1_ps(v.y), _mm_set1_ps(v.z) };
+    }
+
+    Vector3x4 Add3(const Vector3x4& a, const Vector3x4& b)
+    {
+        return { _mm_add_ps(a.X, b.X), _mm_add_ps(a.Y, b.Y), _mm_add_ps(a.Z, b.Z) };
+    }
+
+    Vector3x4 Subtract3(const Vector3x4& a, const Vector3x4& b)
+    {
+        return { _mm_sub_ps(a.X, b.X), _mm_sub_ps(a.Y, b.Y), _mm_sub_ps(a.Z, b.Z) };
+    }
+
+    Vector3x4 Scale3(const Vector3x4& a, __m128 s)
+    {
+        return { _mm_mul_ps(a.X, s), _mm_mul_ps(a.Y, s), _mm_mul_ps(a.Z, s) };
+    }
+
+    __m128 Dot3(const Vector3x4& a, const Vector3x4& b)
+    {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.X, b.X), _mm_mul_ps(a.Y, b.Y)), _mm_mul_ps(a.Z, b.Z));
+    }
+
+    Vector3x4 Normalize3(const Vector3x4& a)
+    {
+        return Scale3(a, _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(Dot3(a, a))));
+    }
+
+    __m128 Saturate(__m128 x)
+    {
+        return _mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    }
+
+    // Material terms of LightingUtil.hlsl, splatted.
+    struct Material4
+    {
+        __m128 Albedo[3];
+        __m128 FresnelR0[3];
+        __m128 Shininess;
+        __m128 RoughnessScale;
+    };
+
+    // BlinnPhong() of LightingUtil.hlsl for four vertices, times scale (the
+    // cosine, attenuation and spot terms). Without specular only the diffuse
+    // albedo is lit.
+    void AccumulateBlinnPhong(const XMFLOAT3& lightStrength, __m128 scale, const Vector3x4& lightVec,
+        const Vector3x4& normal, const Vector3x4* toEye, const Material4& mat, Color3x4& color)
+    {
+        const __m128 one = _mm_set1_ps(1.0f);
+        __m128 specular[3] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+        if (toEye != nullptr)
+        {
+            Vector3x4 halfVec = Normalize3(Add3(*toEye, lightVec));
+            __m128 nDotH = _mm_max_ps(Dot3(halfVec, normal), _mm_setzero_ps());
+            __m128 roughnessFactor = _mm_mul_ps(mat.RoughnessScale, XMVectorPow(nDotH, mat.Shininess));
+
+            // Schlick with the half vector, as the shader does.
+            __m128 f0 = _mm_sub_ps(one, Saturate(Dot3(halfVec, lightVec)));
+            __m128 f2 = _mm_mul_ps(f0, f0);
+            __m128 f5 = _mm_mul_ps(_mm_mul_ps(f2, f2), f0);
+            for (int c = 0; c < 3; ++c)
+            {
+                __m128 fresnel = _mm_add_ps(mat.FresnelR0[c], _mm_mul_ps(_mm_sub_ps(one, mat.FresnelR0[c]), f5));
+                __m128 albedo = _mm_mul_ps(fresnel, roughnessFactor);
+                specular[c] = _mm_div_ps(albedo, _mm_add_ps(albedo, one));
+            }
+        }
+
+        color.R = _mm_add_ps(color.R, _mm_mul_ps(_mm_add_ps(mat.Albedo[0], specular[0]), _mm_mul_ps(scale, _mm_set1_ps(lightStrength.x))));
+        color.G = _mm_add_ps(color.G, _mm_mul_ps(_mm_add_ps(mat.Albedo[1], specular[1]), _mm_mul_ps(scale, _mm_set1_ps(lightStrength.y))));
+        color.B = _mm_add_ps(color.B, _mm_mul_ps(_mm_add_ps(mat.Albedo[2], specular[2]), _mm_mul_ps(scale, _mm_set1_ps(lightStrength.z))));
+    }
+
+    // Cosine and CalculateAttenuation() of a point or spot light; zero past
+    // FalloffEnd. Returns the normalized light vector in lightVec.
+    __m128 PointLightScale(const Light& light, const Vector3x4& position, const Vector3x4& normal, Vector3x4& lightVec)
+    {
+        Vector3x4 toLight = Subtract3(Splat3(light.Position), position);
+        __m128 d = _mm_sqrt_ps(Dot3(toLight, toLight));
+        lightVec = Scale3(toLight, _mm_div_ps(_mm_set1_ps(1.0f), d));
+
+        __m128 nDotL = _mm_max_ps(Dot3(lightVec, normal), _mm_setzero_ps());
+        __m128 attenuation = Saturate(_mm_div_ps(_mm_sub_ps(_mm_set1_ps(light.FalloffEnd), d),
+            _mm_set1_ps(light.FalloffEnd - light.FalloffStart)));
+        __m128 inRange = _mm_cmple_ps(d, _mm_set1_ps(light.FalloffEnd));
+        return _mm_and_ps(inRange, _mm_mul_ps(nDotL, attenuation));
+    }
+}
+
+void BakeVertexLighting(const StaticLightingDesc& desc, const MaterialConstants& material,
+    const StaticLightingVertices& vertices, const float* visibility, XMFLOAT4* colors)
+{
+    assert(desc.DirectionalLightCount + desc.PointLightCount + desc.SpotLightCount <= MaxLights);
+
+    // Shininess as the shader derives it from roughness.
+    const float shininess = (1.0f - material.Roughness) * 256.0f;
+
+    Material4 mat;
+    mat.Albedo[0] = _mm_set1_ps(material.DiffuseAlbedo.x);
+    mat.Albedo[1] = _mm_set1_ps(material.DiffuseAlbedo.y);
+    mat.Albedo[2] = _mm_set1_ps(material.DiffuseAlbedo.z);
+    mat.FresnelR0[0] = _mm_set1_ps(material.FresnelR0.x);
+    mat.FresnelR0[1] = _mm_set1_ps(material.FresnelR0.y);
+    mat.FresnelR0[2] = _mm_set1_ps(material.FresnelR0.z);
+    mat.Shininess = _mm_set1_ps(shininess);
+    mat.RoughnessScale = _mm_set1_ps((shininess + 8.0f) / 8.0f);
+
+    const BYTE* positions = static_cast<const BYTE*>(vertices.Positions);
+    const BYTE* normals = static_cast<const BYTE*>(vertices.Normals);
+    const size_t count = vertices.Count;
+    const size_t taskCount = (count + VerticesPerTask - 1) / VerticesPerTask;
+
+    concurrency::parallel_for(size_t(0), taskCount, [&](size_t task)
+    {
+        const size_t end = std::min(count, (task + 1) * VerticesPerTask);
+        for (size_t first = task * VerticesPerTask; first < end; first += 4)
+        {
+            Vector3x4 position = Load3x4(positions, vertices.Stride, first, end);
+            Vector3x4 normal = Normalize3(Load3x4(normals, vertices.Stride, first, end));
+
+            Vector3x4 toEye;
+            if (desc.BakeSpecular)
+            {
+                toEye = Normalize3(Subtract3(Splat3(desc.EyePosition), position));
+            }
+            const Vector3x4* eye = desc.BakeSpecular ? &toEye : nullptr;
+
+            // Ambient, darkened by the occlusion.
+            __m128 ambientScale = _mm_set1_ps(1.0f);
+            if (visibility != nullptr)
+            {
+                float v[4];
+                for (size_t lane = 0; lane < 4; ++lane)
+                {
+                    v[lane] = visibility[first + std::min(lane, end - first - 1)];
+                }
+                ambientScale = _mm_loadu_ps(v);
+            }
+            Color3x4 color;
+            color.R = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(desc.AmbientLight.x), mat.Albedo[0]), ambientScale);
+            color.G = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(desc.AmbientLight.y), mat.Albedo[1]), ambientScale);
+            color.B = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(desc.AmbientLight.z), mat.Albedo[2]), ambientScale);
+
+            UINT i = 0;
+            for (UINT k = 0; k < desc.DirectionalLightCount; ++k, ++i)
+            {
+                const Light& light = desc.Lights[i];
+                Vector3x4 lightVec = Splat3(XMFLOAT3(-light.Direction.x, -light.Direction.y, -light.Direction.z));
+                __m128 nDotL = _mm_max_ps(Dot3(lightVec, normal), _mm_setzero_ps());
+                AccumulateBlinnPhong(light.Strength, nDotL, lightVec, normal, eye, mat, color);
+            }
+            for (UINT k = 0; k < desc.PointLightCount; ++k, ++i)
+            {
+                const Light& light = desc.Lights[i];
+                Vector3x4 lightVec;
+                __m128 scale = PointLightScale(light, position, normal, lightVec);
+                AccumulateBlinnPhong(light.Strength, scale, lightVec, normal, eye, mat, color);
+            }
+            for (UINT k = 0; k < desc.SpotLightCount; ++k, ++i)
+            {
+                const Light& light = desc.Lights[i];
+                Vector3x4 lightVec;
+                __m128 scale = PointLightScale(light, position, normal, lightVec);
+
+                Vector3x4 direction = Splat3(light.Direction);
+                __m128 cosAngle = _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), Dot3(lightVec, direction)), _mm_setzero_ps());
+                scale = _mm_mul_ps(scale, XMVectorPow(cosAngle, _mm_set1_ps(light.SpotPower)));
+                AccumulateBlinnPhong(light.Strength, scale, lightVec, normal, eye, mat, color);
+            }
+
+            float r[4];
+            float g[4];
+            float b[4];
+            _mm_storeu_ps(r, color.R);
+            _mm_storeu_ps(g, color.G);
+            _mm_storeu_ps(b, color.B);
+            for (size_t lane = 0; lane < 4 && first + lane < end; ++lane)
+            {
+                colors[first + lane] = XMFLOAT4(r[lane], g[lane], b[lane], material.DiffuseAlbedo.w);
+            }
+        }
+    });
+}
+
+void ComputeHorizonOcclusion(const HeightFieldPyramid& heightField, const HorizonOcclusionDesc& desc,
+    const StaticLightingVertices& vertices, float* visibility)
+{
+    const UINT directionCount = std::max((desc.DirectionCount + 3) & ~3u, 4u);
+    const UINT stepCount = std::max(desc.StepCount, 1u);
+
+    std::vector<float> directionX(directionCount);
+    std::vector<float> directionZ(directionCount);
+    for (UINT d = 0; d < directionCount; ++d)
+    {
+        float angle = XM_2PI * (float)d / (float)directionCount;
+        directionX[d] = std::cos(angle);
+        directionZ[d] = std::sin(angle);
+    }
+
+    const BYTE* positions = static_cast<const BYTE*>(vertices.Positions);
+    const BYTE* normals = static_cast<const BYTE*>(vertices.Normals);
+    const size_t count = vertices.Count;
+    const size_t taskCount = (count + VerticesPerTask - 1) / VerticesPerTask;
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    // Four directions per SSE lane group; heights are looked up one by one.
+    concurrency::parallel_for(size_t(0), taskCount, [&](size_t task)
+    {
+        const size_t end = std::min(count, (task + 1) * VerticesPerTask);
+        for (size_t v = task * VerticesPerTask; v < end; ++v)
+        {
+            const XMFLOAT3& p = *reinterpret_cast<const XMFLOAT3*>(positions + v * vertices.Stride);
+            const XMFLOAT3& n = *reinterpret_cast<const XMFLOAT3*>(normals + v * vertices.Stride);
+            const float ny = std::max(n.y, 1e-3f);
+
+            __m128 occlusion = _mm_setzero_ps();
+            for (UINT d = 0; d < directionCount; d += 4)
+            {
+                __m128 dx = _mm_loadu_ps(&directionX[d]);
+                __m128 dz = _mm_loadu_ps(&directionZ[d]);
+
+                // Slope of the tangent plane along each direction; the
+                // horizon never lies below it.
+                __m128 tangentSlope = _mm_div_ps(
+                    _mm_sub_ps(_mm_setzero_ps(), _mm_add_ps(_mm_mul_ps(dx, _mm_set1_ps(n.x)), _mm_mul_ps(dz, _mm_set1_ps(n.z)))),
+                    _mm_set1_ps(ny));
+                __m128 horizonSlope = tangentSlope;
+
+                for (UINT s = 1; s <= stepCount; ++s)
+                {
+                    const float r = desc.Radius * (float)s / (float)stepCount;
+                    float h[4];
+                    for (UINT lane = 0; lane < 4; ++lane)
+                    {
+                        float height = 0.0f;
+                        h[lane] = heightField.GetHeight(p.x + directionX[d + lane] * r, p.z + directionZ[d + lane] * r, height)
+                            ? height : -FLT_MAX;
+                    }
+                    __m128 slope = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(h), _mm_set1_ps(p.y)), _mm_set1_ps(1.0f / r));
+                    horizonSlope = _mm_max_ps(horizonSlope, slope);
+                }
+
+                // sin(atan(s)) = s / sqrt(1 + s^2)
+                __m128 sinHorizon = _mm_div_ps(horizonSlope, _mm_sqrt_ps(_mm_add_ps(one, _mm_mul_ps(horizonSlope, horizonSlope))));
+                __m128 sinTangent = _mm_div_ps(tangentSlope, _mm_sqrt_ps(_mm_add_ps(one, _mm_mul_ps(tangentSlope, tangentSlope))));
+                occlusion = _mm_add_ps(occlusion, _mm_sub_ps(sinHorizon, sinTangent));
+            }
+
+            float lanes[4];
+            _mm_storeu_ps(lanes, occlusion);
+            float mean = (lanes[0] + lanes[1] + lanes[2] + lanes[3]) / (float)directionCount;
+            visibility[v] = std::min(std::max(1.0f - desc.Strength * mean, 0.0f), 1.0f);
+        }
+    });
+}
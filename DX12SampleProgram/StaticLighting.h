@@ -0,0 +1,66 @@
+// Static per-vertex lighting.
+//
+// For lights that never move, the lighting of LightingUtil.hlsl can be
+// evaluated once on the CPU and stored as a vertex color, so the pixel shader
+// only has to pass it through (BakedLighting.hlsl). BakeVertexLighting lights
+// directional, point and spot lights with the attenuation, Schlick Fresnel and
+// Blinn-Phong of LightingUtil.hlsl, four vertices at a time and in parallel.
+// Specular highlights depend on the viewer, so they are only baked when asked
+// for, seen from a fixed eye position.
+//
+// Height-field terrain can also bake ambient occlusion: ComputeHorizonOcclusion
+// walks a few directions from every vertex, finds how far above the tangent
+// plane the horizon rises and darkens the ambient term accordingly.
+#pragma once
+#include "stdafx.h"
+#include "D3DUtil.h"
+#include "HeightFieldPyramid.h"
+
+struct StaticLightingDesc
+{
+    DirectX::XMFLOAT4 AmbientLight = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+    // Laid out like PassConstants::Lights: directional lights first, then
+    // point lights, then spot lights.
+    Light Lights[MaxLights];
+    UINT DirectionalLightCount = 0;
+    UINT PointLightCount = 0;
+    UINT SpotLightCount = 0;
+
+    // Bake Blinn-Phong highlights as seen from EyePosition. Otherwise only
+    // the diffuse term is baked.
+    bool BakeSpecular = false;
+    DirectX::XMFLOAT3 EyePosition = { 0.0f, 0.0f, 0.0f };
+};
+
+// Positions and normals (XMFLOAT3 each) of count vertices, stride bytes apart.
+struct StaticLightingVertices
+{
+    const void* Positions = nullptr;
+    const void* Normals = nullptr;
+    UINT Stride = 0;
+    size_t Count = 0;
+};
+
+struct HorizonOcclusionDesc
+{
+    // Directions searched around each vertex; rounded up to a multiple of 4.
+    UINT DirectionCount = 8;
+
+    // Height samples per direction, evenly spaced out to Radius.
+    UINT StepCount = 12;
+    float Radius = 16.0f;
+
+    // 0 disables the occlusion, 1 applies it fully.
+    float Strength = 1.0f;
+};
+
+// Writes the lit color of each vertex. visibility may be null; otherwise the
+// ambient term of vertex i is scaled by visibility[i].
+void BakeVertexLighting(const StaticLightingDesc& desc, const MaterialConstants& material,
+    const StaticLightingVertices& vertices, const float* visibility, DirectX::XMFLOAT4* colors);
+
+// Writes the fraction of the sky each vertex sees, from 0 (fully occluded) to
+// 1 (open), against the heights of heightField.
+void ComputeHorizonOcclusion(const HeightFieldPyramid& heightField, const HorizonOcclusionDesc& desc,
+    const StaticLightingVertices& vertices, float* visibility);
@@ -0,0 +1,377 @@
+#include "stdafx.h"
+#include "StreamingUploader.h"
+
+namespace
+{
+    // Staging offsets of buffer pieces; textures need
+    // D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT.
+    const UINT64 BufferStagingAlignment = 16;
+
+    // A split buffer piece is not put in the last few bytes before the end
+    // of the ring if it could start over at the beginning instead.
+    const UINT64 MinBufferPiece = 64 * 1024;
+}
+
+#if defined(_WIN32)
+D3D12StreamingBackend::D3D12StreamingBackend(ID3D12Device* device, UINT64 stagingCapacity) :
+    m_device(device),
+    m_copyQueue(device),
+    m_stagingCapacity(stagingCapacity)
+{
+    ThrowIfFailed(m_device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(stagingCapacity),
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(&m_staging)));
+
+    CD3DX12_RANGE readRange(0, 0);
+    ThrowIfFailed(m_staging->Map(0, &readRange, reinterpret_cast<void**>(&m_stagingData)));
+}
+
+D3D12StreamingBackend::~D3D12StreamingBackend()
+{
+    m_copyQueue.WaitForIdle();
+    m_staging->Unmap(0, nullptr);
+}
+
+void D3D12StreamingBackend::GetTextureFootprint(ID3D12Resource* texture, UINT subresource,
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint, UINT& rowCount, UINT64& rowSize)
+{
+    D3D12_RESOURCE_DESC desc = texture->GetDesc();
+    UINT64 totalBytes = 0;
+    m_device->GetCopyableFootprints(&desc, subresource, 1, 0, &footprint, &rowCount, &rowSize, &totalBytes);
+}
+
+void D3D12StreamingBackend::CopyBuffer(ID3D12Resource* dest, UINT64 destOffset, UINT64 stagingOffset, UINT64 byteSize)
+{
+    m_copyQueue.GetCommandList()->CopyBufferRegion(dest, destOffset, m_staging.Get(), stagingOffset, byteSize);
+}
+
+void D3D12StreamingBackend::CopyTexture(ID3D12Resource* dest, UINT subresource,
+    const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& stagingFootprint)
+{
+    CD3DX12_TEXTURE_COPY_LOCATION dst(dest, subresource);
+    CD3DX12_TEXTURE_COPY_LOCATION src(m_staging.Get(), stagingFootprint);
+    m_copyQueue.GetCommandList()->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+}
+
+UINT64 D3D12StreamingBackend::Submit()
+{
+    return m_copyQueue.Submit();
+}
+
+void D3D12StreamingBackend::MakeQueueWait(ID3D12CommandQueue* queue, UINT64 fence)
+{
+    m_copyQueue.MakeQueueWait(queue, fence);
+}
+#endif
+
+void NullStreamingBackend::GetTextureFootprint(ID3D12Resource* texture, UINT subresource,
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint, UINT& rowCount, UINT64& rowSize)
+{
+    footprint = {};
+    footprint.Footprint.Format = DXGI_FORMAT_R8_UINT;
+    footprint.Footprint.Width = TextureRowSize;
+    footprint.Footprint.Height = TextureRowCount;
+    footprint.Footprint.Depth = 1;
+    footprint.Footprint.RowPitch = (UINT)AlignUp(TextureRowSize, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT);
+    rowCount = TextureRowCount;
+    rowSize = TextureRowSize;
+}
+
+void NullStreamingBackend::CopyBuffer(ID3D12Resource* dest, UINT64 destOffset, UINT64 stagingOffset, UINT64 byteSize)
+{
+    Copy copy;
+    copy.Dest = dest;
+    copy.DestOffset = destOffset;
+    copy.StagingOffset = stagingOffset;
+    copy.ByteSize = byteSize;
+    copy.Fence = m_submittedFence + 1;
+    m_copies.push_back(copy);
+}
+
+void NullStreamingBackend::CopyTexture(ID3D12Resource* dest, UINT subresource,
+    const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& stagingFootprint)
+{
+    Copy copy;
+    copy.Dest = dest;
+    copy.Subresource = subresource;
+    copy.StagingOffset = stagingFootprint.Offset;
+    copy.ByteSize = (UINT64)stagingFootprint.Footprint.RowPitch * stagingFootprint.Footprint.Height *
+        stagingFootprint.Footprint.Depth;
+    copy.IsTexture = true;
+    copy.Fence = m_submittedFence + 1;
+    m_copies.push_back(copy);
+}
+
+StreamingUploader::StreamingUploader(StreamingBackend& backend, const StreamingUploaderDesc& desc) :
+    m_backend(backend),
+    m_desc(desc),
+    m_staging(backend.GetStagingCapacity())
+{
+    assert(m_desc.MaxBytesPerFrame > 0);
+}
+
+StreamingUploader::Handle StreamingUploader::AddRequest(Request&& request)
+{
+    Handle handle;
+    if (!m_freeHandles.empty())
+    {
+        handle = m_freeHandles.back();
+        m_freeHandles.pop_back();
+    }
+    else
+    {
+        handle = (Handle)m_requests.size();
+        m_requests.emplace_back();
+    }
+
+    request.State = RequestState::Queued;
+    request.Sequence = m_nextSequence++;
+    m_queue.push_back({ request.Priority, request.Sequence, handle });
+    std::push_heap(m_queue.begin(), m_queue.end());
+
+    m_requests[handle] = std::move(request);
+    ++m_liveRequests;
+    return handle;
+}
+
+StreamingUploader::Handle StreamingUploader::RequestBuffer(ID3D12Resource* dest, UINT64 destOffset,
+    std::vector<BYTE>&& data, int priority, Callback onComplete)
+{
+    Request request;
+    request.Dest = dest;
+    request.DestOffset = destOffset;
+    request.Data = std::move(data);
+    request.Priority = priority;
+    request.OnComplete = std::move(onComplete);
+    return AddRequest(std::move(request));
+}
+
+StreamingUploader::Handle StreamingUploader::RequestTexture(ID3D12Resource* dest, UINT subresource,
+    std::vector<BYTE>&& data, UINT64 rowPitch, UINT64 slicePitch, int priority, Callback onComplete)
+{
+    Request request;
+    request.Dest = dest;
+    request.IsTexture = true;
+    request.Subresource = subresource;
+    request.RowPitch = rowPitch;
+    request.SlicePitch = slicePitch;
+    request.Data = std::move(data);
+    request.Priority = priority;
+    request.OnComplete = std::move(onComplete);
+    return AddRequest(std::move(request));
+}
+
+bool StreamingUploader::Cancel(Handle handle)
+{
+    assert(handle < m_requests.size());
+    Request& request = m_requests[handle];
+    if (request.State != RequestState::Queued || request.StagedBytes > 0)
+    {
+        return false;
+    }
+
+    // The queue entry is left behind and skipped by its stale sequence.
+    request = Request();
+    m_freeHandles.push_back(handle);
+    --m_liveRequests;
+    return true;
+}
+
+UINT64 StreamingUploader::StageBuffer(Request& request, UINT64 budget)
+{
+    UINT64 remaining = request.Data.size() - request.StagedBytes;
+    if (remaining == 0)
+    {
+        // Nothing to copy; the request completes with the copies before it.
+        return 0;
+    }
+
+    UINT64 offset = 0;
+    UINT64 allocated = m_staging.AllocatePartial(std::min(remaining, budget), BufferStagingAlignment,
+        MinBufferPiece, offset);
+    if (allocated == 0)
+    {
+        return 0;
+    }
+
+    memcpy(m_backend.GetStagingData() + offset, request.Data.data() + request.StagedBytes, (size_t)allocated);
+    m_backend.CopyBuffer(request.Dest, request.DestOffset + request.StagedBytes, offset, allocated);
+    request.StagedBytes += allocated;
+    return allocated;
+}
+
+UINT64 StreamingUploader::StageTexture(Request& request, UINT64 budget)
+{
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint;
+    UINT rowCount = 0;
+    UINT64 rowSize = 0;
+    m_backend.GetTextureFootprint(request.Dest, request.Subresource, footprint, rowCount, rowSize);
+
+    const UINT depth = footprint.Footprint.Depth;
+    const UINT64 stagingSize = (UINT64)footprint.Footprint.RowPitch * rowCount * depth;
+    if (stagingSize > m_staging.GetCapacity())
+    {
+        throw std::length_error("StreamingUploader: texture subresource is larger than the staging ring.");
+    }
+    assert(request.Data.size() >= request.SlicePitch * (depth - 1) + request.RowPitch * (rowCount - 1) + rowSize);
+
+    // A subresource goes in one piece. Over budget it waits for a frame
+    // that has staged nothing else.
+    if (stagingSize > budget && m_staging.GetFrameSize() > 0)
+    {
+        return 0;
+    }
+
+    UINT64 offset = 0;
+    if (!m_staging.Allocate(stagingSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT, offset))
+    {
+        return 0;
+    }
+
+    BYTE* staging = m_backend.GetStagingData() + offset;
+    for (UINT z = 0; z < depth; ++z)
+    {
+        for (UINT row = 0; row < rowCount; ++row)
+        {
+            memcpy(staging + (UINT64)footprint.Footprint.RowPitch * (rowCount * z + row),
+                request.Data.data() + request.SlicePitch * z + request.RowPitch * row, (size_t)rowSize);
+        }
+    }
+
+    footprint.Offset = offset;
+    m_backend.CopyTexture(request.Dest, request.Subresource, footprint);
+    request.StagedBytes = request.Data.size();
+    return stagingSize;
+}
+
+void StreamingUploader::Retire()
+{
+    const UINT64 completed = m_backend.GetCompletedFence();
+    m_staging.Retire(completed);
+
+    // Callbacks run last, as they may add requests.
+    std::vector<Callback> callbacks;
+    auto finished = std::partition(m_submitted.begin(), m_submitted.end(),
+        [this, completed](Handle handle) { return m_requests[handle].LastFence > completed; });
+    for (auto it = finished; it != m_submitted.end(); ++it)
+    {
+        Request& request = m_requests[*it];
+        if (request.OnComplete)
+        {
+            callbacks.push_back(std::move(request.OnComplete));
+        }
+        request = Request();
+        m_freeHandles.push_back(*it);
+        --m_liveRequests;
+        ++m_requestsCompleted;
+    }
+    m_submitted.erase(finished, m_submitted.end());
+
+    for (const Callback& callback : callbacks)
+    {
+        callback();
+    }
+}
+
+void StreamingUploader::Update()
+{
+    Retire();
+
+    UINT64 budget = m_desc.MaxBytesPerFrame;
+    std::vector<Handle> staged;
+    while (!m_queue.empty() && budget > 0)
+    {
+        const QueueEntry entry = m_queue.front();
+        Request& request = m_requests[entry.Request];
+        if (request.State == RequestState::Free || request.Sequence != entry.Sequence)
+        {
+            // Cancelled.
+            std::pop_heap(m_queue.begin(), m_queue.end());
+            m_queue.pop_back();
+            continue;
+        }
+
+        UINT64 bytes = request.IsTexture ? StageTexture(request, budget) : StageBuffer(request, budget);
+        if (bytes > 0)
+        {
+            staged.push_back(entry.Request);
+            m_bytesStreamed += bytes;
+            budget -= std::min(bytes, budget);
+        }
+
+        if (request.StagedBytes == request.Data.size())
+        {
+            std::pop_heap(m_queue.begin(), m_queue.end());
+            m_queue.pop_back();
+
+            // An empty request copies nothing, but must still not complete
+            // before the copies queued ahead of it, this frame's included.
+            if (bytes == 0)
+            {
+                staged.push_back(entry.Request);
+            }
+
+            // The CPU copy is no longer needed.
+            request.State = RequestState::Submitted;
+            request.LastFence = m_lastFence;
+            std::vector<BYTE>().swap(request.Data);
+            m_submitted.push_back(entry.Request);
+        }
+        else
+        {
+            // Out of staging space or budget; the rest goes next frame.
+            if (bytes > 0)
+            {
+                request.State = RequestState::Streaming;
+            }
+            break;
+        }
+    }
+
+    if (m_staging.GetFrameSize() > 0)
+    {
+        m_lastFence = m_backend.Submit();
+        m_staging.EndFrame(m_lastFence);
+        ++m_submissions;
+        for (Handle handle : staged)
+        {
+            m_requests[handle].LastFence = m_lastFence;
+        }
+    }
+    m_peakStagingBytes = std::max(m_peakStagingBytes, m_staging.GetUsed());
+}
+
+void StreamingUploader::MakeQueueWait(ID3D12CommandQueue* queue)
+{
+    if (m_lastFence != 0)
+    {
+        m_backend.MakeQueueWait(queue, m_lastFence);
+    }
+}
+
+StreamingUploaderStats StreamingUploader::GetStats()const
+{
+    StreamingUploaderStats stats;
+    for (const Request& request : m_requests)
+    {
+        if (request.State == RequestState::Queued || request.State == RequestState::Streaming)
+        {
+            ++stats.PendingRequests;
+            stats.PendingBytes += request.Data.size() - request.StagedBytes;
+        }
+        else if (request.State == RequestState::Submitted)
+        {
+            ++stats.InFlightRequests;
+        }
+    }
+    stats.StagingBytesInFlight = m_staging.GetUsed();
+    stats.PeakStagingBytesInFlight = m_peakStagingBytes;
+    stats.BytesStreamed = m_bytesStreamed;
+    stats.RequestsCompleted = m_requestsCompleted;
+    stats.Submissions = m_submissions;
+    return stats;
+}
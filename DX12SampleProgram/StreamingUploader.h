@@ -0,0 +1,266 @@
+// Streams buffer and texture data to the GPU on a copy queue while frames
+// keep rendering.
+//
+// Requests queue up by priority. Once a frame, Update moves as many of them
+// as fit into a fixed-size staging ring, and within a per-frame byte budget,
+// records their copies and submits them to the copy queue in one go. Buffer
+// requests larger than what is free are split across frames; a texture
+// subresource always goes in one piece. When the copy fence passes, the ring
+// space is reused and each finished request's callback runs from Update, on
+// the render thread, by which time its resource can be used without any
+// GPU wait. MakeQueueWait is there for data needed before that.
+//
+// Like UploadBatch, destinations stay in the common state and rely on
+// implicit promotion and decay; they must not be in use by other queues
+// while streaming.
+//
+// The GPU side sits behind StreamingBackend. D3D12StreamingBackend owns the
+// copy queue, fence and staging buffer; NullStreamingBackend records the
+// copies and completes fences only when told to, so the scheduling can be
+// run without a device.
+#pragma once
+#include "stdafx.h"
+#include "D3DUtil.h"
+#include "FencedRing.h"
+#include <functional>
+
+#if defined(_WIN32)
+#include "CopyQueue.h"
+#endif
+
+class StreamingBackend
+{
+public:
+    virtual ~StreamingBackend() = default;
+
+    // Persistently mapped staging memory and its size.
+    virtual BYTE* GetStagingData() = 0;
+    virtual UINT64 GetStagingCapacity()const = 0;
+
+    // Layout of subresource of texture when staged at offset 0.
+    virtual void GetTextureFootprint(ID3D12Resource* texture, UINT subresource,
+        D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint, UINT& rowCount, UINT64& rowSize) = 0;
+
+    // Copies recorded for the next Submit.
+    virtual void CopyBuffer(ID3D12Resource* dest, UINT64 destOffset, UINT64 stagingOffset, UINT64 byteSize) = 0;
+    virtual void CopyTexture(ID3D12Resource* dest, UINT subresource,
+        const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& stagingFootprint) = 0;
+
+    // Executes the recorded copies; returns the fence value that marks their
+    // completion. Values increase by one per submission.
+    virtual UINT64 Submit() = 0;
+    virtual UINT64 GetCompletedFence() = 0;
+
+    // Makes queue wait on the GPU until fence has passed.
+    virtual void MakeQueueWait(ID3D12CommandQueue* queue, UINT64 fence) = 0;
+};
+
+#if defined(_WIN32)
+class D3D12StreamingBackend : public StreamingBackend
+{
+public:
+    D3D12StreamingBackend(ID3D12Device* device, UINT64 stagingCapacity);
+    D3D12StreamingBackend(const D3D12StreamingBackend& rhs) = delete;
+    D3D12StreamingBackend& operator=(const D3D12StreamingBackend& rhs) = delete;
+
+    // Waits for the copy queue.
+    ~D3D12StreamingBackend();
+
+    virtual BYTE* GetStagingData()override { return m_stagingData; }
+    virtual UINT64 GetStagingCapacity()const override { return m_stagingCapacity; }
+    virtual void GetTextureFootprint(ID3D12Resource* texture, UINT subresource,
+        D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint, UINT& rowCount, UINT64& rowSize)override;
+    virtual void CopyBuffer(ID3D12Resource* dest, UINT64 destOffset, UINT64 stagingOffset, UINT64 byteSize)override;
+    virtual void CopyTexture(ID3D12Resource* dest, UINT subresource,
+        const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& stagingFootprint)override;
+    virtual UINT64 Submit()override;
+    virtual UINT64 GetCompletedFence()override { return m_copyQueue.GetCompletedFence(); }
+    virtual void MakeQueueWait(ID3D12CommandQueue* queue, UINT64 fence)override;
+
+private:
+    ID3D12Device* m_device = nullptr;
+    CopyQueue m_copyQueue;
+
+    Microsoft::WRL::ComPtr<ID3D12Resource> m_staging;
+    BYTE* m_stagingData = nullptr;
+    UINT64 m_stagingCapacity = 0;
+};
+#endif
+
+class NullStreamingBackend : public StreamingBackend
+{
+public:
+    struct Copy
+    {
+        ID3D12Resource* Dest = nullptr;
+        UINT Subresource = 0;
+        UINT64 DestOffset = 0;
+        UINT64 StagingOffset = 0;
+        UINT64 ByteSize = 0;
+        bool IsTexture = false;
+        UINT64 Fence = 0;
+    };
+
+    explicit NullStreamingBackend(UINT64 stagingCapacity) : m_staging((size_t)stagingCapacity) {}
+
+    virtual BYTE* GetStagingData()override { return m_staging.data(); }
+    virtual UINT64 GetStagingCapacity()const override { return m_staging.size(); }
+
+    // Every texture looks like one tightly packed 2D subresource of
+    // TextureRowCount rows of TextureRowSize bytes, pitched to 256 bytes.
+    virtual void GetTextureFootprint(ID3D12Resource* texture, UINT subresource,
+        D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint, UINT& rowCount, UINT64& rowSize)override;
+    virtual void CopyBuffer(ID3D12Resource* dest, UINT64 destOffset, UINT64 stagingOffset, UINT64 byteSize)override;
+    virtual void CopyTexture(ID3D12Resource* dest, UINT subresource,
+        const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& stagingFootprint)override;
+    virtual UINT64 Submit()override { return ++m_submittedFence; }
+    virtual UINT64 GetCompletedFence()override { return m_completedFence; }
+    virtual void MakeQueueWait(ID3D12CommandQueue* queue, UINT64 fence)override { m_waitedFence = fence; }
+
+    // Pretends the copy queue got through fence.
+    void Complete(UINT64 fence) { m_completedFence = std::min(std::max(m_completedFence, fence), m_submittedFence); }
+    void CompleteAll() { m_completedFence = m_submittedFence; }
+
+    UINT64 GetSubmittedFence()const { return m_submittedFence; }
+    UINT64 GetWaitedFence()const { return m_waitedFence; }
+
+    // Copies recorded so far, tagged with their submission's fence.
+    const std::vector<Copy>& GetCopies()const { return m_copies; }
+
+    UINT TextureRowCount = 64;
+    UINT TextureRowSize = 256;
+
+private:
+    std::vector<BYTE> m_staging;
+    std::vector<Copy> m_copies;
+    UINT64 m_submittedFence = 0;
+    UINT64 m_completedFence = 0;
+    UINT64 m_waitedFence = 0;
+};
+
+struct StreamingUploaderDesc
+{
+    // Most bytes staged per Update, so that a burst of requests does not
+    // turn into one long copy.
+    UINT64 MaxBytesPerFrame = 4ull * 1024 * 1024;
+};
+
+struct StreamingUploaderStats
+{
+    UINT PendingRequests = 0;
+    UINT InFlightRequests = 0;
+    UINT64 PendingBytes = 0;
+
+    // Staging ring bytes the copy queue has not finished with, now and at most.
+    UINT64 StagingBytesInFlight = 0;
+    UINT64 PeakStagingBytesInFlight = 0;
+
+    UINT64 BytesStreamed = 0;
+    UINT RequestsCompleted = 0;
+    UINT Submissions = 0;
+};
+
+class StreamingUploader
+{
+public:
+    using Handle = UINT;
+    static const Handle InvalidHandle = ~0u;
+    using Callback = std::function<void()>;
+
+    StreamingUploader(StreamingBackend& backend, const StreamingUploaderDesc& desc = StreamingUploaderDesc());
+    StreamingUploader(const StreamingUploader& rhs) = delete;
+    StreamingUploader& operator=(const StreamingUploader& rhs) = delete;
+
+    // Copies data to dest at destOffset. Higher priorities go first; equal
+    // priorities in request order. onComplete may be empty. So may data;
+    // the request then completes with the copies before it, without one of
+    // its own.
+    Handle RequestBuffer(ID3D12Resource* dest, UINT64 destOffset, std::vector<BYTE>&& data,
+        int priority = 0, Callback onComplete = Callback());
+
+    // Copies data, rowPitch bytes per row and slicePitch per depth slice, to
+    // subresource of dest.
+    Handle RequestTexture(ID3D12Resource* dest, UINT subresource, std::vector<BYTE>&& data,
+        UINT64 rowPitch, UINT64 slicePitch, int priority = 0, Callback onComplete = Callback());
+
+    // Drops a request nothing of which has been staged yet. Returns false
+    // once streaming has started.
+    bool Cancel(Handle handle);
+
+    // Retires finished copies, running their callbacks, then stages and
+    // submits the next requests. Call once per frame.
+    void Update();
+
+    // Makes queue wait on the GPU for everything submitted so far.
+    void MakeQueueWait(ID3D12CommandQueue* queue);
+
+    bool IsIdle()const { return m_liveRequests == 0; }
+
+    StreamingUploaderStats GetStats()const;
+
+private:
+    enum class RequestState
+    {
+        Free,
+        Queued,
+        Streaming,
+        Submitted
+    };
+
+    struct Request
+    {
+        RequestState State = RequestState::Free;
+        ID3D12Resource* Dest = nullptr;
+        bool IsTexture = false;
+        UINT64 DestOffset = 0;
+        UINT Subresource = 0;
+        UINT64 RowPitch = 0;
+        UINT64 SlicePitch = 0;
+        std::vector<BYTE> Data;
+        UINT64 StagedBytes = 0;
+
+        int Priority = 0;
+        UINT64 Sequence = 0;
+        UINT64 LastFence = 0;
+        Callback OnComplete;
+    };
+
+    struct QueueEntry
+    {
+        int Priority;
+        UINT64 Sequence;
+        Handle Request;
+
+        // Heap order: highest priority, then oldest, on top.
+        bool operator<(const QueueEntry& rhs)const
+        {
+            return Priority != rhs.Priority ? Priority < rhs.Priority : Sequence > rhs.Sequence;
+        }
+    };
+
+    Handle AddRequest(Request&& request);
+    void Retire();
+
+    // Stages as much of request as fits in budget; returns the bytes staged.
+    UINT64 StageBuffer(Request& request, UINT64 budget);
+    UINT64 StageTexture(Request& request, UINT64 budget);
+
+    StreamingBackend& m_backend;
+    StreamingUploaderDesc m_desc;
+
+    std::vector<Request> m_requests;
+    std::vector<Handle> m_freeHandles;
+    std::vector<QueueEntry> m_queue;
+    std::vector<Handle> m_submitted;
+    UINT m_liveRequests = 0;
+    UINT64 m_nextSequence = 0;
+
+    // Staging ring space, a frame per submission.
+    FencedRing m_staging;
+    UINT64 m_lastFence = 0;
+
+    UINT64 m_peakStagingBytes = 0;
+    UINT64 m_bytesStreamed = 0;
+    UINT m_requestsCompleted = 0;
+    UINT m_submissions = 0;
+};
@@ -0,0 +1,289 @@
+#include "stdafx.h"
+#include "Subdivision.h"
+#include <ppl.h>
+#include <atomic>
+
+using namespace DirectX;
+
+namespace
+{
+    using uint32 = std::uint32_t;
+    using Vertex = GeometryGenerator::Vertex;
+
+    void AddScaled(Vertex& sum, const Vertex& v, float weight)
+    {
+        sum.Position.x += weight * v.Position.x;
+        sum.Position.y += weight * v.Position.y;
+        sum.Position.z += weight * v.Position.z;
+        sum.Normal.x += weight * v.Normal.x;
+        sum.Normal.y += weight * v.Normal.y;
+        sum.Normal.z += weight * v.Normal.z;
+        sum.TangentU.x += weight * v.TangentU.x;
+        sum.TangentU.y += weight * v.TangentU.y;
+        sum.TangentU.z += weight * v.TangentU.z;
+        sum.TexC.x += weight * v.TexC.x;
+        sum.TexC.y += weight * v.TexC.y;
+    }
+
+    void RenormalizeAll(std::vector<Vertex>& vertices)
+    {
+        concurrency::parallel_for(size_t(0), vertices.size(), [&](size_t i)
+        {
+            Vertex& v = vertices[i];
+            XMStoreFloat3(&v.Normal, XMVector3Normalize(XMLoadFloat3(&v.Normal)));
+            XMStoreFloat3(&v.TangentU, XMVector3Normalize(XMLoadFloat3(&v.TangentU)));
+        });
+    }
+
+    // Rules shared by both schemes for vertices that are unused or on the
+    // boundary. Returns false for interior vertices, leaving out alone.
+    bool BoundaryVertexRule(const HalfEdgeMesh& mesh, const std::vector<Vertex>& vertices, uint32 v, Vertex& out)
+    {
+        if (mesh.VertexHalfEdge(v) == HalfEdgeMesh::Invalid)
+        {
+            out = vertices[v];
+            return true;
+        }
+        if (!mesh.IsBoundaryVertex(v))
+        {
+            return false;
+        }
+
+        uint32 last = HalfEdgeMesh::Invalid;
+        uint32 faceCount = 0;
+        mesh.ForEachOutgoing(v, [&](uint32 h)
+        {
+            last = h;
+            ++faceCount;
+        });
+
+        // Corners of a single face keep their position.
+        if (faceCount == 1)
+        {
+            out = vertices[v];
+            return true;
+        }
+
+        // Cubic B-spline along the boundary.
+        uint32 next = mesh.Target(mesh.VertexHalfEdge(v));
+        uint32 prev = mesh.Origin(mesh.Prev(last));
+        out = Vertex();
+        AddScaled(out, vertices[v], 0.75f);
+        AddScaled(out, vertices[next], 0.125f);
+        AddScaled(out, vertices[prev], 0.125f);
+        return true;
+    }
+
+    bool MergePair(const uint32* t1, const uint32* t2, uint32* quad)
+    {
+        // Look for an edge x->y of t1 that t2 has as y->x; the quad then runs
+        // from the corner u of t1 opposite the edge over t2's far corner z.
+        for (uint32 r = 0; r < 3; ++r)
+        {
+            uint32 u = t1[r];
+            uint32 x = t1[(r + 1) % 3];
+            uint32 y = t1[(r + 2) % 3];
+            for (uint32 s = 0; s < 3; ++s)
+            {
+                if (t2[s] == y && t2[(s + 1) % 3] == x)
+                {
+                    quad[0] = u;
+                    quad[1] = x;
+                    quad[2] = t2[(s + 2) % 3];
+                    quad[3] = y;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+}
+
+void LoopSubdivideLevel(const HalfEdgeMesh& mesh, const std::vector<Vertex>& vertices,
+    HalfEdgeMesh& outMesh, std::vector<Vertex>& outVertices)
+{
+    assert(mesh.GetFaceSize() == 3 && vertices.size() == mesh.GetVertexCount());
+
+    const uint32 vertexCount = mesh.GetVertexCount();
+    const uint32 edgeCount = mesh.GetEdgeCount();
+    std::vector<Vertex> result(vertexCount + edgeCount);
+
+    // Old vertices: (1 - n*beta) * v + beta * sum of the one-ring.
+    concurrency::parallel_for(0u, vertexCount, [&](uint32 v)
+    {
+        Vertex& out = result[v];
+        if (BoundaryVertexRule(mesh, vertices, v, out))
+        {
+            return;
+        }
+
+        uint32 valence = mesh.FaceValence(v);
+        float beta = valence == 3 ? 3.0f / 16.0f : 3.0f / (8.0f * valence);
+        AddScaled(out, vertices[v], 1.0f - valence * beta);
+        mesh.ForEachOutgoing(v, [&](uint32 h)
+        {
+            AddScaled(out, vertices[mesh.Target(h)], beta);
+        });
+    });
+
+    // Edge vertices: 3/8 of each end plus 1/8 of each opposite corner, the
+    // midpoint on the boundary.
+    concurrency::parallel_for(0u, edgeCount, [&](uint32 e)
+    {
+        Vertex& out = result[vertexCount + e];
+        uint32 h = mesh.EdgeHalfEdge(e);
+        if (mesh.IsBoundary(h))
+        {
+            AddScaled(out, vertices[mesh.Origin(h)], 0.5f);
+            AddScaled(out, vertices[mesh.Target(h)], 0.5f);
+            return;
+        }
+
+        AddScaled(out, vertices[mesh.Origin(h)], 0.375f);
+        AddScaled(out, vertices[mesh.Target(h)], 0.375f);
+        AddScaled(out, vertices[mesh.Origin(mesh.Prev(h))], 0.125f);
+        AddScaled(out, vertices[mesh.Origin(mesh.Prev(mesh.Twin(h)))], 0.125f);
+    });
+
+    RenormalizeAll(result);
+
+    // mesh and outMesh may be the same object.
+    HalfEdgeMesh refined = mesh.RefineLoop();
+    outMesh = std::move(refined);
+    outVertices = std::move(result);
+}
+
+void CatmullClarkSubdivideLevel(const HalfEdgeMesh& mesh, const std::vector<Vertex>& vertices,
+    HalfEdgeMesh& outMesh, std::vector<Vertex>& outVertices)
+{
+    assert(vertices.size() == mesh.GetVertexCount());
+
+    const uint32 vertexCount = mesh.GetVertexCount();
+    const uint32 edgeCount = mesh.GetEdgeCount();
+    const uint32 faceCount = mesh.GetFaceCount();
+    const uint32 faceSize = mesh.GetFaceSize();
+    const uint32 facePointStart = vertexCount + edgeCount;
+    std::vector<Vertex> result(facePointStart + faceCount);
+
+    // Face vertices: centroid.
+    concurrency::parallel_for(0u, faceCount, [&](uint32 f)
+    {
+        Vertex& out = result[facePointStart + f];
+        uint32 h = mesh.FaceHalfEdge(f);
+        for (uint32 k = 0; k < faceSize; ++k, ++h)
+        {
+            AddScaled(out, vertices[mesh.Origin(h)], 1.0f / faceSize);
+        }
+    });
+
+    // Edge vertices: average of both ends and both face vertices, the
+    // midpoint on the boundary.
+    concurrency::parallel_for(0u, edgeCount, [&](uint32 e)
+    {
+        Vertex& out = result[vertexCount + e];
+        uint32 h = mesh.EdgeHalfEdge(e);
+        if (mesh.IsBoundary(h))
+        {
+            AddScaled(out, vertices[mesh.Origin(h)], 0.5f);
+            AddScaled(out, vertices[mesh.Target(h)], 0.5f);
+            return;
+        }
+
+        AddScaled(out, vertices[mesh.Origin(h)], 0.25f);
+        AddScaled(out, vertices[mesh.Target(h)], 0.25f);
+        AddScaled(out, result[facePointStart + mesh.Face(h)], 0.25f);
+        AddScaled(out, result[facePointStart + mesh.Face(mesh.Twin(h))], 0.25f);
+    });
+
+    // Old vertices: (Q + 2R + (n-3)v) / n with Q the average of the face
+    // vertices and R of the edge midpoints, expanded into per-neighbour weights.
+    concurrency::parallel_for(0u, vertexCount, [&](uint32 v)
+    {
+        Vertex& out = result[v];
+        if (BoundaryVertexRule(mesh, vertices, v, out))
+        {
+            return;
+        }
+
+        float n = (float)mesh.FaceValence(v);
+        float neighbourWeight = 1.0f / (n * n);
+        AddScaled(out, vertices[v], (n - 2.0f) / n);
+        mesh.ForEachOutgoing(v, [&](uint32 h)
+        {
+            AddScaled(out, vertices[mesh.Target(h)], neighbourWeight);
+            AddScaled(out, result[facePointStart + mesh.Face(h)], neighbourWeight);
+        });
+    });
+
+    RenormalizeAll(result);
+
+    HalfEdgeMesh refined = mesh.RefineCatmullClark();
+    outMesh = std::move(refined);
+    outVertices = std::move(result);
+}
+
+GeometryGenerator::MeshData LoopSubdivide(const GeometryGenerator::MeshData& meshData, std::uint32_t levels)
+{
+    HalfEdgeMesh mesh(meshData);
+    std::vector<Vertex> vertices = meshData.Vertices;
+    for (uint32 i = 0; i < levels; ++i)
+    {
+        LoopSubdivideLevel(mesh, vertices, mesh, vertices);
+    }
+
+    GeometryGenerator::MeshData result;
+    result.Vertices = std::move(vertices);
+    result.Indices32 = mesh.GetIndices();
+    result.ComputeBounds();
+    return result;
+}
+
+GeometryGenerator::MeshData CatmullClarkSubdivide(const GeometryGenerator::MeshData& meshData, std::uint32_t levels)
+{
+    if (levels == 0)
+    {
+        return meshData;
+    }
+
+    std::vector<uint32> quads;
+    HalfEdgeMesh mesh = MergeTrianglePairs(meshData.Indices32, quads) ?
+        HalfEdgeMesh((uint32)meshData.Vertices.size(), quads, 4) : HalfEdgeMesh(meshData);
+
+    std::vector<Vertex> vertices = meshData.Vertices;
+    for (uint32 i = 0; i < levels; ++i)
+    {
+        CatmullClarkSubdivideLevel(mesh, vertices, mesh, vertices);
+    }
+
+    GeometryGenerator::MeshData result;
+    result.Vertices = std::move(vertices);
+    result.Indices32 = mesh.Triangulate();
+    result.ComputeBounds();
+    return result;
+}
+
+bool MergeTrianglePairs(const std::vector<std::uint32_t>& triangles, std::vector<std::uint32_t>& quads)
+{
+    if (triangles.empty() || triangles.size() % 6 != 0)
+    {
+        return false;
+    }
+
+    const size_t pairCount = triangles.size() / 6;
+    std::vector<uint32> merged(pairCount * 4);
+    std::atomic<bool> allMerged(true);
+    concurrency::parallel_for(size_t(0), pairCount, [&](size_t p)
+    {
+        if (!MergePair(&triangles[p * 6], &triangles[p * 6 + 3], &merged[p * 4]))
+        {
+            allMerged.store(false, std::memory_order_relaxed);
+        }
+    });
+
+    if (!allMerged.load())
+    {
+        return false;
+    }
+    quads = std::move(merged);
+    return true;
+}
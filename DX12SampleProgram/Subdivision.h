@@ -0,0 +1,41 @@
+// Smooth subdivision surfaces on top of HalfEdgeMesh.
+//
+// Loop subdivision refines triangle meshes, Catmull-Clark any mesh into quads.
+// Every level is one parallel pass per new vertex class (old vertices, edge
+// vertices, face vertices); the refined connectivity is derived from the
+// parent's directly, so only the input mesh is ever matched up by search.
+//
+// All vertex attributes go through the same stencils; normals and tangents
+// are renormalized afterwards. The generators duplicate vertices along
+// texture seams and hard edges, which makes those seams boundaries: they stay
+// crack-free and keep their shape as B-spline curves, but the surface is not
+// smoothed across them. Weld the mesh first (WeldVertices with the normal and
+// texture tolerances disabled) to smooth across seams. Boundary vertices
+// with a single face are kept as corners.
+#pragma once
+#include "stdafx.h"
+#include "HalfEdgeMesh.h"
+
+// One level of Loop subdivision. mesh must be a triangle mesh and vertices
+// hold its mesh.GetVertexCount() vertices. outMesh may be reused as the
+// input of the next level.
+void LoopSubdivideLevel(const HalfEdgeMesh& mesh, const std::vector<GeometryGenerator::Vertex>& vertices,
+    HalfEdgeMesh& outMesh, std::vector<GeometryGenerator::Vertex>& outVertices);
+
+// One level of Catmull-Clark subdivision. The output is always quads.
+void CatmullClarkSubdivideLevel(const HalfEdgeMesh& mesh, const std::vector<GeometryGenerator::Vertex>& vertices,
+    HalfEdgeMesh& outMesh, std::vector<GeometryGenerator::Vertex>& outVertices);
+
+// Refines a triangle mesh levels times with Loop subdivision. Each level
+// multiplies the triangle count by four.
+GeometryGenerator::MeshData LoopSubdivide(const GeometryGenerator::MeshData& meshData, std::uint32_t levels);
+
+// Refines meshData levels times with Catmull-Clark subdivision and returns the
+// quads as triangle pairs. When every consecutive pair of triangles forms a
+// quad (as the grid, box and cylinder body generators emit them) the pairs are
+// subdivided as quads, otherwise the triangles are.
+GeometryGenerator::MeshData CatmullClarkSubdivide(const GeometryGenerator::MeshData& meshData, std::uint32_t levels);
+
+// Merges consecutive triangle pairs that share an edge into quads. Returns
+// false, leaving quads untouched, if any pair does not.
+bool MergeTrianglePairs(const std::vector<std::uint32_t>& triangles, std::vector<std::uint32_t>& quads);
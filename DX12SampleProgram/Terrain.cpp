@@ -0,0 +1,269 @@
+#include "stdafx.h"
+#include "Terrain.h"
+
+using namespace DirectX;
+
+namespace
+{
+    UINT RoundUpTo4(UINT value)
+    {
+        return (value + 3) & ~3u;
+    }
+}
+
+XMFLOAT3 TerrainChunk::GetPosition(UINT row, UINT column)const
+{
+    const int quads = (int)Resolution - 1;
+    return XMFLOAT3(
+        (float)(Coord.X * quads + (int)column) * Spacing,
+        Heights[row * Resolution + column],
+        (float)((Coord.Z + 1) * quads - (int)row) * Spacing);
+}
+
+Terrain::Terrain(const TerrainDesc& desc) :
+    m_desc(desc),
+    m_noise(desc.Seed),
+    m_spacing(desc.ChunkSize / desc.ChunkQuads),
+    m_cache(desc.CacheCapacity)
+{
+    assert(desc.ChunkQuads > 0 && desc.CacheCapacity > 0);
+}
+
+Terrain::~Terrain()
+{
+    m_cache.WaitForRequests();
+}
+
+__m128 Terrain::Heights4(__m128 x, __m128 z)const
+{
+    __m128 height = m_noise.Fbm4(x, z, m_desc.Noise);
+    if (m_desc.HillsScale != 0.0f)
+    {
+        XMVECTOR tenth = XMVectorReplicate(0.1f);
+        XMVECTOR hills = XMVectorAdd(
+            XMVectorMultiply(z, XMVectorSin(XMVectorMultiply(tenth, x))),
+            XMVectorMultiply(x, XMVectorCos(XMVectorMultiply(tenth, z))));
+        height = XMVectorMultiplyAdd(hills, XMVectorReplicate(0.3f * m_desc.HillsScale), height);
+    }
+    return height;
+}
+
+float Terrain::GetHeight(float x, float z)const
+{
+    return _mm_cvtss_f32(Heights4(_mm_set1_ps(x), _mm_set1_ps(z)));
+}
+
+void Terrain::GetHeights(const float* x, const float* z, size_t count, float* heights)const
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_ps(heights + i, Heights4(_mm_loadu_ps(x + i), _mm_loadu_ps(z + i)));
+    }
+    for (; i < count; ++i)
+    {
+        heights[i] = GetHeight(x[i], z[i]);
+    }
+}
+
+void Terrain::GetRowHeights(int firstColumn, int row, UINT count, float* heights)const
+{
+    const __m128 spacing = _mm_set1_ps(m_spacing);
+    const __m128 z = _mm_set1_ps((float)row * m_spacing);
+    __m128i column = _mm_add_epi32(_mm_set1_epi32(firstColumn), _mm_set_epi32(3, 2, 1, 0));
+    for (UINT i = 0; i < count; i += 4)
+    {
+        __m128 x = _mm_mul_ps(_mm_cvtepi32_ps(column), spacing);
+        _mm_storeu_ps(heights + i, Heights4(x, z));
+        column = _mm_add_epi32(column, _mm_set1_epi32(4));
+    }
+}
+
+TerrainChunkCoord Terrain::GetChunkCoord(float x, float z)const
+{
+    TerrainChunkCoord coord;
+    coord.X = (int)floorf(x / m_desc.ChunkSize);
+    coord.Z = (int)floorf(z / m_desc.ChunkSize);
+    return coord;
+}
+
+std::shared_ptr<TerrainChunk> Terrain::GenerateChunk(TerrainChunkCoord coord)const
+{
+    const int quads = (int)m_desc.ChunkQuads;
+    const UINT resolution = m_desc.ChunkQuads + 1;
+
+    // Heights with a one-sample border for the central differences. Rows are
+    // padded so vector loads and stores may run past the last sample.
+    const UINT borderedWidth = resolution + 2;
+    const UINT stride = RoundUpTo4(borderedWidth) + 4;
+    std::vector<float> bordered((size_t)borderedWidth * stride + 4);
+    for (UINT r = 0; r < borderedWidth; ++r)
+    {
+        int row = (coord.Z + 1) * quads - ((int)r - 1);
+        GetRowHeights(coord.X * quads - 1, row, borderedWidth, &bordered[(size_t)r * stride]);
+    }
+
+    auto chunk = std::make_shared<TerrainChunk>();
+    chunk->Coord = coord;
+    chunk->Resolution = resolution;
+    chunk->Spacing = m_spacing;
+    chunk->Heights.resize((size_t)resolution * resolution);
+    chunk->Normals.resize((size_t)resolution * resolution);
+
+    float minHeight = FLT_MAX;
+    float maxHeight = -FLT_MAX;
+    for (UINT i = 0; i < resolution; ++i)
+    {
+        const float* src = &bordered[(size_t)(i + 1) * stride + 1];
+        float* dst = &chunk->Heights[(size_t)i * resolution];
+        for (UINT j = 0; j < resolution; ++j)
+        {
+            dst[j] = src[j];
+            minHeight = std::min(minHeight, src[j]);
+            maxHeight = std::max(maxHeight, src[j]);
+        }
+    }
+
+    // n = normalize(-dh/dx, 1, -dh/dz), four samples at a time. Rows run
+    // towards -z, so the row above is the +z neighbour.
+    const __m128 invTwoSpacing = _mm_set1_ps(0.5f / m_spacing);
+    const __m128 one = _mm_set1_ps(1.0f);
+    for (UINT i = 0; i < resolution; ++i)
+    {
+        const float* above = &bordered[(size_t)i * stride + 1];
+        const float* center = &bordered[(size_t)(i + 1) * stride];
+        const float* below = &bordered[(size_t)(i + 2) * stride + 1];
+        for (UINT j = 0; j < resolution; j += 4)
+        {
+            __m128 dhdx = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(center + j + 2), _mm_loadu_ps(center + j)), invTwoSpacing);
+            __m128 dhdz = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(above + j), _mm_loadu_ps(below + j)), invTwoSpacing);
+            __m128 lengthSq = _mm_add_ps(one, _mm_add_ps(_mm_mul_ps(dhdx, dhdx), _mm_mul_ps(dhdz, dhdz)));
+            __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSq));
+
+            alignas(16) float nx[4], ny[4], nz[4];
+            _mm_store_ps(nx, _mm_mul_ps(_mm_sub_ps(_mm_setzero_ps(), dhdx), invLength));
+            _mm_store_ps(ny, invLength);
+            _mm_store_ps(nz, _mm_mul_ps(_mm_sub_ps(_mm_setzero_ps(), dhdz), invLength));
+
+            UINT lanes = std::min(4u, resolution - j);
+            for (UINT lane = 0; lane < lanes; ++lane)
+            {
+                chunk->Normals[(size_t)i * resolution + j + lane] = XMFLOAT3(nx[lane], ny[lane], nz[lane]);
+            }
+        }
+    }
+
+    chunk->MinHeight = minHeight;
+    chunk->MaxHeight = maxHeight;
+    float x0 = (float)(coord.X * quads) * m_spacing;
+    float x1 = (float)((coord.X + 1) * quads) * m_spacing;
+    float z0 = (float)(coord.Z * quads) * m_spacing;
+    float z1 = (float)((coord.Z + 1) * quads) * m_spacing;
+    chunk->Bounds = MakeVertexBounds(XMVectorSet(x0, minHeight, z0, 0.0f), XMVectorSet(x1, maxHeight, z1, 0.0f));
+    return chunk;
+}
+
+std::uint64_t Terrain::ChunkKey(TerrainChunkCoord coord)
+{
+    return ((std::uint64_t)(std::uint32_t)coord.X << 32) | (std::uint32_t)coord.Z;
+}
+
+std::shared_ptr<const TerrainChunk> Terrain::GetChunk(TerrainChunkCoord coord)
+{
+    return m_cache.GetOrFetch(ChunkKey(coord), [this, coord]() { return GenerateChunk(coord); });
+}
+
+std::vector<std::shared_ptr<const TerrainChunk>> Terrain::GetChunks(const std::vector<TerrainChunkCoord>& coords)
+{
+    std::vector<std::shared_ptr<const TerrainChunk>> chunks(coords.size());
+    std::vector<size_t> missing;
+    for (size_t i = 0; i < coords.size(); ++i)
+    {
+        chunks[i] = m_cache.Lookup(ChunkKey(coords[i]));
+        if (chunks[i] == nullptr)
+        {
+            missing.push_back(i);
+        }
+    }
+
+    concurrency::parallel_for(size_t(0), missing.size(), [&](size_t m)
+    {
+        size_t i = missing[m];
+        std::shared_ptr<const TerrainChunk> chunk = GenerateChunk(coords[i]);
+        m_cache.Insert(ChunkKey(coords[i]), chunk);
+        chunks[i] = chunk;
+    });
+    return chunks;
+}
+
+void Terrain::RequestChunk(TerrainChunkCoord coord)
+{
+    m_cache.Request(ChunkKey(coord), [this, coord]() { return GenerateChunk(coord); });
+}
+
+std::shared_ptr<const TerrainChunk> Terrain::FindChunk(TerrainChunkCoord coord)
+{
+    return m_cache.Lookup(ChunkKey(coord));
+}
+
+void Terrain::WaitForRequests()
+{
+    m_cache.WaitForRequests();
+}
+
+size_t Terrain::GetCachedChunkCount()const
+{
+    return m_cache.GetCount();
+}
+
+GeometryGenerator::MeshCounts Terrain::GetChunkCounts()const
+{
+    return GeometryGenerator::GridCounts(m_desc.ChunkQuads + 1, m_desc.ChunkQuads + 1);
+}
+
+void Terrain::WriteChunk(const TerrainChunk& chunk, const GeometryGenerator::MeshWriter& out)const
+{
+    const UINT n = chunk.Resolution;
+    const float texScale = 1.0f / (n - 1);
+
+    for (UINT i = 0; i < n; ++i)
+    {
+        for (UINT j = 0; j < n; ++j)
+        {
+            const XMFLOAT3& normal = chunk.Normals[(size_t)i * n + j];
+
+            GeometryGenerator::Vertex v;
+            v.Position = chunk.GetPosition(i, j);
+            v.Normal = normal;
+
+            // dP/dx of the height field, (1, dh/dx, 0), expressed through the normal.
+            XMVECTOR tangent = XMVectorSet(normal.y, -normal.x, 0.0f, 0.0f);
+            XMStoreFloat3(&v.TangentU, XMVector3Normalize(tangent));
+
+            v.TexC = XMFLOAT2(j * texScale, i * texScale);
+            out.SetVertex(i * n + j, v);
+        }
+    }
+
+    if (out.IndexData == nullptr)
+    {
+        return;
+    }
+
+    size_t k = 0;
+    for (UINT i = 0; i < n - 1; ++i)
+    {
+        for (UINT j = 0; j < n - 1; ++j)
+        {
+            out.SetIndex(k, i * n + j);
+            out.SetIndex(k + 1, i * n + j + 1);
+            out.SetIndex(k + 2, (i + 1) * n + j);
+
+            out.SetIndex(k + 3, (i + 1) * n + j);
+            out.SetIndex(k + 4, i * n + j + 1);
+            out.SetIndex(k + 5, (i + 1) * n + j + 1);
+
+            k += 6;
+        }
+    }
+}
@@ -0,0 +1,128 @@
+// Chunked procedural terrain.
+//
+// The world is an unbounded grid of square chunks, each an independent height
+// field of (ChunkQuads+1)^2 samples. Heights are fBm simplex noise plus the
+// sample hills function, evaluated four samples at a time; normals come from
+// a SIMD central-difference pass over a one-sample border, so neighbouring
+// chunks agree on their shared edges. Sample positions are derived from
+// global integer sample indices, which makes shared edge vertices
+// bit-identical.
+//
+// Generated chunks are kept in an LRU cache. They can be built in parallel
+// batches (GetChunks) or requested asynchronously and picked up later
+// (RequestChunk/FindChunk).
+#pragma once
+#include "stdafx.h"
+#include "GeometryGenerator.h"
+#include "LruCache.h"
+#include "TerrainNoise.h"
+#include <memory>
+
+struct TerrainDesc
+{
+    // World units per chunk side and quads per chunk side.
+    float ChunkSize = 256.0f;
+    UINT ChunkQuads = 64;
+
+    std::uint32_t Seed = 0;
+    FbmDesc Noise = { 6, 1.0f / 512.0f, 60.0f, 2.0f, 0.5f };
+
+    // Weight of the sample hills 0.3 * (z*sin(0.1x) + x*cos(0.1z)). They grow
+    // linearly away from the origin, so leave at 0 for large worlds.
+    float HillsScale = 0.0f;
+
+    // Chunks kept in memory.
+    UINT CacheCapacity = 256;
+};
+
+struct TerrainChunkCoord
+{
+    int X = 0;
+    int Z = 0;
+};
+
+struct TerrainChunk
+{
+    TerrainChunkCoord Coord;
+
+    // Samples per side (ChunkQuads + 1). Row i runs along +x at
+    // z = (Coord.Z + 1) * ChunkSize - i * spacing, matching the vertex order
+    // of GeometryGenerator::GenerateGrid.
+    UINT Resolution = 0;
+    float Spacing = 0.0f;
+
+    std::vector<float> Heights;
+    std::vector<DirectX::XMFLOAT3> Normals;
+
+    float MinHeight = 0.0f;
+    float MaxHeight = 0.0f;
+    VertexBounds Bounds;
+
+    DirectX::XMFLOAT3 GetPosition(UINT row, UINT column)const;
+};
+
+class Terrain
+{
+public:
+    explicit Terrain(const TerrainDesc& desc);
+    Terrain(const Terrain& rhs) = delete;
+    Terrain& operator=(const Terrain& rhs) = delete;
+    ~Terrain();
+
+    const TerrainDesc& GetDesc()const { return m_desc; }
+
+    // The height function the chunks sample.
+    float GetHeight(float x, float z)const;
+
+    // Heights of count points; x and z are read four at a time.
+    void GetHeights(const float* x, const float* z, size_t count, float* heights)const;
+
+    // Chunk containing the world position.
+    TerrainChunkCoord GetChunkCoord(float x, float z)const;
+
+    // Cached chunk, generated on the calling thread if it is not.
+    std::shared_ptr<const TerrainChunk> GetChunk(TerrainChunkCoord coord);
+
+    // Generates all missing chunks in parallel and returns them in the order
+    // of coords.
+    std::vector<std::shared_ptr<const TerrainChunk>> GetChunks(const std::vector<TerrainChunkCoord>& coords);
+
+    // Queues generation of the chunk on a worker thread. Does nothing if it
+    // is cached or already queued.
+    void RequestChunk(TerrainChunkCoord coord);
+
+    // Cached chunk or null; never generates.
+    std::shared_ptr<const TerrainChunk> FindChunk(TerrainChunkCoord coord);
+
+    // Blocks until every requested chunk is in the cache.
+    void WaitForRequests();
+
+    size_t GetCachedChunkCount()const;
+
+    // Vertex and index counts of one chunk as a grid mesh.
+    GeometryGenerator::MeshCounts GetChunkCounts()const;
+
+    // Writes a chunk as a grid mesh with the layout of GenerateGrid, with
+    // indices local to the chunk. Leave out.IndexData null to write vertices
+    // only; every chunk shares the same indices.
+    void WriteChunk(const TerrainChunk& chunk, const GeometryGenerator::MeshWriter& out)const;
+
+private:
+    std::shared_ptr<TerrainChunk> GenerateChunk(TerrainChunkCoord coord)const;
+
+    __m128 Heights4(__m128 x, __m128 z)const;
+
+    // Heights of count samples of global sample row row, starting at global
+    // column firstColumn. Writes count rounded up to a multiple of 4 values.
+    void GetRowHeights(int firstColumn, int row, UINT count, float* heights)const;
+
+    static std::uint64_t ChunkKey(TerrainChunkCoord coord);
+
+    TerrainDesc m_desc;
+    TerrainNoise m_noise;
+    float m_spacing = 0.0f;
+
+    // Last, so requests still generating are waited for before the rest
+    // is destroyed.
+    LruCache<TerrainChunk> m_cache;
+};
@@ -0,0 +1,338 @@
+#include "stdafx.h"
+#include "TerrainLod.h"
+
+using namespace DirectX;
+
+CdlodQuadtree::CdlodQuadtree(const Terrain& terrain, const CdlodDesc& desc) :
+    CdlodQuadtree([&terrain](const float* x, const float* z, size_t count, float* heights)
+        {
+            terrain.GetHeights(x, z, count, heights);
+        }, desc)
+{
+}
+
+CdlodQuadtree::CdlodQuadtree(const CdlodHeightSource& source, const CdlodDesc& desc) :
+    m_desc(desc)
+{
+    assert(desc.PatchQuads >= 2 && desc.PatchQuads % 2 == 0 && "Patches are drawn by quadrant.");
+    assert(desc.LodCount >= 1 && desc.LodCount <= 16);
+
+    m_resolution = (desc.PatchQuads << (desc.LodCount - 1)) + 1;
+
+    float previous = 0.0f;
+    for (UINT lod = 0; lod < desc.LodCount; ++lod)
+    {
+        float range = GetLeafSize() * desc.LodDistanceRatio * (float)(1u << lod);
+        m_lodRanges.push_back(range);
+        m_morphStarts.push_back(previous + (range - previous) * desc.MorphStartRatio);
+        previous = range;
+    }
+
+    BuildHeights(source);
+    BuildBounds();
+}
+
+void CdlodQuadtree::BuildHeights(const CdlodHeightSource& source)
+{
+    const UINT n = m_resolution;
+    m_heights.resize((size_t)n * n);
+
+    std::vector<float> x(n);
+    for (UINT j = 0; j < n; ++j)
+    {
+        x[j] = m_desc.Origin.x + j * m_desc.Spacing;
+    }
+
+    concurrency::parallel_for(0u, n, [&](UINT row)
+    {
+        std::vector<float> z(n, m_desc.Origin.y + row * m_desc.Spacing);
+        source(x.data(), z.data(), n, &m_heights[(size_t)row * n]);
+    });
+}
+
+void CdlodQuadtree::BuildBounds()
+{
+    const UINT patchQuads = m_desc.PatchQuads;
+    const UINT leaves = 1u << (m_desc.LodCount - 1);
+
+    m_bounds.resize(m_desc.LodCount);
+    m_bounds[0].resize((size_t)leaves * leaves);
+    concurrency::parallel_for(0u, leaves, [&](UINT z)
+    {
+        for (UINT x = 0; x < leaves; ++x)
+        {
+            NodeBounds bounds = { FLT_MAX, -FLT_MAX };
+            for (UINT i = 0; i <= patchQuads; ++i)
+            {
+                const float* row = &m_heights[(size_t)(z * patchQuads + i) * m_resolution + x * patchQuads];
+                for (UINT j = 0; j <= patchQuads; ++j)
+                {
+                    bounds.MinHeight = std::min(bounds.MinHeight, row[j]);
+                    bounds.MaxHeight = std::max(bounds.MaxHeight, row[j]);
+                }
+            }
+            m_bounds[0][(size_t)z * leaves + x] = bounds;
+        }
+    });
+
+    for (UINT lod = 1; lod < m_desc.LodCount; ++lod)
+    {
+        const UINT nodes = leaves >> lod;
+        const UINT children = nodes * 2;
+        const std::vector<NodeBounds>& below = m_bounds[lod - 1];
+        m_bounds[lod].resize((size_t)nodes * nodes);
+        for (UINT z = 0; z < nodes; ++z)
+        {
+            for (UINT x = 0; x < nodes; ++x)
+            {
+                NodeBounds bounds = { FLT_MAX, -FLT_MAX };
+                for (UINT c = 0; c < 4; ++c)
+                {
+                    const NodeBounds& child = below[(size_t)(z * 2 + (c >> 1)) * children + x * 2 + (c & 1)];
+                    bounds.MinHeight = std::min(bounds.MinHeight, child.MinHeight);
+                    bounds.MaxHeight = std::max(bounds.MaxHeight, child.MaxHeight);
+                }
+                m_bounds[lod][(size_t)z * nodes + x] = bounds;
+            }
+        }
+    }
+}
+
+float CdlodQuadtree::SampleHeight(float x, float z)const
+{
+    const float last = (float)(m_resolution - 1);
+    float tx = std::min(std::max((x - m_desc.Origin.x) / m_desc.Spacing, 0.0f), last);
+    float tz = std::min(std::max((z - m_desc.Origin.y) / m_desc.Spacing, 0.0f), last);
+
+    UINT i = std::min((UINT)tx, m_resolution - 2);
+    UINT j = std::min((UINT)tz, m_resolution - 2);
+    float wx = tx - (float)i;
+    float wz = tz - (float)j;
+
+    const float* row0 = &m_heights[(size_t)j * m_resolution + i];
+    const float* row1 = row0 + m_resolution;
+    float h0 = row0[0] + (row0[1] - row0[0]) * wx;
+    float h1 = row1[0] + (row1[1] - row1[0]) * wx;
+    return h0 + (h1 - h0) * wz;
+}
+
+BoundingBox CdlodQuadtree::GetNodeBox(UINT lod, UINT x, UINT z)const
+{
+    const UINT nodes = 1u << (m_desc.LodCount - 1 - lod);
+    const NodeBounds& bounds = m_bounds[lod][(size_t)z * nodes + x];
+
+    float size = GetLeafSize() * (float)(1u << lod);
+    float skirt = m_desc.SkirtDepth * size / m_desc.PatchQuads;
+    float x0 = m_desc.Origin.x + x * size;
+    float z0 = m_desc.Origin.y + z * size;
+
+    BoundingBox box;
+    BoundingBox::CreateFromPoints(box,
+        XMVectorSet(x0, bounds.MinHeight - skirt, z0, 0.0f),
+        XMVectorSet(x0 + size, bounds.MaxHeight, z0 + size, 0.0f));
+    return box;
+}
+
+CdlodPatch CdlodQuadtree::MakePatch(UINT lod, UINT x, UINT z, CdlodRegion region)const
+{
+    float size = GetLeafSize() * (float)(1u << lod);
+
+    CdlodPatch patch;
+    patch.Origin = XMFLOAT2(m_desc.Origin.x + x * size, m_desc.Origin.y + z * size);
+    patch.Size = size;
+    patch.Lod = lod;
+    patch.MorphRange = XMFLOAT2(m_morphStarts[lod], m_lodRanges[lod]);
+    patch.Region = region;
+    return patch;
+}
+
+bool CdlodQuadtree::SelectNode(UINT lod, UINT x, UINT z, FXMVECTOR eyePos, const BoundingFrustum& frustum,
+    std::vector<CdlodPatch>& patches)const
+{
+    BoundingBox box = GetNodeBox(lod, x, z);
+
+    BoundingSphere range;
+    XMStoreFloat3(&range.Center, eyePos);
+    range.Radius = m_lodRanges[lod];
+    if (!range.Intersects(box))
+    {
+        return false;
+    }
+
+    // Culled nodes count as handled, so the parent does not draw them either.
+    if (frustum.Contains(box) == DISJOINT)
+    {
+        return true;
+    }
+
+    range.Radius = lod > 0 ? m_lodRanges[lod - 1] : 0.0f;
+    if (lod == 0 || !range.Intersects(box))
+    {
+        patches.push_back(MakePatch(lod, x, z, CdlodRegion::Full));
+        return true;
+    }
+
+    // Children out of their own range are drawn by this node, one quadrant
+    // of the patch each, at this node's resolution.
+    bool covered[4];
+    UINT uncovered = 0;
+    for (UINT c = 0; c < 4; ++c)
+    {
+        covered[c] = SelectNode(lod - 1, x * 2 + (c & 1), z * 2 + (c >> 1), eyePos, frustum, patches);
+        uncovered += covered[c] ? 0 : 1;
+    }
+
+    if (uncovered == 4)
+    {
+        patches.push_back(MakePatch(lod, x, z, CdlodRegion::Full));
+        return true;
+    }
+    for (UINT c = 0; c < 4; ++c)
+    {
+        if (!covered[c])
+        {
+            patches.push_back(MakePatch(lod, x, z, (CdlodRegion)((UINT)CdlodRegion::Quadrant0 + c)));
+        }
+    }
+    return true;
+}
+
+void CdlodQuadtree::Select(FXMVECTOR eyePos, const BoundingFrustum& frustum, CdlodSelection& selection)const
+{
+    std::vector<CdlodPatch> patches;
+    if (!SelectNode(m_desc.LodCount - 1, 0, 0, eyePos, frustum, patches))
+    {
+        // Farther than every range; the root still has to be drawn.
+        if (frustum.Contains(GetNodeBox(m_desc.LodCount - 1, 0, 0)) != DISJOINT)
+        {
+            patches.push_back(MakePatch(m_desc.LodCount - 1, 0, 0, CdlodRegion::Full));
+        }
+    }
+
+    // Group by region with a counting sort, keeping the selection order.
+    const UINT regionCount = (UINT)CdlodRegion::Count;
+    UINT counts[(UINT)CdlodRegion::Count] = {};
+    for (const CdlodPatch& patch : patches)
+    {
+        ++counts[(UINT)patch.Region];
+    }
+    selection.RegionStart[0] = 0;
+    for (UINT r = 0; r < regionCount; ++r)
+    {
+        selection.RegionStart[r + 1] = selection.RegionStart[r] + counts[r];
+    }
+
+    UINT next[(UINT)CdlodRegion::Count];
+    std::copy(selection.RegionStart, selection.RegionStart + regionCount, next);
+    selection.Patches.resize(patches.size());
+    for (const CdlodPatch& patch : patches)
+    {
+        selection.Patches[next[(UINT)patch.Region]++] = patch;
+    }
+}
+
+XMFLOAT3 CdlodQuadtree::MorphVertex(const CdlodPatch& patch, const CdlodPatchVertex& vertex, FXMVECTOR eyePos)const
+{
+    const float quadSize = patch.Size / m_desc.PatchQuads;
+    float gridX = vertex.Grid.x;
+    float gridZ = vertex.Grid.y;
+
+    // Distance from the unmorphed position decides how far to morph.
+    float x = patch.Origin.x + gridX * quadSize;
+    float z = patch.Origin.y + gridZ * quadSize;
+    XMVECTOR position = XMVectorSet(x, SampleHeight(x, z), z, 0.0f);
+    float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(eyePos, position)));
+    float morph = (distance - patch.MorphRange.x) / (patch.MorphRange.y - patch.MorphRange.x);
+    morph = std::min(std::max(morph, 0.0f), 1.0f);
+
+    // Odd grid vertices slide onto their even neighbour.
+    gridX -= (gridX * 0.5f - floorf(gridX * 0.5f)) * 2.0f * morph;
+    gridZ -= (gridZ * 0.5f - floorf(gridZ * 0.5f)) * 2.0f * morph;
+
+    x = patch.Origin.x + gridX * quadSize;
+    z = patch.Origin.y + gridZ * quadSize;
+    float y = SampleHeight(x, z) - vertex.Grid.z * m_desc.SkirtDepth * quadSize;
+    return XMFLOAT3(x, y, z);
+}
+
+void CdlodQuadtree::BuildPatchMesh(std::vector<CdlodPatchVertex>& vertices, std::vector<std::uint16_t>& indices,
+    CdlodIndexRange ranges[(UINT)CdlodRegion::Count])const
+{
+    const UINT n = m_desc.PatchQuads;
+    const UINT half = n / 2;
+    const UINT skirtLoop = half * 4;
+
+    vertices.clear();
+    indices.clear();
+    const size_t vertexCount = (size_t)(n + 1) * (n + 1) + 4 * skirtLoop;
+    assert(vertexCount <= 0x10000 && "Patch does not fit in 16-bit indices.");
+
+    vertices.reserve(vertexCount);
+    for (UINT z = 0; z <= n; ++z)
+    {
+        for (UINT x = 0; x <= n; ++x)
+        {
+            CdlodPatchVertex v;
+            v.Grid = XMFLOAT3((float)x, (float)z, 0.0f);
+            vertices.push_back(v);
+        }
+    }
+
+    for (UINT c = 0; c < 4; ++c)
+    {
+        const UINT x0 = (c & 1) * half;
+        const UINT z0 = (c >> 1) * half;
+
+        CdlodIndexRange& range = ranges[(UINT)CdlodRegion::Quadrant0 + c];
+        range.StartIndex = (UINT)indices.size();
+
+        // Clockwise seen from above, matching GeometryGenerator.
+        for (UINT z = z0; z < z0 + half; ++z)
+        {
+            for (UINT x = x0; x < x0 + half; ++x)
+            {
+                std::uint16_t i00 = (std::uint16_t)(z * (n + 1) + x);
+                std::uint16_t i01 = (std::uint16_t)(i00 + 1);
+                std::uint16_t i10 = (std::uint16_t)(i00 + n + 1);
+                std::uint16_t i11 = (std::uint16_t)(i10 + 1);
+
+                indices.insert(indices.end(), { i00, i10, i01 });
+                indices.insert(indices.end(), { i01, i10, i11 });
+            }
+        }
+
+        // Skirt around the quadrant, walking its border counter-clockwise
+        // seen from above so every wall faces outwards.
+        const std::uint16_t skirtBase = (std::uint16_t)vertices.size();
+        std::vector<std::uint16_t> border(skirtLoop);
+        for (UINT t = 0; t < half; ++t)
+        {
+            border[t] = (std::uint16_t)(z0 * (n + 1) + x0 + t);
+            border[half + t] = (std::uint16_t)((z0 + t) * (n + 1) + x0 + half);
+            border[half * 2 + t] = (std::uint16_t)((z0 + half) * (n + 1) + x0 + half - t);
+            border[half * 3 + t] = (std::uint16_t)((z0 + half - t) * (n + 1) + x0);
+        }
+        for (UINT k = 0; k < skirtLoop; ++k)
+        {
+            CdlodPatchVertex v = vertices[border[k]];
+            v.Grid.z = 1.0f;
+            vertices.push_back(v);
+        }
+        for (UINT k = 0; k < skirtLoop; ++k)
+        {
+            UINT next = (k + 1) % skirtLoop;
+            std::uint16_t a = border[k];
+            std::uint16_t b = border[next];
+            std::uint16_t aSkirt = (std::uint16_t)(skirtBase + k);
+            std::uint16_t bSkirt = (std::uint16_t)(skirtBase + next);
+
+            indices.insert(indices.end(), { a, b, aSkirt });
+            indices.insert(indices.end(), { b, bSkirt, aSkirt });
+        }
+
+        range.IndexCount = (UINT)indices.size() - range.StartIndex;
+    }
+
+    ranges[(UINT)CdlodRegion::Full].StartIndex = 0;
+    ranges[(UINT)CdlodRegion::Full].IndexCount = (UINT)indices.size();
+}
@@ -0,0 +1,173 @@
+// Continuous distance-dependent LOD (CDLOD) for height-field terrain.
+//
+// The terrain is a square height field covered by an implicit quadtree. Every
+// node, whatever its level, is drawn with the same small grid patch scaled to
+// the node's size, so one vertex and index buffer serve the whole terrain and
+// the triangle count follows the distance to the camera rather than the size
+// of the world. Each LOD level owns a distance range twice as large as the
+// finer one; near the far end of its range a patch morphs its odd vertices
+// onto their even neighbours in the vertex shader, so by the time the
+// coarser level takes over the two meshes are identical and no cracks or
+// pops appear. Skirts hang below every patch edge to hide the rounding
+// differences that remain.
+//
+// Selection runs on the CPU per frame against the camera position and
+// frustum, using per-node height bounds. MorphVertex is a CPU reference of
+// the vertex shader in TerrainLod.hlsl and must be kept in step with it.
+#pragma once
+#include "stdafx.h"
+#include "Terrain.h"
+#include <DirectXCollision.h>
+#include <functional>
+
+struct CdlodDesc
+{
+    // Quads per patch side. Must be even so patches can be drawn by quadrant.
+    UINT PatchQuads = 16;
+
+    // Number of levels; the root covers PatchQuads << (LodCount - 1) samples.
+    UINT LodCount = 6;
+
+    // Height-field sample spacing in world units, and the world xz of sample (0, 0).
+    float Spacing = 1.0f;
+    DirectX::XMFLOAT2 Origin = { 0.0f, 0.0f };
+
+    // Range of LOD 0 in leaf node sizes; each level doubles it. Below about
+    // 2.5 a patch can still be morphing where it meets a coarser one.
+    float LodDistanceRatio = 3.0f;
+
+    // Fraction of each level's range before morphing towards the next starts.
+    float MorphStartRatio = 0.7f;
+
+    // Skirt length in vertex spacings of the patch's own level.
+    float SkirtDepth = 2.0f;
+};
+
+// Patch vertex: grid coordinates in [0, PatchQuads] and 1 for skirt vertices.
+struct CdlodPatchVertex
+{
+    DirectX::XMFLOAT3 Grid;
+};
+
+// Part of the patch mesh a selected node draws.
+enum class CdlodRegion : UINT
+{
+    Full = 0,
+    // Quadrant c = (z half << 1) | x half, the lower half being 0.
+    Quadrant0,
+    Quadrant1,
+    Quadrant2,
+    Quadrant3,
+    Count
+};
+
+// One selected node. The leading members are the per-instance vertex data
+// read by TerrainLod.hlsl (PATCH at offset 0, MORPH at offset 16).
+struct CdlodPatch
+{
+    DirectX::XMFLOAT2 Origin;
+    float Size;
+    UINT Lod;
+    // Camera distances between which the patch morphs to the next level.
+    DirectX::XMFLOAT2 MorphRange;
+    CdlodRegion Region;
+};
+
+struct CdlodSelection
+{
+    // Patches grouped by region, so each group is one instanced draw.
+    std::vector<CdlodPatch> Patches;
+    UINT RegionStart[(UINT)CdlodRegion::Count + 1] = {};
+
+    UINT RegionCount(CdlodRegion region)const
+    {
+        return RegionStart[(UINT)region + 1] - RegionStart[(UINT)region];
+    }
+};
+
+// Root constants of TerrainLod.hlsl (cbTerrain).
+struct TerrainLodConstants
+{
+    DirectX::XMFLOAT2 HeightOrigin;
+    float HeightSpacing;
+    UINT HeightResolution;
+    float PatchQuads;
+    float SkirtDepth;
+};
+
+// Index range of the patch mesh to draw for a region.
+struct CdlodIndexRange
+{
+    UINT StartIndex = 0;
+    UINT IndexCount = 0;
+};
+
+// Fills heights[i] for the points (x[i], z[i]). Called from several threads.
+using CdlodHeightSource = std::function<void(const float* x, const float* z, size_t count, float* heights)>;
+
+class CdlodQuadtree
+{
+public:
+    // Samples source, or terrain, over the square the quadtree covers.
+    CdlodQuadtree(const CdlodHeightSource& source, const CdlodDesc& desc);
+    CdlodQuadtree(const Terrain& terrain, const CdlodDesc& desc);
+    CdlodQuadtree(const CdlodQuadtree& rhs) = delete;
+    CdlodQuadtree& operator=(const CdlodQuadtree& rhs) = delete;
+
+    const CdlodDesc& GetDesc()const { return m_desc; }
+
+    // Samples per side of the height field and the samples themselves, row by
+    // row along +z, each row along +x.
+    UINT GetResolution()const { return m_resolution; }
+    const std::vector<float>& GetHeights()const { return m_heights; }
+
+    float GetLeafSize()const { return m_desc.PatchQuads * m_desc.Spacing; }
+    float GetRootSize()const { return GetLeafSize() * (float)(1u << (m_desc.LodCount - 1)); }
+
+    // Upper bound of Select's patch count: no patch is smaller than a leaf.
+    UINT GetMaxPatchCount()const { return 1u << (2 * (m_desc.LodCount - 1)); }
+
+    // Bilinearly filtered height, clamped to the height field.
+    float SampleHeight(float x, float z)const;
+
+    // Selects the nodes to draw this frame. frustum is in world space.
+    void Select(DirectX::FXMVECTOR eyePos, const DirectX::BoundingFrustum& frustum, CdlodSelection& selection)const;
+
+    // World position of a patch vertex seen from eyePos, exactly as the
+    // vertex shader computes it.
+    DirectX::XMFLOAT3 MorphVertex(const CdlodPatch& patch, const CdlodPatchVertex& vertex, DirectX::FXMVECTOR eyePos)const;
+
+    // The shared patch mesh. Indices are grouped by quadrant; each quadrant
+    // carries its own skirt, so Full is simply all four.
+    void BuildPatchMesh(std::vector<CdlodPatchVertex>& vertices, std::vector<std::uint16_t>& indices,
+        CdlodIndexRange ranges[(UINT)CdlodRegion::Count])const;
+
+private:
+    struct NodeBounds
+    {
+        float MinHeight;
+        float MaxHeight;
+    };
+
+    // Returns false if the node lies beyond the range of lod, so its parent
+    // has to cover it.
+    bool SelectNode(UINT lod, UINT x, UINT z, DirectX::FXMVECTOR eyePos, const DirectX::BoundingFrustum& frustum,
+        std::vector<CdlodPatch>& patches)const;
+
+    DirectX::BoundingBox GetNodeBox(UINT lod, UINT x, UINT z)const;
+    CdlodPatch MakePatch(UINT lod, UINT x, UINT z, CdlodRegion region)const;
+
+    void BuildHeights(const CdlodHeightSource& source);
+    void BuildBounds();
+
+    CdlodDesc m_desc;
+    UINT m_resolution = 0;
+    std::vector<float> m_heights;
+
+    // Per level, nodes row by row along +z; level 0 holds the leaves.
+    std::vector<std::vector<NodeBounds>> m_bounds;
+
+    // Far end of each level's range, and where its morph begins.
+    std::vector<float> m_lodRanges;
+    std::vector<float> m_morphStarts;
+};
@@ -0,0 +1,113 @@
+// CDLOD terrain. One grid patch is instanced per selected quadtree node and
+// morphed towards the next coarser level with distance. Heights are fetched
+// from a structured buffer with bilinear filtering. Keep in step with
+// CdlodQuadtree::MorphVertex.
+
+cbuffer cbTerrain :register(b0)
+{
+    float2 gHeightOrigin;
+    float gHeightSpacing;
+    uint gHeightResolution;
+    float gPatchQuads;
+    float gSkirtDepth;
+};
+
+cbuffer cbPass:register(b1)
+{
+    float4x4 gView;
+    float4x4 gInvView;
+    float4x4 gProj;
+    float4x4 gInvProj;
+    float4x4 gViewProj;
+    float4x4 gInvViewProj;
+    float3 gEyePosW;
+    float cbPerObjectPad1;
+    float2 gRenderTargetSize;
+    float2 gInvRenderTargetSize;
+    float  gNearZ;
+    float  gFarZ;
+    float  gTotalTime;
+    float  gDeltaTime;
+};
+
+StructuredBuffer<float> gHeights :register(t0);
+
+struct VertexIn
+{
+    // Grid coordinates in [0, PatchQuads]; z is 1 for skirt vertices.
+    float3 Grid:GRID;
+    // Per instance: patch origin xz and size, then the morph range.
+    float3 Patch:PATCH;
+    float2 MorphRange:MORPH;
+};
+
+struct VertexOut
+{
+    float4 PosH:SV_POSITION;
+    float4 Color:COLOR;
+};
+
+float SampleHeight(float2 posW)
+{
+    float last = (float)(gHeightResolution - 1);
+    float2 t = clamp((posW - gHeightOrigin) / gHeightSpacing, 0.0f, last);
+    uint2 i = min((uint2)t, gHeightResolution - 2);
+    float2 w = t - (float2)i;
+
+    uint row0 = i.y * gHeightResolution + i.x;
+    uint row1 = row0 + gHeightResolution;
+    float h0 = gHeights[row0] + (gHeights[row0 + 1] - gHeights[row0]) * w.x;
+    float h1 = gHeights[row1] + (gHeights[row1 + 1] - gHeights[row1]) * w.x;
+    return h0 + (h1 - h0) * w.y;
+}
+
+float4 HeightColor(float y)
+{
+    // Sandy beaches, grassy low hills, and snow mountain peaks.
+    if (y < -10.0f)
+    {
+        return float4(1.0f, 0.96f, 0.62f, 1.0f);
+    }
+    if (y < 5.0f)
+    {
+        return float4(0.48f, 0.77f, 0.46f, 1.0f);
+    }
+    if (y < 12.0f)
+    {
+        return float4(0.1f, 0.48f, 0.19f, 1.0f);
+    }
+    if (y < 20.0f)
+    {
+        return float4(0.45f, 0.39f, 0.34f, 1.0f);
+    }
+    return float4(1.0f, 1.0f, 1.0f, 1.0f);
+}
+
+VertexOut VSMain(VertexIn vin)
+{
+    VertexOut vout;
+
+    float quadSize = vin.Patch.z / gPatchQuads;
+    float2 grid = vin.Grid.xy;
+
+    // Distance from the unmorphed position decides how far to morph.
+    float2 posXZ = vin.Patch.xy + grid * quadSize;
+    float3 posW = float3(posXZ.x, SampleHeight(posXZ), posXZ.y);
+    float morph = saturate((distance(gEyePosW, posW) - vin.MorphRange.x) / (vin.MorphRange.y - vin.MorphRange.x));
+
+    // Odd grid vertices slide onto their even neighbour.
+    grid -= frac(grid * 0.5f) * 2.0f * morph;
+
+    posXZ = vin.Patch.xy + grid * quadSize;
+    posW = float3(posXZ.x, SampleHeight(posXZ) - vin.Grid.z * gSkirtDepth * quadSize, posXZ.y);
+
+    vout.PosH = mul(float4(posW, 1.0f), gViewProj);
+    vout.Color = HeightColor(posW.y);
+
+    return vout;
+}
+
+float4 PSMain(VertexOut pin) :SV_Target
+{
+    return pin.Color;
+}
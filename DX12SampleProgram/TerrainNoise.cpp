@@ -0,0 +1,134 @@
+#include "stdafx.h"
+#include "TerrainNoise.h"
+
+namespace
+{
+    // Skew and unskew factors between the square grid and the simplex grid.
+    const float F2 = 0.36602540378f; // (sqrt(3) - 1) / 2
+    const float G2 = 0.21132486540f; // (3 - sqrt(3)) / 6
+
+    // Twelve gradient directions, the 2D projection of the classic 3D set.
+    const float GradX[12] = { 1, -1, 1, -1, 1, -1, 1, -1, 0, 0, 0, 0 };
+    const float GradY[12] = { 1, 1, -1, -1, 0, 0, 0, 0, 1, -1, 1, -1 };
+
+    // floor() for SSE2, which lacks a rounding instruction.
+    __m128i FloorToInt(__m128 v)
+    {
+        __m128i truncated = _mm_cvttps_epi32(v);
+        // Truncation rounds negative values up; subtract 1 where it did.
+        __m128 back = _mm_cvtepi32_ps(truncated);
+        __m128i roundedUp = _mm_castps_si128(_mm_cmpgt_ps(back, v));
+        return _mm_add_epi32(truncated, roundedUp);
+    }
+
+    // Falloff t^4 * dot(gradient, offset) of one simplex corner.
+    __m128 Corner(__m128 x, __m128 z, const std::uint32_t gradient[4])
+    {
+        __m128 gx = _mm_set_ps(GradX[gradient[3]], GradX[gradient[2]], GradX[gradient[1]], GradX[gradient[0]]);
+        __m128 gz = _mm_set_ps(GradY[gradient[3]], GradY[gradient[2]], GradY[gradient[1]], GradY[gradient[0]]);
+
+        __m128 t = _mm_sub_ps(_mm_set1_ps(0.5f), _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(z, z)));
+        t = _mm_max_ps(t, _mm_setzero_ps());
+        t = _mm_mul_ps(t, t);
+        t = _mm_mul_ps(t, t);
+        return _mm_mul_ps(t, _mm_add_ps(_mm_mul_ps(gx, x), _mm_mul_ps(gz, z)));
+    }
+}
+
+TerrainNoise::TerrainNoise(std::uint32_t seed)
+{
+    for (int i = 0; i < 256; ++i)
+    {
+        m_perm[i] = (std::uint8_t)i;
+    }
+
+    // Fisher-Yates with a fixed LCG, so a seed gives the same terrain with
+    // any standard library.
+    std::uint32_t state = seed * 747796405u + 2891336453u;
+    for (int i = 255; i > 0; --i)
+    {
+        state = state * 1664525u + 1013904223u;
+        int j = (int)((state >> 8) % (std::uint32_t)(i + 1));
+        std::swap(m_perm[i], m_perm[j]);
+    }
+
+    for (int i = 0; i < 256; ++i)
+    {
+        m_perm[256 + i] = m_perm[i];
+    }
+}
+
+__m128 TerrainNoise::Simplex4(__m128 x, __m128 z)const
+{
+    // Skew into simplex space to find the containing cell.
+    __m128 s = _mm_mul_ps(_mm_add_ps(x, z), _mm_set1_ps(F2));
+    __m128i i = FloorToInt(_mm_add_ps(x, s));
+    __m128i j = FloorToInt(_mm_add_ps(z, s));
+
+    __m128 fi = _mm_cvtepi32_ps(i);
+    __m128 fj = _mm_cvtepi32_ps(j);
+    __m128 t = _mm_mul_ps(_mm_add_ps(fi, fj), _mm_set1_ps(G2));
+    __m128 x0 = _mm_sub_ps(x, _mm_sub_ps(fi, t));
+    __m128 z0 = _mm_sub_ps(z, _mm_sub_ps(fj, t));
+
+    // Middle corner: step along x first when x0 > z0 (lower triangle).
+    __m128 lower = _mm_cmpgt_ps(x0, z0);
+    __m128 i1 = _mm_and_ps(lower, _mm_set1_ps(1.0f));
+    __m128 j1 = _mm_andnot_ps(lower, _mm_set1_ps(1.0f));
+
+    __m128 g2 = _mm_set1_ps(G2);
+    __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, i1), g2);
+    __m128 z1 = _mm_add_ps(_mm_sub_ps(z0, j1), g2);
+    __m128 g2x2m1 = _mm_set1_ps(2.0f * G2 - 1.0f);
+    __m128 x2 = _mm_add_ps(x0, g2x2m1);
+    __m128 z2 = _mm_add_ps(z0, g2x2m1);
+
+    // Gradient indices of the three corners, per lane.
+    alignas(16) std::int32_t ii[4], jj[4];
+    alignas(16) float i1s[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(ii), _mm_and_si128(i, _mm_set1_epi32(255)));
+    _mm_store_si128(reinterpret_cast<__m128i*>(jj), _mm_and_si128(j, _mm_set1_epi32(255)));
+    _mm_store_ps(i1s, i1);
+
+    std::uint32_t gi0[4], gi1[4], gi2[4];
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        int a = ii[lane];
+        int b = jj[lane];
+        int di = i1s[lane] != 0.0f ? 1 : 0;
+        gi0[lane] = m_perm[a + m_perm[b]] % 12;
+        gi1[lane] = m_perm[a + di + m_perm[b + 1 - di]] % 12;
+        gi2[lane] = m_perm[a + 1 + m_perm[b + 1]] % 12;
+    }
+
+    __m128 n = _mm_add_ps(Corner(x0, z0, gi0), _mm_add_ps(Corner(x1, z1, gi1), Corner(x2, z2, gi2)));
+
+    // Scale the sum into [-1, 1].
+    return _mm_mul_ps(n, _mm_set1_ps(70.0f));
+}
+
+__m128 TerrainNoise::Fbm4(__m128 x, __m128 z, const FbmDesc& desc)const
+{
+    __m128 sum = _mm_setzero_ps();
+    float frequency = desc.Frequency;
+    float amplitude = desc.Amplitude;
+    for (UINT octave = 0; octave < desc.Octaves; ++octave)
+    {
+        __m128 f = _mm_set1_ps(frequency);
+        __m128 layer = Simplex4(_mm_mul_ps(x, f), _mm_mul_ps(z, f));
+        sum = _mm_add_ps(sum, _mm_mul_ps(layer, _mm_set1_ps(amplitude)));
+        frequency *= desc.Lacunarity;
+        amplitude *= desc.Gain;
+    }
+    return sum;
+}
+
+float TerrainNoise::Simplex(float x, float z)const
+{
+    return _mm_cvtss_f32(Simplex4(_mm_set1_ps(x), _mm_set1_ps(z)));
+}
+
+float TerrainNoise::Fbm(float x, float z, const FbmDesc& desc)const
+{
+    return _mm_cvtss_f32(Fbm4(_mm_set1_ps(x), _mm_set1_ps(z), desc));
+}
@@ -0,0 +1,38 @@
+// Seeded 2D gradient noise for procedural terrain.
+//
+// Simplex noise and fractal Brownian motion evaluated four points at a time
+// with SSE2. Only the permutation lookups are done per lane; everything else
+// runs on whole vectors. Results are deterministic for a given seed.
+#pragma once
+#include "stdafx.h"
+#include <emmintrin.h>
+
+struct FbmDesc
+{
+    UINT Octaves = 6;
+    float Frequency = 1.0f / 512.0f;
+    float Amplitude = 1.0f;
+    // Frequency and amplitude multipliers between octaves.
+    float Lacunarity = 2.0f;
+    float Gain = 0.5f;
+};
+
+class TerrainNoise
+{
+public:
+    explicit TerrainNoise(std::uint32_t seed = 0);
+
+    // Simplex noise in [-1, 1] at the four points (x[i], z[i]).
+    __m128 Simplex4(__m128 x, __m128 z)const;
+
+    // Sum of Octaves simplex layers, in [-Amplitude*(1+Gain+...), ...].
+    __m128 Fbm4(__m128 x, __m128 z, const FbmDesc& desc)const;
+
+    // Scalar conveniences; they run the vector path in one lane.
+    float Simplex(float x, float z)const;
+    float Fbm(float x, float z, const FbmDesc& desc)const;
+
+private:
+    // Permutation of 0..255 repeated twice so lookups never wrap.
+    std::array<std::uint8_t, 512> m_perm;
+};
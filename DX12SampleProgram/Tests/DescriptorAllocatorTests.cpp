@@ -0,0 +1,191 @@
+#include "stdafx.h"
+#include "DescriptorAllocator.h"
+#include <gtest/gtest.h>
+#include <deque>
+#include <random>
+
+namespace
+{
+    DescriptorAllocatorDesc SmallDesc(UINT stagingPageSize, UINT shaderVisibleCount)
+    {
+        DescriptorAllocatorDesc desc;
+        desc.StagingPageSize = stagingPageSize;
+        desc.ShaderVisibleCount = shaderVisibleCount;
+        return desc;
+    }
+
+    D3D12_CPU_DESCRIPTOR_HANDLE Slot(const DescriptorTable& table, UINT slot)
+    {
+        return { table.CPU.ptr + slot };
+    }
+
+    // A table and the tags it was filled with.
+    struct FilledTable
+    {
+        DescriptorTable Table;
+        std::vector<UINT64> Tags;
+    };
+
+    ::testing::AssertionResult HoldsItsTags(MockDescriptorBackend& backend, const FilledTable& filled)
+    {
+        for (UINT slot = 0; slot < filled.Table.Count; ++slot)
+        {
+            if (backend.Descriptor(Slot(filled.Table, slot)) != filled.Tags[slot])
+            {
+                return ::testing::AssertionFailure() << "slot " << slot << " of the table at "
+                    << filled.Table.Offset << " was overwritten";
+            }
+        }
+        return ::testing::AssertionSuccess();
+    }
+}
+
+TEST(DescriptorAllocator, PersistentDescriptorsAddPagesOnlyWhenFull)
+{
+    MockDescriptorBackend backend;
+    DescriptorAllocator descriptors(backend, SmallDesc(16, 64));
+
+    DescriptorAllocation a = descriptors.Allocate(10);
+    DescriptorAllocation b = descriptors.Allocate(6);
+    EXPECT_EQ(0u, a.Page);
+    EXPECT_EQ(0u, b.Page);
+    EXPECT_EQ(a.CPU.ptr + 10, b.CPU.ptr);
+
+    // No room left in the first page.
+    DescriptorAllocation c = descriptors.Allocate(1);
+    EXPECT_EQ(1u, c.Page);
+
+    // Freed ranges are reused before any new page.
+    descriptors.Free(a);
+    EXPECT_FALSE(a.IsValid());
+    DescriptorAllocation d = descriptors.Allocate(8);
+    EXPECT_EQ(0u, d.Page);
+    EXPECT_EQ(2u, descriptors.GetStats().StagingPageCount);
+
+    // Larger than a page, so it gets one of its own size.
+    DescriptorAllocation e = descriptors.Allocate(40);
+    EXPECT_EQ(2u, e.Page);
+    DescriptorAllocatorStats stats = descriptors.GetStats();
+    EXPECT_EQ(3u, stats.StagingPageCount);
+    EXPECT_EQ(16u + 16u + 40u, stats.StagingCapacity);
+    EXPECT_EQ(6u + 1u + 8u + 40u, stats.PersistentDescriptors);
+    EXPECT_EQ(4u, stats.PersistentAllocationCount);
+}
+
+TEST(DescriptorAllocator, ManyPersistentDescriptorsStayDistinct)
+{
+    MockDescriptorBackend backend;
+    DescriptorAllocator descriptors(backend);
+
+    const UINT count = 200000;
+    std::vector<DescriptorAllocation> allocations;
+    allocations.reserve(count);
+    for (UINT i = 0; i < count; ++i)
+    {
+        allocations.push_back(descriptors.Allocate());
+        backend.Descriptor(allocations.back().CPU) = i + 1;
+    }
+
+    // Tags written through one allocation's handle are never overwritten
+    // through another's, and the pages are filled before new ones are added.
+    for (UINT i = 0; i < count; ++i)
+    {
+        ASSERT_EQ(i + 1, backend.Descriptor(allocations[i].CPU));
+    }
+    DescriptorAllocatorStats stats = descriptors.GetStats();
+    const UINT pageSize = DescriptorAllocatorDesc().StagingPageSize;
+    EXPECT_EQ((count + pageSize - 1) / pageSize, stats.StagingPageCount);
+    EXPECT_EQ(count, stats.PersistentDescriptors);
+
+    for (DescriptorAllocation& allocation : allocations)
+    {
+        descriptors.Free(allocation);
+    }
+    EXPECT_EQ(0u, descriptors.GetStats().PersistentDescriptors);
+}
+
+TEST(DescriptorAllocator, FramesOfTablesTakeOneCopyCallEach)
+{
+    MockDescriptorBackend backend;
+    DescriptorAllocator descriptors(backend, SmallDesc(256, 4096));
+
+    std::vector<DescriptorAllocation> sources;
+    for (UINT i = 0; i < 1000; ++i)
+    {
+        sources.push_back(descriptors.Allocate());
+        backend.Descriptor(sources.back().CPU) = 1000 + i;
+    }
+
+    // The GPU runs two frames behind, so three frames of tables are in
+    // flight at once.
+    const UINT64 lag = 2;
+    std::mt19937 random(7);
+    std::deque<std::pair<UINT64, std::vector<FilledTable>>> inFlight;
+    for (UINT64 frame = 0; frame < 200; ++frame)
+    {
+        const UINT64 completedFence = frame > lag ? frame - lag : 0;
+        while (!inFlight.empty() && inFlight.front().first <= completedFence)
+        {
+            inFlight.pop_front();
+        }
+        descriptors.BeginFrame(completedFence);
+
+        std::vector<FilledTable> tables(20 + random() % 80);
+        for (FilledTable& filled : tables)
+        {
+            filled.Table = descriptors.AllocateTransient(1 + random() % 8);
+            for (UINT slot = 0; slot < filled.Table.Count; ++slot)
+            {
+                const DescriptorAllocation& source = sources[random() % sources.size()];
+                descriptors.StageCopy(filled.Table, slot, source);
+                filled.Tags.push_back(backend.Descriptor(source.CPU));
+            }
+        }
+
+        const UINT copyCalls = backend.GetCopyCallCount();
+        descriptors.FlushCopies();
+        ASSERT_EQ(copyCalls + 1, backend.GetCopyCallCount());
+
+        // Neither this frame's tables nor those of frames still on the GPU
+        // were written over.
+        inFlight.push_back({ frame + 1, std::move(tables) });
+        for (const auto& entry : inFlight)
+        {
+            for (const FilledTable& filled : entry.second)
+            {
+                ASSERT_TRUE(HoldsItsTags(backend, filled)) << "frame " << frame;
+            }
+        }
+        descriptors.EndFrame(frame + 1);
+        EXPECT_LE(descriptors.GetStats().FramesInFlight, lag + 1);
+    }
+
+    DescriptorAllocatorStats stats = descriptors.GetStats();
+    EXPECT_EQ(200u, stats.CopyCalls);
+    EXPECT_LE(stats.TransientHighWaterMark, stats.TransientCapacity);
+
+    for (DescriptorAllocation& source : sources)
+    {
+        descriptors.Free(source);
+    }
+}
+
+TEST(DescriptorAllocator, ThrowsWhenTheRingIsFull)
+{
+    MockDescriptorBackend backend;
+    DescriptorAllocator descriptors(backend, SmallDesc(16, 64));
+
+    descriptors.BeginFrame(0);
+    descriptors.AllocateTransient(40);
+    descriptors.EndFrame(1);
+
+    // Frame 1 still holds 40 of the 64.
+    descriptors.BeginFrame(0);
+    EXPECT_THROW(descriptors.AllocateTransient(30), std::overflow_error);
+    descriptors.EndFrame(2);
+
+    descriptors.BeginFrame(1);
+    DescriptorTable table = descriptors.AllocateTransient(30);
+    EXPECT_EQ(0u, table.Offset);
+    descriptors.EndFrame(3);
+}
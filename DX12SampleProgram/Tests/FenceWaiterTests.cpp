@@ -0,0 +1,114 @@
+#include "stdafx.h"
+#include "FenceWaiter.h"
+#include <gtest/gtest.h>
+#include <thread>
+
+namespace
+{
+    FenceWaitPolicy Policy(UINT spinMicroseconds, UINT stallMilliseconds = 1000)
+    {
+        FenceWaitPolicy policy;
+        policy.SpinMicroseconds = spinMicroseconds;
+        policy.StallMilliseconds = stallMilliseconds;
+        return policy;
+    }
+
+    // Signals fence with value after delay, from a thread of its own.
+    std::thread SignalLater(ManualFence& fence, UINT64 value, std::chrono::milliseconds delay)
+    {
+        return std::thread([&fence, value, delay]()
+        {
+            std::this_thread::sleep_for(delay);
+            fence.Signal(value);
+        });
+    }
+}
+
+TEST(FenceWaiter, ReturnsAtOnceForCompletedValues)
+{
+    ManualFence fence;
+    fence.Signal(5);
+
+    FenceWaiter waiter(Policy(0));
+    EXPECT_TRUE(waiter.Wait(fence, 3));
+    EXPECT_TRUE(waiter.Wait(fence, 5));
+
+    const FenceWaiterStats& stats = waiter.GetStats();
+    EXPECT_EQ(2u, stats.ImmediateCount);
+    EXPECT_EQ(0u, stats.SpinCount + stats.BlockCount);
+    EXPECT_EQ(0.0, stats.TotalWaitSeconds);
+}
+
+TEST(FenceWaiter, CatchesSignalsWhileSpinning)
+{
+    ManualFence fence;
+
+    // A spin long enough that the signal always lands inside it.
+    FenceWaiter waiter(Policy(5 * 1000 * 1000));
+    std::thread signaler = SignalLater(fence, 1, std::chrono::milliseconds(2));
+    EXPECT_TRUE(waiter.Wait(fence, 1));
+    signaler.join();
+
+    const FenceWaiterStats& stats = waiter.GetStats();
+    EXPECT_EQ(1u, stats.SpinCount);
+    EXPECT_EQ(0u, stats.BlockCount);
+    EXPECT_GT(stats.TotalWaitSeconds, 0.0);
+}
+
+TEST(FenceWaiter, BlocksUntilSignaledFromAnotherThread)
+{
+    ManualFence fence;
+    FenceWaiter waiter(Policy(0, 10));
+
+    // Lower values do not wake the wait for good.
+    std::thread early = SignalLater(fence, 1, std::chrono::milliseconds(5));
+    std::thread late = SignalLater(fence, 2, std::chrono::milliseconds(30));
+    EXPECT_TRUE(waiter.Wait(fence, 2));
+    early.join();
+    late.join();
+
+    EXPECT_EQ(2u, fence.GetCompletedValue());
+    const FenceWaiterStats& stats = waiter.GetStats();
+    EXPECT_EQ(1u, stats.BlockCount);
+    EXPECT_EQ(0u, stats.TimeoutCount);
+    EXPECT_GE(stats.TotalWaitSeconds, 0.025);
+
+    // Longer than StallMilliseconds.
+    EXPECT_EQ(1u, stats.StallCount);
+
+    waiter.EndFrame();
+    EXPECT_EQ(stats.TotalWaitSeconds, stats.LastFrameWaitSeconds);
+    EXPECT_EQ(stats.TotalWaitSeconds, stats.MaxFrameWaitSeconds);
+    waiter.EndFrame();
+    EXPECT_EQ(0.0, stats.LastFrameWaitSeconds);
+}
+
+TEST(FenceWaiter, GivesUpAfterTheTimeout)
+{
+    ManualFence fence;
+    FenceWaiter waiter(Policy(0));
+
+    EXPECT_FALSE(waiter.Wait(fence, 1, std::chrono::milliseconds(20)));
+    const FenceWaiterStats& stats = waiter.GetStats();
+    EXPECT_EQ(1u, stats.BlockCount);
+    EXPECT_EQ(1u, stats.TimeoutCount);
+    EXPECT_GE(stats.TotalWaitSeconds, 0.02);
+
+    // A signal before the timeout ends the wait early.
+    std::thread signaler = SignalLater(fence, 1, std::chrono::milliseconds(5));
+    EXPECT_TRUE(waiter.Wait(fence, 1, std::chrono::milliseconds(10 * 1000)));
+    signaler.join();
+    EXPECT_EQ(1u, stats.TimeoutCount);
+    EXPECT_LT(stats.TotalWaitSeconds, 5.0);
+}
+
+TEST(ManualFence, BlockReturnsOnTimeoutWithoutTheValue)
+{
+    ManualFence fence;
+    fence.Signal(3);
+    fence.Signal(2);
+    EXPECT_EQ(3u, fence.GetCompletedValue());
+
+    fence.Block(4, std::chrono::milliseconds(1));
+    EXPECT_EQ(3u, fence.GetCompletedValue());
+}
@@ -0,0 +1,246 @@
+#include "stdafx.h"
+#include "HeapAllocator.h"
+#include <gtest/gtest.h>
+
+namespace
+{
+    const UINT64 KB = 1024;
+    const UINT64 MB = 1024 * 1024;
+
+    // The allocator rounds blocks up to the 4MB MSAA alignment, so this is
+    // the smallest block it will use.
+    HeapAllocatorDesc TestDesc()
+    {
+        HeapAllocatorDesc desc;
+        desc.BlockSize = 4 * MB;
+        return desc;
+    }
+
+    HeapAllocation AllocateBuffer(HeapAllocator& allocator, UINT64 size)
+    {
+        return allocator.Allocate(D3D12_HEAP_TYPE_DEFAULT, HeapResourceKind::Buffer, size,
+            D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+    }
+}
+
+TEST(HeapAllocator, FreedSpaceIsReusedWithoutNewHeaps)
+{
+    MockHeapBackend backend;
+    HeapAllocator allocator(backend, TestDesc());
+
+    HeapAllocation a = AllocateBuffer(allocator, 1 * MB);
+    HeapAllocation b = AllocateBuffer(allocator, 1 * MB);
+    HeapAllocation c = AllocateBuffer(allocator, 1 * MB);
+    ASSERT_TRUE(a.IsValid() && b.IsValid() && c.IsValid());
+    EXPECT_EQ(a.HeapId, b.HeapId);
+    EXPECT_EQ(a.HeapId, c.HeapId);
+
+    // The block allocator over-asks by the alignment, so the 1MB left at the
+    // end cannot take another 1MB buffer until a and b merge into a 2MB hole.
+    const UINT heapId = a.HeapId;
+    const UINT64 holeOffset = std::min(a.Offset, b.Offset);
+    allocator.Free(a);
+    allocator.Free(b);
+    EXPECT_FALSE(a.IsValid());
+    EXPECT_EQ(1 * MB, allocator.GetStats().AllocatedBytes);
+
+    HeapAllocation d = AllocateBuffer(allocator, 1 * MB);
+    EXPECT_EQ(heapId, d.HeapId);
+    EXPECT_EQ(holeOffset, d.Offset);
+
+    EXPECT_EQ(1u, backend.GetCreateCount());
+    EXPECT_EQ(1u, allocator.GetStats().HeapCount);
+    EXPECT_EQ(4 * MB, allocator.GetStats().ReservedBytes);
+
+    allocator.Free(c);
+    allocator.Free(d);
+}
+
+TEST(HeapAllocator, PoolsDoNotShareBlocks)
+{
+    MockHeapBackend backend;
+    HeapAllocator allocator(backend, TestDesc());
+
+    HeapAllocation buffer = AllocateBuffer(allocator, 64 * KB);
+    HeapAllocation upload = allocator.Allocate(D3D12_HEAP_TYPE_UPLOAD, HeapResourceKind::Buffer, 64 * KB,
+        D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+    HeapAllocation texture = allocator.Allocate(D3D12_HEAP_TYPE_DEFAULT, HeapResourceKind::Texture, 64 * KB,
+        D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+
+    EXPECT_NE(buffer.HeapId, upload.HeapId);
+    EXPECT_NE(buffer.HeapId, texture.HeapId);
+    EXPECT_NE(upload.HeapId, texture.HeapId);
+    EXPECT_EQ(3u, backend.GetLiveHeapCount());
+
+    allocator.Free(buffer);
+    allocator.Free(upload);
+    allocator.Free(texture);
+}
+
+TEST(HeapAllocator, AllocationsLargerThanABlockGetDedicatedHeaps)
+{
+    MockHeapBackend backend;
+    HeapAllocator allocator(backend, TestDesc());
+
+    HeapAllocation small = AllocateBuffer(allocator, 1 * MB);
+    HeapAllocation large = AllocateBuffer(allocator, 6 * MB + 1);
+    ASSERT_TRUE(large.IsValid());
+    EXPECT_NE(small.HeapId, large.HeapId);
+    EXPECT_EQ(0u, large.Offset);
+
+    HeapAllocatorStats stats = allocator.GetStats();
+    EXPECT_EQ(2u, stats.HeapCount);
+    EXPECT_EQ(1u, stats.DedicatedHeapCount);
+
+    // Sized to the allocation, rounded to the 64KB placement alignment.
+    EXPECT_EQ(4 * MB + 6 * MB + 64 * KB, backend.GetLiveBytes());
+
+    // A block one alignment short of fitting is dedicated too, since the
+    // block allocator reserves room to align.
+    HeapAllocation edge = AllocateBuffer(allocator, 4 * MB);
+    EXPECT_EQ(2u, allocator.GetStats().DedicatedHeapCount);
+
+    // Dedicated heaps are never kept as spares.
+    allocator.Free(large);
+    allocator.Free(edge);
+    stats = allocator.GetStats();
+    EXPECT_EQ(0u, stats.DedicatedHeapCount);
+    EXPECT_EQ(1u, backend.GetLiveHeapCount());
+    EXPECT_EQ(4 * MB, backend.GetLiveBytes());
+
+    allocator.Free(small);
+}
+
+TEST(HeapAllocator, KeepsOneSpareBlockPerPool)
+{
+    MockHeapBackend backend;
+    HeapAllocator allocator(backend, TestDesc());
+
+    // Three quarters of a block each, so every allocation needs a new block.
+    HeapAllocation allocations[3];
+    for (HeapAllocation& allocation : allocations)
+    {
+        allocation = AllocateBuffer(allocator, 3 * MB);
+        ASSERT_TRUE(allocation.IsValid());
+    }
+    EXPECT_EQ(3u, backend.GetLiveHeapCount());
+
+    // The first block to empty stays as the spare; later ones are destroyed.
+    allocator.Free(allocations[0]);
+    EXPECT_EQ(3u, backend.GetLiveHeapCount());
+    allocator.Free(allocations[1]);
+    EXPECT_EQ(2u, backend.GetLiveHeapCount());
+    allocator.Free(allocations[2]);
+    EXPECT_EQ(1u, backend.GetLiveHeapCount());
+    EXPECT_EQ(0u, allocator.GetStats().AllocationCount);
+
+    // The spare takes the next allocation without a new heap.
+    const UINT creates = backend.GetCreateCount();
+    HeapAllocation again = AllocateBuffer(allocator, 3 * MB);
+    EXPECT_EQ(creates, backend.GetCreateCount());
+    allocator.Free(again);
+
+    allocator.Trim();
+    EXPECT_EQ(0u, backend.GetLiveHeapCount());
+    EXPECT_EQ(0u, allocator.GetStats().HeapCount);
+    EXPECT_EQ(backend.GetCreateCount(), allocator.GetStats().HeapCreateCount);
+    EXPECT_EQ(backend.GetDestroyCount(), allocator.GetStats().HeapDestroyCount);
+}
+
+TEST(HeapAllocator, FailsWhenTheBackendIsOutOfBudget)
+{
+    MockHeapBackend backend(6 * MB);
+    HeapAllocator allocator(backend, TestDesc());
+
+    HeapAllocation first = AllocateBuffer(allocator, 3 * MB);
+    ASSERT_TRUE(first.IsValid());
+
+    // A second block would take 8MB.
+    HeapAllocation second = AllocateBuffer(allocator, 3 * MB);
+    EXPECT_FALSE(second.IsValid());
+
+    HeapAllocation dedicated = AllocateBuffer(allocator, 8 * MB);
+    EXPECT_FALSE(dedicated.IsValid());
+
+    // Failures leave no trace in the stats.
+    HeapAllocatorStats stats = allocator.GetStats();
+    EXPECT_EQ(1u, stats.AllocationCount);
+    EXPECT_EQ(3 * MB, stats.AllocatedBytes);
+    EXPECT_EQ(1u, stats.HeapCount);
+    EXPECT_EQ(1u, stats.HeapCreateCount);
+
+    // What still fits in the existing block succeeds.
+    HeapAllocation fits = AllocateBuffer(allocator, 512 * KB);
+    EXPECT_TRUE(fits.IsValid());
+    EXPECT_EQ(first.HeapId, fits.HeapId);
+
+    // Freeing makes room for a new block.
+    allocator.Free(first);
+    allocator.Free(fits);
+    allocator.Trim();
+    HeapAllocation retry = AllocateBuffer(allocator, 3 * MB);
+    EXPECT_TRUE(retry.IsValid());
+    allocator.Free(retry);
+}
+
+TEST(HeapAllocator, CountsAllocationsPerAlignmentTier)
+{
+    MockHeapBackend backend;
+    HeapAllocator allocator(backend, TestDesc());
+
+    HeapAllocation small = allocator.Allocate(D3D12_HEAP_TYPE_DEFAULT, HeapResourceKind::Texture, 5 * KB,
+        D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT);
+    HeapAllocation normal = allocator.Allocate(D3D12_HEAP_TYPE_DEFAULT, HeapResourceKind::Texture, 100 * KB,
+        D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+    HeapAllocation msaa = allocator.Allocate(D3D12_HEAP_TYPE_DEFAULT, HeapResourceKind::Texture, 1 * MB,
+        D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT);
+    ASSERT_TRUE(small.IsValid() && normal.IsValid() && msaa.IsValid());
+
+    EXPECT_EQ(HeapAlignmentTier::Small, small.Tier);
+    EXPECT_EQ(HeapAlignmentTier::Default, normal.Tier);
+    EXPECT_EQ(HeapAlignmentTier::Msaa, msaa.Tier);
+
+    // MSAA placements need a 4MB aligned heap, which the first block is not.
+    EXPECT_EQ(small.HeapId, normal.HeapId);
+    EXPECT_NE(small.HeapId, msaa.HeapId);
+    EXPECT_EQ(0u, msaa.Offset % D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT);
+
+    // Sizes are rounded to the 4KB granularity.
+    HeapAllocatorStats stats = allocator.GetStats();
+    EXPECT_EQ(1u, stats.TierAllocationCount[(UINT)HeapAlignmentTier::Small]);
+    EXPECT_EQ(1u, stats.TierAllocationCount[(UINT)HeapAlignmentTier::Default]);
+    EXPECT_EQ(1u, stats.TierAllocationCount[(UINT)HeapAlignmentTier::Msaa]);
+    EXPECT_EQ(8 * KB, stats.TierAllocatedBytes[(UINT)HeapAlignmentTier::Small]);
+    EXPECT_EQ(100 * KB, stats.TierAllocatedBytes[(UINT)HeapAlignmentTier::Default]);
+    EXPECT_EQ(1 * MB, stats.TierAllocatedBytes[(UINT)HeapAlignmentTier::Msaa]);
+    EXPECT_EQ(3u, stats.AllocationCount);
+    EXPECT_EQ(8 * KB + 100 * KB + 1 * MB, stats.AllocatedBytes);
+
+    allocator.Free(normal);
+    stats = allocator.GetStats();
+    EXPECT_EQ(0u, stats.TierAllocationCount[(UINT)HeapAlignmentTier::Default]);
+    EXPECT_EQ(0u, stats.TierAllocatedBytes[(UINT)HeapAlignmentTier::Default]);
+    EXPECT_EQ(1u, stats.TierAllocationCount[(UINT)HeapAlignmentTier::Small]);
+
+    allocator.Free(small);
+    allocator.Free(msaa);
+    stats = allocator.GetStats();
+    for (UINT tier = 0; tier < (UINT)HeapAlignmentTier::Count; ++tier)
+    {
+        EXPECT_EQ(0u, stats.TierAllocationCount[tier]);
+        EXPECT_EQ(0u, stats.TierAllocatedBytes[tier]);
+    }
+}
+
+TEST(HeapAllocator, DestructorReleasesEveryHeap)
+{
+    MockHeapBackend backend;
+    {
+        HeapAllocator allocator(backend, TestDesc());
+        AllocateBuffer(allocator, 1 * MB);
+        AllocateBuffer(allocator, 16 * MB);
+        EXPECT_EQ(2u, backend.GetLiveHeapCount());
+    }
+    EXPECT_EQ(0u, backend.GetLiveHeapCount());
+    EXPECT_EQ(0u, backend.GetLiveBytes());
+}
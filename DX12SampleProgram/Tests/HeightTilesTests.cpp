@@ -0,0 +1,267 @@
+#include "stdafx.h"
+#include "HeightTiles.h"
+#include <gtest/gtest.h>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+    const UINT TileSize = 16;
+    const UINT TilesX = 3;
+    const UINT TilesZ = 2;
+
+    HeightTileFileDesc SmallDesc(HeightTileCompression compression)
+    {
+        HeightTileFileDesc desc;
+        desc.TileSize = TileSize;
+        desc.TilesX = TilesX;
+        desc.TilesZ = TilesZ;
+        desc.Compression = compression;
+        desc.OriginX = -10.0f;
+        desc.OriginZ = 5.0f;
+        desc.Spacing = 0.5f;
+        desc.MinHeight = -20.0f;
+        desc.MaxHeight = 80.0f;
+        return desc;
+    }
+
+    // Smooth rolling hills over the whole map, in [-20, 80].
+    float HeightAt(UINT x, UINT z)
+    {
+        return 30.0f + 50.0f * sinf(x * 0.3f) * cosf(z * 0.2f);
+    }
+
+    void FillTile(UINT tileX, UINT tileZ, float* heights)
+    {
+        for (UINT j = 0; j < TileSize; ++j)
+        {
+            for (UINT i = 0; i < TileSize; ++i)
+            {
+                heights[j * TileSize + i] = HeightAt(tileX * TileSize + i, tileZ * TileSize + j);
+            }
+        }
+    }
+
+    // A path under the test temporary directory, removed again on exit.
+    class TempFile
+    {
+    public:
+        explicit TempFile(const char* name) :
+            m_path(::testing::TempDir() + name)
+        {
+        }
+
+        ~TempFile()
+        {
+            std::remove(m_path.c_str());
+        }
+
+        std::wstring Name()const { return std::wstring(m_path.begin(), m_path.end()); }
+
+        std::vector<char> Read()const
+        {
+            std::ifstream file(m_path, std::ios::binary);
+            return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+
+        void Write(const std::vector<char>& bytes)const
+        {
+            std::ofstream file(m_path, std::ios::binary | std::ios::trunc);
+            file.write(bytes.data(), bytes.size());
+        }
+
+    private:
+        std::string m_path;
+    };
+
+    template<typename T>
+    void Poke(std::vector<char>& bytes, size_t offset, T value)
+    {
+        memcpy(bytes.data() + offset, &value, sizeof(value));
+    }
+
+    size_t TileBytes()
+    {
+        return TileSize * TileSize * sizeof(std::uint16_t) + sizeof(HeightTile);
+    }
+}
+
+TEST(HeightTiles, RoundTripsBothCompressions)
+{
+    const HeightTileCompression compressions[] = { HeightTileCompression::Raw, HeightTileCompression::DeltaVarint };
+    size_t fileSizes[2] = {};
+    for (int c = 0; c < 2; ++c)
+    {
+        SCOPED_TRACE(::testing::Message() << "compression " << (int)compressions[c]);
+        TempFile temp("RoundTrip.htl");
+        ASSERT_TRUE(WriteHeightTileFile(temp.Name(), SmallDesc(compressions[c]), FillTile));
+        fileSizes[c] = temp.Read().size();
+
+        HeightTileFile file;
+        ASSERT_TRUE(file.Open(temp.Name()));
+        const HeightTileFileHeader& h = file.Header();
+        EXPECT_EQ(TileSize, h.TileSize);
+        EXPECT_EQ(TilesX, h.TilesX);
+        EXPECT_EQ(TilesZ, h.TilesZ);
+        EXPECT_EQ(compressions[c], h.Compression);
+        EXPECT_EQ(-20.0f, h.HeightOffset);
+
+        // Every sample comes back within half a quantization step.
+        std::vector<std::uint16_t> samples(TileSize * TileSize);
+        for (UINT tileZ = 0; tileZ < TilesZ; ++tileZ)
+        {
+            for (UINT tileX = 0; tileX < TilesX; ++tileX)
+            {
+                ASSERT_TRUE(file.ReadTile(tileX, tileZ, samples.data()));
+                for (UINT j = 0; j < TileSize; ++j)
+                {
+                    for (UINT i = 0; i < TileSize; ++i)
+                    {
+                        float height = h.HeightOffset + samples[j * TileSize + i] * h.HeightScale;
+                        ASSERT_NEAR(HeightAt(tileX * TileSize + i, tileZ * TileSize + j), height, 0.6f * h.HeightScale);
+                    }
+                }
+            }
+        }
+
+        // The stream gives the same heights at the sample points, across
+        // tile edges too.
+        HeightTileStream stream;
+        ASSERT_TRUE(stream.Open(temp.Name()));
+        for (UINT z = 0; z < TilesZ * TileSize; z += 3)
+        {
+            for (UINT x = 0; x < TilesX * TileSize; x += 5)
+            {
+                float height = stream.GetHeight(-10.0f + x * 0.5f, 5.0f + z * 0.5f);
+                ASSERT_NEAR(HeightAt(x, z), height, h.HeightScale);
+            }
+        }
+        EXPECT_EQ(0u, stream.GetStats().ReadFailures);
+        EXPECT_EQ(TilesX * TilesZ, stream.GetResidentTileCount());
+    }
+
+    // Raw tiles take exactly their samples. These hills climb thousands of
+    // steps per sample, so the varints do not come out smaller here.
+    const size_t rawByteSize = sizeof(HeightTileFileHeader) + TilesX * TilesZ *
+        (sizeof(HeightTileEntry) + TileSize * TileSize * sizeof(std::uint16_t));
+    EXPECT_EQ(rawByteSize, fileSizes[0]);
+    EXPECT_NE(fileSizes[0], fileSizes[1]);
+}
+
+TEST(HeightTiles, RejectsTruncatedAndCorruptFiles)
+{
+    TempFile temp("Corrupt.htl");
+    HeightTileFile file;
+    EXPECT_FALSE(file.Open(temp.Name()));
+
+    ASSERT_TRUE(WriteHeightTileFile(temp.Name(), SmallDesc(HeightTileCompression::Raw), FillTile));
+    const std::vector<char> valid = temp.Read();
+    ASSERT_TRUE(file.Open(temp.Name()));
+    file.Close();
+
+    std::vector<std::vector<char>> broken;
+    // Short of the header, of the table, and of the last tile.
+    broken.emplace_back(valid.begin(), valid.begin() + sizeof(HeightTileFileHeader) - 4);
+    broken.emplace_back(valid.begin(), valid.begin() + sizeof(HeightTileFileHeader) + sizeof(HeightTileEntry));
+    broken.emplace_back(valid.begin(), valid.end() - 1);
+
+    broken.push_back(valid);
+    Poke(broken.back(), offsetof(HeightTileFileHeader, Magic), 0x12345678u);
+    broken.push_back(valid);
+    Poke(broken.back(), offsetof(HeightTileFileHeader, Version), HeightTileFileVersion + 1);
+    broken.push_back(valid);
+    Poke(broken.back(), offsetof(HeightTileFileHeader, TileSize), HeightTileMaxSize * 2);
+    broken.push_back(valid);
+    Poke(broken.back(), offsetof(HeightTileFileHeader, Compression), 7u);
+
+    // A table far larger than the file, and entries pointing past its end.
+    broken.push_back(valid);
+    Poke(broken.back(), offsetof(HeightTileFileHeader, TilesX), 0x10000u);
+    Poke(broken.back(), offsetof(HeightTileFileHeader, TilesZ), 0x10000u);
+    broken.push_back(valid);
+    Poke(broken.back(), sizeof(HeightTileFileHeader) + offsetof(HeightTileEntry, Offset), (std::uint64_t)valid.size());
+    broken.push_back(valid);
+    Poke(broken.back(), sizeof(HeightTileFileHeader) + offsetof(HeightTileEntry, Offset), ~(std::uint64_t)0);
+
+    for (size_t k = 0; k < broken.size(); ++k)
+    {
+        temp.Write(broken[k]);
+        EXPECT_FALSE(file.Open(temp.Name())) << "case " << k;
+    }
+}
+
+TEST(HeightTiles, CorruptTileDataReadsAsFlat)
+{
+    TempFile temp("CorruptTile.htl");
+    ASSERT_TRUE(WriteHeightTileFile(temp.Name(), SmallDesc(HeightTileCompression::DeltaVarint), FillTile));
+
+    // Continuation bits on every byte of tile (0, 0) make a varint too long
+    // to decode; the table itself is still sound.
+    std::vector<char> bytes = temp.Read();
+    HeightTileEntry entry;
+    memcpy(&entry, bytes.data() + sizeof(HeightTileFileHeader), sizeof(entry));
+    std::fill(bytes.begin() + (size_t)entry.Offset, bytes.begin() + (size_t)entry.Offset + entry.ByteSize, (char)0xff);
+    temp.Write(bytes);
+
+    HeightTileFile file;
+    ASSERT_TRUE(file.Open(temp.Name()));
+    std::vector<std::uint16_t> samples(TileSize * TileSize);
+    EXPECT_FALSE(file.ReadTile(0, 0, samples.data()));
+    EXPECT_TRUE(file.ReadTile(1, 0, samples.data()));
+
+    HeightTileStream stream;
+    ASSERT_TRUE(stream.Open(temp.Name()));
+    EXPECT_EQ(-20.0f, stream.GetHeight(-10.0f, 5.0f));
+    EXPECT_NEAR(HeightAt(TileSize + 2, 1), stream.GetHeight(-10.0f + (TileSize + 2) * 0.5f, 5.5f), 0.01f);
+    HeightTileStreamStats stats = stream.GetStats();
+    EXPECT_EQ(2u, stats.TilesRead);
+    EXPECT_EQ(1u, stats.ReadFailures);
+}
+
+TEST(HeightTiles, BudgetCapsResidentTiles)
+{
+    TempFile temp("Budget.htl");
+    ASSERT_TRUE(WriteHeightTileFile(temp.Name(), SmallDesc(HeightTileCompression::DeltaVarint), FillTile));
+
+    HeightTileStreamDesc desc;
+    desc.MemoryBudget = 3 * TileBytes() + TileBytes() / 2;
+    HeightTileStream stream(desc);
+    ASSERT_TRUE(stream.Open(temp.Name()));
+    EXPECT_EQ(3u, stream.GetTileCapacity());
+
+    for (UINT tileZ = 0; tileZ < TilesZ; ++tileZ)
+    {
+        for (UINT tileX = 0; tileX < TilesX; ++tileX)
+        {
+            ASSERT_NE(nullptr, stream.GetTile(tileX, tileZ));
+            EXPECT_LE(stream.GetResidentTileCount(), 3u);
+            EXPECT_LE(stream.GetResidentBytes(), desc.MemoryBudget);
+        }
+    }
+    EXPECT_EQ(3u, stream.GetResidentTileCount());
+    EXPECT_EQ(6u, stream.GetStats().TilesRead);
+
+    // The last three stay. Touching (0, 1) and (2, 1) leaves (1, 1) the
+    // oldest, so reading (0, 0) back evicts that one.
+    EXPECT_EQ(nullptr, stream.FindTile(0, 0));
+    ASSERT_NE(nullptr, stream.FindTile(0, 1));
+    ASSERT_NE(nullptr, stream.GetTile(2, 1));
+    EXPECT_EQ(6u, stream.GetStats().TilesRead);
+
+    ASSERT_NE(nullptr, stream.GetTile(0, 0));
+    EXPECT_EQ(7u, stream.GetStats().TilesRead);
+    EXPECT_EQ(3u, stream.GetResidentTileCount());
+    EXPECT_EQ(nullptr, stream.FindTile(1, 1));
+    EXPECT_NE(nullptr, stream.FindTile(0, 1));
+    EXPECT_NE(nullptr, stream.FindTile(2, 1));
+
+    // Heights still come out right while tiles cycle through the budget.
+    for (UINT x = 0; x < TilesX * TileSize; x += 7)
+    {
+        EXPECT_NEAR(HeightAt(x, 20), stream.GetHeight(-10.0f + x * 0.5f, 15.0f), 0.01f);
+        EXPECT_NEAR(HeightAt(x, 3), stream.GetHeight(-10.0f + x * 0.5f, 6.5f), 0.01f);
+        EXPECT_LE(stream.GetResidentTileCount(), 3u);
+    }
+}
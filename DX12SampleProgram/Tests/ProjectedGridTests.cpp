@@ -0,0 +1,242 @@
+#include "stdafx.h"
+#include "ProjectedGrid.h"
+#include <gtest/gtest.h>
+
+using namespace DirectX;
+
+namespace
+{
+    const float FovY = 0.25f * XM_PI;
+    const float Aspect = 1.5f;
+    const float NearZ = 1.0f;
+    const float FarZ = 1000.0f;
+
+    struct Camera
+    {
+        XMMATRIX View;
+        XMMATRIX ViewProj;
+        XMMATRIX InvViewProj;
+    };
+
+    Camera LookAt(const XMFLOAT3& eye, const XMFLOAT3& focus, const XMFLOAT3& up = XMFLOAT3(0.0f, 1.0f, 0.0f))
+    {
+        Camera camera;
+        camera.View = XMMatrixLookAtLH(XMLoadFloat3(&eye), XMLoadFloat3(&focus), XMLoadFloat3(&up));
+        camera.ViewProj = XMMatrixMultiply(camera.View, XMMatrixPerspectiveFovLH(FovY, Aspect, NearZ, FarZ));
+        camera.InvViewProj = XMMatrixInverse(nullptr, camera.ViewProj);
+        return camera;
+    }
+
+    XMFLOAT3 Transform(const XMFLOAT3& p, CXMMATRIX m)
+    {
+        XMFLOAT3 result;
+        XMStoreFloat3(&result, XMVector3TransformCoord(XMLoadFloat3(&p), m));
+        return result;
+    }
+
+    ProjectedGridDesc GridDesc(float waterLevel)
+    {
+        ProjectedGridDesc desc;
+        desc.Columns = 30;
+        desc.Rows = 24;
+        desc.WaterLevel = waterLevel;
+        return desc;
+    }
+
+    // NDC x of a column, as the grid lays them out.
+    float ColumnX(const ProjectedGridDesc& desc, UINT column)
+    {
+        return -1.0f - desc.Margin + (2.0f + 2.0f * desc.Margin) * column / (desc.Columns - 1);
+    }
+
+    std::vector<WaveSpectrumComponent> Components()
+    {
+        std::vector<WaveSpectrumComponent> components(4);
+        components[0].Direction = XMFLOAT2(3.0f, 4.0f);
+        components[0].WaveLength = 12.0f;
+        components[0].Amplitude = 0.4f;
+        components[0].Speed = 3.0f;
+        components[1].Direction = XMFLOAT2(-1.0f, 0.2f);
+        components[1].WaveLength = 5.0f;
+        components[1].Amplitude = 0.15f;
+        components[1].Phase = 1.0f;
+        components[2].Direction = XMFLOAT2(0.0f, -2.0f);
+        components[2].WaveLength = 31.0f;
+        components[2].Amplitude = 0.8f;
+        components[2].Speed = 6.0f;
+
+        // No direction; dropped.
+        components[3].Direction = XMFLOAT2(0.0f, 0.0f);
+        return components;
+    }
+
+    // The spectrum summed one sine at a time.
+    float ScalarHeight(const std::vector<WaveSpectrumComponent>& components, float time, float x, float z)
+    {
+        float height = 0.0f;
+        for (const WaveSpectrumComponent& c : components)
+        {
+            float length = std::sqrt(c.Direction.x * c.Direction.x + c.Direction.y * c.Direction.y);
+            if (length == 0.0f)
+            {
+                continue;
+            }
+            float k = XM_2PI / c.WaveLength;
+            float along = (c.Direction.x * x + c.Direction.y * z) / length;
+            height += c.Amplitude * sinf(k * along - k * c.Speed * time + c.Phase);
+        }
+        return height;
+    }
+}
+
+TEST(ProjectedGrid, PointsLieOnTheWaterPlane)
+{
+    // Looking down at the water; the top of the screen still meets it well
+    // inside the far plane.
+    const Camera camera = LookAt(XMFLOAT3(5.0f, 12.0f, -20.0f), XMFLOAT3(5.0f, 2.0f, 0.0f));
+    const ProjectedGridDesc desc = GridDesc(2.0f);
+    ProjectedGrid grid(desc);
+    std::vector<XMFLOAT3> positions(grid.GetVertexCount());
+    ASSERT_TRUE(grid.Project(camera.InvViewProj, WaterHeightSource(), positions.data()));
+
+    // Each vertex is on the plane, on the screen ray of its grid point:
+    // columns evenly across the screen, rows evenly down from the top.
+    const float top = 1.0f + desc.Margin;
+    const float bottom = -1.0f - desc.Margin;
+    for (UINT row = 0; row < desc.Rows; ++row)
+    {
+        for (UINT column = 0; column < desc.Columns; ++column)
+        {
+            const XMFLOAT3& p = positions[row * desc.Columns + column];
+            ASSERT_NEAR(2.0f, p.y, 1.0e-3f) << "row " << row << ", column " << column;
+
+            XMFLOAT3 ndc = Transform(p, camera.ViewProj);
+            EXPECT_NEAR(ColumnX(desc, column), ndc.x, 1.0e-3f);
+            EXPECT_NEAR(top - (top - bottom) * row / (desc.Rows - 1), ndc.y, 1.0e-3f);
+            EXPECT_GE(ndc.z, 0.0f);
+            EXPECT_LE(ndc.z, 1.0f);
+        }
+    }
+
+    const VertexBounds& bounds = grid.GetBounds();
+    EXPECT_NEAR(2.0f, bounds.Box.Center.y, 1.0e-3f);
+    EXPECT_NEAR(0.0f, bounds.Box.Extents.y, 1.0e-3f);
+}
+
+TEST(ProjectedGrid, GridStopsAtTheHorizon)
+{
+    // Looking straight ahead, the far plane meets the water just below the
+    // middle of the screen, where the top row of the grid goes.
+    const float eyeHeight = 10.0f;
+    const Camera camera = LookAt(XMFLOAT3(0.0f, eyeHeight, 0.0f), XMFLOAT3(0.0f, eyeHeight, 100.0f));
+    const ProjectedGridDesc desc = GridDesc(0.0f);
+    ProjectedGrid grid(desc);
+    std::vector<XMFLOAT3> positions(grid.GetVertexCount());
+    ASSERT_TRUE(grid.Project(camera.InvViewProj, WaterHeightSource(), positions.data()));
+
+    const float horizonY = -eyeHeight / (FarZ * tanf(0.5f * FovY));
+    for (UINT column = 0; column < desc.Columns; ++column)
+    {
+        const XMFLOAT3& p = positions[column];
+        EXPECT_NEAR(0.0f, p.y, 1.0e-2f);
+        EXPECT_NEAR(FarZ, Transform(p, camera.View).z, 1.0f);
+        EXPECT_NEAR(horizonY, Transform(p, camera.ViewProj).y, 1.0e-3f);
+    }
+    for (const XMFLOAT3& p : positions)
+    {
+        ASSERT_NEAR(0.0f, p.y, 1.0e-2f);
+        ASSERT_LE(Transform(p, camera.View).z, FarZ + 1.0f);
+    }
+
+    // Rolled, the horizon runs across the screen at a slant and the top row
+    // goes through its higher end. Below that, rays on the lower side pass
+    // over the water; they are clamped to the far plane but stay on the
+    // water, while the rest land on their own screen rays.
+    const Camera rolled = LookAt(XMFLOAT3(0.0f, eyeHeight, 0.0f), XMFLOAT3(0.0f, eyeHeight, 100.0f), XMFLOAT3(0.3f, 1.0f, 0.0f));
+    ASSERT_TRUE(grid.Project(rolled.InvViewProj, WaterHeightSource(), positions.data()));
+    const UINT last = desc.Columns - 1;
+    const float topLeftX = Transform(positions[0], rolled.ViewProj).x;
+    const float topRightX = Transform(positions[last], rolled.ViewProj).x;
+    EXPECT_TRUE(fabsf(topLeftX - ColumnX(desc, 0)) < 1.0e-3f || fabsf(topRightX - ColumnX(desc, last)) < 1.0e-3f);
+
+    UINT onRay = 0;
+    UINT clamped = 0;
+    for (UINT row = 0; row < desc.Rows; ++row)
+    {
+        for (UINT column = 0; column < desc.Columns; ++column)
+        {
+            const XMFLOAT3& p = positions[row * desc.Columns + column];
+            ASSERT_NEAR(0.0f, p.y, 1.0e-2f);
+            const float depth = Transform(p, rolled.View).z;
+            ASSERT_LE(depth, FarZ + 1.0f);
+            if (depth > FarZ - 1.0f)
+            {
+                ++clamped;
+            }
+            else
+            {
+                EXPECT_NEAR(ColumnX(desc, column), Transform(p, rolled.ViewProj).x, 1.0e-3f);
+                ++onRay;
+            }
+        }
+    }
+    EXPECT_GT(onRay, desc.Columns * desc.Rows / 2);
+    EXPECT_GT(clamped, desc.Columns);
+}
+
+TEST(ProjectedGrid, NothingVisibleLookingAwayFromTheWater)
+{
+    ProjectedGrid grid(GridDesc(0.0f));
+    std::vector<XMFLOAT3> positions(grid.GetVertexCount());
+
+    // Pitched up 45 degrees, well past half the field of view.
+    const Camera sky = LookAt(XMFLOAT3(0.0f, 10.0f, 0.0f), XMFLOAT3(0.0f, 110.0f, 100.0f));
+    EXPECT_FALSE(grid.Project(sky.InvViewProj, WaterHeightSource(), positions.data()));
+
+    // From below the surface the same view looks up at the water.
+    const Camera underwater = LookAt(XMFLOAT3(0.0f, -10.0f, 0.0f), XMFLOAT3(0.0f, 90.0f, 100.0f));
+    EXPECT_TRUE(grid.Project(underwater.InvViewProj, WaterHeightSource(), positions.data()));
+}
+
+TEST(ProjectedGrid, SpectrumMatchesAScalarSumOfSines)
+{
+    const std::vector<WaveSpectrumComponent> components = Components();
+    WaveSpectrum spectrum(components);
+    const float time = 1.7f;
+    spectrum.SetTime(time);
+
+    // 11 points: two groups of four and a tail of three. Offset by one so
+    // the loads are unaligned too.
+    const size_t counts[] = { 1, 3, 4, 11 };
+    std::vector<float> x(12), z(12);
+    for (size_t i = 0; i < x.size(); ++i)
+    {
+        x[i] = -40.0f + 7.3f * i;
+        z[i] = 25.0f - 4.1f * i;
+    }
+    for (size_t count : counts)
+    {
+        std::vector<float> heights(count + 1, -100.0f);
+        spectrum.GetHeights(x.data() + 1, z.data() + 1, count, heights.data());
+        for (size_t i = 0; i < count; ++i)
+        {
+            EXPECT_NEAR(ScalarHeight(components, time, x[i + 1], z[i + 1]), heights[i], 1.0e-4f)
+                << "point " << i << " of " << count;
+        }
+        EXPECT_EQ(-100.0f, heights[count]);
+    }
+
+    // As a height source, the spectrum lifts each projected vertex by its
+    // height at that point.
+    const Camera camera = LookAt(XMFLOAT3(0.0f, 12.0f, -20.0f), XMFLOAT3(0.0f, 0.0f, 0.0f));
+    const ProjectedGridDesc desc = GridDesc(1.0f);
+    ProjectedGrid grid(desc);
+    std::vector<XMFLOAT3> positions(grid.GetVertexCount());
+    ASSERT_TRUE(grid.Project(camera.InvViewProj,
+        [&spectrum](const float* x, const float* z, size_t count, float* heights) { spectrum.GetHeights(x, z, count, heights); },
+        positions.data()));
+    for (const XMFLOAT3& p : positions)
+    {
+        ASSERT_NEAR(1.0f + ScalarHeight(components, time, p.x, p.z), p.y, 1.0e-3f);
+    }
+}
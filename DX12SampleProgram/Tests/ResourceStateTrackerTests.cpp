@@ -0,0 +1,145 @@
+#include "stdafx.h"
+#include "ResourceStateTracker.h"
+#include <gtest/gtest.h>
+
+namespace
+{
+    // Registry and tracker only compare and hand on the pointers.
+    ID3D12Resource* FakeResource(UINT id)
+    {
+        return reinterpret_cast<ID3D12Resource*>((uintptr_t)(id + 1) * 64);
+    }
+
+    // Keeps each ResourceBarrier call's barriers.
+    class RecordingCommandList : public ID3D12GraphicsCommandList
+    {
+    public:
+        ULONG AddRef() override { return 1; }
+        ULONG Release() override { return 1; }
+
+        void ResourceBarrier(UINT count, const D3D12_RESOURCE_BARRIER* barriers) override
+        {
+            m_calls.emplace_back(barriers, barriers + count);
+        }
+
+        const std::vector<std::vector<D3D12_RESOURCE_BARRIER>>& GetCalls()const { return m_calls; }
+
+    private:
+        std::vector<std::vector<D3D12_RESOURCE_BARRIER>> m_calls;
+    };
+
+    void ExpectTransition(const D3D12_RESOURCE_BARRIER& barrier, ID3D12Resource* resource,
+        D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after)
+    {
+        EXPECT_EQ(resource, barrier.Transition.pResource);
+        EXPECT_EQ(before, barrier.Transition.StateBefore);
+        EXPECT_EQ(after, barrier.Transition.StateAfter);
+    }
+
+    D3D12_RESOURCE_STATES StateOf(const ResourceStateRegistry& registry, ID3D12Resource* resource)
+    {
+        D3D12_RESOURCE_STATES state = D3D12_RESOURCE_STATE_COMMON;
+        EXPECT_TRUE(registry.GetState(resource, state));
+        return state;
+    }
+}
+
+TEST(ResourceStateTracker, MergesAndElidesBarriers)
+{
+    ID3D12Resource* a = FakeResource(0);
+    ID3D12Resource* b = FakeResource(1);
+    ID3D12Resource* c = FakeResource(2);
+    const D3D12_RESOURCE_STATES vertexAndIndex =
+        D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_INDEX_BUFFER;
+
+    ResourceStateRegistry registry;
+    registry.Register(a, D3D12_RESOURCE_STATE_COPY_DEST);
+    registry.Register(b, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    registry.Register(c, D3D12_RESOURCE_STATE_COMMON);
+
+    ResourceStateTracker tracker(registry);
+    RecordingCommandList cmdList;
+
+    // A->B->C becomes A->C; a state already held, or a read state that
+    // includes it, needs nothing.
+    tracker.Transition(a, D3D12_RESOURCE_STATE_COPY_DEST);
+    tracker.Transition(a, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    tracker.Transition(a, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    tracker.Transition(b, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    tracker.Transition(b, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    tracker.Transition(c, vertexAndIndex);
+    tracker.Transition(c, D3D12_RESOURCE_STATE_INDEX_BUFFER);
+    tracker.FlushBarriers(&cmdList);
+    ASSERT_EQ(1u, cmdList.GetCalls().size());
+    ASSERT_EQ(1u, cmdList.GetCalls()[0].size());
+    ExpectTransition(cmdList.GetCalls()[0][0], a, D3D12_RESOURCE_STATE_COPY_DEST,
+        D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+
+    // A->B->A disappears, and a flush with nothing queued makes no call.
+    tracker.Transition(a, D3D12_RESOURCE_STATE_COPY_DEST);
+    tracker.Transition(a, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    tracker.FlushBarriers(&cmdList);
+    EXPECT_EQ(1u, cmdList.GetCalls().size());
+
+    // a starts in the state the registry has; b and c need a barrier first.
+    std::vector<D3D12_RESOURCE_BARRIER> initialBarriers;
+    ASSERT_EQ(2u, tracker.Submit(initialBarriers));
+    ASSERT_EQ(2u, initialBarriers.size());
+    ExpectTransition(initialBarriers[0], b, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    ExpectTransition(initialBarriers[1], c, D3D12_RESOURCE_STATE_COMMON, vertexAndIndex);
+    EXPECT_EQ(D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, StateOf(registry, a));
+    EXPECT_EQ(D3D12_RESOURCE_STATE_RENDER_TARGET, StateOf(registry, b));
+    EXPECT_EQ(vertexAndIndex, StateOf(registry, c));
+
+    const ResourceStateTrackerStats& stats = tracker.GetStats();
+    EXPECT_EQ(9u, stats.TransitionsRequested);
+    EXPECT_EQ(3u, stats.BarriersElided);
+    EXPECT_EQ(2u, stats.BarriersMerged);
+    EXPECT_EQ(3u, stats.BarriersEmitted);
+    EXPECT_EQ(2u, stats.BarrierCalls);
+    EXPECT_EQ(2u, stats.InitialBarriers);
+
+    // The next list picks up where this one left b.
+    initialBarriers.clear();
+    tracker.Transition(b, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    tracker.FlushBarriers(&cmdList);
+    EXPECT_EQ(0u, tracker.Submit(initialBarriers));
+    EXPECT_TRUE(initialBarriers.empty());
+}
+
+TEST(ResourceStateTracker, SubmitThrowsOnUnregisteredResources)
+{
+    ID3D12Resource* a = FakeResource(0);
+    ID3D12Resource* unregistered = FakeResource(1);
+
+    ResourceStateRegistry registry;
+    registry.Register(a, D3D12_RESOURCE_STATE_COMMON);
+    ResourceStateTracker tracker(registry);
+    RecordingCommandList cmdList;
+
+    tracker.Transition(a, D3D12_RESOURCE_STATE_COPY_DEST);
+    tracker.Transition(unregistered, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    tracker.FlushBarriers(&cmdList);
+
+    // Barriers from an earlier list are left as they were, and so is the
+    // registry.
+    std::vector<D3D12_RESOURCE_BARRIER> initialBarriers(1,
+        CD3DX12_RESOURCE_BARRIER::Transition(FakeResource(7), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_SOURCE));
+    EXPECT_THROW(tracker.Submit(initialBarriers), std::runtime_error);
+    ASSERT_EQ(1u, initialBarriers.size());
+    EXPECT_EQ(FakeResource(7), initialBarriers[0].Transition.pResource);
+    EXPECT_EQ(D3D12_RESOURCE_STATE_COMMON, StateOf(registry, a));
+    EXPECT_EQ(1u, registry.GetCount());
+
+    // Nothing of the failed list carries over: a is new to the next one, so
+    // its barrier comes from the registry, and the unregistered resource no
+    // longer fails the submit.
+    tracker.Transition(a, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    tracker.FlushBarriers(&cmdList);
+    EXPECT_TRUE(cmdList.GetCalls().empty());
+
+    initialBarriers.clear();
+    ASSERT_EQ(1u, tracker.Submit(initialBarriers));
+    ExpectTransition(initialBarriers[0], a, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    EXPECT_EQ(D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, StateOf(registry, a));
+}
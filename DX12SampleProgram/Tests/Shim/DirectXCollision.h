@@ -0,0 +1,74 @@
+// The part of DirectXCollision the headless tests compile against. The
+// frustum has no planes: it contains everything, so selection code run in a
+// test is limited by distance alone.
+#pragma once
+#include "DirectXMath.h"
+#include <algorithm>
+
+namespace DirectX
+{
+    enum ContainmentType
+    {
+        DISJOINT = 0,
+        INTERSECTS = 1,
+        CONTAINS = 2,
+    };
+
+    struct BoundingBox
+    {
+        XMFLOAT3 Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+        XMFLOAT3 Extents = XMFLOAT3(1.0f, 1.0f, 1.0f);
+
+        static void CreateFromPoints(BoundingBox& out, FXMVECTOR a, FXMVECTOR b)
+        {
+            XMVECTOR vMin = XMVectorMin(a, b);
+            XMVECTOR vMax = XMVectorMax(a, b);
+            XMStoreFloat3(&out.Center, XMVectorScale(XMVectorAdd(vMin, vMax), 0.5f));
+            XMStoreFloat3(&out.Extents, XMVectorScale(XMVectorSubtract(vMax, vMin), 0.5f));
+        }
+
+        static void CreateMerged(BoundingBox& out, const BoundingBox& a, const BoundingBox& b)
+        {
+            XMVECTOR aCenter = XMLoadFloat3(&a.Center);
+            XMVECTOR aExtents = XMLoadFloat3(&a.Extents);
+            XMVECTOR bCenter = XMLoadFloat3(&b.Center);
+            XMVECTOR bExtents = XMLoadFloat3(&b.Extents);
+            CreateFromPoints(out,
+                XMVectorMin(XMVectorSubtract(aCenter, aExtents), XMVectorSubtract(bCenter, bExtents)),
+                XMVectorMax(XMVectorAdd(aCenter, aExtents), XMVectorAdd(bCenter, bExtents)));
+        }
+    };
+
+    struct BoundingSphere
+    {
+        XMFLOAT3 Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+        float Radius = 1.0f;
+
+        bool Intersects(const BoundingBox& box)const
+        {
+            const float* c = &Center.x;
+            const float* boxCenter = &box.Center.x;
+            const float* boxExtents = &box.Extents.x;
+            float distanceSq = 0.0f;
+            for (int i = 0; i < 3; ++i)
+            {
+                float lo = boxCenter[i] - boxExtents[i];
+                float hi = boxCenter[i] + boxExtents[i];
+                float d = c[i] < lo ? lo - c[i] : (c[i] > hi ? c[i] - hi : 0.0f);
+                distanceSq += d * d;
+            }
+            return distanceSq <= Radius * Radius;
+        }
+
+        static void CreateFromBoundingBox(BoundingSphere& out, const BoundingBox& box)
+        {
+            out.Center = box.Center;
+            out.Radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&box.Extents)));
+        }
+    };
+
+    struct BoundingFrustum
+    {
+        ContainmentType Contains(const BoundingBox&)const { return CONTAINS; }
+    };
+}
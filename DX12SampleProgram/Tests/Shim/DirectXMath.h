@@ -0,0 +1,316 @@
+// The part of DirectXMath the headless tests compile against, on SSE2 like
+// the real library on x64. Only what the code under test calls is here;
+// add functions as tests reach further.
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <emmintrin.h>
+
+#define XM_CALLCONV
+
+namespace DirectX
+{
+    const float XM_PI = 3.141592654f;
+    const float XM_2PI = 6.283185307f;
+    const float XM_PIDIV2 = 1.570796327f;
+
+    using XMVECTOR = __m128;
+    using FXMVECTOR = const XMVECTOR;
+    using GXMVECTOR = const XMVECTOR;
+    using HXMVECTOR = const XMVECTOR&;
+    using CXMVECTOR = const XMVECTOR&;
+
+    struct XMFLOAT2
+    {
+        float x;
+        float y;
+
+        XMFLOAT2() = default;
+        XMFLOAT2(float _x, float _y) : x(_x), y(_y) {}
+    };
+
+    struct XMFLOAT3
+    {
+        float x;
+        float y;
+        float z;
+
+        XMFLOAT3() = default;
+        XMFLOAT3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+    };
+
+    struct XMFLOAT4
+    {
+        float x;
+        float y;
+        float z;
+        float w;
+
+        XMFLOAT4() = default;
+        XMFLOAT4(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
+    };
+
+    struct XMFLOAT4X4
+    {
+        float _11, _12, _13, _14;
+        float _21, _22, _23, _24;
+        float _31, _32, _33, _34;
+        float _41, _42, _43, _44;
+    };
+
+    struct XMMATRIX
+    {
+        XMVECTOR r[4];
+    };
+
+    using FXMMATRIX = const XMMATRIX;
+    using CXMMATRIX = const XMMATRIX&;
+
+    inline XMVECTOR XMVectorZero() { return _mm_setzero_ps(); }
+    inline XMVECTOR XMVectorSet(float x, float y, float z, float w) { return _mm_set_ps(w, z, y, x); }
+    inline XMVECTOR XMVectorReplicate(float value) { return _mm_set1_ps(value); }
+    inline float XMVectorGetX(FXMVECTOR v) { return _mm_cvtss_f32(v); }
+
+    inline XMVECTOR XMVectorAdd(FXMVECTOR a, FXMVECTOR b) { return _mm_add_ps(a, b); }
+    inline XMVECTOR XMVectorSubtract(FXMVECTOR a, FXMVECTOR b) { return _mm_sub_ps(a, b); }
+    inline XMVECTOR XMVectorMultiply(FXMVECTOR a, FXMVECTOR b) { return _mm_mul_ps(a, b); }
+    inline XMVECTOR XMVectorMultiplyAdd(FXMVECTOR a, FXMVECTOR b, FXMVECTOR c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    inline XMVECTOR XMVectorScale(FXMVECTOR v, float s) { return _mm_mul_ps(v, _mm_set1_ps(s)); }
+    inline XMVECTOR XMVectorMin(FXMVECTOR a, FXMVECTOR b) { return _mm_min_ps(a, b); }
+    inline XMVECTOR XMVectorMax(FXMVECTOR a, FXMVECTOR b) { return _mm_max_ps(a, b); }
+    inline XMVECTOR XMVectorSqrt(FXMVECTOR v) { return _mm_sqrt_ps(v); }
+
+    namespace ShimDetail
+    {
+        template<typename Fn>
+        XMVECTOR PerLane(FXMVECTOR v, Fn fn)
+        {
+            alignas(16) float f[4];
+            _mm_store_ps(f, v);
+            for (float& x : f)
+            {
+                x = fn(x);
+            }
+            return _mm_load_ps(f);
+        }
+
+        inline float Dot3(FXMVECTOR a, FXMVECTOR b)
+        {
+            alignas(16) float fa[4];
+            alignas(16) float fb[4];
+            _mm_store_ps(fa, a);
+            _mm_store_ps(fb, b);
+            return fa[0] * fb[0] + fa[1] * fb[1] + fa[2] * fb[2];
+        }
+    }
+
+    inline XMVECTOR XMVectorSin(FXMVECTOR v) { return ShimDetail::PerLane(v, [](float x) { return sinf(x); }); }
+    inline XMVECTOR XMVectorCos(FXMVECTOR v) { return ShimDetail::PerLane(v, [](float x) { return cosf(x); }); }
+
+    inline XMVECTOR XMVector3Dot(FXMVECTOR a, FXMVECTOR b) { return _mm_set1_ps(ShimDetail::Dot3(a, b)); }
+    inline XMVECTOR XMVector3LengthSq(FXMVECTOR v) { return XMVector3Dot(v, v); }
+    inline XMVECTOR XMVector3Length(FXMVECTOR v) { return _mm_set1_ps(sqrtf(ShimDetail::Dot3(v, v))); }
+
+    inline XMVECTOR XMVector3Normalize(FXMVECTOR v)
+    {
+        float length = sqrtf(ShimDetail::Dot3(v, v));
+        return length > 0.0f ? _mm_div_ps(v, _mm_set1_ps(length)) : _mm_setzero_ps();
+    }
+
+    inline XMVECTOR XMVector3Cross(FXMVECTOR a, FXMVECTOR b)
+    {
+        alignas(16) float fa[4];
+        alignas(16) float fb[4];
+        _mm_store_ps(fa, a);
+        _mm_store_ps(fb, b);
+        return XMVectorSet(
+            fa[1] * fb[2] - fa[2] * fb[1],
+            fa[2] * fb[0] - fa[0] * fb[2],
+            fa[0] * fb[1] - fa[1] * fb[0],
+            0.0f);
+    }
+
+    inline XMVECTOR XMLoadFloat2(const XMFLOAT2* p) { return XMVectorSet(p->x, p->y, 0.0f, 0.0f); }
+    inline XMVECTOR XMLoadFloat3(const XMFLOAT3* p) { return XMVectorSet(p->x, p->y, p->z, 0.0f); }
+    inline XMVECTOR XMLoadFloat4(const XMFLOAT4* p) { return _mm_loadu_ps(&p->x); }
+
+    inline void XMStoreFloat2(XMFLOAT2* p, FXMVECTOR v)
+    {
+        alignas(16) float f[4];
+        _mm_store_ps(f, v);
+        *p = XMFLOAT2(f[0], f[1]);
+    }
+
+    inline void XMStoreFloat3(XMFLOAT3* p, FXMVECTOR v)
+    {
+        alignas(16) float f[4];
+        _mm_store_ps(f, v);
+        *p = XMFLOAT3(f[0], f[1], f[2]);
+    }
+
+    inline void XMStoreFloat4(XMFLOAT4* p, FXMVECTOR v) { _mm_storeu_ps(&p->x, v); }
+
+    inline XMMATRIX XMLoadFloat4x4(const XMFLOAT4X4* p)
+    {
+        XMMATRIX m;
+        for (int i = 0; i < 4; ++i)
+        {
+            m.r[i] = _mm_loadu_ps(&p->_11 + 4 * i);
+        }
+        return m;
+    }
+
+    inline void XMStoreFloat4x4(XMFLOAT4X4* p, FXMMATRIX m)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            _mm_storeu_ps(&p->_11 + 4 * i, m.r[i]);
+        }
+    }
+
+    inline XMMATRIX XMMatrixIdentity()
+    {
+        XMMATRIX m;
+        m.r[0] = XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f);
+        m.r[1] = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+        m.r[2] = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
+        m.r[3] = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+        return m;
+    }
+
+    // Row vectors, as in DirectXMath: v' = v * M.
+    inline XMMATRIX XMMatrixMultiply(CXMMATRIX a, CXMMATRIX b)
+    {
+        XMFLOAT4X4 fa, fb, fr;
+        XMStoreFloat4x4(&fa, a);
+        XMStoreFloat4x4(&fb, b);
+        const float* pa = &fa._11;
+        const float* pb = &fb._11;
+        float* pr = &fr._11;
+        for (int i = 0; i < 4; ++i)
+        {
+            for (int j = 0; j < 4; ++j)
+            {
+                pr[4 * i + j] = pa[4 * i] * pb[j] + pa[4 * i + 1] * pb[4 + j] +
+                    pa[4 * i + 2] * pb[8 + j] + pa[4 * i + 3] * pb[12 + j];
+            }
+        }
+        return XMLoadFloat4x4(&fr);
+    }
+
+    // Gauss-Jordan with partial pivoting, in double. A singular matrix
+    // gives a zero determinant and an unspecified result.
+    inline XMMATRIX XMMatrixInverse(XMVECTOR* determinant, FXMMATRIX m)
+    {
+        XMFLOAT4X4 f;
+        XMStoreFloat4x4(&f, m);
+        double a[4][8];
+        for (int i = 0; i < 4; ++i)
+        {
+            for (int j = 0; j < 4; ++j)
+            {
+                a[i][j] = (&f._11)[4 * i + j];
+                a[i][4 + j] = i == j ? 1.0 : 0.0;
+            }
+        }
+
+        double det = 1.0;
+        for (int c = 0; c < 4; ++c)
+        {
+            int pivot = c;
+            for (int i = c + 1; i < 4; ++i)
+            {
+                if (std::fabs(a[i][c]) > std::fabs(a[pivot][c]))
+                {
+                    pivot = i;
+                }
+            }
+            if (a[pivot][c] == 0.0)
+            {
+                det = 0.0;
+                break;
+            }
+            if (pivot != c)
+            {
+                for (int j = 0; j < 8; ++j)
+                {
+                    std::swap(a[c][j], a[pivot][j]);
+                }
+                det = -det;
+            }
+            det *= a[c][c];
+            double scale = 1.0 / a[c][c];
+            for (int j = 0; j < 8; ++j)
+            {
+                a[c][j] *= scale;
+            }
+            for (int i = 0; i < 4; ++i)
+            {
+                if (i != c && a[i][c] != 0.0)
+                {
+                    double factor = a[i][c];
+                    for (int j = 0; j < 8; ++j)
+                    {
+                        a[i][j] -= factor * a[c][j];
+                    }
+                }
+            }
+        }
+
+        for (int i = 0; i < 4; ++i)
+        {
+            for (int j = 0; j < 4; ++j)
+            {
+                (&f._11)[4 * i + j] = (float)a[i][4 + j];
+            }
+        }
+        if (determinant != nullptr)
+        {
+            *determinant = _mm_set1_ps((float)det);
+        }
+        return XMLoadFloat4x4(&f);
+    }
+
+    inline XMMATRIX XMMatrixLookAtLH(FXMVECTOR eye, FXMVECTOR focus, FXMVECTOR up)
+    {
+        XMVECTOR zAxis = XMVector3Normalize(_mm_sub_ps(focus, eye));
+        XMVECTOR xAxis = XMVector3Normalize(XMVector3Cross(up, zAxis));
+        XMVECTOR yAxis = XMVector3Cross(zAxis, xAxis);
+
+        XMFLOAT3 x, y, z;
+        XMStoreFloat3(&x, xAxis);
+        XMStoreFloat3(&y, yAxis);
+        XMStoreFloat3(&z, zAxis);
+        XMMATRIX m;
+        m.r[0] = XMVectorSet(x.x, y.x, z.x, 0.0f);
+        m.r[1] = XMVectorSet(x.y, y.y, z.y, 0.0f);
+        m.r[2] = XMVectorSet(x.z, y.z, z.z, 0.0f);
+        m.r[3] = XMVectorSet(-ShimDetail::Dot3(xAxis, eye), -ShimDetail::Dot3(yAxis, eye), -ShimDetail::Dot3(zAxis, eye), 1.0f);
+        return m;
+    }
+
+    inline XMMATRIX XMMatrixPerspectiveFovLH(float fovAngleY, float aspectRatio, float nearZ, float farZ)
+    {
+        float height = 1.0f / tanf(0.5f * fovAngleY);
+        float width = height / aspectRatio;
+        float range = farZ / (farZ - nearZ);
+        XMMATRIX m;
+        m.r[0] = XMVectorSet(width, 0.0f, 0.0f, 0.0f);
+        m.r[1] = XMVectorSet(0.0f, height, 0.0f, 0.0f);
+        m.r[2] = XMVectorSet(0.0f, 0.0f, range, 1.0f);
+        m.r[3] = XMVectorSet(0.0f, 0.0f, -range * nearZ, 0.0f);
+        return m;
+    }
+
+    // (x, y, z, 1) * M, divided through by w.
+    inline XMVECTOR XMVector3TransformCoord(FXMVECTOR v, FXMMATRIX m)
+    {
+        alignas(16) float f[4];
+        _mm_store_ps(f, v);
+        XMVECTOR result = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(f[0]), m.r[0]), _mm_mul_ps(_mm_set1_ps(f[1]), m.r[1])),
+            _mm_add_ps(_mm_mul_ps(_mm_set1_ps(f[2]), m.r[2]), m.r[3]));
+        _mm_store_ps(f, result);
+        return _mm_div_ps(result, _mm_set1_ps(f[3]));
+    }
+}
@@ -0,0 +1,202 @@
+// The Win32 file calls FileUtil and HeightTiles make, on top of POSIX, so
+// the file formats can be round-tripped in the headless tests.
+//
+// A file or mapping HANDLE points to a ShimFile holding a descriptor. Wide
+// paths are narrowed character by character, which is enough for the ASCII
+// temporary paths the tests use.
+#pragma once
+#include <fcntl.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef std::int64_t LONGLONG;
+typedef const WCHAR* LPCWSTR;
+
+struct LARGE_INTEGER
+{
+    LONGLONG QuadPart;
+};
+
+struct OVERLAPPED;
+struct SECURITY_ATTRIBUTES;
+
+struct SYSTEM_INFO
+{
+    DWORD dwPageSize;
+    DWORD dwAllocationGranularity;
+};
+
+#define INVALID_HANDLE_VALUE ((HANDLE)(std::intptr_t)-1)
+
+#define GENERIC_READ 0x80000000u
+#define GENERIC_WRITE 0x40000000u
+#define FILE_SHARE_READ 0x1u
+#define CREATE_ALWAYS 2u
+#define OPEN_EXISTING 3u
+#define FILE_ATTRIBUTE_NORMAL 0x80u
+#define FILE_FLAG_RANDOM_ACCESS 0x10000000u
+#define FILE_FLAG_SEQUENTIAL_SCAN 0x08000000u
+#define FILE_BEGIN 0u
+#define MOVEFILE_REPLACE_EXISTING 0x1u
+#define PAGE_READONLY 0x02u
+#define FILE_MAP_READ 0x4u
+
+namespace shim
+{
+    struct ShimFile
+    {
+        int Descriptor;
+    };
+
+    inline std::string NarrowPath(LPCWSTR path)
+    {
+        std::string narrow;
+        for (; *path != L'\0'; ++path)
+        {
+            narrow.push_back((char)*path);
+        }
+        return narrow;
+    }
+
+    inline int Descriptor(HANDLE handle)
+    {
+        return static_cast<ShimFile*>(handle)->Descriptor;
+    }
+
+    // Views are unmapped by address alone, so their sizes are kept here.
+    inline std::mutex& ViewMutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    inline std::map<const void*, size_t>& ViewSizes()
+    {
+        static std::map<const void*, size_t> sizes;
+        return sizes;
+    }
+}
+
+inline HANDLE CreateFile(LPCWSTR fileName, DWORD access, DWORD, SECURITY_ATTRIBUTES*, DWORD disposition, DWORD, HANDLE)
+{
+    int flags = (access & GENERIC_WRITE) ? ((access & GENERIC_READ) ? O_RDWR : O_WRONLY) : O_RDONLY;
+    if (disposition == CREATE_ALWAYS)
+    {
+        flags |= O_CREAT | O_TRUNC;
+    }
+    int descriptor = open(shim::NarrowPath(fileName).c_str(), flags, 0644);
+    if (descriptor < 0)
+    {
+        return INVALID_HANDLE_VALUE;
+    }
+    return new shim::ShimFile{ descriptor };
+}
+
+inline BOOL CloseHandle(HANDLE handle)
+{
+    shim::ShimFile* file = static_cast<shim::ShimFile*>(handle);
+    BOOL ok = close(file->Descriptor) == 0;
+    delete file;
+    return ok;
+}
+
+inline BOOL GetFileSizeEx(HANDLE file, LARGE_INTEGER* size)
+{
+    struct stat status;
+    if (fstat(shim::Descriptor(file), &status) != 0)
+    {
+        return 0;
+    }
+    size->QuadPart = (LONGLONG)status.st_size;
+    return 1;
+}
+
+inline BOOL ReadFile(HANDLE file, void* buffer, DWORD byteCount, DWORD* bytesRead, OVERLAPPED*)
+{
+    ssize_t result = read(shim::Descriptor(file), buffer, byteCount);
+    *bytesRead = result > 0 ? (DWORD)result : 0;
+    return result >= 0;
+}
+
+inline BOOL WriteFile(HANDLE file, const void* buffer, DWORD byteCount, DWORD* bytesWritten, OVERLAPPED*)
+{
+    ssize_t result = write(shim::Descriptor(file), buffer, byteCount);
+    *bytesWritten = result > 0 ? (DWORD)result : 0;
+    return result >= 0;
+}
+
+inline BOOL SetFilePointerEx(HANDLE file, LARGE_INTEGER distance, LARGE_INTEGER* newPosition, DWORD method)
+{
+    off_t position = lseek(shim::Descriptor(file), (off_t)distance.QuadPart, method == FILE_BEGIN ? SEEK_SET : SEEK_CUR);
+    if (position < 0)
+    {
+        return 0;
+    }
+    if (newPosition != nullptr)
+    {
+        newPosition->QuadPart = (LONGLONG)position;
+    }
+    return 1;
+}
+
+inline BOOL MoveFileEx(LPCWSTR existingName, LPCWSTR newName, DWORD)
+{
+    return rename(shim::NarrowPath(existingName).c_str(), shim::NarrowPath(newName).c_str()) == 0;
+}
+
+inline BOOL DeleteFile(LPCWSTR fileName)
+{
+    return unlink(shim::NarrowPath(fileName).c_str()) == 0;
+}
+
+// The mapping keeps its own descriptor, as a Win32 mapping outlives the file
+// handle it was made from.
+inline HANDLE CreateFileMapping(HANDLE file, SECURITY_ATTRIBUTES*, DWORD, DWORD, DWORD, LPCWSTR)
+{
+    int descriptor = dup(shim::Descriptor(file));
+    if (descriptor < 0)
+    {
+        return nullptr;
+    }
+    return new shim::ShimFile{ descriptor };
+}
+
+inline void* MapViewOfFile(HANDLE mapping, DWORD, DWORD offsetHigh, DWORD offsetLow, SIZE_T byteSize)
+{
+    off_t offset = (off_t)(((std::uint64_t)offsetHigh << 32) | offsetLow);
+    void* view = mmap(nullptr, byteSize, PROT_READ, MAP_PRIVATE, shim::Descriptor(mapping), offset);
+    if (view == MAP_FAILED)
+    {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(shim::ViewMutex());
+    shim::ViewSizes()[view] = byteSize;
+    return view;
+}
+
+inline BOOL UnmapViewOfFile(const void* view)
+{
+    size_t byteSize = 0;
+    {
+        std::lock_guard<std::mutex> lock(shim::ViewMutex());
+        auto it = shim::ViewSizes().find(view);
+        if (it == shim::ViewSizes().end())
+        {
+            return 0;
+        }
+        byteSize = it->second;
+        shim::ViewSizes().erase(it);
+    }
+    return munmap(const_cast<void*>(view), byteSize) == 0;
+}
+
+// 64 KB, as on Windows; a multiple of the page size on any host.
+inline void GetSystemInfo(SYSTEM_INFO* info)
+{
+    info->dwPageSize = (DWORD)sysconf(_SC_PAGESIZE);
+    info->dwAllocationGranularity = 65536;
+}
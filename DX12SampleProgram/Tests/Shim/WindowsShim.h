@@ -0,0 +1,392 @@
+// What stdafx.h takes from the Windows SDK, for the headless test builds off
+// Windows.
+//
+// Only types are provided: the Win32 integer types, the D3D12 enums and
+// descriptor structs the allocators and backends work with, the d3dx12
+// transition helper, and the COM interfaces as opaque, reference-counted
+// classes with the few methods headers call inline or tests mock. Nothing here talks to a GPU; code that does stays
+// behind _WIN32, and the tests drive the mock backends instead. The file
+// calls, which the tests can serve for real, are in Win32FileShim.h.
+#pragma once
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <emmintrin.h>
+#include <memory>
+#include <string>
+#include "DirectXMath.h"
+
+typedef std::uint8_t BYTE;
+typedef std::int32_t INT;
+typedef std::uint32_t UINT;
+typedef std::uint32_t UINT32;
+typedef std::int32_t LONG;
+typedef std::uint32_t ULONG;
+typedef std::uint32_t DWORD;
+typedef std::int64_t INT64;
+typedef std::uint64_t UINT64;
+typedef std::uint64_t SIZE_T;
+typedef std::int32_t BOOL;
+typedef wchar_t WCHAR;
+typedef void* HANDLE;
+typedef std::int32_t HRESULT;
+
+#define S_OK ((HRESULT)0)
+#define E_FAIL ((HRESULT)0x80004005L)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000EL)
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+#define INFINITE 0xFFFFFFFFu
+#define CP_ACP 0
+
+#define _Out_writes_(size)
+
+inline int MultiByteToWideChar(UINT, DWORD, const char* src, int, WCHAR* dst, int dstCount)
+{
+    int i = 0;
+    for (; src[i] != '\0' && i < dstCount - 1; ++i)
+    {
+        dst[i] = (WCHAR)(unsigned char)src[i];
+    }
+    dst[i] = L'\0';
+    return i + 1;
+}
+
+inline void YieldProcessor()
+{
+    _mm_pause();
+}
+
+enum DXGI_FORMAT
+{
+    DXGI_FORMAT_UNKNOWN = 0,
+    DXGI_FORMAT_R32G32B32A32_FLOAT = 2,
+    DXGI_FORMAT_R32G32B32_FLOAT = 6,
+    DXGI_FORMAT_R16G16B16A16_UNORM = 11,
+    DXGI_FORMAT_R32G32_FLOAT = 16,
+    DXGI_FORMAT_R10G10B10A2_UNORM = 24,
+    DXGI_FORMAT_R8G8B8A8_UNORM = 28,
+    DXGI_FORMAT_R16G16_FLOAT = 34,
+    DXGI_FORMAT_R16G16_UNORM = 35,
+    DXGI_FORMAT_R16G16_SNORM = 37,
+    DXGI_FORMAT_R32_FLOAT = 41,
+    DXGI_FORMAT_R32_UINT = 42,
+    DXGI_FORMAT_R8G8_UNORM = 49,
+    DXGI_FORMAT_R8G8_SNORM = 51,
+    DXGI_FORMAT_R16_UINT = 57,
+    DXGI_FORMAT_R8_UINT = 62,
+};
+
+typedef UINT64 D3D12_GPU_VIRTUAL_ADDRESS;
+
+#define D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT 4096
+#define D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT 65536
+#define D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT 4194304
+#define D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT 256
+#define D3D12_TEXTURE_DATA_PITCH_ALIGNMENT 256
+#define D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT 512
+
+enum D3D12_HEAP_TYPE
+{
+    D3D12_HEAP_TYPE_DEFAULT = 1,
+    D3D12_HEAP_TYPE_UPLOAD = 2,
+    D3D12_HEAP_TYPE_READBACK = 3,
+    D3D12_HEAP_TYPE_CUSTOM = 4,
+};
+
+enum D3D12_HEAP_FLAGS
+{
+    D3D12_HEAP_FLAG_NONE = 0,
+    D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS = 0xc0,
+    D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES = 0x44,
+    D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES = 0x84,
+};
+
+enum D3D12_RESOURCE_STATES
+{
+    D3D12_RESOURCE_STATE_COMMON = 0,
+    D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER = 0x1,
+    D3D12_RESOURCE_STATE_INDEX_BUFFER = 0x2,
+    D3D12_RESOURCE_STATE_RENDER_TARGET = 0x4,
+    D3D12_RESOURCE_STATE_UNORDERED_ACCESS = 0x8,
+    D3D12_RESOURCE_STATE_DEPTH_WRITE = 0x10,
+    D3D12_RESOURCE_STATE_DEPTH_READ = 0x20,
+    D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE = 0x40,
+    D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE = 0x80,
+    D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT = 0x200,
+    D3D12_RESOURCE_STATE_COPY_DEST = 0x400,
+    D3D12_RESOURCE_STATE_COPY_SOURCE = 0x800,
+    D3D12_RESOURCE_STATE_RESOLVE_SOURCE = 0x2000,
+    D3D12_RESOURCE_STATE_GENERIC_READ = 0xac3,
+    D3D12_RESOURCE_STATE_PRESENT = 0,
+};
+
+inline D3D12_RESOURCE_STATES operator|(D3D12_RESOURCE_STATES a, D3D12_RESOURCE_STATES b)
+{
+    return (D3D12_RESOURCE_STATES)((int)a | (int)b);
+}
+
+inline D3D12_RESOURCE_STATES operator&(D3D12_RESOURCE_STATES a, D3D12_RESOURCE_STATES b)
+{
+    return (D3D12_RESOURCE_STATES)((int)a & (int)b);
+}
+
+inline D3D12_RESOURCE_STATES operator~(D3D12_RESOURCE_STATES a)
+{
+    return (D3D12_RESOURCE_STATES)~(int)a;
+}
+
+struct D3D12_HEAP_PROPERTIES
+{
+    D3D12_HEAP_TYPE Type;
+    UINT CPUPageProperty;
+    UINT MemoryPoolPreference;
+    UINT CreationNodeMask;
+    UINT VisibleNodeMask;
+};
+
+struct D3D12_HEAP_DESC
+{
+    UINT64 SizeInBytes;
+    D3D12_HEAP_PROPERTIES Properties;
+    UINT64 Alignment;
+    D3D12_HEAP_FLAGS Flags;
+};
+
+enum D3D12_DESCRIPTOR_HEAP_TYPE
+{
+    D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV = 0,
+    D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER,
+    D3D12_DESCRIPTOR_HEAP_TYPE_RTV,
+    D3D12_DESCRIPTOR_HEAP_TYPE_DSV,
+    D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES,
+};
+
+enum D3D12_DESCRIPTOR_HEAP_FLAGS
+{
+    D3D12_DESCRIPTOR_HEAP_FLAG_NONE = 0,
+    D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE = 0x1,
+};
+
+struct D3D12_DESCRIPTOR_HEAP_DESC
+{
+    D3D12_DESCRIPTOR_HEAP_TYPE Type;
+    UINT NumDescriptors;
+    D3D12_DESCRIPTOR_HEAP_FLAGS Flags;
+    UINT NodeMask;
+};
+
+struct D3D12_CPU_DESCRIPTOR_HANDLE
+{
+    SIZE_T ptr;
+};
+
+struct D3D12_GPU_DESCRIPTOR_HANDLE
+{
+    UINT64 ptr;
+};
+
+struct D3D12_VERTEX_BUFFER_VIEW
+{
+    D3D12_GPU_VIRTUAL_ADDRESS BufferLocation;
+    UINT SizeInBytes;
+    UINT StrideInBytes;
+};
+
+struct D3D12_INDEX_BUFFER_VIEW
+{
+    D3D12_GPU_VIRTUAL_ADDRESS BufferLocation;
+    UINT SizeInBytes;
+    DXGI_FORMAT Format;
+};
+
+struct D3D12_SUBRESOURCE_DATA
+{
+    const void* pData;
+    INT64 RowPitch;
+    INT64 SlicePitch;
+};
+
+struct D3D12_SUBRESOURCE_FOOTPRINT
+{
+    DXGI_FORMAT Format;
+    UINT Width;
+    UINT Height;
+    UINT Depth;
+    UINT RowPitch;
+};
+
+struct D3D12_PLACED_SUBRESOURCE_FOOTPRINT
+{
+    UINT64 Offset;
+    D3D12_SUBRESOURCE_FOOTPRINT Footprint;
+};
+
+enum D3D12_RESOURCE_DIMENSION
+{
+    D3D12_RESOURCE_DIMENSION_UNKNOWN = 0,
+    D3D12_RESOURCE_DIMENSION_BUFFER = 1,
+    D3D12_RESOURCE_DIMENSION_TEXTURE1D = 2,
+    D3D12_RESOURCE_DIMENSION_TEXTURE2D = 3,
+    D3D12_RESOURCE_DIMENSION_TEXTURE3D = 4,
+};
+
+struct D3D12_RESOURCE_DESC
+{
+    D3D12_RESOURCE_DIMENSION Dimension;
+    UINT64 Alignment;
+    UINT64 Width;
+    UINT Height;
+    std::uint16_t DepthOrArraySize;
+    std::uint16_t MipLevels;
+    DXGI_FORMAT Format;
+};
+
+struct D3D12_RESOURCE_TRANSITION_BARRIER
+{
+    struct ID3D12Resource* pResource;
+    UINT Subresource;
+    D3D12_RESOURCE_STATES StateBefore;
+    D3D12_RESOURCE_STATES StateAfter;
+};
+
+#define D3D12_RESOURCE_BARRIER_TYPE_TRANSITION 0u
+#define D3D12_RESOURCE_BARRIER_FLAG_NONE 0u
+#define D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES 0xffffffffu
+
+struct D3D12_RESOURCE_BARRIER
+{
+    UINT Type;
+    UINT Flags;
+    D3D12_RESOURCE_TRANSITION_BARRIER Transition;
+};
+
+// From d3dx12.h, transitions only.
+struct CD3DX12_RESOURCE_BARRIER : D3D12_RESOURCE_BARRIER
+{
+    static CD3DX12_RESOURCE_BARRIER Transition(struct ID3D12Resource* resource,
+        D3D12_RESOURCE_STATES stateBefore, D3D12_RESOURCE_STATES stateAfter,
+        UINT subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, UINT flags = D3D12_RESOURCE_BARRIER_FLAG_NONE)
+    {
+        // Through the base, as Transition names this function here.
+        CD3DX12_RESOURCE_BARRIER result;
+        D3D12_RESOURCE_BARRIER& barrier = result;
+        barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+        barrier.Flags = flags;
+        barrier.Transition.pResource = resource;
+        barrier.Transition.Subresource = subresource;
+        barrier.Transition.StateBefore = stateBefore;
+        barrier.Transition.StateAfter = stateAfter;
+        return result;
+    }
+};
+
+// COM interfaces: reference counting only, plus the methods headers call.
+struct IUnknown
+{
+    virtual ~IUnknown() = default;
+    virtual ULONG AddRef() = 0;
+    virtual ULONG Release() = 0;
+};
+
+struct ID3DBlob : IUnknown
+{
+    virtual void* GetBufferPointer() = 0;
+    virtual SIZE_T GetBufferSize() = 0;
+};
+
+struct ID3D12Resource : IUnknown
+{
+    virtual D3D12_GPU_VIRTUAL_ADDRESS GetGPUVirtualAddress() = 0;
+};
+
+struct ID3D12Heap : IUnknown {};
+struct ID3D12DescriptorHeap : IUnknown {};
+struct ID3D12CommandAllocator : IUnknown {};
+struct ID3D12CommandList : IUnknown {};
+struct ID3D12GraphicsCommandList : ID3D12CommandList
+{
+    virtual void ResourceBarrier(UINT count, const D3D12_RESOURCE_BARRIER* barriers) = 0;
+};
+struct ID3D12CommandQueue : IUnknown {};
+struct ID3D12PipelineState : IUnknown {};
+struct ID3D12RootSignature : IUnknown {};
+struct ID3D12Device : IUnknown {};
+
+struct ID3D12Fence : IUnknown
+{
+    virtual UINT64 GetCompletedValue() = 0;
+};
+
+namespace Microsoft
+{
+    namespace WRL
+    {
+        template<typename T>
+        class ComPtr
+        {
+        public:
+            ComPtr() = default;
+            ComPtr(std::nullptr_t) {}
+            ComPtr(T* p) : m_ptr(p) { AddRef(); }
+            ComPtr(const ComPtr& rhs) : m_ptr(rhs.m_ptr) { AddRef(); }
+            ComPtr(ComPtr&& rhs) : m_ptr(rhs.m_ptr) { rhs.m_ptr = nullptr; }
+            ~ComPtr() { Reset(); }
+
+            ComPtr& operator=(const ComPtr& rhs)
+            {
+                ComPtr(rhs).Swap(*this);
+                return *this;
+            }
+
+            ComPtr& operator=(ComPtr&& rhs)
+            {
+                ComPtr(std::move(rhs)).Swap(*this);
+                return *this;
+            }
+
+            ComPtr& operator=(std::nullptr_t)
+            {
+                Reset();
+                return *this;
+            }
+
+            T* Get()const { return m_ptr; }
+            T* operator->()const { return m_ptr; }
+            T** GetAddressOf() { return &m_ptr; }
+            T** operator&() { Reset(); return &m_ptr; }
+            explicit operator bool()const { return m_ptr != nullptr; }
+
+            bool operator==(std::nullptr_t)const { return m_ptr == nullptr; }
+            bool operator!=(std::nullptr_t)const { return m_ptr != nullptr; }
+
+            void Reset()
+            {
+                if (m_ptr != nullptr)
+                {
+                    T* p = m_ptr;
+                    m_ptr = nullptr;
+                    p->Release();
+                }
+            }
+
+            void Swap(ComPtr& rhs) { std::swap(m_ptr, rhs.m_ptr); }
+
+        private:
+            void AddRef()
+            {
+                if (m_ptr != nullptr)
+                {
+                    m_ptr->AddRef();
+                }
+            }
+
+            T* m_ptr = nullptr;
+        };
+    }
+}
+
+#include "Win32FileShim.h"
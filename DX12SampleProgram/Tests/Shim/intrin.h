@@ -0,0 +1,22 @@
+// MSVC bit-scan intrinsics on top of the GCC and Clang builtins.
+#pragma once
+
+inline unsigned char _BitScanReverse64(unsigned long* index, unsigned long long mask)
+{
+    if (mask == 0)
+    {
+        return 0;
+    }
+    *index = 63 - __builtin_clzll(mask);
+    return 1;
+}
+
+inline unsigned char _BitScanForward64(unsigned long* index, unsigned long long mask)
+{
+    if (mask == 0)
+    {
+        return 0;
+    }
+    *index = __builtin_ctzll(mask);
+    return 1;
+}
@@ -0,0 +1,106 @@
+// Stand-ins for the Parallel Patterns Library. By default tasks run inline
+// on the calling thread, in order, which keeps the tests deterministic.
+// Tests of code that must not depend on scheduling can set a Schedule to
+// run parallel_for iterations shuffled and on several threads.
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace concurrency
+{
+    namespace shim
+    {
+        struct Schedule
+        {
+            // Iterations run in an order shuffled with this seed; 0 keeps
+            // them in order.
+            unsigned Seed = 0;
+
+            // Threads taking iterations off a shared queue.
+            unsigned ThreadCount = 1;
+        };
+
+        inline Schedule& CurrentSchedule()
+        {
+            static Schedule schedule;
+            return schedule;
+        }
+
+        template<typename Index, typename Fn>
+        void Run(std::vector<Index>& iterations, const Fn& fn)
+        {
+            const Schedule& schedule = CurrentSchedule();
+            if (schedule.Seed != 0)
+            {
+                std::shuffle(iterations.begin(), iterations.end(), std::mt19937(schedule.Seed));
+            }
+
+            if (schedule.ThreadCount <= 1)
+            {
+                for (Index i : iterations)
+                {
+                    fn(i);
+                }
+                return;
+            }
+
+            std::atomic<size_t> next(0);
+            std::vector<std::thread> threads;
+            for (unsigned t = 0; t < schedule.ThreadCount; ++t)
+            {
+                threads.emplace_back([&]()
+                {
+                    for (size_t k = next++; k < iterations.size(); k = next++)
+                    {
+                        fn(iterations[k]);
+                    }
+                });
+            }
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+        }
+    }
+
+    template<typename Index, typename Fn>
+    void parallel_for(Index first, Index last, Index step, const Fn& fn)
+    {
+        std::vector<Index> iterations;
+        for (Index i = first; i < last; i += step)
+        {
+            iterations.push_back(i);
+        }
+        shim::Run(iterations, fn);
+    }
+
+    template<typename Index, typename Fn>
+    void parallel_for(Index first, Index last, const Fn& fn)
+    {
+        parallel_for(first, last, Index(1), fn);
+    }
+
+    template<typename Iterator>
+    void parallel_sort(Iterator first, Iterator last)
+    {
+        std::sort(first, last);
+    }
+
+    template<typename Iterator, typename Compare>
+    void parallel_sort(Iterator first, Iterator last, const Compare& compare)
+    {
+        std::sort(first, last, compare);
+    }
+
+    class task_group
+    {
+    public:
+        template<typename Fn>
+        void run(const Fn& fn) { fn(); }
+
+        void wait() {}
+    };
+}
@@ -0,0 +1,256 @@
+#include "stdafx.h"
+#include "StreamingUploader.h"
+#include <gtest/gtest.h>
+
+namespace
+{
+    const UINT64 KB = 1024;
+
+    // The uploader only hands destinations on to the backend, so any
+    // distinct pointer will do.
+    ID3D12Resource* FakeResource(UINT id)
+    {
+        return reinterpret_cast<ID3D12Resource*>((uintptr_t)(id + 1) * 64);
+    }
+
+    std::vector<BYTE> Pattern(UINT64 size, BYTE seed)
+    {
+        std::vector<BYTE> data((size_t)size);
+        for (size_t i = 0; i < data.size(); ++i)
+        {
+            data[i] = (BYTE)(seed + i * 7);
+        }
+        return data;
+    }
+
+    StreamingUploaderDesc Budget(UINT64 maxBytesPerFrame)
+    {
+        StreamingUploaderDesc desc;
+        desc.MaxBytesPerFrame = maxBytesPerFrame;
+        return desc;
+    }
+}
+
+TEST(StreamingUploader, HigherPrioritiesStreamFirst)
+{
+    NullStreamingBackend backend(256 * KB);
+    StreamingUploader uploader(backend);
+
+    uploader.RequestBuffer(FakeResource(0), 0, Pattern(KB, 0), 0);
+    uploader.RequestBuffer(FakeResource(1), 0, Pattern(KB, 1), 5);
+    uploader.RequestBuffer(FakeResource(2), 0, Pattern(KB, 2), 5);
+    uploader.RequestBuffer(FakeResource(3), 0, Pattern(KB, 3), -1);
+    uploader.Update();
+
+    // Equal priorities keep their request order.
+    const std::vector<NullStreamingBackend::Copy>& copies = backend.GetCopies();
+    ASSERT_EQ(4u, copies.size());
+    EXPECT_EQ(FakeResource(1), copies[0].Dest);
+    EXPECT_EQ(FakeResource(2), copies[1].Dest);
+    EXPECT_EQ(FakeResource(0), copies[2].Dest);
+    EXPECT_EQ(FakeResource(3), copies[3].Dest);
+
+    // All in one submission.
+    EXPECT_EQ(1u, backend.GetSubmittedFence());
+    for (const NullStreamingBackend::Copy& copy : copies)
+    {
+        EXPECT_EQ(1u, copy.Fence);
+    }
+}
+
+TEST(StreamingUploader, SplitsBuffersAcrossFrames)
+{
+    NullStreamingBackend backend(256 * KB);
+    StreamingUploader uploader(backend, Budget(64 * KB));
+
+    const std::vector<BYTE> data = Pattern(160 * KB, 9);
+    bool completed = false;
+    uploader.RequestBuffer(FakeResource(0), 4 * KB, std::vector<BYTE>(data), 0, [&completed]() { completed = true; });
+
+    // A budget's worth a frame, each piece staged as it is copied.
+    const UINT64 pieces[] = { 64 * KB, 64 * KB, 32 * KB };
+    UINT64 offset = 0;
+    for (UINT frame = 0; frame < 3; ++frame)
+    {
+        uploader.Update();
+        ASSERT_EQ(frame + 1, backend.GetCopies().size());
+
+        const NullStreamingBackend::Copy& copy = backend.GetCopies().back();
+        EXPECT_EQ(4 * KB + offset, copy.DestOffset);
+        EXPECT_EQ(pieces[frame], copy.ByteSize);
+        EXPECT_EQ(frame + 1, copy.Fence);
+        EXPECT_EQ(0, memcmp(backend.GetStagingData() + copy.StagingOffset, data.data() + offset,
+            (size_t)copy.ByteSize));
+        offset += copy.ByteSize;
+    }
+    EXPECT_EQ(160 * KB, uploader.GetStats().BytesStreamed);
+    EXPECT_EQ(3u, uploader.GetStats().Submissions);
+
+    // The callback waits for the fence of the last piece.
+    backend.Complete(2);
+    uploader.Update();
+    EXPECT_FALSE(completed);
+    EXPECT_FALSE(uploader.IsIdle());
+
+    backend.Complete(3);
+    uploader.Update();
+    EXPECT_TRUE(completed);
+    EXPECT_TRUE(uploader.IsIdle());
+    EXPECT_EQ(0u, uploader.GetStats().StagingBytesInFlight);
+}
+
+TEST(StreamingUploader, StagingWrapsAroundTheRing)
+{
+    NullStreamingBackend backend(256 * KB);
+    StreamingUploader uploader(backend, Budget(256 * KB));
+
+    uploader.RequestBuffer(FakeResource(0), 0, Pattern(100 * KB, 0));
+    uploader.Update();
+    uploader.RequestBuffer(FakeResource(1), 0, Pattern(100 * KB, 1));
+    uploader.Update();
+    ASSERT_EQ(2u, backend.GetCopies().size());
+    EXPECT_EQ(0u, backend.GetCopies()[0].StagingOffset);
+    EXPECT_EQ(100 * KB, backend.GetCopies()[1].StagingOffset);
+
+    // Only the first 100KB are free again. The 56KB before the end is too
+    // short a piece, so the next request starts over at 0 in one piece and
+    // the end of the ring is held as padding.
+    backend.Complete(1);
+    const std::vector<BYTE> data = Pattern(100 * KB, 2);
+    uploader.RequestBuffer(FakeResource(2), 0, std::vector<BYTE>(data));
+    uploader.Update();
+
+    ASSERT_EQ(3u, backend.GetCopies().size());
+    const NullStreamingBackend::Copy& copy = backend.GetCopies().back();
+    EXPECT_EQ(0u, copy.StagingOffset);
+    EXPECT_EQ(100 * KB, copy.ByteSize);
+    EXPECT_EQ(0, memcmp(backend.GetStagingData(), data.data(), data.size()));
+    EXPECT_EQ(256 * KB, uploader.GetStats().StagingBytesInFlight);
+
+    // With the ring full, nothing more is staged until a fence passes.
+    uploader.RequestBuffer(FakeResource(3), 0, Pattern(KB, 3));
+    uploader.Update();
+    EXPECT_EQ(3u, backend.GetCopies().size());
+    EXPECT_EQ(1u, uploader.GetStats().PendingRequests);
+
+    backend.Complete(2);
+    uploader.Update();
+    ASSERT_EQ(4u, backend.GetCopies().size());
+    EXPECT_EQ(100 * KB, backend.GetCopies().back().StagingOffset);
+}
+
+TEST(StreamingUploader, TexturesWaitForContiguousSpace)
+{
+    NullStreamingBackend backend(64 * KB);
+    StreamingUploader uploader(backend, Budget(64 * KB));
+
+    // 64 rows pitched to 256 bytes take 16KB of staging each.
+    const UINT64 textureBytes = backend.TextureRowCount * backend.TextureRowSize;
+    uploader.RequestBuffer(FakeResource(0), 0, Pattern(40 * KB, 0));
+    uploader.Update();
+    uploader.RequestTexture(FakeResource(1), 0, Pattern(textureBytes, 1), backend.TextureRowSize, textureBytes);
+    uploader.Update();
+    ASSERT_EQ(2u, backend.GetCopies().size());
+    EXPECT_EQ(40 * KB, backend.GetCopies()[1].StagingOffset);
+
+    // 8KB left at the end, so the next texture has to wait for the front.
+    uploader.RequestTexture(FakeResource(2), 0, Pattern(textureBytes, 2), backend.TextureRowSize, textureBytes);
+    uploader.Update();
+    EXPECT_EQ(2u, backend.GetCopies().size());
+
+    backend.Complete(1);
+    uploader.Update();
+    ASSERT_EQ(3u, backend.GetCopies().size());
+    EXPECT_TRUE(backend.GetCopies()[2].IsTexture);
+    EXPECT_EQ(0u, backend.GetCopies()[2].StagingOffset);
+    EXPECT_EQ(0u, backend.GetCopies()[2].StagingOffset % D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+}
+
+TEST(StreamingUploader, CancelledRequestsLeaveStaleQueueEntries)
+{
+    NullStreamingBackend backend(256 * KB);
+    StreamingUploader uploader(backend);
+
+    StreamingUploader::Handle first = uploader.RequestBuffer(FakeResource(0), 0, Pattern(KB, 0), 0);
+    StreamingUploader::Handle cancelled = uploader.RequestBuffer(FakeResource(1), 0, Pattern(KB, 1), 9);
+    EXPECT_TRUE(uploader.Cancel(cancelled));
+    EXPECT_FALSE(uploader.Cancel(cancelled));
+
+    // The new request takes the cancelled one's handle while the old queue
+    // entry, with its higher priority, is still in the heap.
+    StreamingUploader::Handle reused = uploader.RequestBuffer(FakeResource(2), 0, Pattern(KB, 2), -3);
+    EXPECT_EQ(cancelled, reused);
+    EXPECT_EQ(2u, uploader.GetStats().PendingRequests);
+
+    uploader.Update();
+    const std::vector<NullStreamingBackend::Copy>& copies = backend.GetCopies();
+    ASSERT_EQ(2u, copies.size());
+    EXPECT_EQ(FakeResource(0), copies[0].Dest);
+    EXPECT_EQ(FakeResource(2), copies[1].Dest);
+
+    // Nothing can be cancelled once streaming has started.
+    EXPECT_FALSE(uploader.Cancel(first));
+
+    backend.CompleteAll();
+    uploader.Update();
+    EXPECT_TRUE(uploader.IsIdle());
+    EXPECT_EQ(2u, uploader.GetStats().RequestsCompleted);
+}
+
+TEST(StreamingUploader, EmptyRequestsCompleteWithoutACopy)
+{
+    NullStreamingBackend backend(256 * KB);
+    StreamingUploader uploader(backend);
+
+    bool completed = false;
+    uploader.RequestBuffer(FakeResource(0), 0, std::vector<BYTE>(), 0, [&completed]() { completed = true; });
+    uploader.Update();
+    EXPECT_TRUE(backend.GetCopies().empty());
+    EXPECT_EQ(0u, backend.GetSubmittedFence());
+    uploader.Update();
+    EXPECT_TRUE(completed);
+    EXPECT_TRUE(uploader.IsIdle());
+
+    // Behind other copies, it completes with them.
+    uploader.RequestBuffer(FakeResource(1), 0, Pattern(KB, 1));
+    uploader.Update();
+    completed = false;
+    uploader.RequestBuffer(FakeResource(0), 0, std::vector<BYTE>(), 0, [&completed]() { completed = true; });
+    uploader.Update();
+    uploader.Update();
+    EXPECT_EQ(1u, backend.GetCopies().size());
+    EXPECT_EQ(1u, backend.GetSubmittedFence());
+    EXPECT_FALSE(completed);
+
+    backend.Complete(1);
+    uploader.Update();
+    EXPECT_TRUE(completed);
+    EXPECT_TRUE(uploader.IsIdle());
+}
+
+TEST(StreamingUploader, EmptyRequestsWaitForCopiesStagedTheSameFrame)
+{
+    NullStreamingBackend backend(256 * KB);
+    StreamingUploader uploader(backend);
+
+    // Staged in the same Update as the copy ahead of it, so it completes
+    // with that copy's fence, not the one before.
+    bool copied = false;
+    bool completed = false;
+    uploader.RequestBuffer(FakeResource(1), 0, Pattern(KB, 1), 5, [&copied]() { copied = true; });
+    uploader.RequestBuffer(FakeResource(0), 0, std::vector<BYTE>(), 0, [&completed]() { completed = true; });
+    uploader.Update();
+    ASSERT_EQ(1u, backend.GetCopies().size());
+    EXPECT_EQ(1u, backend.GetSubmittedFence());
+
+    uploader.Update();
+    EXPECT_FALSE(copied);
+    EXPECT_FALSE(completed);
+    EXPECT_EQ(2u, uploader.GetStats().InFlightRequests);
+
+    backend.Complete(1);
+    uploader.Update();
+    EXPECT_TRUE(copied);
+    EXPECT_TRUE(completed);
+    EXPECT_TRUE(uploader.IsIdle());
+}
@@ -0,0 +1,237 @@
+#include "stdafx.h"
+#include "Subdivision.h"
+#include <gtest/gtest.h>
+
+using DirectX::XMFLOAT3;
+
+namespace
+{
+    typedef GeometryGenerator::Vertex Vertex;
+
+    const float Epsilon = 1.0e-5f;
+
+    Vertex At(float x, float y, float z)
+    {
+        return Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+    }
+
+    // Regular tetrahedron centred on the origin, so the vertices sum to 0.
+    std::vector<Vertex> TetrahedronVertices()
+    {
+        return { At(1.0f, 1.0f, 1.0f), At(1.0f, -1.0f, -1.0f), At(-1.0f, 1.0f, -1.0f), At(-1.0f, -1.0f, 1.0f) };
+    }
+
+    const std::vector<std::uint32_t> TetrahedronTriangles = { 0, 1, 2, 0, 3, 1, 0, 2, 3, 1, 3, 2 };
+
+    // Vertex i of the cube is at -1 or +1 along x, y and z by bits 0, 1 and 2.
+    std::vector<Vertex> CubeVertices()
+    {
+        std::vector<Vertex> vertices;
+        for (int i = 0; i < 8; ++i)
+        {
+            vertices.push_back(At(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f));
+        }
+        return vertices;
+    }
+
+    // Wound outwards.
+    const std::vector<std::uint32_t> CubeQuads = { 0, 4, 6, 2, 1, 3, 7, 5, 0, 1, 5, 4, 2, 6, 7, 3, 0, 2, 3, 1, 4, 5, 7, 6 };
+
+    // A 3x2 grid of points, with uneven columns so the boundary rules do
+    // not cancel out:
+    //   3 - 4 - 5
+    //   |   |   |
+    //   0 - 1 - 2
+    std::vector<Vertex> StripVertices()
+    {
+        return { At(0.0f, 0.0f, 0.0f), At(1.0f, 0.0f, 0.0f), At(3.0f, 0.0f, 0.0f),
+            At(0.0f, 1.0f, 0.0f), At(1.0f, 1.0f, 0.0f), At(3.0f, 1.0f, 0.0f) };
+    }
+
+    void ExpectPosition(const Vertex& v, float x, float y, float z)
+    {
+        EXPECT_NEAR(x, v.Position.x, Epsilon);
+        EXPECT_NEAR(y, v.Position.y, Epsilon);
+        EXPECT_NEAR(z, v.Position.z, Epsilon);
+    }
+
+    // V - E + F, 2 for a closed surface of genus 0 and 1 for a disc.
+    int EulerCharacteristic(const HalfEdgeMesh& mesh)
+    {
+        return (int)mesh.GetVertexCount() - (int)mesh.GetEdgeCount() + (int)mesh.GetFaceCount();
+    }
+}
+
+TEST(Subdivision, LoopRefinesATetrahedron)
+{
+    HalfEdgeMesh mesh(4, TetrahedronTriangles, 3);
+    ASSERT_EQ(6u, mesh.GetEdgeCount());
+
+    HalfEdgeMesh refined;
+    std::vector<Vertex> vertices;
+    LoopSubdivideLevel(mesh, TetrahedronVertices(), refined, vertices);
+
+    // A vertex per old vertex and per edge, four faces per face.
+    EXPECT_EQ(4u + 6u, refined.GetVertexCount());
+    EXPECT_EQ(2u * 6u + 3u * 4u, refined.GetEdgeCount());
+    EXPECT_EQ(4u * 4u, refined.GetFaceCount());
+    EXPECT_EQ(2, EulerCharacteristic(refined));
+    ASSERT_EQ(10u, vertices.size());
+
+    // Valence 3 gives beta = 3/16, so an old vertex moves to
+    // 7/16 v + 3/16 (-v) = v/4. An edge vertex is 3/8 (a + b) + 1/8 (c + d)
+    // = (a + b) / 4.
+    const std::vector<Vertex> original = TetrahedronVertices();
+    for (std::uint32_t v = 0; v < 4; ++v)
+    {
+        const XMFLOAT3& p = original[v].Position;
+        ExpectPosition(vertices[v], p.x / 4.0f, p.y / 4.0f, p.z / 4.0f);
+    }
+    for (std::uint32_t e = 0; e < mesh.GetEdgeCount(); ++e)
+    {
+        std::uint32_t h = mesh.EdgeHalfEdge(e);
+        const XMFLOAT3& a = original[mesh.Origin(h)].Position;
+        const XMFLOAT3& b = original[mesh.Target(h)].Position;
+        ExpectPosition(vertices[4 + e], (a.x + b.x) / 4.0f, (a.y + b.y) / 4.0f, (a.z + b.z) / 4.0f);
+    }
+
+    // The MeshData form, two levels deep.
+    GeometryGenerator::MeshData meshData;
+    meshData.Vertices = TetrahedronVertices();
+    meshData.Indices32 = TetrahedronTriangles;
+    GeometryGenerator::MeshData result = LoopSubdivide(meshData, 2);
+    EXPECT_EQ(34u, result.Vertices.size());
+    EXPECT_EQ(64u * 3u, result.Indices32.size());
+}
+
+TEST(Subdivision, CatmullClarkRefinesACube)
+{
+    HalfEdgeMesh mesh(8, CubeQuads, 4);
+    ASSERT_EQ(12u, mesh.GetEdgeCount());
+    EXPECT_FALSE(mesh.IsBoundaryVertex(0));
+
+    HalfEdgeMesh refined;
+    std::vector<Vertex> vertices;
+    CatmullClarkSubdivideLevel(mesh, CubeVertices(), refined, vertices);
+
+    // A vertex per old vertex, edge and face, four quads per face.
+    EXPECT_EQ(8u + 12u + 6u, refined.GetVertexCount());
+    EXPECT_EQ(2u * 12u + 4u * 6u, refined.GetEdgeCount());
+    EXPECT_EQ(4u * 6u, refined.GetFaceCount());
+    EXPECT_EQ(4u, refined.GetFaceSize());
+    EXPECT_EQ(2, EulerCharacteristic(refined));
+    ASSERT_EQ(26u, vertices.size());
+
+    // Corners move to (Q + 2R) / 3 = 5/9 of the way, edge vertices to 3/4
+    // of their midpoint and face vertices stay at the face centres.
+    const std::vector<Vertex> original = CubeVertices();
+    const float corner = 5.0f / 9.0f;
+    for (std::uint32_t v = 0; v < 8; ++v)
+    {
+        const XMFLOAT3& p = original[v].Position;
+        ExpectPosition(vertices[v], corner * p.x, corner * p.y, corner * p.z);
+    }
+    for (std::uint32_t e = 0; e < 12; ++e)
+    {
+        std::uint32_t h = mesh.EdgeHalfEdge(e);
+        const XMFLOAT3& a = original[mesh.Origin(h)].Position;
+        const XMFLOAT3& b = original[mesh.Target(h)].Position;
+        ExpectPosition(vertices[8 + e], 0.375f * (a.x + b.x), 0.375f * (a.y + b.y), 0.375f * (a.z + b.z));
+    }
+    ExpectPosition(vertices[20], -1.0f, 0.0f, 0.0f);
+
+    // The MeshData form merges triangle pairs back into the quads.
+    GeometryGenerator::MeshData meshData;
+    meshData.Vertices = CubeVertices();
+    for (size_t q = 0; q < CubeQuads.size(); q += 4)
+    {
+        const std::uint32_t* quad = &CubeQuads[q];
+        std::uint32_t pair[] = { quad[0], quad[1], quad[2], quad[0], quad[2], quad[3] };
+        meshData.Indices32.insert(meshData.Indices32.end(), pair, pair + 6);
+    }
+    GeometryGenerator::MeshData result = CatmullClarkSubdivide(meshData, 1);
+    EXPECT_EQ(26u, result.Vertices.size());
+    EXPECT_EQ(24u * 2u * 3u, result.Indices32.size());
+}
+
+TEST(Subdivision, LoopBoundaryRulesOnATriangleStrip)
+{
+    const std::vector<std::uint32_t> triangles = { 0, 1, 4, 0, 4, 3, 1, 2, 5, 1, 5, 4 };
+    HalfEdgeMesh mesh(6, triangles, 3);
+    ASSERT_TRUE(mesh.IsBoundaryVertex(0));
+
+    const std::vector<Vertex> original = StripVertices();
+    HalfEdgeMesh refined;
+    std::vector<Vertex> vertices;
+    LoopSubdivideLevel(mesh, original, refined, vertices);
+    EXPECT_EQ(6u + 9u, refined.GetVertexCount());
+    EXPECT_EQ(16u, refined.GetFaceCount());
+    EXPECT_EQ(1, EulerCharacteristic(refined));
+
+    // 2 and 3 belong to a single triangle and are kept as corners. 0 lies
+    // on two and follows the boundary curve, 3/4 of itself and 1/8 of each
+    // boundary neighbour; the diagonal 4 does not count.
+    ExpectPosition(vertices[2], 3.0f, 0.0f, 0.0f);
+    ExpectPosition(vertices[3], 0.0f, 1.0f, 0.0f);
+    ExpectPosition(vertices[0], 0.125f, 0.125f, 0.0f);
+    ExpectPosition(vertices[1], 0.75f + 0.125f * 3.0f, 0.0f, 0.0f);
+
+    // Boundary edges split at their midpoint, interior ones use the 3/8 and
+    // 1/8 stencil.
+    for (std::uint32_t e = 0; e < mesh.GetEdgeCount(); ++e)
+    {
+        std::uint32_t h = mesh.EdgeHalfEdge(e);
+        const XMFLOAT3& a = original[mesh.Origin(h)].Position;
+        const XMFLOAT3& b = original[mesh.Target(h)].Position;
+        if (mesh.IsBoundary(h))
+        {
+            ExpectPosition(vertices[6 + e], 0.5f * (a.x + b.x), 0.5f * (a.y + b.y), 0.0f);
+        }
+        else if ((mesh.Origin(h) == 0 && mesh.Target(h) == 4) || (mesh.Origin(h) == 4 && mesh.Target(h) == 0))
+        {
+            ExpectPosition(vertices[6 + e], 0.5f, 0.5f, 0.0f);
+        }
+    }
+}
+
+TEST(Subdivision, CatmullClarkBoundaryRulesOnAQuadStrip)
+{
+    const std::vector<std::uint32_t> quads = { 0, 1, 4, 3, 1, 2, 5, 4 };
+    HalfEdgeMesh mesh(6, quads, 4);
+
+    const std::vector<Vertex> original = StripVertices();
+    HalfEdgeMesh refined;
+    std::vector<Vertex> vertices;
+    CatmullClarkSubdivideLevel(mesh, original, refined, vertices);
+    EXPECT_EQ(6u + 7u + 2u, refined.GetVertexCount());
+    EXPECT_EQ(2u * 7u + 4u * 2u, refined.GetEdgeCount());
+    EXPECT_EQ(8u, refined.GetFaceCount());
+    EXPECT_EQ(1, EulerCharacteristic(refined));
+
+    // The four outer corners belong to one quad each and stay put; 1 and 4
+    // follow the boundary curve.
+    ExpectPosition(vertices[0], 0.0f, 0.0f, 0.0f);
+    ExpectPosition(vertices[2], 3.0f, 0.0f, 0.0f);
+    ExpectPosition(vertices[5], 3.0f, 1.0f, 0.0f);
+    ExpectPosition(vertices[1], 1.125f, 0.0f, 0.0f);
+    ExpectPosition(vertices[4], 1.125f, 1.0f, 0.0f);
+
+    // Face vertices are centroids. The shared edge averages its ends and
+    // both face vertices; boundary edges split at their midpoint.
+    ExpectPosition(vertices[13], 0.5f, 0.5f, 0.0f);
+    ExpectPosition(vertices[14], 2.0f, 0.5f, 0.0f);
+    for (std::uint32_t e = 0; e < mesh.GetEdgeCount(); ++e)
+    {
+        std::uint32_t h = mesh.EdgeHalfEdge(e);
+        const XMFLOAT3& a = original[mesh.Origin(h)].Position;
+        const XMFLOAT3& b = original[mesh.Target(h)].Position;
+        if (mesh.IsBoundary(h))
+        {
+            ExpectPosition(vertices[6 + e], 0.5f * (a.x + b.x), 0.5f * (a.y + b.y), 0.0f);
+        }
+        else
+        {
+            ExpectPosition(vertices[6 + e], 1.125f, 0.5f, 0.0f);
+        }
+    }
+}
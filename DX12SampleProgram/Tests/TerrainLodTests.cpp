@@ -0,0 +1,216 @@
+#include "stdafx.h"
+#include "TerrainLod.h"
+#include <gtest/gtest.h>
+
+using namespace DirectX;
+
+namespace
+{
+    // TerrainLod.hlsl's VSMain and SampleHeight, statement for statement,
+    // with the HLSL intrinsics spelled out. Keep in step with the shader.
+    struct HlslMorph
+    {
+        const CdlodQuadtree& Tree;
+
+        static float Saturate(float v) { return std::min(std::max(v, 0.0f), 1.0f); }
+        static float Frac(float v) { return v - floorf(v); }
+
+        float SampleHeight(float posX, float posZ)const
+        {
+            const std::vector<float>& gHeights = Tree.GetHeights();
+            const UINT gHeightResolution = Tree.GetResolution();
+            const float gHeightSpacing = Tree.GetDesc().Spacing;
+            const XMFLOAT2 gHeightOrigin = Tree.GetDesc().Origin;
+
+            float last = (float)(gHeightResolution - 1);
+            float tx = std::min(std::max((posX - gHeightOrigin.x) / gHeightSpacing, 0.0f), last);
+            float tz = std::min(std::max((posZ - gHeightOrigin.y) / gHeightSpacing, 0.0f), last);
+            UINT ix = std::min((UINT)tx, gHeightResolution - 2);
+            UINT iz = std::min((UINT)tz, gHeightResolution - 2);
+            float wx = tx - (float)ix;
+            float wz = tz - (float)iz;
+
+            UINT row0 = iz * gHeightResolution + ix;
+            UINT row1 = row0 + gHeightResolution;
+            float h0 = gHeights[row0] + (gHeights[row0 + 1] - gHeights[row0]) * wx;
+            float h1 = gHeights[row1] + (gHeights[row1 + 1] - gHeights[row1]) * wx;
+            return h0 + (h1 - h0) * wz;
+        }
+
+        XMFLOAT3 VSMain(const CdlodPatch& patch, const CdlodPatchVertex& vertex, const XMFLOAT3& gEyePosW)const
+        {
+            const float gPatchQuads = (float)Tree.GetDesc().PatchQuads;
+            const float gSkirtDepth = Tree.GetDesc().SkirtDepth;
+
+            float quadSize = patch.Size / gPatchQuads;
+            float gridX = vertex.Grid.x;
+            float gridZ = vertex.Grid.y;
+
+            float posX = patch.Origin.x + gridX * quadSize;
+            float posZ = patch.Origin.y + gridZ * quadSize;
+            float posY = SampleHeight(posX, posZ);
+            float dx = gEyePosW.x - posX;
+            float dy = gEyePosW.y - posY;
+            float dz = gEyePosW.z - posZ;
+            float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+            float morph = Saturate((distance - patch.MorphRange.x) / (patch.MorphRange.y - patch.MorphRange.x));
+
+            gridX -= Frac(gridX * 0.5f) * 2.0f * morph;
+            gridZ -= Frac(gridZ * 0.5f) * 2.0f * morph;
+
+            posX = patch.Origin.x + gridX * quadSize;
+            posZ = patch.Origin.y + gridZ * quadSize;
+            posY = SampleHeight(posX, posZ) - vertex.Grid.z * gSkirtDepth * quadSize;
+            return XMFLOAT3(posX, posY, posZ);
+        }
+    };
+
+    CdlodDesc TestDesc()
+    {
+        CdlodDesc desc;
+        desc.PatchQuads = 8;
+        desc.LodCount = 4;
+        desc.Spacing = 0.5f;
+        desc.Origin = XMFLOAT2(-16.0f, -16.0f);
+        return desc;
+    }
+
+    void RollingHills(const float* x, const float* z, size_t count, float* heights)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            heights[i] = 3.0f * sinf(0.3f * x[i]) * cosf(0.2f * z[i]) + 0.25f * x[i];
+        }
+    }
+
+    void ExpectNear(const XMFLOAT3& expected, const XMFLOAT3& actual)
+    {
+        const float tolerance = 1e-4f;
+        EXPECT_NEAR(expected.x, actual.x, tolerance);
+        EXPECT_NEAR(expected.y, actual.y, tolerance);
+        EXPECT_NEAR(expected.z, actual.z, tolerance);
+    }
+}
+
+TEST(CdlodQuadtree, MorphVertexMatchesShaderOnSelectedPatches)
+{
+    CdlodQuadtree tree(RollingHills, TestDesc());
+    HlslMorph shader = { tree };
+
+    std::vector<CdlodPatchVertex> vertices;
+    std::vector<std::uint16_t> indices;
+    CdlodIndexRange ranges[(UINT)CdlodRegion::Count];
+    tree.BuildPatchMesh(vertices, indices, ranges);
+
+    const XMFLOAT3 eyes[] =
+    {
+        XMFLOAT3(0.0f, 5.0f, 0.0f),
+        XMFLOAT3(-13.0f, 2.0f, 9.5f),
+        XMFLOAT3(40.0f, 30.0f, -40.0f),
+    };
+
+    UINT morphingVertices = 0;
+    for (const XMFLOAT3& eye : eyes)
+    {
+        XMVECTOR eyePos = XMLoadFloat3(&eye);
+        CdlodSelection selection;
+        tree.Select(eyePos, BoundingFrustum(), selection);
+        ASSERT_FALSE(selection.Patches.empty());
+
+        for (const CdlodPatch& patch : selection.Patches)
+        {
+            for (const CdlodPatchVertex& vertex : vertices)
+            {
+                XMFLOAT3 expected = shader.VSMain(patch, vertex, eye);
+                ExpectNear(expected, tree.MorphVertex(patch, vertex, eyePos));
+
+                float quadSize = patch.Size / tree.GetDesc().PatchQuads;
+                float unmorphedX = patch.Origin.x + vertex.Grid.x * quadSize;
+                morphingVertices += expected.x != unmorphedX ? 1 : 0;
+            }
+        }
+    }
+
+    // The eyes are placed so some patches are part way through a morph.
+    EXPECT_GT(morphingVertices, 0u);
+}
+
+TEST(CdlodQuadtree, MorphVertexMatchesShaderAcrossTheMorphRange)
+{
+    CdlodQuadtree tree(RollingHills, TestDesc());
+    HlslMorph shader = { tree };
+
+    CdlodPatch patch;
+    patch.Origin = XMFLOAT2(-8.0f, 0.0f);
+    patch.Size = 8.0f;
+    patch.Lod = 1;
+    patch.MorphRange = XMFLOAT2(10.0f, 20.0f);
+    patch.Region = CdlodRegion::Full;
+
+    // Eyes from inside the morph start to past the range end, straight up
+    // from the patch corner.
+    for (float height = 0.0f; height <= 30.0f; height += 2.5f)
+    {
+        XMFLOAT3 eye(-8.0f, height, 0.0f);
+        for (float gz = 0.0f; gz <= 8.0f; gz += 1.0f)
+        {
+            for (float gx = 0.0f; gx <= 8.0f; gx += 1.0f)
+            {
+                CdlodPatchVertex vertex = { XMFLOAT3(gx, gz, 0.0f) };
+                ExpectNear(shader.VSMain(patch, vertex, eye), tree.MorphVertex(patch, vertex, XMLoadFloat3(&eye)));
+
+                CdlodPatchVertex skirt = { XMFLOAT3(gx, gz, 1.0f) };
+                ExpectNear(shader.VSMain(patch, skirt, eye), tree.MorphVertex(patch, skirt, XMLoadFloat3(&eye)));
+            }
+        }
+    }
+}
+
+TEST(CdlodQuadtree, FullyMorphedOddVerticesLandOnEvenNeighbours)
+{
+    CdlodQuadtree tree(RollingHills, TestDesc());
+
+    CdlodPatch patch;
+    patch.Origin = XMFLOAT2(0.0f, -8.0f);
+    patch.Size = 8.0f;
+    patch.Lod = 1;
+    patch.MorphRange = XMFLOAT2(1.0f, 2.0f);
+    patch.Region = CdlodRegion::Full;
+
+    // Far beyond the range end, so the morph is complete.
+    XMVECTOR eyePos = XMVectorSet(500.0f, 0.0f, 500.0f, 0.0f);
+    for (float gz = 0.0f; gz <= 8.0f; gz += 1.0f)
+    {
+        for (float gx = 1.0f; gx <= 8.0f; gx += 2.0f)
+        {
+            CdlodPatchVertex odd = { XMFLOAT3(gx, gz, 0.0f) };
+            CdlodPatchVertex even = { XMFLOAT3(gx - 1.0f, gz - fmodf(gz, 2.0f), 0.0f) };
+            ExpectNear(tree.MorphVertex(patch, even, eyePos), tree.MorphVertex(patch, odd, eyePos));
+        }
+    }
+}
+
+TEST(CdlodQuadtree, UnmorphedVerticesSitOnTheHeightField)
+{
+    CdlodQuadtree tree(RollingHills, TestDesc());
+
+    CdlodPatch patch;
+    patch.Origin = XMFLOAT2(-4.0f, -4.0f);
+    patch.Size = 4.0f;
+    patch.Lod = 0;
+    patch.MorphRange = XMFLOAT2(100.0f, 200.0f);
+    patch.Region = CdlodRegion::Full;
+
+    XMVECTOR eyePos = XMVectorSet(-2.0f, 10.0f, -2.0f, 0.0f);
+    for (float gz = 0.0f; gz <= 8.0f; gz += 1.0f)
+    {
+        for (float gx = 0.0f; gx <= 8.0f; gx += 1.0f)
+        {
+            CdlodPatchVertex vertex = { XMFLOAT3(gx, gz, 0.0f) };
+            XMFLOAT3 position = tree.MorphVertex(patch, vertex, eyePos);
+            EXPECT_FLOAT_EQ(-4.0f + gx * 0.5f, position.x);
+            EXPECT_FLOAT_EQ(-4.0f + gz * 0.5f, position.z);
+            EXPECT_NEAR(tree.SampleHeight(position.x, position.z), position.y, 1e-5f);
+        }
+    }
+}
@@ -0,0 +1,171 @@
+#include "stdafx.h"
+#include "VertexWelder.h"
+#include <gtest/gtest.h>
+#include <map>
+#include <ppl.h>
+#include <tuple>
+
+namespace
+{
+    typedef GeometryGenerator::Vertex Vertex;
+
+    WeldTolerances PositionOnly()
+    {
+        WeldTolerances tolerances;
+        tolerances.Normal = -1.0f;
+        tolerances.Tangent = -1.0f;
+        tolerances.TexCoord = -1.0f;
+        return tolerances;
+    }
+
+    // A grid of quads, each with four vertices of its own, so every inner
+    // grid point is repeated up to four times.
+    GeometryGenerator::MeshData SplitGrid(std::uint32_t quadsPerSide)
+    {
+        GeometryGenerator::MeshData mesh;
+        for (std::uint32_t z = 0; z < quadsPerSide; ++z)
+        {
+            for (std::uint32_t x = 0; x < quadsPerSide; ++x)
+            {
+                std::uint32_t base = (std::uint32_t)mesh.Vertices.size();
+                for (std::uint32_t corner = 0; corner < 4; ++corner)
+                {
+                    float px = (float)(x + (corner & 1));
+                    float pz = (float)(z + (corner >> 1));
+                    mesh.Vertices.push_back(Vertex(px, 0.0f, pz, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+                        px / quadsPerSide, pz / quadsPerSide));
+                }
+                std::uint32_t quad[] = { base, base + 2, base + 1, base + 1, base + 2, base + 3 };
+                mesh.Indices32.insert(mesh.Indices32.end(), quad, quad + 6);
+            }
+        }
+        return mesh;
+    }
+
+    // The remap WeldVertices promises, worked out serially: survivors are
+    // the first vertex of each position, numbered in order.
+    std::vector<std::uint32_t> ReferenceRemap(const std::vector<Vertex>& vertices)
+    {
+        std::map<std::tuple<float, float, float>, std::uint32_t> firstIndex;
+        std::vector<std::uint32_t> remap;
+        for (const Vertex& v : vertices)
+        {
+            auto key = std::make_tuple(v.Position.x, v.Position.y, v.Position.z);
+            auto it = firstIndex.emplace(key, (std::uint32_t)firstIndex.size()).first;
+            remap.push_back(it->second);
+        }
+        return remap;
+    }
+
+    struct ScheduleScope
+    {
+        explicit ScheduleScope(const concurrency::shim::Schedule& schedule)
+        {
+            concurrency::shim::CurrentSchedule() = schedule;
+        }
+        ~ScheduleScope()
+        {
+            concurrency::shim::CurrentSchedule() = concurrency::shim::Schedule();
+        }
+    };
+}
+
+TEST(VertexWelder, CubeFacesWeldToCorners)
+{
+    GeometryGenerator geoGen;
+    GeometryGenerator::MeshData box = geoGen.CreateBox(2.0f, 4.0f, 6.0f, 0);
+    const GeometryGenerator::MeshData original = box;
+    ASSERT_EQ(24u, box.Vertices.size());
+
+    // Faces differ in normals and texture coordinates, so nothing merges
+    // by default.
+    WeldStats stats = WeldVertices(box);
+    EXPECT_EQ(24u, stats.OutputVertexCount);
+    EXPECT_EQ(original.Indices32, box.Indices32);
+
+    stats = WeldVertices(box, PositionOnly());
+    EXPECT_EQ(24u, stats.InputVertexCount);
+    EXPECT_EQ(8u, stats.OutputVertexCount);
+    ASSERT_EQ(8u, box.Vertices.size());
+    ASSERT_EQ(original.Indices32.size(), box.Indices32.size());
+    for (size_t k = 0; k < box.Indices32.size(); ++k)
+    {
+        ASSERT_LT(box.Indices32[k], 8u);
+        const Vertex& welded = box.Vertices[box.Indices32[k]];
+        const Vertex& source = original.Vertices[original.Indices32[k]];
+        EXPECT_EQ(source.Position.x, welded.Position.x);
+        EXPECT_EQ(source.Position.y, welded.Position.y);
+        EXPECT_EQ(source.Position.z, welded.Position.z);
+    }
+
+    // The first vertex of each corner is the one kept.
+    const std::vector<std::uint32_t> expected = ReferenceRemap(original.Vertices);
+    std::vector<bool> seen(8);
+    for (size_t i = 0; i < original.Vertices.size(); ++i)
+    {
+        if (!seen[expected[i]])
+        {
+            seen[expected[i]] = true;
+            EXPECT_EQ(original.Vertices[i].Normal.x, box.Vertices[expected[i]].Normal.x);
+            EXPECT_EQ(original.Vertices[i].Normal.y, box.Vertices[expected[i]].Normal.y);
+            EXPECT_EQ(original.Vertices[i].Normal.z, box.Vertices[expected[i]].Normal.z);
+        }
+    }
+}
+
+TEST(VertexWelder, ToleranceMergesNearbyValues)
+{
+    std::vector<Vertex> vertices;
+    vertices.push_back(Vertex(1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f));
+    vertices.push_back(Vertex(1.0f, -0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f));
+    vertices.push_back(Vertex(1.000001f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f));
+    vertices.push_back(Vertex(1.001f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f));
+
+    std::vector<std::uint32_t> remap;
+    EXPECT_EQ(2u, BuildWeldRemap(vertices.data(), (std::uint32_t)vertices.size(), WeldTolerances(), remap));
+    EXPECT_EQ((std::vector<std::uint32_t>{ 0, 0, 0, 1 }), remap);
+
+    // With a zero tolerance only exact matches merge, -0 with +0 included.
+    WeldTolerances exact;
+    exact.Position = 0.0f;
+    EXPECT_EQ(3u, BuildWeldRemap(vertices.data(), (std::uint32_t)vertices.size(), exact, remap));
+    EXPECT_EQ((std::vector<std::uint32_t>{ 0, 0, 1, 2 }), remap);
+}
+
+TEST(VertexWelder, ResultDoesNotDependOnScheduling)
+{
+    // 64x64 quads give 16384 vertices, several blocks' worth.
+    const GeometryGenerator::MeshData original = SplitGrid(64);
+    const std::vector<std::uint32_t> expected = ReferenceRemap(original.Vertices);
+    const std::uint32_t vertexCount = (std::uint32_t)original.Vertices.size();
+
+    concurrency::shim::Schedule schedules[4];
+    schedules[1].Seed = 1;
+    schedules[2].Seed = 2;
+    schedules[2].ThreadCount = 4;
+    schedules[3].ThreadCount = 8;
+    for (const concurrency::shim::Schedule& schedule : schedules)
+    {
+        SCOPED_TRACE(::testing::Message() << "seed " << schedule.Seed << ", threads " << schedule.ThreadCount);
+        ScheduleScope scope(schedule);
+
+        std::vector<std::uint32_t> remap;
+        EXPECT_EQ(65u * 65u, BuildWeldRemap(original.Vertices.data(), vertexCount, WeldTolerances(), remap));
+        EXPECT_EQ(expected, remap);
+
+        GeometryGenerator::MeshData mesh = original;
+        WeldStats stats = WeldVertices(mesh);
+        EXPECT_EQ(65u * 65u, stats.OutputVertexCount);
+        ASSERT_EQ(65u * 65u, mesh.Vertices.size());
+        for (size_t k = 0; k < mesh.Indices32.size(); ++k)
+        {
+            ASSERT_EQ(expected[original.Indices32[k]], mesh.Indices32[k]);
+        }
+        for (std::uint32_t i = 0; i < vertexCount; ++i)
+        {
+            const Vertex& welded = mesh.Vertices[expected[i]];
+            ASSERT_EQ(original.Vertices[i].Position.x, welded.Position.x);
+            ASSERT_EQ(original.Vertices[i].Position.z, welded.Position.z);
+        }
+    }
+}
@@ -0,0 +1,172 @@
+#include "stdafx.h"
+#include "UploadBatch.h"
+
+using Microsoft::WRL::ComPtr;
+
+UploadBatch::UploadBatch(ID3D12Device* device, UINT64 chunkSize) :
+    m_device(device),
+    m_chunkSize(chunkSize),
+    m_copyQueue(device)
+{
+}
+
+UploadBatch::~UploadBatch()
+{
+    if (m_copyQueue.IsRecording())
+    {
+        Submit();
+    }
+    WaitForIdle();
+}
+
+ID3D12GraphicsCommandList* UploadBatch::BeginRecording()
+{
+    if (!m_copyQueue.IsRecording())
+    {
+        ReleaseCompleted();
+    }
+    return m_copyQueue.GetCommandList();
+}
+
+void UploadBatch::Stage(UINT64 size, UINT64 alignment, ID3D12Resource*& buffer, UINT64& offset, BYTE*& mappedData)
+{
+    Chunk* chunk = m_recording.Chunks.empty() ? nullptr : &m_recording.Chunks.back();
+    if (chunk == nullptr || AlignUp(chunk->Used, alignment) + size > chunk->Size)
+    {
+        Chunk newChunk;
+        newChunk.Size = std::max(m_chunkSize, size);
+        ThrowIfFailed(m_device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+            D3D12_HEAP_FLAG_NONE,
+            &CD3DX12_RESOURCE_DESC::Buffer(newChunk.Size),
+            D3D12_RESOURCE_STATE_GENERIC_READ,
+            nullptr,
+            IID_PPV_ARGS(&newChunk.Buffer)));
+
+        // Write only; the chunk is unmapped with the buffer.
+        CD3DX12_RANGE readRange(0, 0);
+        ThrowIfFailed(newChunk.Buffer->Map(0, &readRange, reinterpret_cast<void**>(&newChunk.MappedData)));
+
+        m_stats.LiveStagingBytes += newChunk.Size;
+        m_stats.PeakStagingBytes = std::max(m_stats.PeakStagingBytes, m_stats.LiveStagingBytes);
+        m_recording.Chunks.push_back(std::move(newChunk));
+        chunk = &m_recording.Chunks.back();
+    }
+
+    offset = AlignUp(chunk->Used, alignment);
+    chunk->Used = offset + size;
+    buffer = chunk->Buffer.Get();
+    mappedData = chunk->MappedData + offset;
+    m_stats.StagedBytes += size;
+}
+
+ComPtr<ID3D12Resource> UploadBatch::CreateBuffer(const void* data, UINT64 byteSize)
+{
+    ComPtr<ID3D12Resource> buffer;
+    ThrowIfFailed(m_device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+        D3D12_RESOURCE_STATE_COMMON,
+        nullptr,
+        IID_PPV_ARGS(&buffer)));
+
+    CopyToBuffer(buffer.Get(), 0, data, byteSize);
+    return buffer;
+}
+
+void UploadBatch::CopyToBuffer(ID3D12Resource* dest, UINT64 destOffset, const void* data, UINT64 byteSize)
+{
+    ID3D12GraphicsCommandList* commandList = BeginRecording();
+
+    ID3D12Resource* staging = nullptr;
+    UINT64 stagingOffset = 0;
+    BYTE* mappedData = nullptr;
+    Stage(byteSize, 4, staging, stagingOffset, mappedData);
+    memcpy(mappedData, data, (size_t)byteSize);
+
+    commandList->CopyBufferRegion(dest, destOffset, staging, stagingOffset, byteSize);
+    ++m_stats.CopyCount;
+}
+
+void UploadBatch::CopyToTexture(ID3D12Resource* dest, UINT firstSubresource, UINT subresourceCount,
+    const D3D12_SUBRESOURCE_DATA* data)
+{
+    ID3D12GraphicsCommandList* commandList = BeginRecording();
+
+    std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> layouts(subresourceCount);
+    std::vector<UINT> rowCounts(subresourceCount);
+    std::vector<UINT64> rowSizes(subresourceCount);
+    UINT64 totalBytes = 0;
+    D3D12_RESOURCE_DESC desc = dest->GetDesc();
+    m_device->GetCopyableFootprints(&desc, firstSubresource, subresourceCount, 0,
+        layouts.data(), rowCounts.data(), rowSizes.data(), &totalBytes);
+
+    ID3D12Resource* staging = nullptr;
+    UINT64 stagingOffset = 0;
+    BYTE* mappedData = nullptr;
+    Stage(totalBytes, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT, staging, stagingOffset, mappedData);
+
+    for (UINT i = 0; i < subresourceCount; ++i)
+    {
+        // Rows are repacked to the footprint pitch, slice by slice.
+        const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& layout = layouts[i];
+        BYTE* destSlice = mappedData + layout.Offset;
+        const BYTE* srcSlice = static_cast<const BYTE*>(data[i].pData);
+        for (UINT z = 0; z < layout.Footprint.Depth; ++z)
+        {
+            for (UINT row = 0; row < rowCounts[i]; ++row)
+            {
+                memcpy(destSlice + (UINT64)layout.Footprint.RowPitch * (rowCounts[i] * z + row),
+                    srcSlice + data[i].SlicePitch * z + data[i].RowPitch * row, (size_t)rowSizes[i]);
+            }
+        }
+
+        D3D12_PLACED_SUBRESOURCE_FOOTPRINT placed = layout;
+        placed.Offset += stagingOffset;
+        CD3DX12_TEXTURE_COPY_LOCATION dst(dest, firstSubresource + i);
+        CD3DX12_TEXTURE_COPY_LOCATION src(staging, placed);
+        commandList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+        ++m_stats.CopyCount;
+    }
+}
+
+UINT64 UploadBatch::Submit(ID3D12CommandQueue* waitingQueue)
+{
+    if (m_copyQueue.IsRecording())
+    {
+        m_recording.Fence = m_copyQueue.Submit();
+        m_inFlight.push_back(std::move(m_recording));
+        m_recording = Submission();
+        ++m_stats.SubmissionCount;
+    }
+
+    const UINT64 fence = m_copyQueue.GetLastFence();
+    if (waitingQueue != nullptr)
+    {
+        m_copyQueue.MakeQueueWait(waitingQueue, fence);
+    }
+    return fence;
+}
+
+void UploadBatch::ReleaseCompleted()
+{
+    const UINT64 completed = m_copyQueue.GetCompletedFence();
+    auto done = std::partition(m_inFlight.begin(), m_inFlight.end(),
+        [completed](const Submission& submission) { return submission.Fence > completed; });
+
+    for (auto it = done; it != m_inFlight.end(); ++it)
+    {
+        for (const Chunk& chunk : it->Chunks)
+        {
+            m_stats.LiveStagingBytes -= chunk.Size;
+        }
+    }
+    m_inFlight.erase(done, m_inFlight.end());
+}
+
+void UploadBatch::WaitForIdle()
+{
+    m_copyQueue.WaitForIdle();
+    ReleaseCompleted();
+}
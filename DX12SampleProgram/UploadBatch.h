@@ -0,0 +1,105 @@
+// Batched uploads on a copy queue.
+//
+// CreateDefaultBuffer gives every buffer an upload buffer of its own, records
+// the copy on the direct queue and leaves the caller to keep the uploader
+// alive until a full flush. UploadBatch instead packs the data of many
+// buffers and textures back to back into a few large staging chunks, records
+// all the copies on one copy command list and submits them together. Each
+// submission keeps its staging chunks and command allocator until its fence
+// passes, then ReleaseCompleted hands them back without any wait.
+//
+// Destination resources are created in, or must be in, the common state:
+// the copy queue promotes them to COPY_DEST implicitly, and they decay back
+// to common when the copies finish, ready to be promoted again to whatever
+// read state the direct queue uses them in. Submit can make a queue wait for
+// the copies on the GPU, so nothing has to block on the CPU.
+//
+// Recording and submission happen on one thread.
+#pragma once
+#include "stdafx.h"
+#include "D3DUtil.h"
+#include "CopyQueue.h"
+
+struct UploadBatchStats
+{
+    UINT64 StagedBytes = 0;
+    UINT64 PeakStagingBytes = 0;
+    UINT64 LiveStagingBytes = 0;
+    UINT SubmissionCount = 0;
+    UINT CopyCount = 0;
+};
+
+class UploadBatch
+{
+public:
+    // Staging memory comes in chunks of chunkSize bytes; larger uploads get a
+    // chunk of their own.
+    UploadBatch(ID3D12Device* device, UINT64 chunkSize = 16ull * 1024 * 1024);
+    UploadBatch(const UploadBatch& rhs) = delete;
+    UploadBatch& operator=(const UploadBatch& rhs) = delete;
+
+    // Waits for every submission.
+    ~UploadBatch();
+
+    // A default heap buffer in the common state holding a copy of data.
+    // data can go away as soon as this returns.
+    Microsoft::WRL::ComPtr<ID3D12Resource> CreateBuffer(const void* data, UINT64 byteSize);
+
+    // Copies byteSize bytes of data to dest at destOffset.
+    void CopyToBuffer(ID3D12Resource* dest, UINT64 destOffset, const void* data, UINT64 byteSize);
+
+    // Copies subresourceCount subresources of data, laid out as for
+    // UpdateSubresources, to dest starting at firstSubresource.
+    void CopyToTexture(ID3D12Resource* dest, UINT firstSubresource, UINT subresourceCount,
+        const D3D12_SUBRESOURCE_DATA* data);
+
+    // Executes everything recorded since the last Submit on the copy queue
+    // and returns the fence value that marks its completion. If waitingQueue
+    // is given, work submitted to it afterwards waits for the copies on the
+    // GPU. Returns the last fence value if nothing was recorded.
+    UINT64 Submit(ID3D12CommandQueue* waitingQueue = nullptr);
+
+    // Frees the staging memory of every finished submission. Cheap enough to
+    // call once a frame.
+    void ReleaseCompleted();
+
+    // Blocks until every submission has finished, then releases.
+    void WaitForIdle();
+
+    bool IsComplete(UINT64 fence)const { return m_copyQueue.GetCompletedFence() >= fence; }
+
+    ID3D12CommandQueue* GetQueue()const { return m_copyQueue.GetQueue(); }
+    const UploadBatchStats& GetStats()const { return m_stats; }
+
+private:
+    struct Chunk
+    {
+        Microsoft::WRL::ComPtr<ID3D12Resource> Buffer;
+        BYTE* MappedData = nullptr;
+        UINT64 Size = 0;
+        UINT64 Used = 0;
+    };
+
+    struct Submission
+    {
+        UINT64 Fence = 0;
+        std::vector<Chunk> Chunks;
+    };
+
+    // The copy command list, opened if nothing is being recorded yet.
+    ID3D12GraphicsCommandList* BeginRecording();
+
+    // Reserves size bytes of staging memory at a multiple of alignment.
+    void Stage(UINT64 size, UINT64 alignment, ID3D12Resource*& buffer, UINT64& offset, BYTE*& mappedData);
+
+    ID3D12Device* m_device = nullptr;
+    UINT64 m_chunkSize = 0;
+
+    CopyQueue m_copyQueue;
+
+    // What is being recorded now, and what the GPU may still be copying.
+    Submission m_recording;
+    std::vector<Submission> m_inFlight;
+
+    UploadBatchStats m_stats;
+};
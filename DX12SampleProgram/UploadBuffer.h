@@ -7,7 +7,8 @@ class UploadBuffer
 {
 public:
     UploadBuffer(ID3D12Device* device, UINT elementCount, bool isConstantBuffer)
-        :m_isConstantBuffer(isConstantBuffer)
+        :m_elementCount(elementCount),
+        m_isConstantBuffer(isConstantBuffer)
     {
         m_elementByteSize = sizeof(T);
 
@@ -47,15 +48,88 @@ public:
         return m_uploadBuffer.Get();
     }
 
+    UINT ElementCount()const
+    {
+        return m_elementCount;
+    }
+
     void CopyData(int elementIndex, const T& data)
     {
+        assert(elementIndex >= 0 && (UINT)elementIndex < m_elementCount);
         memcpy(&m_mappedData[elementIndex * m_elementByteSize], &data, sizeof(T));
     }
 
+    // The bulk writes below use non-temporal stores (StreamToUploadHeap) and
+    // never read the write-combined mapping back.
+
+    // Writes data[0, count) to elements [firstElement, firstElement + count).
+    void CopyRange(UINT firstElement, const T* data, UINT count)
+    {
+        assert(firstElement <= m_elementCount && count <= m_elementCount - firstElement);
+        if (count == 0)
+        {
+            return;
+        }
+
+        BYTE* dest = &m_mappedData[(size_t)firstElement * m_elementByteSize];
+        if (m_elementByteSize == sizeof(T))
+        {
+            StreamToUploadHeap(dest, data, (size_t)count * sizeof(T));
+        }
+        else
+        {
+            for (UINT i = 0; i < count; ++i)
+            {
+                StreamToUploadHeap(dest + (size_t)i * m_elementByteSize, &data[i], sizeof(T));
+            }
+        }
+        _mm_sfence();
+    }
+
+    // Writes data[i] to element indices[i] for i in [0, count).
+    void CopyScatter(const UINT* indices, const T* data, UINT count)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        for (UINT i = 0; i < count; ++i)
+        {
+            assert(indices[i] < m_elementCount);
+            StreamToUploadHeap(&m_mappedData[(size_t)indices[i] * m_elementByteSize], &data[i], sizeof(T));
+        }
+        _mm_sfence();
+    }
+
+    // Fills elements [firstElement, firstElement + count) in batches:
+    // fn(T* elements, UINT first, UINT batchCount) writes elements first to
+    // first + batchCount - 1 into elements, CPU scratch memory that it may
+    // also read, which is then copied out.
+    template<typename Fn>
+    void Generate(UINT firstElement, UINT count, Fn fn)
+    {
+        assert(firstElement <= m_elementCount && count <= m_elementCount - firstElement);
+        const UINT batchSize = (UINT)std::max<size_t>(1, GenerateBatchBytes / sizeof(T));
+        m_scratch.resize(std::min(batchSize, count));
+        for (UINT first = firstElement; first < firstElement + count; first += batchSize)
+        {
+            UINT batchCount = std::min(batchSize, firstElement + count - first);
+            fn(m_scratch.data(), first, batchCount);
+            CopyRange(first, m_scratch.data(), batchCount);
+        }
+    }
+
 private:
     Microsoft::WRL::ComPtr<ID3D12Resource> m_uploadBuffer;
     BYTE* m_mappedData = nullptr;
 
+    static const size_t GenerateBatchBytes = 16 * 1024;
+
     UINT m_elementByteSize = 0;
+    UINT m_elementCount = 0;
     bool m_isConstantBuffer = false;
+
+    // Batch storage for Generate.
+    std::vector<T> m_scratch;
 };
\ No newline at end of file
@@ -0,0 +1,115 @@
+#include "stdafx.h"
+#include "UploadRing.h"
+
+namespace
+{
+    // Growth rounds the capacity up to whole 64KB heap pages.
+    const UINT64 CapacityGranularity = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+}
+
+UploadRing::UploadRing(ID3D12Device* device, UINT64 capacity) :
+    m_device(device)
+{
+    CreateBuffer(AlignUp(std::max(capacity, (UINT64)1), CapacityGranularity));
+}
+
+UploadRing::~UploadRing()
+{
+    if (m_buffer != nullptr)
+    {
+        m_buffer->Unmap(0, nullptr);
+    }
+    m_mappedData = nullptr;
+}
+
+void UploadRing::CreateBuffer(UINT64 capacity)
+{
+    ThrowIfFailed(m_device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(capacity),
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(&m_buffer)
+    ));
+
+    // Mapped for the lifetime of the buffer; the fences keep the CPU from
+    // overwriting bytes the GPU still reads.
+    ThrowIfFailed(m_buffer->Map(0, nullptr, reinterpret_cast<void**>(&m_mappedData)));
+    m_gpuAddress = m_buffer->GetGPUVirtualAddress();
+
+    m_ring.Reset(capacity);
+    m_stats.Capacity = capacity;
+}
+
+void UploadRing::Grow(UINT64 size, UINT64 alignment)
+{
+    // The current buffer still backs the frames in flight and whatever this
+    // frame has already allocated. Those all finish no later than this frame,
+    // so it is released with this frame's fence.
+    m_retiredBuffers.push_back({ m_buffer, 0 });
+    m_buffer = nullptr;
+    m_mappedData = nullptr;
+
+    CreateBuffer(AlignUp(std::max(m_ring.GetCapacity() * 2, size + alignment), CapacityGranularity));
+    m_stats.GrowCount++;
+}
+
+void UploadRing::BeginFrame(UINT64 completedFence)
+{
+    assert(m_ring.GetFrameSize() == 0 && "EndFrame was not called for the previous frame.");
+
+    m_ring.Retire(completedFence);
+
+    m_retiredBuffers.erase(std::remove_if(m_retiredBuffers.begin(), m_retiredBuffers.end(),
+        [completedFence](const RetiredBuffer& retired)
+        {
+            return retired.Fence != 0 && retired.Fence <= completedFence;
+        }), m_retiredBuffers.end());
+
+    m_stats.BytesInFlight = m_ring.GetUsed();
+    m_stats.FramesInFlight = m_ring.GetFramesInFlight();
+}
+
+UploadAllocation UploadRing::Allocate(UINT64 size, UINT64 alignment)
+{
+    UINT64 frameSize = m_ring.GetFrameSize();
+    UINT64 offset = 0;
+    if (!m_ring.Allocate(size, alignment, offset))
+    {
+        // The new buffer starts out empty and always has room.
+        Grow(size, alignment);
+        frameSize = 0;
+        m_ring.Allocate(size, alignment, offset);
+    }
+
+    m_frameTotalSize += m_ring.GetFrameSize() - frameSize;
+    m_stats.BytesInFlight = m_ring.GetUsed();
+    m_stats.HighWaterMark = std::max(m_stats.HighWaterMark, m_ring.GetUsed());
+
+    UploadAllocation allocation;
+    allocation.CPU = m_mappedData + offset;
+    allocation.GPU = m_gpuAddress + offset;
+    allocation.Resource = m_buffer.Get();
+    allocation.Offset = offset;
+    allocation.Size = size;
+    return allocation;
+}
+
+void UploadRing::EndFrame(UINT64 fence)
+{
+    m_ring.EndFrame(fence);
+
+    for (RetiredBuffer& retired : m_retiredBuffers)
+    {
+        if (retired.Fence == 0)
+        {
+            retired.Fence = fence;
+        }
+    }
+
+    m_stats.LastFrameBytes = m_frameTotalSize;
+    m_stats.PeakFrameBytes = std::max(m_stats.PeakFrameBytes, m_frameTotalSize);
+    m_stats.FramesInFlight = m_ring.GetFramesInFlight();
+    m_frameTotalSize = 0;
+}
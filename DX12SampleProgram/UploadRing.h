@@ -0,0 +1,115 @@
+// Per-frame ring allocator for upload heap data.
+//
+// One committed upload buffer, mapped once, is handed out linearly: each
+// frame's constants and dynamic vertices are carved from the head of the
+// ring, and a whole frame is given back at once when the GPU has passed the
+// fence it was submitted with. Nothing is sized per data type, so the number
+// of objects can change from frame to frame without rebuilding anything.
+//
+// If a frame needs more than is free, the ring moves to a buffer twice as
+// large. The old buffer stays alive until the frame that outgrew it retires,
+// so allocations already made this frame remain valid.
+//
+// Usage, on the render thread only:
+//     ring.BeginFrame(fence->GetCompletedValue());
+//     ... Allocate / AllocateConstants while recording ...
+//     queue->Signal(fence, value); ring.EndFrame(value);
+#pragma once
+#include "stdafx.h"
+#include "D3DUtil.h"
+#include "FencedRing.h"
+
+struct UploadAllocation
+{
+    // Persistently mapped; write only, the memory is write-combined.
+    void* CPU = nullptr;
+    D3D12_GPU_VIRTUAL_ADDRESS GPU = 0;
+
+    ID3D12Resource* Resource = nullptr;
+    UINT64 Offset = 0;
+    UINT64 Size = 0;
+
+    D3D12_VERTEX_BUFFER_VIEW VertexBufferView(UINT stride)const
+    {
+        D3D12_VERTEX_BUFFER_VIEW vbv;
+        vbv.BufferLocation = GPU;
+        vbv.SizeInBytes = (UINT)Size;
+        vbv.StrideInBytes = stride;
+        return vbv;
+    }
+};
+
+struct UploadRingStats
+{
+    // Size of the current buffer. GrowCount is the number of times a frame
+    // outgrew it and moved the ring to a larger one.
+    UINT64 Capacity = 0;
+
+    // Bytes owned by frames the GPU has not finished, alignment padding
+    // included, and the most there have ever been.
+    UINT64 BytesInFlight = 0;
+    UINT64 HighWaterMark = 0;
+
+    // Bytes allocated by the last ended frame and by the largest one.
+    UINT64 LastFrameBytes = 0;
+    UINT64 PeakFrameBytes = 0;
+
+    UINT FramesInFlight = 0;
+    UINT GrowCount = 0;
+};
+
+class UploadRing
+{
+public:
+    UploadRing(ID3D12Device* device, UINT64 capacity);
+    UploadRing(const UploadRing& rhs) = delete;
+    UploadRing& operator=(const UploadRing& rhs) = delete;
+    ~UploadRing();
+
+    // Reclaims every frame, and every outgrown buffer, whose fence is at
+    // most completedFence.
+    void BeginFrame(UINT64 completedFence);
+
+    // size bytes at a multiple of alignment (a power of two). The default
+    // suits constant buffers.
+    UploadAllocation Allocate(UINT64 size, UINT64 alignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+
+    // Copies data into a new constant buffer and returns its address.
+    template<typename T>
+    D3D12_GPU_VIRTUAL_ADDRESS AllocateConstants(const T& data)
+    {
+        UploadAllocation allocation = Allocate(CalculateConstantBufferByteSize(sizeof(T)));
+        memcpy(allocation.CPU, &data, sizeof(T));
+        return allocation.GPU;
+    }
+
+    // Everything allocated since BeginFrame is in use until fence completes.
+    void EndFrame(UINT64 fence);
+
+    const UploadRingStats& GetStats()const { return m_stats; }
+
+private:
+    void CreateBuffer(UINT64 capacity);
+    void Grow(UINT64 size, UINT64 alignment);
+
+    struct RetiredBuffer
+    {
+        Microsoft::WRL::ComPtr<ID3D12Resource> Buffer;
+
+        // 0 until the frame that outgrew the buffer ends.
+        UINT64 Fence;
+    };
+
+    ID3D12Device* m_device = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12Resource> m_buffer;
+    BYTE* m_mappedData = nullptr;
+    D3D12_GPU_VIRTUAL_ADDRESS m_gpuAddress = 0;
+    // Frames in the current buffer, and the bytes of the open frame as a
+    // whole across a growth.
+    FencedRing m_ring;
+    UINT64 m_frameTotalSize = 0;
+
+    std::vector<RetiredBuffer> m_retiredBuffers;
+
+    UploadRingStats m_stats;
+};
@@ -0,0 +1,375 @@
+#include "stdafx.h"
+#include "VertexFormat.h"
+#include <fstream>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+namespace
+{
+    template<typename T>
+    const T* Strided(const T* base, UINT stride, UINT i)
+    {
+        return reinterpret_cast<const T*>(reinterpret_cast<const BYTE*>(base) + (size_t)stride * i);
+    }
+
+    UINT PositionSize(PositionEncoding e)
+    {
+        return e == PositionEncoding::UNorm16 ? 8 : 12;
+    }
+
+    UINT DirectionSize(DirectionEncoding e)
+    {
+        switch (e)
+        {
+        case DirectionEncoding::Float3:         return 12;
+        case DirectionEncoding::Octahedral16:   return 4;
+        default:                                return 0;
+        }
+    }
+
+    UINT TexCoordSize(TexCoordEncoding e)
+    {
+        switch (e)
+        {
+        case TexCoordEncoding::Float2:  return 8;
+        case TexCoordEncoding::Half2:   return 4;
+        default:                        return 0;
+        }
+    }
+
+    UINT ColorSize(ColorEncoding e)
+    {
+        switch (e)
+        {
+        case ColorEncoding::Float4: return 16;
+        case ColorEncoding::UNorm8: return 4;
+        default:                    return 0;
+        }
+    }
+
+    DXGI_FORMAT DirectionFormat(DirectionEncoding e)
+    {
+        return e == DirectionEncoding::Octahedral16 ? DXGI_FORMAT_R16G16_SNORM : DXGI_FORMAT_R32G32B32_FLOAT;
+    }
+
+    void StoreDirection(DirectionEncoding e, FXMVECTOR v, BYTE* dst)
+    {
+        if (e == DirectionEncoding::Float3)
+        {
+            XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(dst), v);
+        }
+        else if (e == DirectionEncoding::Octahedral16)
+        {
+            XMFLOAT2 oct = EncodeOctahedral(v);
+            XMStoreShortN2(reinterpret_cast<XMSHORTN2*>(dst), XMLoadFloat2(&oct));
+        }
+    }
+
+    const char* DirectionHlslType(DirectionEncoding e)
+    {
+        return e == DirectionEncoding::Octahedral16 ? "float2" : "float3";
+    }
+}
+
+XMFLOAT2 EncodeOctahedral(FXMVECTOR n)
+{
+    // Project onto the octahedron |x|+|y|+|z| = 1.
+    XMVECTOR absN = XMVectorAbs(n);
+    float l1 = XMVectorGetX(absN) + XMVectorGetY(absN) + XMVectorGetZ(absN);
+    XMFLOAT3 p;
+    XMStoreFloat3(&p, XMVectorScale(n, l1 > 0.0f ? 1.0f / l1 : 0.0f));
+
+    // Fold the lower hemisphere over the diagonals.
+    if (p.z < 0.0f)
+    {
+        float x = (1.0f - fabsf(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f);
+        float y = (1.0f - fabsf(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f);
+        return XMFLOAT2(x, y);
+    }
+    return XMFLOAT2(p.x, p.y);
+}
+
+XMVECTOR DecodeOctahedral(const XMFLOAT2& e)
+{
+    XMFLOAT3 n(e.x, e.y, 1.0f - fabsf(e.x) - fabsf(e.y));
+    float t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return XMVector3Normalize(XMLoadFloat3(&n));
+}
+
+VertexLayoutDesc VertexLayoutDesc::Full()
+{
+    VertexLayoutDesc desc;
+    desc.Position = PositionEncoding::Float3;
+    desc.Normal = DirectionEncoding::Float3;
+    desc.Tangent = DirectionEncoding::Float3;
+    desc.TexCoord = TexCoordEncoding::Float2;
+    desc.Color = ColorEncoding::None;
+    return desc;
+}
+
+VertexLayoutDesc VertexLayoutDesc::Compact()
+{
+    VertexLayoutDesc desc;
+    desc.Position = PositionEncoding::UNorm16;
+    desc.Normal = DirectionEncoding::Octahedral16;
+    desc.Tangent = DirectionEncoding::Octahedral16;
+    desc.TexCoord = TexCoordEncoding::Half2;
+    desc.Color = ColorEncoding::UNorm8;
+    return desc;
+}
+
+VertexFormat::VertexFormat(const VertexLayoutDesc& desc)
+    :m_desc(desc)
+{
+    UINT offset = 0;
+
+    m_positionOffset = offset;
+    m_inputLayout.push_back({ "POSITION", 0,
+        desc.Position == PositionEncoding::UNorm16 ? DXGI_FORMAT_R16G16B16A16_UNORM : DXGI_FORMAT_R32G32B32_FLOAT,
+        0, offset, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 });
+    offset += PositionSize(desc.Position);
+
+    if (desc.Normal != DirectionEncoding::None)
+    {
+        m_normalOffset = offset;
+        m_inputLayout.push_back({ "NORMAL", 0, DirectionFormat(desc.Normal),
+            0, offset, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 });
+        offset += DirectionSize(desc.Normal);
+    }
+
+    if (desc.Tangent != DirectionEncoding::None)
+    {
+        m_tangentOffset = offset;
+        m_inputLayout.push_back({ "TANGENT", 0, DirectionFormat(desc.Tangent),
+            0, offset, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 });
+        offset += DirectionSize(desc.Tangent);
+    }
+
+    if (desc.TexCoord != TexCoordEncoding::None)
+    {
+        m_texCoordOffset = offset;
+        m_inputLayout.push_back({ "TEXCOORD", 0,
+            desc.TexCoord == TexCoordEncoding::Half2 ? DXGI_FORMAT_R16G16_FLOAT : DXGI_FORMAT_R32G32_FLOAT,
+            0, offset, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 });
+        offset += TexCoordSize(desc.TexCoord);
+    }
+
+    if (desc.Color != ColorEncoding::None)
+    {
+        m_colorOffset = offset;
+        m_inputLayout.push_back({ "COLOR", 0,
+            desc.Color == ColorEncoding::UNorm8 ? DXGI_FORMAT_R8G8B8A8_UNORM : DXGI_FORMAT_R32G32B32A32_FLOAT,
+            0, offset, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 });
+        offset += ColorSize(desc.Color);
+    }
+
+    m_stride = offset;
+}
+
+PackedVertexRange VertexFormat::MakeRange(const BoundingBox& bounds)const
+{
+    PackedVertexRange range;
+    if (m_desc.Position != PositionEncoding::UNorm16)
+    {
+        return range;
+    }
+
+    // Quantize positions to [0,1] over the bounds. Degenerate axes (flat grids)
+    // keep a unit scale so we never divide by zero.
+    XMVECTOR center = XMLoadFloat3(&bounds.Center);
+    XMVECTOR extents = XMLoadFloat3(&bounds.Extents);
+    XMVECTOR scale = XMVectorScale(extents, 2.0f);
+    scale = XMVectorSelect(scale, XMVectorSplatOne(), XMVectorLessOrEqual(scale, XMVectorZero()));
+    XMStoreFloat3(&range.PositionScale, scale);
+    XMStoreFloat3(&range.PositionBias, XMVectorSubtract(center, extents));
+    return range;
+}
+
+void VertexFormat::PackVertex(const PackedVertexRange& range, FXMVECTOR position, FXMVECTOR normal,
+    FXMVECTOR tangent, GXMVECTOR texCoord, HXMVECTOR color, void* dst)const
+{
+    BYTE* out = static_cast<BYTE*>(dst);
+
+    if (m_desc.Position == PositionEncoding::UNorm16)
+    {
+        XMVECTOR bias = XMLoadFloat3(&range.PositionBias);
+        XMVECTOR scale = XMLoadFloat3(&range.PositionScale);
+        XMVECTOR q = XMVectorSaturate(XMVectorDivide(XMVectorSubtract(position, bias), scale));
+        XMStoreUShortN4(reinterpret_cast<XMUSHORTN4*>(out + m_positionOffset), q);
+    }
+    else
+    {
+        XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(out + m_positionOffset), position);
+    }
+
+    StoreDirection(m_desc.Normal, normal, out + m_normalOffset);
+    StoreDirection(m_desc.Tangent, tangent, out + m_tangentOffset);
+
+    if (m_desc.TexCoord == TexCoordEncoding::Half2)
+    {
+        XMStoreHalf2(reinterpret_cast<XMHALF2*>(out + m_texCoordOffset), texCoord);
+    }
+    else if (m_desc.TexCoord == TexCoordEncoding::Float2)
+    {
+        XMStoreFloat2(reinterpret_cast<XMFLOAT2*>(out + m_texCoordOffset), texCoord);
+    }
+
+    if (m_desc.Color == ColorEncoding::UNorm8)
+    {
+        XMStoreUByteN4(reinterpret_cast<XMUBYTEN4*>(out + m_colorOffset), color);
+    }
+    else if (m_desc.Color == ColorEncoding::Float4)
+    {
+        XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(out + m_colorOffset), color);
+    }
+}
+
+PackedVertexRange VertexFormat::Pack(const VertexStreamSource& src, UINT vertexCount,
+    const BoundingBox& bounds, void* dst)const
+{
+    const PackedVertexRange range = MakeRange(bounds);
+
+    const XMVECTOR defaultNormal = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+    const XMVECTOR defaultTangent = XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f);
+    const XMVECTOR constantColor = XMLoadFloat4(&src.ConstantColor);
+
+    BYTE* out = static_cast<BYTE*>(dst);
+    for (UINT i = 0; i < vertexCount; ++i, out += m_stride)
+    {
+        XMVECTOR p = XMLoadFloat3(Strided(src.Positions, src.PositionStride, i));
+        XMVECTOR n = src.Normals ? XMLoadFloat3(Strided(src.Normals, src.NormalStride, i)) : defaultNormal;
+        XMVECTOR t = src.Tangents ? XMLoadFloat3(Strided(src.Tangents, src.TangentStride, i)) : defaultTangent;
+        XMVECTOR uv = src.TexCoords ? XMLoadFloat2(Strided(src.TexCoords, src.TexCoordStride, i)) : XMVectorZero();
+        XMVECTOR c = src.Colors ? XMLoadFloat4(Strided(src.Colors, src.ColorStride, i)) : constantColor;
+        PackVertex(range, p, n, t, uv, c, out);
+    }
+
+    return range;
+}
+
+std::string VertexFormat::BuildHlslDecode()const
+{
+    std::string hlsl;
+
+    hlsl += "struct PackedVertexIn\n{\n";
+    hlsl += m_desc.Position == PositionEncoding::UNorm16 ? "    float4 PosL : POSITION;\n" : "    float3 PosL : POSITION;\n";
+    if (m_desc.Normal != DirectionEncoding::None)
+    {
+        hlsl += std::string("    ") + DirectionHlslType(m_desc.Normal) + " NormalL : NORMAL;\n";
+    }
+    if (m_desc.Tangent != DirectionEncoding::None)
+    {
+        hlsl += std::string("    ") + DirectionHlslType(m_desc.Tangent) + " TangentU : TANGENT;\n";
+    }
+    if (m_desc.TexCoord != TexCoordEncoding::None)
+    {
+        hlsl += "    float2 TexC : TEXCOORD;\n";
+    }
+    if (m_desc.Color != ColorEncoding::None)
+    {
+        hlsl += "    float4 Color : COLOR;\n";
+    }
+    hlsl += "};\n\n";
+
+    hlsl += "struct DecodedVertex\n{\n"
+        "    float3 PosL;\n"
+        "    float3 NormalL;\n"
+        "    float3 TangentU;\n"
+        "    float2 TexC;\n"
+        "    float4 Color;\n"
+        "};\n\n";
+
+    hlsl += "float3 DecodeOctahedral(float2 e)\n{\n"
+        "    float3 n = float3(e.x, e.y, 1.0f - abs(e.x) - abs(e.y));\n"
+        "    float t = saturate(-n.z);\n"
+        "    n.xy += (n.xy >= 0.0f) ? -t : t;\n"
+        "    return normalize(n);\n"
+        "}\n\n";
+
+    hlsl += "DecodedVertex DecodeVertex(PackedVertexIn vin, float3 posScale, float3 posBias)\n{\n"
+        "    DecodedVertex v;\n";
+
+    // The input assembler already expands UNORM/SNORM/FLOAT16 to float, so
+    // only quantization and octahedral mapping need undoing here.
+    hlsl += m_desc.Position == PositionEncoding::UNorm16
+        ? "    v.PosL = posBias + vin.PosL.xyz * posScale;\n"
+        : "    v.PosL = vin.PosL;\n";
+
+    if (m_desc.Normal == DirectionEncoding::Octahedral16)
+    {
+        hlsl += "    v.NormalL = DecodeOctahedral(vin.NormalL);\n";
+    }
+    else if (m_desc.Normal == DirectionEncoding::Float3)
+    {
+        hlsl += "    v.NormalL = vin.NormalL;\n";
+    }
+    else
+    {
+        hlsl += "    v.NormalL = float3(0.0f, 1.0f, 0.0f);\n";
+    }
+
+    if (m_desc.Tangent == DirectionEncoding::Octahedral16)
+    {
+        hlsl += "    v.TangentU = DecodeOctahedral(vin.TangentU);\n";
+    }
+    else if (m_desc.Tangent == DirectionEncoding::Float3)
+    {
+        hlsl += "    v.TangentU = vin.TangentU;\n";
+    }
+    else
+    {
+        hlsl += "    v.TangentU = float3(1.0f, 0.0f, 0.0f);\n";
+    }
+
+    hlsl += m_desc.TexCoord != TexCoordEncoding::None ? "    v.TexC = vin.TexC;\n" : "    v.TexC = float2(0.0f, 0.0f);\n";
+    hlsl += m_desc.Color != ColorEncoding::None ? "    v.Color = vin.Color;\n" : "    v.Color = float4(1.0f, 1.0f, 1.0f, 1.0f);\n";
+
+    hlsl += "    return v;\n}\n";
+    return hlsl;
+}
+
+VertexDecodeInclude::VertexDecodeInclude(const VertexFormat& format)
+    :m_decode(format.BuildHlslDecode())
+{
+}
+
+HRESULT __stdcall VertexDecodeInclude::Open(D3D_INCLUDE_TYPE includeType, LPCSTR fileName, LPCVOID parentData,
+    LPCVOID* data, UINT* byteSize)
+{
+    if (strcmp(fileName, "VertexDecode.hlsli") == 0)
+    {
+        *data = m_decode.data();
+        *byteSize = (UINT)m_decode.size();
+        return S_OK;
+    }
+
+    std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        return E_FAIL;
+    }
+    std::streamsize size = file.tellg();
+    file.seekg(0);
+
+    char* contents = new char[(size_t)size];
+    if (!file.read(contents, size))
+    {
+        delete[] contents;
+        return E_FAIL;
+    }
+    *data = contents;
+    *byteSize = (UINT)size;
+    return S_OK;
+}
+
+HRESULT __stdcall VertexDecodeInclude::Close(LPCVOID data)
+{
+    if (data != m_decode.data())
+    {
+        delete[] static_cast<const char*>(data);
+    }
+    return S_OK;
+}
@@ -0,0 +1,154 @@
+// Compact vertex layouts and the conversion layer that packs full precision
+// vertices into them.
+//
+// A layout picks an encoding per attribute. The packer writes vertices in that
+// layout, InputLayout() returns the matching D3D12 input elements and
+// BuildHlslDecode() returns an HLSL snippet that turns the packed inputs back
+// into full precision values inside the vertex shader.
+//
+// Quantized positions are stored relative to the bounds of the submesh being
+// packed, so the shader needs the scale/bias returned in PackedVertexRange to
+// decode them (usually through the per-object constant buffer).
+#pragma once
+#include "stdafx.h"
+#include <DirectXCollision.h>
+
+enum class PositionEncoding
+{
+    Float3,         // R32G32B32_FLOAT, 12 bytes.
+    UNorm16         // R16G16B16A16_UNORM against the submesh bounds, 8 bytes.
+};
+
+enum class DirectionEncoding
+{
+    None,
+    Float3,         // R32G32B32_FLOAT, 12 bytes.
+    Octahedral16    // R16G16_SNORM octahedral map, 4 bytes.
+};
+
+enum class TexCoordEncoding
+{
+    None,
+    Float2,         // R32G32_FLOAT, 8 bytes.
+    Half2           // R16G16_FLOAT, 4 bytes.
+};
+
+enum class ColorEncoding
+{
+    None,
+    Float4,         // R32G32B32A32_FLOAT, 16 bytes.
+    UNorm8          // R8G8B8A8_UNORM, 4 bytes.
+};
+
+struct VertexLayoutDesc
+{
+    PositionEncoding Position = PositionEncoding::Float3;
+    DirectionEncoding Normal = DirectionEncoding::Float3;
+    DirectionEncoding Tangent = DirectionEncoding::None;
+    TexCoordEncoding TexCoord = TexCoordEncoding::None;
+    ColorEncoding Color = ColorEncoding::None;
+
+    // Full precision layout equivalent to GeometryGenerator::Vertex.
+    static VertexLayoutDesc Full();
+
+    // Smallest layout carrying every attribute.
+    static VertexLayoutDesc Compact();
+};
+
+// Strided views over the source attributes. Any pointer may be null, in which
+// case the attribute is filled with a default (up normal, +x tangent, zero
+// texcoord, ConstantColor).
+struct VertexStreamSource
+{
+    const DirectX::XMFLOAT3* Positions = nullptr;
+    UINT PositionStride = sizeof(DirectX::XMFLOAT3);
+
+    const DirectX::XMFLOAT3* Normals = nullptr;
+    UINT NormalStride = sizeof(DirectX::XMFLOAT3);
+
+    const DirectX::XMFLOAT3* Tangents = nullptr;
+    UINT TangentStride = sizeof(DirectX::XMFLOAT3);
+
+    const DirectX::XMFLOAT2* TexCoords = nullptr;
+    UINT TexCoordStride = sizeof(DirectX::XMFLOAT2);
+
+    const DirectX::XMFLOAT4* Colors = nullptr;
+    UINT ColorStride = sizeof(DirectX::XMFLOAT4);
+    DirectX::XMFLOAT4 ConstantColor = { 1.0f,1.0f,1.0f,1.0f };
+};
+
+// Decode constants for a packed range of vertices.
+// Position = PositionBias + packed * PositionScale.
+struct PackedVertexRange
+{
+    DirectX::XMFLOAT3 PositionScale = { 1.0f,1.0f,1.0f };
+    DirectX::XMFLOAT3 PositionBias = { 0.0f,0.0f,0.0f };
+};
+
+class VertexFormat
+{
+public:
+    explicit VertexFormat(const VertexLayoutDesc& desc);
+
+    const VertexLayoutDesc& Desc()const { return m_desc; }
+    UINT Stride()const { return m_stride; }
+
+    // Input elements for slot 0. The semantic names stay the same as the full
+    // precision layout (POSITION, NORMAL, TANGENT, TEXCOORD, COLOR) so only the
+    // decode step in the shader differs.
+    const std::vector<D3D12_INPUT_ELEMENT_DESC>& InputLayout()const { return m_inputLayout; }
+
+    // Packs vertexCount vertices from src into dst, which must hold
+    // Stride() * vertexCount bytes. bounds must enclose every position; it is
+    // only used by quantized position encodings.
+    PackedVertexRange Pack(const VertexStreamSource& src, UINT vertexCount,
+        const DirectX::BoundingBox& bounds, void* dst)const;
+
+    // Decode constants for positions quantized against bounds. The same
+    // bounds always give the same range, so a mesh loaded back from disk only
+    // needs its bounds to be drawn.
+    PackedVertexRange MakeRange(const DirectX::BoundingBox& bounds)const;
+
+    // Packs a single vertex into dst (Stride() bytes), for writers that
+    // produce one vertex at a time. range comes from MakeRange.
+    void PackVertex(const PackedVertexRange& range, DirectX::FXMVECTOR position, DirectX::FXMVECTOR normal,
+        DirectX::FXMVECTOR tangent, DirectX::GXMVECTOR texCoord, DirectX::HXMVECTOR color, void* dst)const;
+
+    // HLSL declaring struct PackedVertexIn (matching InputLayout()), struct
+    // DecodedVertex and
+    //   DecodedVertex DecodeVertex(PackedVertexIn vin, float3 posScale, float3 posBias);
+    std::string BuildHlslDecode()const;
+
+private:
+    VertexLayoutDesc m_desc;
+    UINT m_stride = 0;
+
+    UINT m_positionOffset = 0;
+    UINT m_normalOffset = 0;
+    UINT m_tangentOffset = 0;
+    UINT m_texCoordOffset = 0;
+    UINT m_colorOffset = 0;
+
+    std::vector<D3D12_INPUT_ELEMENT_DESC> m_inputLayout;
+};
+
+// Serves BuildHlslDecode() to D3DCompileFromFile as "VertexDecode.hlsli",
+// so shaders can #include the decode of the layout they are compiled for.
+// Any other include is opened from the working directory.
+class VertexDecodeInclude : public ID3DInclude
+{
+public:
+    explicit VertexDecodeInclude(const VertexFormat& format);
+
+    HRESULT __stdcall Open(D3D_INCLUDE_TYPE includeType, LPCSTR fileName, LPCVOID parentData,
+        LPCVOID* data, UINT* byteSize)override;
+    HRESULT __stdcall Close(LPCVOID data)override;
+
+private:
+    std::string m_decode;
+};
+
+// Octahedral mapping of a unit vector onto [-1,1]^2, for CPU-side consumers
+// of packed data.
+DirectX::XMFLOAT2 EncodeOctahedral(DirectX::FXMVECTOR n);
+DirectX::XMVECTOR DecodeOctahedral(const DirectX::XMFLOAT2& e);
@@ -0,0 +1,294 @@
+#include "stdafx.h"
+#include "VertexWelder.h"
+#include <ppl.h>
+#include <atomic>
+
+namespace
+{
+    // Position, normal, tangent and texture coordinates.
+    const int WeldKeyComponents = 3 + 3 + 3 + 2;
+
+    struct WeldKey
+    {
+        std::int64_t Cells[WeldKeyComponents];
+
+        bool operator==(const WeldKey& rhs)const
+        {
+            return memcmp(Cells, rhs.Cells, sizeof(Cells)) == 0;
+        }
+    };
+
+    // Vertices are processed in blocks so each task amortizes the scheduling cost.
+    const std::uint32_t WeldBlockSize = 4096;
+
+    const std::uint32_t EmptySlot = 0xffffffff;
+
+    // Cells are computed in double and kept within this magnitude; anything
+    // beyond it (huge values over tiny tolerances, infinities, NaNs) falls
+    // back to an exact match, keyed above the range so the two never mix.
+    const double MaxWeldCell = 4611686018427387904.0; // 2^62
+    const std::int64_t ExactWeldCellBase = (std::int64_t)1 << 62;
+
+    std::int64_t ExactCell(float value)
+    {
+        // Bit pattern, with -0 folded onto +0.
+        value += 0.0f;
+        std::uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return ExactWeldCellBase + bits;
+    }
+
+    std::int64_t Quantize(float value, float tolerance)
+    {
+        if (tolerance < 0.0f)
+        {
+            return 0;
+        }
+        if (tolerance == 0.0f)
+        {
+            return ExactCell(value);
+        }
+
+        double cell = floor((double)value / tolerance + 0.5);
+        if (!(cell > -MaxWeldCell && cell < MaxWeldCell))
+        {
+            return ExactCell(value);
+        }
+        return (std::int64_t)cell;
+    }
+
+    void QuantizeVertex(const GeometryGenerator::Vertex& v, const WeldTolerances& tol, WeldKey& key)
+    {
+        key.Cells[0] = Quantize(v.Position.x, tol.Position);
+        key.Cells[1] = Quantize(v.Position.y, tol.Position);
+        key.Cells[2] = Quantize(v.Position.z, tol.Position);
+        key.Cells[3] = Quantize(v.Normal.x, tol.Normal);
+        key.Cells[4] = Quantize(v.Normal.y, tol.Normal);
+        key.Cells[5] = Quantize(v.Normal.z, tol.Normal);
+        key.Cells[6] = Quantize(v.TangentU.x, tol.Tangent);
+        key.Cells[7] = Quantize(v.TangentU.y, tol.Tangent);
+        key.Cells[8] = Quantize(v.TangentU.z, tol.Tangent);
+        key.Cells[9] = Quantize(v.TexC.x, tol.TexCoord);
+        key.Cells[10] = Quantize(v.TexC.y, tol.TexCoord);
+    }
+
+    std::uint32_t HashKey(const WeldKey& key)
+    {
+        // Murmur3 style mixing of each cell, finalized with fmix32.
+        std::uint32_t h = 0x9747b28c;
+        for (int i = 0; i < WeldKeyComponents * 2; ++i)
+        {
+            // Low then high half of each cell.
+            std::uint32_t k = (std::uint32_t)((std::uint64_t)key.Cells[i / 2] >> (32 * (i & 1)));
+            k *= 0xcc9e2d51;
+            k = (k << 15) | (k >> 17);
+            k *= 0x1b873593;
+            h ^= k;
+            h = (h << 13) | (h >> 19);
+            h = h * 5 + 0xe6546b64;
+        }
+        h ^= h >> 16;
+        h *= 0x85ebca6b;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35;
+        h ^= h >> 16;
+        return h;
+    }
+
+    // Open addressing table of vertex indices keyed by WeldKey. Each distinct
+    // key owns exactly one slot: a slot only ever changes from empty to a
+    // vertex, or from a vertex to a lower vertex with the same key, so a
+    // probe that finds its key can stop there. Once every vertex is inserted,
+    // each slot holds the lowest index of its key, whatever the thread order.
+    class WeldTable
+    {
+    public:
+        WeldTable(const std::vector<WeldKey>& keys, const std::vector<std::uint32_t>& hashes)
+            :m_keys(keys), m_hashes(hashes)
+        {
+            size_t capacity = 16;
+            while (capacity < keys.size() * 2)
+            {
+                capacity <<= 1;
+            }
+            m_mask = capacity - 1;
+            m_slots.reset(new std::atomic<std::uint32_t>[capacity]);
+            for (size_t i = 0; i < capacity; ++i)
+            {
+                m_slots[i].store(EmptySlot, std::memory_order_relaxed);
+            }
+        }
+
+        void Insert(std::uint32_t vertex)
+        {
+            size_t slot = m_hashes[vertex] & m_mask;
+            for (;;)
+            {
+                std::uint32_t current = m_slots[slot].load(std::memory_order_acquire);
+                if (current == EmptySlot)
+                {
+                    if (m_slots[slot].compare_exchange_strong(current, vertex, std::memory_order_acq_rel))
+                    {
+                        return;
+                    }
+                    // Lost the race; current now holds the winner, fall through and compare.
+                }
+
+                if (m_hashes[current] == m_hashes[vertex] && m_keys[current] == m_keys[vertex])
+                {
+                    // Keep the lowest index.
+                    while (vertex < current &&
+                        !m_slots[slot].compare_exchange_weak(current, vertex, std::memory_order_acq_rel))
+                    {
+                    }
+                    return;
+                }
+
+                slot = (slot + 1) & m_mask;
+            }
+        }
+
+        std::uint32_t Find(std::uint32_t vertex)const
+        {
+            size_t slot = m_hashes[vertex] & m_mask;
+            for (;;)
+            {
+                std::uint32_t current = m_slots[slot].load(std::memory_order_relaxed);
+                if (m_hashes[current] == m_hashes[vertex] && m_keys[current] == m_keys[vertex])
+                {
+                    return current;
+                }
+                slot = (slot + 1) & m_mask;
+            }
+        }
+
+    private:
+        const std::vector<WeldKey>& m_keys;
+        const std::vector<std::uint32_t>& m_hashes;
+        std::unique_ptr<std::atomic<std::uint32_t>[]> m_slots;
+        size_t m_mask = 0;
+    };
+}
+
+std::uint32_t BuildWeldRemap(const GeometryGenerator::Vertex* vertices, std::uint32_t vertexCount,
+    const WeldTolerances& tolerances, std::vector<std::uint32_t>& remap)
+{
+    remap.resize(vertexCount);
+    if (vertexCount == 0)
+    {
+        return 0;
+    }
+
+    const std::uint32_t blockCount = (vertexCount + WeldBlockSize - 1) / WeldBlockSize;
+
+    std::vector<WeldKey> keys(vertexCount);
+    std::vector<std::uint32_t> hashes(vertexCount);
+    concurrency::parallel_for(0u, blockCount, [&](std::uint32_t block)
+        {
+            std::uint32_t end = std::min(vertexCount, (block + 1) * WeldBlockSize);
+            for (std::uint32_t i = block * WeldBlockSize; i < end; ++i)
+            {
+                QuantizeVertex(vertices[i], tolerances, keys[i]);
+                hashes[i] = HashKey(keys[i]);
+            }
+        });
+
+    WeldTable table(keys, hashes);
+    concurrency::parallel_for(0u, blockCount, [&](std::uint32_t block)
+        {
+            std::uint32_t end = std::min(vertexCount, (block + 1) * WeldBlockSize);
+            for (std::uint32_t i = block * WeldBlockSize; i < end; ++i)
+            {
+                table.Insert(i);
+            }
+        });
+
+    // Representative of each vertex, and the number of survivors per block.
+    std::vector<std::uint32_t> blockUniqueCount(blockCount);
+    concurrency::parallel_for(0u, blockCount, [&](std::uint32_t block)
+        {
+            std::uint32_t end = std::min(vertexCount, (block + 1) * WeldBlockSize);
+            std::uint32_t unique = 0;
+            for (std::uint32_t i = block * WeldBlockSize; i < end; ++i)
+            {
+                remap[i] = table.Find(i);
+                unique += remap[i] == i ? 1 : 0;
+            }
+            blockUniqueCount[block] = unique;
+        });
+
+    // Exclusive prefix sum gives each block its first output slot.
+    std::vector<std::uint32_t> blockStart(blockCount);
+    std::uint32_t uniqueCount = 0;
+    for (std::uint32_t block = 0; block < blockCount; ++block)
+    {
+        blockStart[block] = uniqueCount;
+        uniqueCount += blockUniqueCount[block];
+    }
+
+    // Number the survivors. A representative always precedes the vertices it
+    // absorbs, but it may live in an earlier block, so duplicates are
+    // resolved in a second pass once every survivor has its final index.
+    std::vector<std::uint32_t> newIndex(vertexCount);
+    concurrency::parallel_for(0u, blockCount, [&](std::uint32_t block)
+        {
+            std::uint32_t end = std::min(vertexCount, (block + 1) * WeldBlockSize);
+            std::uint32_t next = blockStart[block];
+            for (std::uint32_t i = block * WeldBlockSize; i < end; ++i)
+            {
+                if (remap[i] == i)
+                {
+                    newIndex[i] = next++;
+                }
+            }
+        });
+    concurrency::parallel_for(0u, blockCount, [&](std::uint32_t block)
+        {
+            std::uint32_t end = std::min(vertexCount, (block + 1) * WeldBlockSize);
+            for (std::uint32_t i = block * WeldBlockSize; i < end; ++i)
+            {
+                remap[i] = newIndex[remap[i]];
+            }
+        });
+
+    return uniqueCount;
+}
+
+WeldStats WeldVertices(GeometryGenerator::MeshData& meshData, const WeldTolerances& tolerances)
+{
+    WeldStats stats;
+    stats.InputVertexCount = (std::uint32_t)meshData.Vertices.size();
+
+    std::vector<std::uint32_t> remap;
+    stats.OutputVertexCount = BuildWeldRemap(meshData.Vertices.data(), stats.InputVertexCount, tolerances, remap);
+    if (stats.OutputVertexCount == stats.InputVertexCount)
+    {
+        return stats;
+    }
+
+    // Survivors only move towards the front, and remap is increasing over
+    // survivors, so the compaction can be done in place.
+    std::vector<GeometryGenerator::Vertex>& vertices = meshData.Vertices;
+    std::uint32_t next = 0;
+    for (std::uint32_t i = 0; i < stats.InputVertexCount; ++i)
+    {
+        if (remap[i] == next)
+        {
+            vertices[next++] = vertices[i];
+        }
+    }
+    vertices.resize(stats.OutputVertexCount);
+    vertices.shrink_to_fit();
+
+    std::vector<std::uint32_t>& indices = meshData.Indices32;
+    concurrency::parallel_for(size_t(0), indices.size(), size_t(WeldBlockSize), [&](size_t start)
+        {
+            size_t end = std::min(indices.size(), start + WeldBlockSize);
+            for (size_t k = start; k < end; ++k)
+            {
+                indices[k] = remap[indices[k]];
+            }
+        });
+
+    return stats;
+}
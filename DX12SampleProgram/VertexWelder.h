@@ -0,0 +1,41 @@
+// Vertex welding for GeometryGenerator::MeshData.
+//
+// Every attribute is quantized to a grid of its tolerance and vertices whose
+// quantized attributes all match are merged into one. Hashing and lookup run
+// in parallel against a lock-free open addressing table, so the pass is cheap
+// enough to run on multi-million-vertex meshes at load time.
+//
+// Quantizing snaps to fixed cells, so two vertices closer than the tolerance
+// that straddle a cell boundary are not merged. This keeps the pass
+// transitive and the result independent of thread scheduling.
+#pragma once
+#include "stdafx.h"
+#include "GeometryGenerator.h"
+
+struct WeldTolerances
+{
+    // Cell size per attribute. 0 only merges bit-identical values (+0 and -0
+    // are treated as equal). A negative value ignores the attribute.
+    float Position = 1.0e-5f;
+    float Normal = 1.0e-3f;
+    float Tangent = 1.0e-3f;
+    float TexCoord = 1.0e-5f;
+};
+
+struct WeldStats
+{
+    std::uint32_t InputVertexCount = 0;
+    std::uint32_t OutputVertexCount = 0;
+};
+
+// Merges duplicate vertices of meshData in place: Vertices is compacted and
+// Indices32 remapped. Of each group of merged vertices the one with the lowest
+// index is kept, and survivors keep their relative order, so the output is
+// deterministic.
+WeldStats WeldVertices(GeometryGenerator::MeshData& meshData,
+    const WeldTolerances& tolerances = WeldTolerances());
+
+// Lower level form: computes remap[i], the welded index of vertex i, and
+// returns the number of unique vertices. Vertices and indices are untouched.
+std::uint32_t BuildWeldRemap(const GeometryGenerator::Vertex* vertices, std::uint32_t vertexCount,
+    const WeldTolerances& tolerances, std::vector<std::uint32_t>& remap);
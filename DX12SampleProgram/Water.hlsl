@@ -0,0 +1,62 @@
+// Water of LandAndWavesApp: the vertex color under a fixed sun, lit with the
+// normals the app computes on the CPU for the wave grid or projected grid.
+cbuffer cbPerObject :register(b0)
+{
+    float4x4 gWorld;
+};
+
+cbuffer cbPass:register(b1)
+{
+    float4x4 gView;
+    float4x4 gInvView;
+    float4x4 gProj;
+    float4x4 gInvProj;
+    float4x4 gViewProj;
+    float4x4 gInvViewProj;
+    float3 gEyePosW;
+    float cbPerObjectPad1;
+    float2 gRenderTargetSize;
+    float2 gInvRenderTargetSize;
+    float  gNearZ;
+    float  gFarZ;
+    float  gTotalTime;
+    float  gDeltaTime;
+};
+
+// Direction the sunlight travels in.
+static const float3 gSunDirection = float3(0.57735f, -0.57735f, 0.57735f);
+
+struct VertexIn
+{
+    float3 PosL:POSITION;
+    float4 Color:COLOR;
+    float3 NormalL:NORMAL;
+};
+
+struct VertexOut
+{
+    float4 PosH:SV_POSITION;
+    float3 NormalW:NORMAL;
+    float4 Color:COLOR;
+};
+
+VertexOut VSMain(VertexIn vin)
+{
+    VertexOut vout;
+
+    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    vout.PosH = mul(posW, gViewProj);
+
+    // Water is never scaled non-uniformly, so the world matrix does for normals.
+    vout.NormalW = mul(vin.NormalL, (float3x3)gWorld);
+    vout.Color = vin.Color;
+
+    return vout;
+}
+
+float4 PSMain(VertexOut pin) :SV_Target
+{
+    float3 normal = normalize(pin.NormalW);
+    float diffuse = saturate(dot(normal, -gSunDirection));
+    return float4(pin.Color.rgb * (0.4f + 0.6f * diffuse), pin.Color.a);
+}
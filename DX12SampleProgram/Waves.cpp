@@ -47,6 +47,11 @@ Waves::Waves(int m, int n, float dx, float dt, float speed, float damping)
             m_tangentX[(INT64)i * n + j] = XMFLOAT3(1.0f, 0.0f, 0.0f);
         }
     }
+
+    m_rowMinY.assign(m, 0.0f);
+    m_rowMaxY.assign(m, 0.0f);
+    UpdateBounds();
+    MarkDirtyRows(0, m);
 }
 
 Waves::~Waves()
@@ -98,6 +103,73 @@ void Waves::Disturb(int i, int j, float magnitude)
     m_currentSolution[(INT64)i * m_numCols + j - 1].y += halfMag;
     m_currentSolution[((INT64)i + 1) * m_numCols + j].y += halfMag;
     m_currentSolution[((INT64)i - 1) * m_numCols + j].y += halfMag;
+
+    // Only rows i-1..i+1 changed, so just widen their ranges.
+    for (int row = i - 1; row <= i + 1; ++row)
+    {
+        for (int col = j - 1; col <= j + 1; ++col)
+        {
+            float y = m_currentSolution[(INT64)row * m_numCols + col].y;
+            m_rowMinY[row] = std::min(m_rowMinY[row], y);
+            m_rowMaxY[row] = std::max(m_rowMaxY[row], y);
+        }
+    }
+    UpdateBounds();
+    MarkDirtyRows(i - 1, i + 2);
+}
+
+HeightFieldDesc Waves::GetHeightField()const
+{
+    HeightFieldDesc desc;
+    desc.Data = &m_currentSolution[0].y;
+    desc.ColumnStride = sizeof(XMFLOAT3);
+    desc.RowStride = m_numCols * sizeof(XMFLOAT3);
+    desc.Columns = m_numCols;
+    desc.Rows = m_numRows;
+
+    // Rows run from +z towards -z.
+    desc.OriginX = -(m_numCols - 1) * m_spatialStep * 0.5f;
+    desc.OriginZ = (m_numRows - 1) * m_spatialStep * 0.5f;
+    desc.SpacingX = m_spatialStep;
+    desc.SpacingZ = -m_spatialStep;
+    return desc;
+}
+
+bool Waves::TakeDirtyRows(int& firstRow, int& endRow)
+{
+    firstRow = m_dirtyFirstRow;
+    endRow = m_dirtyEndRow;
+    m_dirtyFirstRow = m_dirtyEndRow = 0;
+    return firstRow < endRow;
+}
+
+void Waves::MarkDirtyRows(int firstRow, int endRow)
+{
+    if (m_dirtyFirstRow >= m_dirtyEndRow)
+    {
+        m_dirtyFirstRow = firstRow;
+        m_dirtyEndRow = endRow;
+        return;
+    }
+    m_dirtyFirstRow = std::min(m_dirtyFirstRow, firstRow);
+    m_dirtyEndRow = std::max(m_dirtyEndRow, endRow);
+}
+
+void Waves::UpdateBounds()
+{
+    float minY = 0.0f;
+    float maxY = 0.0f;
+    for (int i = 0; i < m_numRows; ++i)
+    {
+        minY = std::min(minY, m_rowMinY[i]);
+        maxY = std::max(maxY, m_rowMaxY[i]);
+    }
+
+    float halfWidth = (m_numCols - 1) * m_spatialStep * 0.5f;
+    float halfDepth = (m_numRows - 1) * m_spatialStep * 0.5f;
+    m_bounds = MakeVertexBounds(
+        XMVectorSet(-halfWidth, minY, -halfDepth, 0.0f),
+        XMVectorSet(halfWidth, maxY, halfDepth, 0.0f));
 }
 
 void Waves::Update(float dt)
@@ -114,6 +186,9 @@ void Waves::Update(float dt)
         concurrency::parallel_for(1, m_numRows - 1, [this](INT64 i)
             // for(int i=1;i<m_numRows-1;++i)
             {
+                // The boundary columns are pinned at zero height.
+                float rowMinY = 0.0f;
+                float rowMaxY = 0.0f;
                 for (int j = 1; j < m_numCols - 1; ++j)
                 {
                     // After this update we will be discarding the old previous
@@ -133,7 +208,14 @@ void Waves::Update(float dt)
                             m_currentSolution[i * m_numCols + j + 1].y +
                             m_currentSolution[i * m_numCols + j - 1].y
                             );
+
+                    rowMinY = std::min(rowMinY, m_prevSolution[i * m_numCols + j].y);
+                    rowMaxY = std::max(rowMaxY, m_prevSolution[i * m_numCols + j].y);
                 }
+
+                // Each task owns its row, so no synchronization is needed.
+                m_rowMinY[i] = rowMinY;
+                m_rowMaxY[i] = rowMaxY;
             }
         );
 
@@ -144,6 +226,10 @@ void Waves::Update(float dt)
 
         t = 0.0f; // Reset time.
 
+        // The row ranges were gathered while solving, so this is O(rows).
+        UpdateBounds();
+        MarkDirtyRows(1, m_numRows - 1);
+
         // Compute normals using finite difference scheme.
         concurrency::parallel_for(1, m_numRows - 1, [this](INT64 i)
             {
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "stdafx.h"
+#include "BoundingVolume.h"
+#include "HeightFieldPyramid.h"
 
 class Waves
 {
@@ -27,10 +29,25 @@ public:
     // direction.
     const DirectX::XMFLOAT3& TangentX(int i)const { return m_tangentX[i]; }
 
+    // Bounds of the current solution. Kept up to date by Update and Disturb
+    // from per-row height ranges, since x and z never change.
+    const VertexBounds& GetBounds()const { return m_bounds; }
+
+    // The heights of the current solution as a height field. Data is only
+    // valid until the next Update, which swaps solution buffers.
+    HeightFieldDesc GetHeightField()const;
+
+    // Rows changed by Update and Disturb since the last call, as [first, end).
+    // Returns false if nothing changed.
+    bool TakeDirtyRows(int& firstRow, int& endRow);
+
     void Update(float dt);
     void Disturb(int i, int j, float magnitude);
 
 private:
+    void UpdateBounds();
+    void MarkDirtyRows(int firstRow, int endRow);
+
     int m_numRows = 0;
     int m_numCols = 0;
 
@@ -49,4 +66,13 @@ private:
     std::vector<DirectX::XMFLOAT3> m_prevSolution;
     std::vector<DirectX::XMFLOAT3> m_normals;
     std::vector<DirectX::XMFLOAT3> m_tangentX;
+
+    // Height range of each row of the current solution.
+    std::vector<float> m_rowMinY;
+    std::vector<float> m_rowMaxY;
+    VertexBounds m_bounds;
+
+    // Rows changed since the last TakeDirtyRows; empty when first >= end.
+    int m_dirtyFirstRow = 0;
+    int m_dirtyEndRow = 0;
 };
\ No newline at end of file
@@ -2,12 +2,20 @@
 #include "BoxApp.h"
 #include "ShapesApp.h"
 #include "LandAndWavesApp.h"
+#include "GeometryBenchmark.h"
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance, PSTR cmdLine, int showCmd)
 {
     // Enable run-time memory check for debug builds.
 #if defined(DEBUG)|(_DEBUG)
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
+#endif
+#if IS_ENABLE_GEOMETRY_BENCHMARK
+	std::wstring report = FormatGeometryBenchmark(RunGeometryBenchmark()) +
+		FormatNormalBenchmark(RunNormalBenchmark());
+	OutputDebugString(report.c_str());
+	MessageBox(nullptr, report.c_str(), L"Geometry benchmark", MB_OK);
+	return 0;
 #endif
 	try
 	{
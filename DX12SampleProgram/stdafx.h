@@ -1,4 +1,5 @@
 #pragma once
+#if defined(_WIN32)
 #ifndef WIN32_LEAN_AND_MEAN
 #define WIN32_LEAN_AND_MEAN
 #endif // !WIN32_LEAN_AND_MEAN
@@ -13,10 +14,14 @@
 #include <DirectXColors.h>
 #include <DirectXPackedVector.h>
 #include "d3dx12.h"
+#include <shellapi.h>
+#else
+// Off Windows only the headless tests build. Tests/Shim stands in for the
+// parts of the Windows SDK that the code under test touches.
+#include "WindowsShim.h"
+#endif
 
 #include <string>
-#include <wrl.h>
-#include <shellapi.h>
 #include <stdexcept>
 #include <unordered_map>
 #include <cassert>